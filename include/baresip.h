@@ -33,6 +33,7 @@ extern "C" {
 
 
 /* forward declarations */
+struct media_cpu;
 struct sa;
 struct sdp_media;
 struct sdp_session;
@@ -74,6 +75,9 @@ enum sipansbeep {
 struct account;
 
 int account_alloc(struct account **accp, const char *sipaddr);
+int account_aor_decode(char **aorp, const char *sipaddr);
+int account_bulk_begin(void);
+void account_bulk_end(void);
 int account_debug(struct re_printf *pf, const struct account *acc);
 int account_json_api(struct odict *odacc, struct odict *odcfg,
 		 const struct account *acc);
@@ -168,6 +172,21 @@ enum call_state {
 	CALL_STATE_UNKNOWN
 };
 
+/** Call setup milestones */
+enum call_setup_ev {
+	CALL_SETUP_ALLOC = 0,     /**< Call allocated                  */
+	CALL_SETUP_OFFER,         /**< SDP offer sent or received      */
+	CALL_SETUP_RINGING,       /**< First provisional response      */
+	CALL_SETUP_ANSWER,        /**< SDP answer sent or received     */
+	CALL_SETUP_MNAT,          /**< Media NAT established/gathered  */
+	CALL_SETUP_MENC,          /**< First secure media stream       */
+	CALL_SETUP_ESTABLISHED,   /**< SIP session established         */
+	CALL_SETUP_RTP,           /**< First RTP packet received       */
+	CALL_SETUP_AUDIO,         /**< First audio frame played        */
+
+	CALL_SETUP_MAX
+};
+
 /** Video mode */
 enum vidmode {
 	VIDMODE_OFF = 0,    /**< Video disabled                */
@@ -198,6 +217,7 @@ int  call_transfer(struct call *call, const char *uri);
 int  call_replace_transfer(struct call *target_call, struct call *source_call);
 int  call_status(struct re_printf *pf, const struct call *call);
 int  call_debug(struct re_printf *pf, const struct call *call);
+int  call_media_cpu(const struct call *call, struct media_cpu *cpu);
 int  call_notify_sipfrag(struct call *call, uint16_t scode,
 			 const char *reason, ...);
 void call_set_handlers(struct call *call, call_event_h *eh,
@@ -207,6 +227,10 @@ uint16_t      call_scode(const struct call *call);
 enum call_state call_state(const struct call *call);
 uint32_t      call_duration(const struct call *call);
 uint32_t      call_setup_duration(const struct call *call);
+uint64_t      call_setup_time(const struct call *call,
+			      enum call_setup_ev ev);
+const char   *call_setup_ev_name(enum call_setup_ev ev);
+int           callsetup_debug(struct re_printf *pf, void *unused);
 const char   *call_id(const struct call *call);
 const char   *call_peeruri(const struct call *call);
 const char   *call_peername(const struct call *call);
@@ -297,6 +321,8 @@ struct config_sip {
 	enum sip_transp transp; /**< Default outgoing SIP transport protocol */
 	bool verify_server;     /**< Enable SIP TLS verify server   */
 	uint8_t tos;            /**< Type-of-Service for SIP        */
+	uint32_t reg_window;    /**< Register spread window [ms]    */
+	uint32_t reg_inflight;  /**< Max. REGISTERs in flight       */
 };
 
 /** Call config */
@@ -304,6 +330,7 @@ struct config_call {
 	uint32_t local_timeout; /**< Incoming call timeout [sec] 0=off    */
 	uint32_t max_calls;     /**< Maximum number of calls, 0=unlimited */
 	bool hold_other_calls;  /**< Hold other calls */
+	char acl[256];          /**< Call-screening ACL file          */
 };
 
 /** Audio */
@@ -327,6 +354,8 @@ struct config_audio {
 	int dec_fmt;            /**< Audio decoder sample format    */
 	struct range buffer;    /**< Audio receive buffer in [ms]   */
 	uint32_t telev_pt;      /**< Payload type for tel.-event    */
+	bool enc_shared;        /**< Share encoder among calls      */
+	uint32_t jitter_pct;    /**< Jitter percentile for playout  */
 };
 
 /** Video */
@@ -340,6 +369,8 @@ struct config_video {
 	double fps;             /**< Video framerate                */
 	bool fullscreen;        /**< Enable fullscreen display      */
 	int enc_fmt;            /**< Encoder pixelfmt (enum vidfmt) */
+	bool src_shared;        /**< Share video source among calls */
+	bool enc_shared;        /**< Share encoder among calls      */
 };
 
 /** Audio/Video Transport */
@@ -431,6 +462,27 @@ void contacts_set_current(struct contacts *contacts, struct contact *cnt);
 struct contact *contacts_current(const struct contacts *contacts);
 
 
+/*
+ * Call-screening access control list
+ */
+
+enum acl_action {
+	ACL_NONE = 0,
+	ACL_ALLOW,
+	ACL_BLOCK,
+};
+
+struct acl;
+
+int  acl_alloc(struct acl **aclp);
+int  acl_add(struct acl *acl, const struct pl *line);
+int  acl_load(struct acl **aclp, const char *file);
+enum acl_action acl_check(struct acl *acl, const char *uri);
+int  acl_debug(struct re_printf *pf, const struct acl *acl);
+int  acl_reload(const char *file);
+struct acl *acl_current(void);
+
+
 /*
  * Media Context
  */
@@ -557,6 +609,43 @@ int auplay_alloc(struct auplay_st **stp, struct list *auplayl,
 		 auplay_write_h *wh, void *arg);
 
 
+/*
+ * Media CPU accounting
+ */
+
+/** Media processing stages */
+enum media_cpu_stage {
+	MEDIA_CPU_ENCODE = 0,   /**< Encoder                          */
+	MEDIA_CPU_DECODE,       /**< Decoder                          */
+	MEDIA_CPU_FILTER_ENC,   /**< Filters in the encoding path     */
+	MEDIA_CPU_FILTER_DEC,   /**< Filters in the decoding path     */
+	MEDIA_CPU_RESAMPLE_ENC, /**< Resampling in the encoding path  */
+	MEDIA_CPU_RESAMPLE_DEC, /**< Resampling in the decoding path  */
+
+	MEDIA_CPU_STAGES
+};
+
+/** CPU time spent in one processing stage */
+struct media_cpu_stat {
+	uint64_t n;             /**< Number of invocations            */
+	uint64_t usec;          /**< Total processing time [us]       */
+	uint32_t usec_max;      /**< Max. time of one invocation [us] */
+};
+
+/** CPU accounting of a media stream or a call */
+struct media_cpu {
+	struct media_cpu_stat stagev[MEDIA_CPU_STAGES];
+};
+
+void media_cpu_add(struct media_cpu_stat *st, uint64_t t0);
+void media_cpu_merge(struct media_cpu *dst, const struct media_cpu *src);
+const char *media_cpu_stage_name(enum media_cpu_stage stage);
+int  media_cpu_stat_print(struct re_printf *pf,
+			 const struct media_cpu_stat *st);
+int  media_cpu_debug(struct re_printf *pf, const struct media_cpu *cpu);
+int  media_cpu_encode(struct odict *od, const struct media_cpu *cpu);
+
+
 /*
  * Audio Filter
  */
@@ -567,11 +656,13 @@ struct aufilt;
 struct aufilt_enc_st {
 	const struct aufilt *af;
 	struct le le;
+	struct media_cpu_stat cpu;  /**< CPU time spent in this filter */
 };
 
 struct aufilt_dec_st {
 	const struct aufilt *af;
 	struct le le;
+	struct media_cpu_stat cpu;  /**< CPU time spent in this filter */
 };
 
 /** Audio Filter Parameters */
@@ -624,6 +715,13 @@ struct log {
 	log_h *h;
 };
 
+/** Asynchronous logging statistics */
+struct log_stat {
+	uint64_t n_msg;         /**< Messages written by logger thread */
+	uint64_t n_drop;        /**< Messages dropped, ring was full   */
+	uint64_t n_suppressed;  /**< Messages suppressed by rate-limit */
+};
+
 void log_register_handler(struct log *logh);
 void log_unregister_handler(struct log *logh);
 void log_level_set(enum log_level level);
@@ -632,6 +730,12 @@ const char *log_level_name(enum log_level level);
 void log_enable_debug(bool enable);
 void log_enable_info(bool enable);
 void log_enable_stdout(bool enable);
+int  log_enable_async(bool enable);
+void log_set_ratelimit(uint32_t burst);
+void log_flush(void);
+void log_stat_get(struct log_stat *stat);
+int  log_debug(struct re_printf *pf, void *unused);
+int  log_bench(struct re_printf *pf, uint32_t n);
 void vlog(enum log_level level, const char *fmt, va_list ap);
 void loglv(enum log_level level, const char *fmt, ...);
 void debug(const char *fmt, ...);
@@ -771,6 +875,7 @@ enum ua_event {
 	UA_EVENT_AUDIO_ERROR,
 	UA_EVENT_CALL_LOCAL_SDP,      /**< param: offer or answer */
 	UA_EVENT_CALL_REMOTE_SDP,     /**< param: offer or answer */
+	UA_EVENT_CALL_SETUP,          /**< param: milestone,usec  */
 	UA_EVENT_MODULE,
 	UA_EVENT_CUSTOM,
 
@@ -812,6 +917,7 @@ int  ua_print_calls(struct re_printf *pf, const struct ua *ua);
 int  ua_print_status(struct re_printf *pf, const struct ua *ua);
 int  ua_print_supported(struct re_printf *pf, const struct ua *ua);
 int  ua_update_account(struct ua *ua);
+int  ua_set_account(struct ua *ua, const char *addr);
 int  ua_register(struct ua *ua);
 int  ua_fallback(struct ua *ua);
 void ua_unregister(struct ua *ua);
@@ -874,6 +980,7 @@ struct sipsess_sock  *uag_sipsess_sock(void);
 struct sipevent_sock *uag_sipevent_sock(void);
 struct call *uag_call_find(const char *id);
 void uag_filter_calls(call_list_h *listh, call_match_h *matchh, void *arg);
+int  reg_sched_debug(struct re_printf *pf, void *unused);
 
 
 /*
@@ -1021,6 +1128,27 @@ int vidsrc_alloc(struct vidsrc_st **stp, struct list *vidsrcl,
 		 vidsrc_error_h *errorh, void *arg);
 
 
+/* Shared video source */
+struct vidsrc_sub;
+
+/** Statistics for a shared video source subscriber */
+struct vidsrc_sub_stats {
+	uint64_t n_frame;    /**< Frames delivered to the subscriber  */
+	uint64_t n_scale;    /**< Frames delivered as scaled variant  */
+	uint64_t n_drop;     /**< Frames dropped for this subscriber  */
+};
+
+int vidsrc_sub_alloc(struct vidsrc_sub **subp, const struct vidsrc *vs,
+		     struct media_ctx **ctx, const struct vidsrc_prm *prm,
+		     const struct vidsz *size, const char *dev,
+		     const struct vidsz *scale,
+		     vidsrc_frame_h *frameh, vidsrc_packet_h *packeth,
+		     vidsrc_error_h *errorh, void *arg);
+int vidsrc_sub_stats(const struct vidsrc_sub *sub,
+		     struct vidsrc_sub_stats *stats);
+int vidsrc_share_debug(struct re_printf *pf, void *unused);
+
+
 /*
  * Video Display
  */
@@ -1194,11 +1322,13 @@ struct vidfilt;
 struct vidfilt_enc_st {
 	const struct vidfilt *vf;
 	struct le le;
+	struct media_cpu_stat cpu;  /**< CPU time spent in this filter */
 };
 
 struct vidfilt_dec_st {
 	const struct vidfilt *vf;
 	struct le le;
+	struct media_cpu_stat cpu;  /**< CPU time spent in this filter */
 };
 
 /** Video Filter Parameters */
@@ -1251,9 +1381,28 @@ struct stream_param;
 struct mnat;
 struct mnat_sess;
 
+enum {
+	AUDIO_PLAYOUT_HIST_BINS = 16,  /**< Number of delay histogram bins */
+	AUDIO_PLAYOUT_HIST_MS   = 10,  /**< Width of a histogram bin [ms]  */
+};
+
+/** Audio playout statistics */
+struct audio_playout_stat {
+	uint64_t n_late;        /**< Packets later than target delay */
+	uint64_t n_lost;        /**< Lost packets                    */
+	uint64_t n_concealed;   /**< Concealed samples per channel   */
+	uint64_t n_accel;       /**< Samples removed by time-stretch */
+	uint64_t n_decel;       /**< Samples added by time-stretch   */
+	uint32_t delay_ms;      /**< Current playout delay [ms]      */
+	uint32_t target_ms;     /**< Target playout delay [ms]       */
+	uint32_t jitter_ms;     /**< Jitter percentile [ms]          */
+	uint64_t hist[AUDIO_PLAYOUT_HIST_BINS];  /**< Delay histogram */
+};
+
 typedef void (audio_event_h)(int key, bool end, void *arg);
 typedef void (audio_level_h)(bool tx, double lvl, void *arg);
 typedef void (audio_err_h)(int err, const char *str, void *arg);
+typedef void (audio_firstplay_h)(uint64_t ts, void *arg);
 
 int audio_alloc(struct audio **ap, struct list *streaml,
 		const struct stream_param *stream_prm,
@@ -1274,8 +1423,12 @@ int  audio_level_get(const struct audio *au, double *level);
 int  audio_debug(struct re_printf *pf, const struct audio *a);
 struct stream *audio_strm(const struct audio *au);
 uint64_t audio_jb_current_value(const struct audio *au);
+int  audio_playout_stat(const struct audio *au,
+			struct audio_playout_stat *stat);
 int  audio_set_bitrate(struct audio *au, uint32_t bitrate);
 bool audio_rxaubuf_started(const struct audio *au);
+int  audio_set_firstplay_handler(struct audio *au,
+				 audio_firstplay_h *firstplayh);
 int  audio_start(struct audio *a);
 int  audio_start_source(struct audio *a, struct list *ausrcl,
 			struct list *aufiltl);
@@ -1293,6 +1446,15 @@ struct config_audio *audio_config(struct audio *au);
 void audio_set_media_context(struct audio *au, struct media_ctx **ctx);
 
 
+/*
+ * Audio time-stretching
+ */
+
+size_t tstretch_maxlag(uint32_t srate);
+int    tstretch_s16(int16_t *y, size_t *yn, const int16_t *x, size_t xn,
+		    size_t ch, uint32_t srate, bool accel);
+
+
 /*
  * Video stream
  */
@@ -1351,6 +1513,7 @@ typedef void (stream_error_h)(struct stream *strm, int err, void *arg);
 
 void stream_update(struct stream *s);
 const struct rtcp_stats *stream_rtcp_stats(const struct stream *strm);
+const struct media_cpu *stream_media_cpu(const struct stream *strm);
 struct sdp_media *stream_sdpmedia(const struct stream *s);
 uint32_t stream_metric_get_tx_n_packets(const struct stream *strm);
 uint32_t stream_metric_get_tx_n_bytes(const struct stream *strm);
@@ -1460,6 +1623,136 @@ int sip_req_send(struct ua *ua, const char *method, const char *uri,
 		 sip_resp_h *resph, void *arg, const char *fmt, ...);
 
 
+/*
+ * Timer wheel
+ */
+
+/** Defines a timer on the core timer wheel */
+struct tmrw {
+	struct le le;        /**< Member of wheel slot        */
+	uint64_t due;        /**< Expiry [ticks]              */
+	uint32_t period;     /**< Period [ms], 0 for one-shot */
+	unsigned level;      /**< Wheel level                 */
+	tmr_h *th;           /**< Timeout handler             */
+	void *arg;           /**< Handler argument            */
+	const char *name;    /**< Timer name, for profiling   */
+};
+
+void tmrw_init(struct tmrw *tw, const char *name);
+void tmrw_start(struct tmrw *tw, uint64_t delay, tmr_h *th, void *arg);
+void tmrw_start_periodic(struct tmrw *tw, uint64_t delay, uint32_t period,
+			 tmr_h *th, void *arg);
+void tmrw_cancel(struct tmrw *tw);
+bool tmrw_isrunning(const struct tmrw *tw);
+int  wheel_debug(struct re_printf *pf, void *unused);
+
+
+/*
+ * Main-loop profiler
+ */
+
+/** Defines one invocation of a profiled main-loop handler */
+struct mlprof_probe {
+	const char *name;    /**< Handler name              */
+	uint64_t t0;         /**< Start time [us], 0 if off */
+};
+
+int  mlprof_init(uint32_t stall_ms);
+void mlprof_close(void);
+void mlprof_reset(void);
+bool mlprof_enabled(void);
+void mlprof_enter(struct mlprof_probe *probe, const char *name);
+void mlprof_leave(struct mlprof_probe *probe);
+int  mlprof_debug(struct re_printf *pf, void *unused);
+
+
+/*
+ * Codec state pools
+ */
+
+int  codecpool_debug(struct re_printf *pf, void *unused);
+
+
+/*
+ * Media thread factory
+ */
+
+/** Media thread classes */
+enum mthread_class {
+	MTHREAD_AUDIO_SRC = 0,  /**< Audio source devices          */
+	MTHREAD_AUDIO_PLAY,     /**< Audio player devices          */
+	MTHREAD_AUDIO_PROC,     /**< Audio encoding and decoding   */
+	MTHREAD_VIDEO_SRC,      /**< Video source devices          */
+
+	MTHREAD_CLASS_MAX
+};
+
+struct mthread;
+
+typedef void *(mthread_h)(void *arg);
+
+int  mthread_create(struct mthread **mtp, enum mthread_class cls,
+		    const char *name, mthread_h *h, void *arg);
+int  mthread_set_sched(enum mthread_class cls, const struct pl *sched);
+const char *mthread_class_name(enum mthread_class cls);
+int  mthread_debug(struct re_printf *pf, void *unused);
+
+
+/*
+ * Startup and shutdown trace
+ */
+
+int  trace_init(const char *prefix, uint64_t t0);
+void trace_close(void);
+bool trace_enabled(void);
+void trace_begin(const char *cat, const char *name);
+void trace_end(const char *cat, const char *name);
+void trace_instant(const char *cat, const char *name);
+void trace_ready(void);
+void trace_shutdown(void);
+
+
+/*
+ * Metrics registry
+ */
+
+/** Metric types */
+enum metrics_type {
+	METRICS_COUNTER = 0,
+	METRICS_GAUGE,
+	METRICS_HISTOGRAM,
+};
+
+struct metrics_fam;
+struct metrics_exp;
+
+/**
+ * Collect the samples of a metric family
+ *
+ * @param exp  Export context
+ * @param posp Position in the family, for incremental collection
+ * @param arg  Handler argument
+ *
+ * @return 0 if done, EAGAIN to continue later, otherwise errorcode
+ */
+typedef int  (metrics_collect_h)(struct metrics_exp *exp, uint32_t *posp,
+				 void *arg);
+typedef void (metrics_done_h)(int err, struct mbuf *mb, void *arg);
+
+int  metrics_register(struct metrics_fam **famp, const char *name,
+		      enum metrics_type type, const char *help,
+		      metrics_collect_h *colh, void *arg);
+int  metrics_sample(struct metrics_exp *exp, double value,
+		    const char *fmt, ...);
+int  metrics_histogram(struct metrics_exp *exp, const double *limitv,
+		       const uint64_t *countv, size_t limitc, double sum,
+		       const char *fmt, ...);
+bool metrics_yield(const struct metrics_exp *exp);
+int  metrics_label_print(struct re_printf *pf, const char *str);
+int  metrics_export(struct metrics_exp **expp, metrics_done_h *doneh,
+		    void *arg);
+
+
 /*
  * Modules
  */
@@ -1475,6 +1768,9 @@ int  module_preload(const char *module);
 int  module_load(const char *path, const char *name);
 void module_unload(const char *name);
 void module_app_unload(void);
+void module_unload_all(void);
+int  module_lazy_load(const char *kind, const char *name);
+int  module_debug(struct re_printf *pf, void *unused);
 
 
 /*
@@ -1484,6 +1780,9 @@ void module_app_unload(void);
 int event_encode_dict(struct odict *od, struct ua *ua, enum ua_event ev,
 		      struct call *call, const char *prm);
 int event_add_au_jb_stat(struct odict *od_parent, const struct call *call);
+int event_add_media_cpu(struct odict *od_parent, const struct call *call);
+int event_encode_json(struct re_printf *pf, struct ua *ua, enum ua_event ev,
+		      struct call *call, const char *prm);
 int  uag_event_register(ua_event_h *eh, void *arg);
 void uag_event_unregister(ua_event_h *eh);
 void ua_event(struct ua *ua, enum ua_event ev, struct call *call,
@@ -1491,6 +1790,7 @@ void ua_event(struct ua *ua, enum ua_event ev, struct call *call,
 void module_event(const char *module, const char *event, struct ua *ua,
 		struct call *call, const char *fmt, ...);
 const char  *uag_event_str(enum ua_event ev);
+const char  *uag_event_class_str(enum ua_event ev);
 
 
 /*
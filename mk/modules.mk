@@ -195,6 +195,9 @@ USE_V4L2 := $(shell [ -f $(SYSROOT)/include/linux/videodev2.h ] || \
 USE_X11 := $(shell [ -f $(SYSROOT)/include/X11/Xlib.h ] || \
 	[ -f $(SYSROOT)/local/include/X11/Xlib.h ] || \
 	[ -f $(SYSROOT_ALT)/include/X11/Xlib.h ] && echo "yes")
+HAVE_XDAMAGE := $(shell [ -f $(SYSROOT)/include/X11/extensions/Xdamage.h ] || \
+	[ -f $(SYSROOT)/local/include/X11/extensions/Xdamage.h ] || \
+	[ -f $(SYSROOT_ALT)/include/X11/extensions/Xdamage.h ] && echo "yes")
 USE_ZRTP := $(shell [ -f $(SYSROOT)/include/libzrtp/zrtp.h ] || \
 	[ -f $(SYSROOT)/local/include/libzrtp/zrtp.h ] || \
 	[ -f $(SYSROOT_ALT)/include/libzrtp/zrtp.h ] && echo "yes")
@@ -286,7 +289,7 @@ MODULES   += mixminus
 MODULES   += multicast
 
 ifneq ($(HAVE_PTHREAD),)
-MODULES   += aubridge aufile ausine
+MODULES   += aubcast aubridge aufile ausine
 endif
 
 endif
@@ -17,6 +17,23 @@
  * from this file. If the file does not exist, a template file will be
  * created.
  *
+ * The file is read in one go, and the accounts are provisioned in bulk,
+ * so that accounts with identical codec settings share the resolved
+ * codec lists. The load time is logged in accounts per second.
+ *
+ * The accounts can be reloaded at runtime without a restart:
+ *
+ \verbatim
+  /uareload [path]         Reload the accounts file
+  /uasync <accounts>       Set the accounts from newline separated lines
+ \endverbatim
+ *
+ * The new accounts are compared with the current ones by AOR, and only
+ * the added, changed and removed accounts are created, updated and
+ * deleted. Large sets are processed in time slices on the main loop.
+ * An AOR that already has a User-Agent from elsewhere, e.g. 'uanew',
+ * is skipped.
+ *
  * Examples:
  \verbatim
   "User 1 with password prompt" <sip:user@domain.com>
@@ -111,25 +128,162 @@ static int account_write_template(const char *file)
 }
 
 
+enum {
+	ENTRY_HASH_SIZE = 256,
+	SLICE_USEC      = 5000,    /**< Max. time per reload slice [us] */
+};
+
+
+/** An account provisioned from the accounts file or a batch */
+struct entry {
+	struct le he;              /**< Member of hash, by AOR          */
+	struct le le;              /**< Member of entry list            */
+	char *aor;                 /**< Address-of-Record               */
+	char *addr;                /**< SIP address with parameters     */
+	struct ua *ua;             /**< User-Agent (no reference)       */
+	uint32_t gen;              /**< Last reload that contained it   */
+};
+
+
+/** Incremental reload, processed in time-sliced chunks */
+struct reload {
+	struct tmr tmr;            /**< Slice timer                     */
+	struct mbuf *mb;           /**< Account lines                   */
+	struct pl pl;              /**< Remaining account lines         */
+	struct le *le;             /**< Next entry to check for removal */
+	bool removing;             /**< Removing the old accounts       */
+	uint64_t t0;               /**< Start time [us]                 */
+	uint32_t gen;              /**< Reload generation               */
+	uint32_t slices;           /**< Number of slices                */
+
+	uint32_t n_added;
+	uint32_t n_updated;
+	uint32_t n_removed;
+	uint32_t n_same;
+	uint32_t n_failed;
+};
+
+
+static struct hash *entries;      /**< Provisioned accounts, by AOR   */
+static struct list entryl;        /**< Provisioned accounts           */
+static struct reload *reload;     /**< Current reload, if any         */
+static uint32_t generation;       /**< Current reload generation      */
+
+
+static void entry_destructor(void *arg)
+{
+	struct entry *e = arg;
+
+	hash_unlink(&e->he);
+	list_unlink(&e->le);
+	mem_deref(e->aor);
+	mem_deref(e->addr);
+}
+
+
+static bool entry_cmp_handler(struct le *le, void *arg)
+{
+	const struct entry *e = le->data;
+
+	return 0 == str_cmp(e->aor, arg);
+}
+
+
+static struct entry *entry_find(const char *aor)
+{
+	return list_ledata(hash_lookup(entries, hash_joaat_str(aor),
+				       entry_cmp_handler, (void *)aor));
+}
+
+
+/* The User-Agent of an entry, if it was not deleted by other means */
+static struct ua *entry_ua(const struct entry *e)
+{
+	struct le *le;
+
+	for (le = list_head(uag_list()); le; le = le->next) {
+
+		struct ua *ua = le->data;
+
+		if (ua == e->ua &&
+		    0 == str_cmp(account_aor(ua_account(ua)), e->aor))
+			return ua;
+	}
+
+	return NULL;
+}
+
+
+static int entry_set(const char *aor, const char *addr, struct ua *ua)
+{
+	struct entry *e;
+	int err;
+
+	e = entry_find(aor);
+	if (e) {
+		e->gen = generation;
+		e->ua  = ua;
+		e->addr = mem_deref(e->addr);
+		return str_dup(&e->addr, addr);
+	}
+
+	e = mem_zalloc(sizeof(*e), entry_destructor);
+	if (!e)
+		return ENOMEM;
+
+	err  = str_dup(&e->aor, aor);
+	err |= str_dup(&e->addr, addr);
+	if (err) {
+		mem_deref(e);
+		return err;
+	}
+
+	e->gen = generation;
+	e->ua  = ua;
+
+	hash_append(entries, hash_joaat_str(aor), &e->he, e);
+	list_append(&entryl, &e->le, e);
+
+	return 0;
+}
+
+
+static void register_ua(struct ua *ua)
+{
+	struct account *acc = ua_account(ua);
+	int err;
+
+	if (!account_regint(acc))
+		return;
+
+	if (!account_prio(acc))
+		err = ua_register(ua);
+	else
+		err = ua_fallback(ua);
+
+	if (err) {
+		warning("account: failed to register ua"
+			" '%s' (%m)\n", account_aor(acc), err);
+	}
+}
+
+
 /**
  * Add a User-Agent (UA)
  *
- * @param addr SIP Address string
- * @param arg  Handler argument (unused)
+ * @param uap    Pointer to allocated User-Agent
+ * @param addr   SIP Address string
+ * @param prompt True to prompt for a missing password
  *
  * @return 0 if success, otherwise errorcode
  */
-static int line_handler(const struct pl *addr, void *arg)
+static int ua_add(struct ua **uap, const char *addr, bool prompt)
 {
-	char buf[512];
 	struct ua *ua;
 	struct account *acc;
 	int err;
-	(void)arg;
 
-	(void)pl_strcpy(addr, buf, sizeof(buf));
-
-	err = ua_alloc(&ua, buf);
+	err = ua_alloc(&ua, addr);
 	if (err)
 		return err;
 
@@ -139,25 +293,23 @@ static int line_handler(const struct pl *addr, void *arg)
 		return ENOENT;
 	}
 
-	if (account_regint(acc)) {
-		int e;
+	register_ua(ua);
 
-		if (!account_prio(acc))
-			e = ua_register(ua);
-		else
-			e = ua_fallback(ua);
-
-		if (e) {
-			warning("account: failed to register ua"
-				" '%s' (%m)\n", account_aor(acc), e);
-		}
-	}
+	err = entry_set(account_aor(acc), addr, ua);
+	if (err)
+		goto out;
 
 	/* prompt password if auth_user is set, but auth_pass is not  */
 	if (str_isset(account_auth_user(acc)) &&
 	    !str_isset(account_auth_pass(acc))) {
 		char *pass = NULL;
 
+		if (!prompt) {
+			warning("account: %s: no password\n",
+				account_aor(acc));
+			goto out;
+		}
+
 		(void)re_printf("Please enter password for %s: ",
 				account_aor(acc));
 
@@ -171,10 +323,42 @@ static int line_handler(const struct pl *addr, void *arg)
 	}
 
  out:
+	if (!err && uap)
+		*uap = ua;
+
 	return err;
 }
 
 
+static int line_handler(const struct pl *addr, void *arg)
+{
+	char buf[512];
+	(void)arg;
+
+	(void)pl_strcpy(addr, buf, sizeof(buf));
+
+	return ua_add(NULL, buf, true);
+}
+
+
+static int accounts_file(char *file, size_t sz)
+{
+	char path[256] = "";
+	int err;
+
+	err = conf_path_get(path, sizeof(path));
+	if (err) {
+		warning("account: conf_path_get (%m)\n", err);
+		return err;
+	}
+
+	if (re_snprintf(file, sz, "%s/accounts", path) < 0)
+		return ENOMEM;
+
+	return 0;
+}
+
+
 /**
  * Read the SIP accounts from the ~/.baresip/accounts file
  *
@@ -183,20 +367,17 @@ static int line_handler(const struct pl *addr, void *arg)
 static int account_read_file(void)
 {
 	char path[256] = "", file[256] = "";
+	uint64_t t0, usec;
 	uint32_t n;
 	int err;
 
-	err = conf_path_get(path, sizeof(path));
-	if (err) {
-		warning("account: conf_path_get (%m)\n", err);
+	err = accounts_file(file, sizeof(file));
+	if (err)
 		return err;
-	}
-
-	if (re_snprintf(file, sizeof(file), "%s/accounts", path) < 0)
-		return ENOMEM;
 
 	if (!conf_fileexist(file)) {
 
+		(void)conf_path_get(path, sizeof(path));
 		(void)fs_mkdir(path, 0700);
 
 		err = account_write_template(file);
@@ -204,12 +385,23 @@ static int account_read_file(void)
 			return err;
 	}
 
+	t0 = tmr_jiffies_usec();
+
+	/* share the codec lists of accounts with identical settings */
+	(void)account_bulk_begin();
 	err = conf_parse(file, line_handler, NULL);
+	account_bulk_end();
 	if (err)
 		return err;
 
+	usec = max(tmr_jiffies_usec() - t0, 1);
+
 	n = list_count(uag_list());
 	info("Populated %u account%s\n", n, 1==n ? "" : "s");
+	if (n) {
+		info("account: loaded in %llu ms (%llu accounts/sec)\n",
+		     usec / 1000, n * 1000000ULL / usec);
+	}
 
 	if (list_isempty(uag_list())) {
 		info("account: No SIP accounts found\n"
@@ -221,14 +413,296 @@ static int account_read_file(void)
 }
 
 
+static void reload_destructor(void *arg)
+{
+	struct reload *rl = arg;
+
+	tmr_cancel(&rl->tmr);
+	mem_deref(rl->mb);
+}
+
+
+static void reload_line(struct reload *rl, const char *addr)
+{
+	struct entry *e;
+	struct ua *ua;
+	char *aor = NULL;
+	int err;
+
+	err = account_aor_decode(&aor, addr);
+	if (err) {
+		warning("account: reload: invalid account '%s'\n", addr);
+		goto out;
+	}
+
+	e = entry_find(aor);
+	if (e && 0 == str_cmp(e->addr, addr)) {
+		e->gen = rl->gen;
+		++rl->n_same;
+		goto out;
+	}
+
+	ua = e ? entry_ua(e) : NULL;
+	if (ua) {
+		err = ua_set_account(ua, addr);
+		if (err)
+			goto out;
+
+		register_ua(ua);
+
+		err = entry_set(aor, addr, ua);
+		if (!err)
+			++rl->n_updated;
+	}
+	else {
+		/* the User-Agent of the entry was deleted by other means */
+		e = mem_deref(e);
+
+		if (uag_find_aor(aor)) {
+			warning("account: reload: %s exists and was not"
+				" provisioned here, skipped\n", aor);
+			++rl->n_failed;
+			goto out;
+		}
+
+		err = ua_add(NULL, addr, false);
+		if (!err)
+			++rl->n_added;
+	}
+
+ out:
+	if (err) {
+		warning("account: reload: %s failed (%m)\n", aor, err);
+		++rl->n_failed;
+
+		/* keep the existing UA */
+		e = aor ? entry_find(aor) : NULL;
+		if (e)
+			e->gen = rl->gen;
+	}
+
+	mem_deref(aor);
+}
+
+
+/* Remove one account that is not provisioned anymore */
+static void reload_remove(struct reload *rl, struct entry *e)
+{
+	struct ua *ua = entry_ua(e);
+
+	if (ua) {
+		info("account: reload: removing %s\n", e->aor);
+		mem_deref(ua);
+	}
+
+	mem_deref(e);
+	++rl->n_removed;
+}
+
+
+static void reload_done(struct reload *rl)
+{
+	const uint64_t ms = (tmr_jiffies_usec() - rl->t0) / 1000;
+
+	info("account: reload done in %llu ms (%u slices): %u added,"
+	     " %u updated, %u removed, %u unchanged, %u failed\n",
+	     ms, rl->slices, rl->n_added, rl->n_updated, rl->n_removed,
+	     rl->n_same, rl->n_failed);
+
+	module_event("account", "reload", NULL, NULL,
+		     "added=%u updated=%u removed=%u unchanged=%u failed=%u",
+		     rl->n_added, rl->n_updated, rl->n_removed, rl->n_same,
+		     rl->n_failed);
+
+	reload = mem_deref(reload);
+}
+
+
+static void reload_slice(void *arg)
+{
+	struct reload *rl = arg;
+	const uint64_t t0 = tmr_jiffies_usec();
+
+	++rl->slices;
+
+	(void)account_bulk_begin();
+
+	/* 1. create and update the accounts of the new set */
+	while (rl->pl.l) {
+		const char *lb = pl_strchr(&rl->pl, '\n');
+		struct pl line;
+		char buf[512];
+
+		line.p = rl->pl.p;
+		line.l = lb ? (size_t)(lb - rl->pl.p) : rl->pl.l;
+		pl_advance(&rl->pl, min(line.l + 1, rl->pl.l));
+
+		if (!line.l || line.p[0] == '#')
+			continue;
+
+		(void)pl_strcpy(&line, buf, sizeof(buf));
+		reload_line(rl, buf);
+
+		if (tmr_jiffies_usec() - t0 >= SLICE_USEC)
+			goto yield;
+	}
+
+	if (!rl->removing) {
+		rl->removing = true;
+		rl->le = list_head(&entryl);
+	}
+
+	/* 2. remove the accounts that are not in the new set */
+	while (rl->le) {
+		struct entry *e = rl->le->data;
+
+		rl->le = rl->le->next;
+
+		if (e->gen != rl->gen)
+			reload_remove(rl, e);
+
+		if (tmr_jiffies_usec() - t0 >= SLICE_USEC)
+			goto yield;
+	}
+
+	account_bulk_end();
+	reload_done(rl);
+	return;
+
+ yield:
+	account_bulk_end();
+	tmr_start(&rl->tmr, 0, reload_slice, rl);
+}
+
+
+static int line_collect_handler(const struct pl *addr, void *arg)
+{
+	return mbuf_printf(arg, "%r\n", addr);
+}
+
+
+/**
+ * Start an incremental reload of the provisioned accounts. The new set of
+ * accounts is compared with the current set by Address-of-Record, and
+ * only the new, changed and removed accounts are created, updated and
+ * deleted. User-Agents that were not provisioned by this module, e.g.
+ * with the 'uanew' command, are not touched.
+ *
+ * @param file  Accounts file, or NULL
+ * @param batch Account lines separated by newlines, if file is NULL
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+static int reload_start(const char *file, const char *batch)
+{
+	struct reload *rl;
+	int err;
+
+	if (reload)
+		return EBUSY;
+
+	rl = mem_zalloc(sizeof(*rl), reload_destructor);
+	if (!rl)
+		return ENOMEM;
+
+	rl->mb = mbuf_alloc(4096);
+	if (!rl->mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	if (file)
+		err = conf_parse(file, line_collect_handler, rl->mb);
+	else
+		err = mbuf_write_str(rl->mb, batch);
+	if (err)
+		goto out;
+
+	rl->pl.p = (const char *)rl->mb->buf;
+	rl->pl.l = rl->mb->end;
+	rl->t0   = tmr_jiffies_usec();
+	rl->gen  = ++generation;
+
+	reload = rl;
+	tmr_start(&rl->tmr, 0, reload_slice, rl);
+
+ out:
+	if (err)
+		mem_deref(rl);
+
+	return err;
+}
+
+
+static int cmd_reload(struct re_printf *pf, void *arg)
+{
+	const struct cmd_arg *carg = arg;
+	char file[256] = "";
+	int err;
+
+	if (str_isset(carg->prm))
+		str_ncpy(file, carg->prm, sizeof(file));
+	else {
+		err = accounts_file(file, sizeof(file));
+		if (err)
+			return err;
+	}
+
+	err = reload_start(file, NULL);
+	if (err)
+		return re_hprintf(pf, "account: reload failed (%m)\n", err);
+
+	return re_hprintf(pf, "reloading accounts from %s\n", file);
+}
+
+
+static int cmd_sync(struct re_printf *pf, void *arg)
+{
+	const struct cmd_arg *carg = arg;
+	int err;
+
+	if (!str_isset(carg->prm))
+		return re_hprintf(pf, "usage: /uasync <account>[\\n...]\n");
+
+	err = reload_start(NULL, carg->prm);
+	if (err)
+		return re_hprintf(pf, "account: sync failed (%m)\n", err);
+
+	return re_hprintf(pf, "synchronizing accounts\n");
+}
+
+
+static const struct cmd cmdv[] = {
+{"uareload", 0, CMD_PRM, "Reload accounts file [path]",    cmd_reload },
+{"uasync",   0, CMD_PRM, "Synchronize accounts <lines>",   cmd_sync   },
+};
+
+
 static int module_init(void)
 {
-	return account_read_file();
+	int err;
+
+	err = hash_alloc(&entries, ENTRY_HASH_SIZE);
+	if (err)
+		return err;
+
+	err = account_read_file();
+	if (err)
+		return err;
+
+	return cmd_register(baresip_commands(), cmdv, ARRAY_SIZE(cmdv));
 }
 
 
 static int module_close(void)
 {
+	cmd_unregister(baresip_commands(), cmdv);
+
+	reload = mem_deref(reload);
+
+	list_flush(&entryl);
+	entries = mem_deref(entries);
+
 	return 0;
 }
 
@@ -10,7 +10,6 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <alsa/asoundlib.h>
-#include <pthread.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
@@ -18,7 +17,7 @@
 
 
 struct auplay_st {
-	pthread_t thread;
+	struct mthread *thread;
 	volatile bool run;
 	snd_pcm_t *write;
 	void *sampv;
@@ -39,7 +38,7 @@ static void auplay_destructor(void *arg)
 		debug("alsa: stopping playback thread (%s)\n", st->device);
 		st->run = false;
 		snd_pcm_drop(st->write);
-		(void)pthread_join(st->thread, NULL);
+		st->thread = mem_deref(st->thread);
 	}
 
 	if (st->write)
@@ -159,7 +158,8 @@ int alsa_play_alloc(struct auplay_st **stp, const struct auplay *ap,
 	}
 
 	st->run = true;
-	err = pthread_create(&st->thread, NULL, write_thread, st);
+	err = mthread_create(&st->thread, MTHREAD_AUDIO_PLAY,
+			     "alsa play", write_thread, st);
 	if (err) {
 		st->run = false;
 		goto out;
@@ -10,7 +10,6 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <alsa/asoundlib.h>
-#include <pthread.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
@@ -18,7 +17,7 @@
 
 
 struct ausrc_st {
-	pthread_t thread;
+	struct mthread *thread;
 	volatile bool run;
 	snd_pcm_t *read;
 	void *sampv;
@@ -38,7 +37,7 @@ static void ausrc_destructor(void *arg)
 	if (st->run) {
 		debug("alsa: stopping recording thread (%s)\n", st->device);
 		st->run = false;
-		(void)pthread_join(st->thread, NULL);
+		st->thread = mem_deref(st->thread);
 	}
 
 	if (st->read)
@@ -156,7 +155,8 @@ int alsa_src_alloc(struct ausrc_st **stp, const struct ausrc *as,
 	}
 
 	st->run = true;
-	err = pthread_create(&st->thread, NULL, read_thread, st);
+	err = mthread_create(&st->thread, MTHREAD_AUDIO_SRC,
+			     "alsa src", read_thread, st);
 	if (err) {
 		st->run = false;
 		goto out;
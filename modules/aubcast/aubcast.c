@@ -0,0 +1,570 @@
+/**
+ * @file aubcast.c  Shared broadcast audio source
+ *
+ * Copyright (C) 2010 Alfred E. Heggestad
+ */
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+
+
+/**
+ * @defgroup aubcast aubcast
+ *
+ * Shared broadcast audio source, e.g. for music-on-hold or announcements
+ *
+ * The device is another audio source and its device. All calls using the
+ * same device share one instance of that source, which runs on its own
+ * clock. A new subscriber starts at the current playout position.
+ *
+ * The frames are converted once for each combination of sample rate,
+ * channels and sample format that the subscribers need, and not once
+ * per subscriber.
+ *
+ * Example config:
+ \verbatim
+  audio_source       aubcast,aufile,/usr/share/sounds/moh.wav
+  aubcast_loop       yes    # restart the source at end of file
+ \endverbatim
+ */
+
+
+enum {
+	PTIME = 20,   /* Default packet time of the source [ms] */
+};
+
+
+/** Defines a shared broadcast source */
+struct bcast {
+	struct le le;              /**< Member of broadcast list         */
+	char *device;              /**< Source module and device         */
+	char *mod;                 /**< Source module                    */
+	char *dev;                 /**< Source device                    */
+	struct ausrc_st *src;      /**< Shared audio source              */
+	struct ausrc_prm prm;      /**< Parameters of shared source      */
+	struct lock *lock;         /**< Protects the variant list        */
+	struct list varl;          /**< Conversions (struct variant)     */
+	struct tmr tmr;            /**< Restart timer                    */
+	uint64_t n_frame;          /**< Frames from the source           */
+	uint32_t n_restart;        /**< Number of restarts               */
+};
+
+/** Defines one output format, shared by all its subscribers */
+struct variant {
+	struct le le;              /**< Member of bcast varl             */
+	uint32_t srate;            /**< Sampling rate in [Hz]            */
+	uint8_t ch;                /**< Number of channels               */
+	enum aufmt fmt;            /**< Sample format                    */
+	struct auresamp resamp;    /**< Optional resampler               */
+	int16_t *sampv_rs;         /**< Resampled samples                */
+	void *sampv;               /**< Converted samples                */
+	size_t sampc_max;          /**< Size of sample buffers           */
+	struct list subl;          /**< Subscribers (struct ausrc_st)    */
+	uint64_t n_conv;           /**< Converted frames                 */
+};
+
+/** Defines one subscriber, e.g. a call */
+struct ausrc_st {
+	struct le le;              /**< Member of variant subl           */
+	struct bcast *bc;          /**< Broadcast source (reference)     */
+	struct variant *var;       /**< Output format                    */
+	ausrc_read_h *rh;          /**< Read handler                     */
+	ausrc_error_h *errh;       /**< Error handler                    */
+	void *arg;                 /**< Handler argument                 */
+};
+
+
+static struct ausrc *ausrc;
+static struct list bcastl;
+static bool loop = true;
+
+
+static void variant_destructor(void *arg)
+{
+	struct variant *var = arg;
+
+	list_unlink(&var->le);
+	mem_deref(var->sampv_rs);
+	mem_deref(var->sampv);
+}
+
+
+static void bcast_destructor(void *arg)
+{
+	struct bcast *bc = arg;
+
+	list_unlink(&bc->le);
+	tmr_cancel(&bc->tmr);
+
+	/* stops the source thread, must not hold the lock */
+	mem_deref(bc->src);
+
+	list_flush(&bc->varl);
+	mem_deref(bc->lock);
+	mem_deref(bc->device);
+	mem_deref(bc->mod);
+	mem_deref(bc->dev);
+}
+
+
+static void sub_destructor(void *arg)
+{
+	struct ausrc_st *st = arg;
+	struct bcast *bc = st->bc;
+
+	if (bc) {
+		lock_write_get(bc->lock);
+
+		list_unlink(&st->le);
+
+		if (st->var && list_isempty(&st->var->subl))
+			mem_deref(st->var);
+
+		lock_rel(bc->lock);
+	}
+
+	mem_deref(bc);
+}
+
+
+static int variant_convert(struct variant *var, const struct auframe *af,
+			   struct auframe *vaf)
+{
+	int16_t *sampv = af->sampv;
+	size_t sampc = af->sampc;
+	int err;
+
+	if (var->resamp.resample) {
+
+		sampc = var->sampc_max;
+
+		err = auresamp(&var->resamp, var->sampv_rs, &sampc,
+			       af->sampv, af->sampc);
+		if (err)
+			return err;
+
+		sampv = var->sampv_rs;
+	}
+
+	if (var->fmt == AUFMT_S16LE) {
+		auframe_init(vaf, AUFMT_S16LE, sampv, sampc,
+			     var->srate, var->ch);
+	}
+	else {
+		auconv_from_s16(var->fmt, var->sampv, sampv, sampc);
+		auframe_init(vaf, var->fmt, var->sampv, sampc,
+			     var->srate, var->ch);
+	}
+
+	vaf->timestamp = af->timestamp;
+	++var->n_conv;
+
+	return 0;
+}
+
+
+/* Called from the thread of the shared source */
+static void src_read_handler(struct auframe *af, void *arg)
+{
+	struct bcast *bc = arg;
+	struct le *le;
+
+	if (af->fmt != AUFMT_S16LE)
+		return;
+
+	lock_read_get(bc->lock);
+
+	++bc->n_frame;
+
+	for (le = bc->varl.head; le; le = le->next) {
+
+		struct variant *var = le->data;
+		struct auframe vaf;
+		struct le *les;
+
+		if (variant_convert(var, af, &vaf))
+			continue;
+
+		for (les = var->subl.head; les; les = les->next) {
+
+			struct ausrc_st *st = les->data;
+
+			st->rh(&vaf, st->arg);
+		}
+	}
+
+	lock_rel(bc->lock);
+}
+
+
+static void src_error_handler(int err, const char *str, void *arg);
+
+
+static int src_start(struct bcast *bc)
+{
+	int err;
+
+	err = ausrc_alloc(&bc->src, baresip_ausrcl(), NULL, bc->mod,
+			  &bc->prm, bc->dev, src_read_handler,
+			  src_error_handler, bc);
+	if (err) {
+		warning("aubcast: could not start source %s,%s (%m)\n",
+			bc->mod, bc->dev, err);
+	}
+
+	return err;
+}
+
+
+static void restart_handler(void *arg)
+{
+	struct bcast *bc = arg;
+
+	bc->src = mem_deref(bc->src);
+
+	if (src_start(bc))
+		return;
+
+	++bc->n_restart;
+}
+
+
+/* Called from the re_main thread */
+static void src_error_handler(int err, const char *str, void *arg)
+{
+	struct bcast *bc = arg;
+	struct ausrc_st **stv;
+	struct le *le;
+	size_t i, n = 0;
+
+	if (!err && loop) {
+		tmr_start(&bc->tmr, 0, restart_handler, bc);
+		return;
+	}
+
+	/* the source has ended, a new subscriber starts a new one */
+	list_unlink(&bc->le);
+
+	lock_read_get(bc->lock);
+
+	for (le = bc->varl.head; le; le = le->next) {
+		const struct variant *var = le->data;
+
+		n += list_count(&var->subl);
+	}
+
+	stv = n ? mem_zalloc(n * sizeof(*stv), NULL) : NULL;
+	if (!stv) {
+		lock_rel(bc->lock);
+		return;
+	}
+
+	/* the subscribers may be destroyed by their error handlers */
+	for (le = bc->varl.head, n = 0; le; le = le->next) {
+
+		struct variant *var = le->data;
+		struct le *les;
+
+		for (les = var->subl.head; les; les = les->next)
+			stv[n++] = mem_ref(les->data);
+	}
+
+	lock_rel(bc->lock);
+
+	for (i = 0; i < n; i++) {
+
+		if (stv[i]->errh)
+			stv[i]->errh(err, str, stv[i]->arg);
+
+		mem_deref(stv[i]);
+	}
+
+	mem_deref(stv);
+}
+
+
+static int bcast_alloc(struct bcast **bcp, const char *device,
+		       const struct ausrc_prm *prm)
+{
+	struct pl mod, dev;
+	struct bcast *bc;
+	int err;
+
+	if (re_regex(device, str_len(device), "[^,]+,[~]*", &mod, &dev)) {
+		warning("aubcast: invalid device '%s'"
+			" (expected module,device)\n", device);
+		return EINVAL;
+	}
+
+	if (0 == pl_strcmp(&mod, "aubcast"))
+		return EINVAL;
+
+	bc = mem_zalloc(sizeof(*bc), bcast_destructor);
+	if (!bc)
+		return ENOMEM;
+
+	tmr_init(&bc->tmr);
+
+	err  = str_dup(&bc->device, device);
+	err |= pl_strdup(&bc->mod, &mod);
+	err |= pl_strdup(&bc->dev, &dev);
+	err |= lock_alloc(&bc->lock);
+	if (err)
+		goto out;
+
+	/* the source may change rate and channels, e.g. for a file */
+	bc->prm.srate = prm->srate;
+	bc->prm.ch    = prm->ch;
+	bc->prm.ptime = prm->ptime ? prm->ptime : PTIME;
+	bc->prm.fmt   = AUFMT_S16LE;
+
+	err = src_start(bc);
+	if (err)
+		goto out;
+
+	list_append(&bcastl, &bc->le, bc);
+
+	info("aubcast: started %s,%s (%u Hz, %u ch)\n",
+	     bc->mod, bc->dev, bc->prm.srate, bc->prm.ch);
+
+ out:
+	if (err)
+		mem_deref(bc);
+	else
+		*bcp = bc;
+
+	return err;
+}
+
+
+static struct bcast *bcast_find(const char *device)
+{
+	struct le *le;
+
+	for (le = bcastl.head; le; le = le->next) {
+
+		struct bcast *bc = le->data;
+
+		if (0 == str_cmp(bc->device, device))
+			return bc;
+	}
+
+	return NULL;
+}
+
+
+static struct variant *variant_find(const struct bcast *bc,
+				    const struct ausrc_prm *prm)
+{
+	struct le *le;
+
+	for (le = bc->varl.head; le; le = le->next) {
+
+		struct variant *var = le->data;
+
+		if (var->srate == prm->srate && var->ch == prm->ch &&
+		    var->fmt == (enum aufmt)prm->fmt)
+			return var;
+	}
+
+	return NULL;
+}
+
+
+static int variant_alloc(struct variant **varp, const struct bcast *bc,
+			 const struct ausrc_prm *prm)
+{
+	struct variant *var;
+	size_t sampc;
+	int err;
+
+	var = mem_zalloc(sizeof(*var), variant_destructor);
+	if (!var)
+		return ENOMEM;
+
+	var->srate = prm->srate;
+	var->ch    = prm->ch;
+	var->fmt   = prm->fmt;
+
+	/* samples of one source frame after conversion, with margin */
+	sampc = var->srate * var->ch * bc->prm.ptime / 1000;
+	var->sampc_max = 2 * sampc;
+
+	auresamp_init(&var->resamp);
+
+	err = auresamp_setup(&var->resamp, bc->prm.srate, bc->prm.ch,
+			     var->srate, var->ch);
+	if (err) {
+		warning("aubcast: no conversion %uHz/%uch -> %uHz/%uch\n",
+			bc->prm.srate, bc->prm.ch, var->srate, var->ch);
+		goto out;
+	}
+
+	if (var->resamp.resample) {
+		var->sampv_rs = mem_zalloc(var->sampc_max * sizeof(int16_t),
+					   NULL);
+		if (!var->sampv_rs) {
+			err = ENOMEM;
+			goto out;
+		}
+	}
+
+	if (var->fmt != AUFMT_S16LE) {
+		var->sampv = mem_zalloc(var->sampc_max *
+					aufmt_sample_size(var->fmt), NULL);
+		if (!var->sampv) {
+			err = ENOMEM;
+			goto out;
+		}
+	}
+
+	debug("aubcast: new variant %uHz/%uch/%s\n",
+	      var->srate, var->ch, aufmt_name(var->fmt));
+
+ out:
+	if (err)
+		mem_deref(var);
+	else
+		*varp = var;
+
+	return err;
+}
+
+
+static int alloc_handler(struct ausrc_st **stp, const struct ausrc *as,
+			 struct media_ctx **ctx,
+			 struct ausrc_prm *prm, const char *device,
+			 ausrc_read_h *rh, ausrc_error_h *errh, void *arg)
+{
+	struct ausrc_st *st;
+	struct variant *var;
+	struct bcast *bc;
+	int err = 0;
+	(void)ctx;
+
+	if (!stp || !as || !prm || !rh)
+		return EINVAL;
+
+	if (!str_isset(device))
+		return EINVAL;
+
+	st = mem_zalloc(sizeof(*st), sub_destructor);
+	if (!st)
+		return ENOMEM;
+
+	st->rh   = rh;
+	st->errh = errh;
+	st->arg  = arg;
+
+	bc = bcast_find(device);
+	if (bc) {
+		st->bc = mem_ref(bc);
+	}
+	else {
+		err = bcast_alloc(&st->bc, device, prm);
+		if (err)
+			goto out;
+
+		bc = st->bc;
+	}
+
+	lock_write_get(bc->lock);
+
+	var = variant_find(bc, prm);
+	if (!var) {
+		err = variant_alloc(&var, bc, prm);
+		if (!err)
+			list_append(&bc->varl, &var->le, var);
+	}
+
+	if (!err) {
+		st->var = var;
+		list_append(&var->subl, &st->le, st);
+	}
+
+	lock_rel(bc->lock);
+
+ out:
+	if (err)
+		mem_deref(st);
+	else
+		*stp = st;
+
+	return err;
+}
+
+
+static int cmd_debug(struct re_printf *pf, void *unused)
+{
+	struct le *le;
+	int err = 0;
+	(void)unused;
+
+	err |= re_hprintf(pf, "aubcast: %u sources\n", list_count(&bcastl));
+
+	for (le = bcastl.head; le; le = le->next) {
+
+		struct bcast *bc = le->data;
+		struct le *lev;
+
+		lock_read_get(bc->lock);
+
+		err |= re_hprintf(pf, "  %s,%s: %uHz/%uch frames=%llu"
+				  " restarts=%u\n",
+				  bc->mod, bc->dev,
+				  bc->prm.srate, bc->prm.ch,
+				  bc->n_frame, bc->n_restart);
+
+		for (lev = bc->varl.head; lev; lev = lev->next) {
+
+			const struct variant *var = lev->data;
+
+			err |= re_hprintf(pf, "    %uHz/%uch/%s:"
+					  " subscribers=%u converted=%llu\n",
+					  var->srate, var->ch,
+					  aufmt_name(var->fmt),
+					  list_count(&var->subl),
+					  var->n_conv);
+		}
+
+		lock_rel(bc->lock);
+	}
+
+	return err;
+}
+
+
+static const struct cmd cmdv[] = {
+	{"aubcast", 0, 0, "Shared broadcast sources", cmd_debug },
+};
+
+
+static int module_init(void)
+{
+	int err;
+
+	(void)conf_get_bool(conf_cur(), "aubcast_loop", &loop);
+
+	err  = ausrc_register(&ausrc, baresip_ausrcl(),
+			      "aubcast", alloc_handler);
+	err |= cmd_register(baresip_commands(), cmdv, ARRAY_SIZE(cmdv));
+
+	return err;
+}
+
+
+static int module_close(void)
+{
+	cmd_unregister(baresip_commands(), cmdv);
+	ausrc = mem_deref(ausrc);
+
+	return 0;
+}
+
+
+EXPORT_SYM const struct mod_export DECL_EXPORTS(aubcast) = {
+	"aubcast",
+	"ausrc",
+	module_init,
+	module_close
+};
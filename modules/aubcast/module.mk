@@ -0,0 +1,11 @@
+#
+# module.mk
+#
+# Copyright (C) 2010 Alfred E. Heggestad
+#
+
+MOD		:= aubcast
+$(MOD)_SRCS	+= aubcast.c
+$(MOD)_LFLAGS	+=
+
+include mk/mod.mk
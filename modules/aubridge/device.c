@@ -6,7 +6,6 @@
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
-#include <pthread.h>
 #include "aubridge.h"
 
 
@@ -19,7 +18,7 @@ struct device {
 	const struct ausrc_st *ausrc;
 	const struct auplay_st *auplay;
 	char name[64];
-	pthread_t thread;
+	struct mthread *thread;
 	volatile bool run;
 };
 
@@ -166,7 +165,8 @@ int aubridge_device_connect(struct device **devp, const char *device,
 	if (dev->ausrc && dev->auplay && !dev->run) {
 
 		dev->run = true;
-		err = pthread_create(&dev->thread, NULL, device_thread, dev);
+		err = mthread_create(&dev->thread, MTHREAD_AUDIO_PROC,
+				     "aubridge", device_thread, dev);
 		if (err) {
 			dev->run = false;
 		}
@@ -183,7 +183,7 @@ void aubridge_device_stop(struct device *dev)
 
 	if (dev->run) {
 		dev->run = false;
-		pthread_join(dev->thread, NULL);
+		dev->thread = mem_deref(dev->thread);
 	}
 
 	dev->auplay = NULL;
@@ -5,7 +5,7 @@
  */
 #define _DEFAULT_SOURCE 1
 #define _BSD_SOURCE 1
-#include <pthread.h>
+#include <string.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
@@ -17,10 +17,15 @@
  *
  * Audio module for using a WAV-file as audio input
  *
+ * By default the file is streamed from disk, and the open file is shared
+ * by all sources playing the same file. With aufile_stream disabled the
+ * whole file is loaded into memory for each source.
+ *
  * Sample config:
  *
  \verbatim
   audio_source            aufile,/tmp/test.wav
+  aufile_stream           yes
  \endverbatim
  */
 
@@ -29,12 +34,14 @@ struct ausrc_st {
 	struct tmr tmr;
 	struct aufile *aufile;
 	struct aubuf *aubuf;
+	struct aufile_map *map;         /**< Shared WAV file (optional)      */
+	size_t pos;                     /**< Read position in shared file    */
 	enum aufmt fmt;                 /**< Wav file sample format          */
 	struct ausrc_prm *prm;          /**< Audio src parameter             */
 	uint32_t ptime;
 	size_t sampc;
 	bool run;
-	pthread_t thread;
+	struct mthread *thread;
 	ausrc_read_h *rh;
 	ausrc_error_h *errh;
 	void *arg;
@@ -43,6 +50,7 @@ struct ausrc_st {
 
 static struct ausrc *ausrc;
 static struct auplay *auplay;
+static bool stream = true;
 
 
 static void destructor(void *arg)
@@ -51,13 +59,14 @@ static void destructor(void *arg)
 
 	if (st->run) {
 		st->run = false;
-		pthread_join(st->thread, NULL);
+		st->thread = mem_deref(st->thread);
 	}
 
 	tmr_cancel(&st->tmr);
 
 	mem_deref(st->aufile);
 	mem_deref(st->aubuf);
+	mem_deref(st->map);
 }
 
 
@@ -89,13 +98,32 @@ static void *play_thread(void *arg)
 		if (ts > now)
 			continue;
 
-		aubuf_read_samp(st->aubuf, sampv, st->sampc);
+		if (st->map) {
+			size_t n;
+
+			n = aufile_map_read(st->map, st->pos,
+					    sampv, st->sampc);
+			if (n < st->sampc) {
+				memset(&sampv[n], 0,
+				       (st->sampc - n) * sizeof(int16_t));
+			}
+
+			st->pos += n;
+
+			/* end of file, or the file was truncated */
+			if (n < st->sampc)
+				st->run = false;
+		}
+		else {
+			aubuf_read_samp(st->aubuf, sampv, st->sampc);
+		}
 
 		st->rh(&af, st->arg);
 
 		ts += st->ptime;
 
-		if (aubuf_cur_size(st->aubuf) == 0)
+		if (st->map ? st->pos >= aufile_map_sampc(st->map) :
+		    aubuf_cur_size(st->aubuf) == 0)
 			st->run = false;
 	}
 
@@ -230,10 +258,24 @@ static int alloc_handler(struct ausrc_st **stp, const struct ausrc *as,
 	if (!ptime)
 		ptime = 40;
 
-	err = aufile_open(&st->aufile, &fprm, dev, AUFILE_READ);
-	if (err) {
-		warning("aufile: failed to open file '%s' (%m)\n", dev, err);
-		goto out;
+	if (stream) {
+		err = aufile_map_get(&st->map, dev);
+		if (err) {
+			info("aufile: streaming '%s' failed (%m),"
+			     " loading whole file\n", dev, err);
+		}
+		else {
+			fprm = *aufile_map_prm(st->map);
+		}
+	}
+
+	if (!st->map) {
+		err = aufile_open(&st->aufile, &fprm, dev, AUFILE_READ);
+		if (err) {
+			warning("aufile: failed to open file '%s' (%m)\n",
+				dev, err);
+			goto out;
+		}
 	}
 
 	info("aufile: %s: %u Hz, %d channels, %s\n",
@@ -248,21 +290,24 @@ static int alloc_handler(struct ausrc_st **stp, const struct ausrc *as,
 
 	info("aufile: audio ptime=%u sampc=%zu\n", st->ptime, st->sampc);
 
-	/* 1 - inf seconds of audio */
-	err = aubuf_alloc(&st->aubuf,
-			  st->sampc * 2,
-			  0);
-	if (err)
-		goto out;
+	if (!st->map) {
+		/* 1 - inf seconds of audio */
+		err = aubuf_alloc(&st->aubuf,
+				  st->sampc * 2,
+				  0);
+		if (err)
+			goto out;
 
-	err = read_file(st);
-	if (err)
-		goto out;
+		err = read_file(st);
+		if (err)
+			goto out;
+	}
 
 	tmr_start(&st->tmr, ptime, timeout, st);
 
 	st->run = true;
-	err = pthread_create(&st->thread, NULL, play_thread, st);
+	err = mthread_create(&st->thread, MTHREAD_AUDIO_SRC,
+			     "aufile", play_thread, st);
 	if (err) {
 		st->run = false;
 		goto out;
@@ -281,6 +326,9 @@ static int alloc_handler(struct ausrc_st **stp, const struct ausrc *as,
 static int module_init(void)
 {
 	int err;
+
+	(void)conf_get_bool(conf_cur(), "aufile_stream", &stream);
+
 	err  = ausrc_register(&ausrc, baresip_ausrcl(),
 			      "aufile", alloc_handler);
 	err |= auplay_register(&auplay, baresip_auplayl(),
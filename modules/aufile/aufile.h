@@ -7,3 +7,12 @@
 int play_alloc(struct auplay_st **stp, const struct auplay *ap,
 		    struct auplay_prm *prm, const char *device,
 		    auplay_write_h *wh, void *arg);
+
+
+struct aufile_map;
+
+int    aufile_map_get(struct aufile_map **mapp, const char *path);
+const struct aufile_prm *aufile_map_prm(const struct aufile_map *map);
+size_t aufile_map_sampc(const struct aufile_map *map);
+size_t aufile_map_read(const struct aufile_map *map, size_t pos,
+		       int16_t *sampv, size_t sampc);
@@ -0,0 +1,355 @@
+/**
+ * @file aufile_map.c Shared WAV files
+ *
+ * Copyright (C) 2015 Alfred E. Heggestad
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "aufile.h"
+
+
+/*
+ * A WAV file is opened and parsed once, and shared by all audio sources
+ * that play the same file. Each source only keeps a read position and
+ * reads and decodes one frame at a time with pread(), so the memory per
+ * source is constant and the start time does not depend on the file size.
+ *
+ * The file is not memory-mapped, since a mapping raises SIGBUS if the
+ * file is truncated while it is played. A short read is end of file.
+ *
+ * The list of shared files is only used from the re_main thread.
+ */
+
+
+enum {
+	WAVE_FMT_PCM  = 1,
+	WAVE_FMT_ALAW = 6,
+	WAVE_FMT_ULAW = 7,
+
+	READ_CHUNK    = 512,  /* Bytes per read for G.711 decoding */
+};
+
+
+/** Defines a shared WAV file */
+struct aufile_map {
+	struct le le;              /**< Member of file list              */
+	char *path;                /**< File path                        */
+	dev_t dev;                 /**< File device                      */
+	ino_t ino;                 /**< File inode                       */
+	time_t mtime;              /**< File modification time           */
+	size_t len;                /**< Length of file                   */
+	int fd;                    /**< File descriptor                  */
+	off_t data;                /**< Offset of sample data            */
+	size_t sampc;              /**< Number of samples, all channels  */
+	struct aufile_prm prm;     /**< Sample rate, channels and format */
+};
+
+
+static struct list mapl;
+
+
+static void map_destructor(void *arg)
+{
+	struct aufile_map *map = arg;
+
+	list_unlink(&map->le);
+
+	if (map->fd >= 0)
+		(void)close(map->fd);
+
+	mem_deref(map->path);
+}
+
+
+static inline uint16_t get_u16(const uint8_t *p)
+{
+	return (uint16_t)(p[0] | p[1] << 8);
+}
+
+
+static inline uint32_t get_u32(const uint8_t *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 |
+		(uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+
+static bool read_at(int fd, off_t off, uint8_t *buf, size_t len)
+{
+	ssize_t n;
+
+	do {
+		n = pread(fd, buf, len, off);
+	}
+	while (n < 0 && errno == EINTR);
+
+	return n == (ssize_t)len;
+}
+
+
+static int wav_parse(struct aufile_map *map)
+{
+	const off_t end = (off_t)map->len;
+	uint8_t hdr[16];
+	off_t p;
+	bool fmt = false;
+
+	if (!read_at(map->fd, 0, hdr, 12) ||
+	    memcmp(hdr, "RIFF", 4) || memcmp(hdr + 8, "WAVE", 4))
+		return EBADMSG;
+
+	p = 12;
+
+	while (end - p >= 8) {
+
+		const off_t chunk = p + 8;
+		const size_t left = (size_t)(end - chunk);
+		uint32_t size;
+
+		if (!read_at(map->fd, p, hdr, 8))
+			return EBADMSG;
+
+		size = get_u32(hdr + 4);
+
+		if (0 == memcmp(hdr, "fmt ", 4)) {
+
+			uint16_t format, bits;
+
+			if (size < 16 || left < 16 ||
+			    !read_at(map->fd, chunk, hdr, 16))
+				return EBADMSG;
+
+			format = get_u16(hdr);
+			bits   = get_u16(hdr + 14);
+
+			map->prm.channels = (uint8_t)get_u16(hdr + 2);
+			map->prm.srate    = get_u32(hdr + 4);
+
+			if (format == WAVE_FMT_PCM && bits == 16)
+				map->prm.fmt = AUFMT_S16LE;
+			else if (format == WAVE_FMT_ALAW && bits == 8)
+				map->prm.fmt = AUFMT_PCMA;
+			else if (format == WAVE_FMT_ULAW && bits == 8)
+				map->prm.fmt = AUFMT_PCMU;
+			else
+				return ENOTSUP;
+
+			fmt = true;
+		}
+		else if (0 == memcmp(hdr, "data", 4)) {
+
+			if (!fmt || !map->prm.srate || !map->prm.channels)
+				return EBADMSG;
+
+			map->data  = chunk;
+			map->sampc = min((size_t)size, left) /
+				aufmt_sample_size(map->prm.fmt);
+
+			return 0;
+		}
+
+		if (size > left)
+			break;
+
+		/* chunks are padded to an even size */
+		p = chunk + size + (size & 1);
+	}
+
+	return EBADMSG;
+}
+
+
+static int map_alloc(struct aufile_map **mapp, const char *path,
+		     const struct stat *st)
+{
+	struct aufile_map *map;
+	int err;
+
+	if (st->st_size <= 0)
+		return EINVAL;
+
+	map = mem_zalloc(sizeof(*map), map_destructor);
+	if (!map)
+		return ENOMEM;
+
+	map->fd = -1;
+
+	err = str_dup(&map->path, path);
+	if (err)
+		goto out;
+
+	map->dev   = st->st_dev;
+	map->ino   = st->st_ino;
+	map->mtime = st->st_mtime;
+	map->len   = (size_t)st->st_size;
+
+	map->fd = open(path, O_RDONLY);
+	if (map->fd < 0) {
+		err = errno;
+		goto out;
+	}
+
+	err = wav_parse(map);
+	if (err) {
+		warning("aufile: %s: invalid or unsupported wav file (%m)\n",
+			path, err);
+		goto out;
+	}
+
+	list_append(&mapl, &map->le, map);
+
+ out:
+	if (err)
+		mem_deref(map);
+	else
+		*mapp = map;
+
+	return err;
+}
+
+
+/**
+ * Get a shared WAV file. An open file is reused if it has not changed.
+ *
+ * @param mapp Pointer to referenced shared file
+ * @param path Path to WAV file
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int aufile_map_get(struct aufile_map **mapp, const char *path)
+{
+	struct stat st;
+	struct le *le;
+
+	if (!mapp || !str_isset(path))
+		return EINVAL;
+
+	if (stat(path, &st) < 0)
+		return errno;
+
+	for (le = mapl.head; le; le = le->next) {
+
+		struct aufile_map *map = le->data;
+
+		if (map->dev == st.st_dev && map->ino == st.st_ino &&
+		    map->mtime == st.st_mtime &&
+		    map->len == (size_t)st.st_size) {
+
+			*mapp = mem_ref(map);
+			return 0;
+		}
+	}
+
+	return map_alloc(mapp, path, &st);
+}
+
+
+/**
+ * Get the parameters of a shared WAV file
+ *
+ * @param map Shared WAV file
+ *
+ * @return File parameters
+ */
+const struct aufile_prm *aufile_map_prm(const struct aufile_map *map)
+{
+	return map ? &map->prm : NULL;
+}
+
+
+/**
+ * Get the number of samples in a shared WAV file
+ *
+ * @param map Shared WAV file
+ *
+ * @return Number of samples, all channels
+ */
+size_t aufile_map_sampc(const struct aufile_map *map)
+{
+	return map ? map->sampc : 0;
+}
+
+
+/**
+ * Read and decode samples from a shared WAV file. Safe to call from any
+ * thread.
+ *
+ * @param map   Shared WAV file
+ * @param pos   Read position in samples, all channels
+ * @param sampv Buffer for decoded S16 samples
+ * @param sampc Number of samples to read
+ *
+ * @return Number of samples read, 0 at end of file
+ *
+ * @note If the file was truncated, fewer samples are returned
+ */
+size_t aufile_map_read(const struct aufile_map *map, size_t pos,
+		       int16_t *sampv, size_t sampc)
+{
+	const size_t sz = map ? aufmt_sample_size(map->prm.fmt) : 0;
+	uint8_t buf[READ_CHUNK];
+	off_t off;
+	size_t i, n, done = 0;
+	ssize_t r;
+
+	if (!map || !sampv || !sz || pos >= map->sampc)
+		return 0;
+
+	n   = min(sampc, map->sampc - pos);
+	off = map->data + (off_t)(pos * sz);
+
+	while (done < n) {
+
+		const size_t want = min(n - done, sizeof(buf) / sz);
+		size_t got;
+
+		do {
+			r = pread(map->fd, buf, want * sz,
+				  off + (off_t)(done * sz));
+		}
+		while (r < 0 && errno == EINTR);
+
+		if (r <= 0)
+			break;
+
+		got = (size_t)r / sz;
+
+		for (i = 0; i < got; i++) {
+
+			int16_t *v = &sampv[done + i];
+
+			switch (map->prm.fmt) {
+
+			case AUFMT_S16LE:
+				*v = (int16_t)get_u16(&buf[2*i]);
+				break;
+
+			case AUFMT_PCMA:
+				*v = g711_alaw2pcm(buf[i]);
+				break;
+
+			case AUFMT_PCMU:
+				*v = g711_ulaw2pcm(buf[i]);
+				break;
+
+			default:
+				return 0;
+			}
+		}
+
+		done += got;
+
+		/* short read, the file was truncated */
+		if (got < want)
+			break;
+	}
+
+	return done;
+}
@@ -5,7 +5,6 @@
  */
 #define _DEFAULT_SOURCE 1
 #define _BSD_SOURCE 1
-#include <pthread.h>
 #include <string.h>
 #include <re.h>
 #include <rem.h>
@@ -17,7 +16,7 @@ struct auplay_st {
 	struct aufile *auf;
 	struct auplay_prm prm;
 
-	pthread_t thread;
+	struct mthread *thread;
 	volatile bool run;
 	void *sampv;
 	size_t sampc;
@@ -34,7 +33,7 @@ static void auplay_destructor(void *arg)
 	if (st->run) {
 		debug("aufile: stopping playback thread\n");
 		st->run = false;
-		(void)pthread_join(st->thread, NULL);
+		st->thread = mem_deref(st->thread);
 	}
 
 	mem_deref(st->auf);
@@ -120,7 +119,8 @@ int play_alloc(struct auplay_st **stp, const struct auplay *ap,
 	st->sampv = mem_alloc(st->num_bytes, NULL);
 
 	info("aufile: writing speaker audio to %s\n", file);
-	err = pthread_create(&st->thread, NULL, write_thread, st);
+	err = mthread_create(&st->thread, MTHREAD_AUDIO_PLAY,
+			     "aufile_play", write_thread, st);
 	if (err) {
 		st->run = false;
 		goto out;
@@ -6,6 +6,7 @@
 
 MOD		:= aufile
 $(MOD)_SRCS	+= aufile.c
+$(MOD)_SRCS	+= aufile_map.c
 $(MOD)_SRCS	+= aufile_play.c
 $(MOD)_LFLAGS	+=
 
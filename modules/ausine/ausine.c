@@ -5,7 +5,6 @@
  */
 #define _DEFAULT_SOURCE 1
 #define _BSD_SOURCE 1
-#include <pthread.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
@@ -41,7 +40,7 @@ struct ausrc_st {
 	uint32_t ptime;
 	size_t sampc;
 	bool run;
-	pthread_t thread;
+	struct mthread *thread;
 	ausrc_read_h *rh;
 	ausrc_error_h *errh;
 	void *arg;
@@ -61,7 +60,7 @@ static void destructor(void *arg)
 
 	if (st->run) {
 		st->run = false;
-		pthread_join(st->thread, NULL);
+		st->thread = mem_deref(st->thread);
 	}
 }
 
@@ -221,7 +220,8 @@ static int alloc_handler(struct ausrc_st **stp, const struct ausrc *as,
 	     st->ptime, st->sampc);
 
 	st->run = true;
-	err = pthread_create(&st->thread, NULL, play_thread, st);
+	err = mthread_create(&st->thread, MTHREAD_AUDIO_SRC,
+			     "ausine", play_thread, st);
 	if (err) {
 		st->run = false;
 		goto out;
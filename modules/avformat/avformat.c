@@ -10,7 +10,6 @@
 #define _BSD_SOURCE 1
 #include <unistd.h>
 #include <string.h>
-#include <pthread.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
@@ -58,7 +57,7 @@ static void shared_destructor(void *arg)
 
 	if (st->run) {
 		st->run = false;
-		pthread_join(st->thread, NULL);
+		st->thread = mem_deref(st->thread);
 	}
 
 	if (st->au.ctx) {
@@ -402,7 +401,8 @@ int avformat_shared_alloc(struct shared **shp, const char *dev,
 	}
 
 	st->run = true;
-	err = pthread_create(&st->thread, NULL, read_thread, st);
+	err = mthread_create(&st->thread, MTHREAD_VIDEO_SRC,
+			     "avformat", read_thread, st);
 	if (err) {
 		st->run = false;
 		goto out;
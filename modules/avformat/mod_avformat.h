@@ -12,7 +12,7 @@ struct shared {
 	struct vidsrc_st *vidsrc_st;  /* pointer */
 	struct lock *lock;
 	AVFormatContext *ic;
-	pthread_t thread;
+	struct mthread *thread;
 	bool is_realtime;
 	bool run;
 	bool is_pass_through;
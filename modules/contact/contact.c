@@ -263,7 +263,7 @@ static int write_template(const char *file)
 			 "# Displayname <sip:user@domain>;addr-params\n"
 			 "#\n"
 			 "#  addr-params:\n"
-			 "#    ;presence={none,p2p}\n"
+			 "#    ;presence={none,p2p,rls}\n"
 			 "#    ;access={allow,block}\n"
 			 "#\n"
 			 "\n"
@@ -4,6 +4,8 @@
  * Copyright (C) 2018 46 Labs LLC
  */
 
+#include <stdlib.h>
+#include <string.h>
 #include <re.h>
 #include <baresip.h>
 
@@ -79,6 +81,33 @@
  \endverbatim
  *
  *
+ * Several commands can be sent in one message, they are processed in
+ * order and each gets its own response:
+ *
+ \verbatim
+ {"commands" : [
+	{"command":"dial", "params":"sip:alice@atlanta.com", "token":"1"},
+	{"command":"dial", "params":"sip:bob@biloxy.com",    "token":"2"}
+ ]}
+ \endverbatim
+ *
+ * The client does not have to wait for a response before sending the
+ * next command. The responses and events of one main-loop iteration are
+ * sent with one TCP write.
+ *
+ * The events can be filtered by event class and account, with the
+ * command "ctrl_subscribe":
+ *
+ \verbatim
+ {
+  "command" : "ctrl_subscribe",
+  "params"  : "call register sip:alice@atlanta.com"
+ }
+ \endverbatim
+ *
+ * The command "ctrl_bench [n]" measures the event encoding in events/sec.
+ *
+ *
  * Sample config:
  *
  \verbatim
@@ -87,12 +116,37 @@
  */
 
 
-enum {CTRL_PORT = 4444};
+enum {
+	CTRL_PORT    = 4444,
+	OUTQ_MAX     = 4194304,   /**< Max. queued output [bytes]      */
+	TXQ_SIZE     = 1048576,   /**< TCP send queue size [bytes]     */
+	BUF_SIZE     = 2048,
+	BENCH_EVENTS = 100000,    /**< Default number of bench events  */
+};
 
 struct ctrl_st {
 	struct tcp_sock *ts;
 	struct tcp_conn *tc;
 	struct netstring *ns;
+	struct mbuf *outq;        /**< Encoded frames not yet sent     */
+	struct mbuf *mb_enc;      /**< Buffer for encoding one frame   */
+	struct mbuf *mb_cmd;      /**< Buffer for command output       */
+	struct tmr tmr_flush;     /**< Flush the output queue          */
+	uint32_t classes;         /**< Subscribed classes, 0 for all   */
+	struct list aorl;         /**< Subscribed accounts (struct aor)*/
+	uint64_t n_drop;          /**< Events dropped, queue full      */
+};
+
+/** Subscribed account */
+struct aor {
+	struct le le;
+	char *aor;
+};
+
+/** Event classes for the subscription filter */
+static const char *classv[] = {
+	"register", "mwi", "application", "call", "VU_REPORT", "other",
+	"message",
 };
 
 static struct ctrl_st *ctrl = NULL;  /* allow only one instance */
@@ -105,87 +159,153 @@ static int print_handler(const char *p, size_t size, void *arg)
 }
 
 
-static int encode_response(int cmd_error, struct mbuf *resp, const char *token)
+/* Send the output queue, at most TXQ_SIZE bytes at a time so that the
+ * unsent part of a write always fits into the TCP send queue. Frames
+ * which could not be sent are kept and sent when the socket is
+ * writable again. */
+static void flush_handler(void *arg)
 {
-	struct re_printf pf = {print_handler, resp};
-	struct odict *od = NULL;
-	char *buf = NULL;
-	char m[256];
+	struct ctrl_st *st = arg;
+	struct mbuf *outq = st->outq;
+	size_t end, len;
 	int err;
 
-	/* Empty response. */
-	if (resp->pos == NETSTRING_HEADER_SIZE)
-	{
-		buf = mem_alloc(1, NULL);
-		buf[0] = '\0';
+	if (!st->tc || !outq || !outq->end)
+		return;
+
+	end = outq->end;
+	len = min(end, (size_t)TXQ_SIZE);
+
+	outq->pos = 0;
+	outq->end = len;
+
+	err = netstring_send_frames(st->ns, outq);
+
+	outq->end = end;
+
+	if (err) {
+		if (err != ENOSPC)
+			warning("ctrl_tcp: failed to send (%m)\n", err);
+		len = 0;
 	}
-	else
-	{
-		resp->pos = NETSTRING_HEADER_SIZE;
-		err = mbuf_strdup(resp, &buf,
-			resp->end - NETSTRING_HEADER_SIZE);
-		if (err)
-			return err;
+
+	memmove(outq->buf, outq->buf + len, end - len);
+	outq->pos = outq->end = end - len;
+
+	(void)tcp_set_send(st->tc, outq->end ? flush_handler : NULL);
+}
+
+
+/* Queue one frame, all frames of one main-loop iteration are sent
+ * with one TCP write. If the queue is full, events are dropped but
+ * command responses are always queued. */
+static int queue_frame(struct ctrl_st *st, const struct mbuf *mb,
+		       bool event)
+{
+	int err;
+
+	if (!st->tc)
+		return ENOTCONN;
+
+	if (!st->outq) {
+		st->outq = mbuf_alloc(BUF_SIZE);
+		if (!st->outq)
+			return ENOMEM;
 	}
 
-	err = odict_alloc(&od, 8);
+	if (event && st->outq->end > OUTQ_MAX) {
+		++st->n_drop;
+		return ENOBUFS;
+	}
+
+	err = netstring_frame_write(st->outq, mb->buf, mb->end);
 	if (err)
 		return err;
 
-	err |= odict_entry_add(od, "response", ODICT_BOOL, true);
-	err |= odict_entry_add(od, "ok", ODICT_BOOL, (bool)!cmd_error);
+	if (!tmr_isrunning(&st->tmr_flush))
+		tmr_start(&st->tmr_flush, 0, flush_handler, st);
 
-	if (cmd_error && str_len(buf) == 0)
-		err |= odict_entry_add(od, "data", ODICT_STRING,
-			str_error(cmd_error, m, sizeof(m)));
-	else
-		err |= odict_entry_add(od, "data", ODICT_STRING, buf);
+	return 0;
+}
 
-	if (token)
-		err |= odict_entry_add(od, "token", ODICT_STRING, token);
 
-	if (err)
-		goto out;
+static uint32_t class_bit(const char *name)
+{
+	size_t i;
 
-	mbuf_reset(resp);
-	mbuf_init(resp);
-	resp->pos = NETSTRING_HEADER_SIZE;
+	for (i=0; i<ARRAY_SIZE(classv); i++) {
+		if (0 == str_casecmp(classv[i], name))
+			return 1u << i;
+	}
 
-	err = json_encode_odict(&pf, od);
-	if (err)
-		warning("ctrl_tcp: failed to encode response JSON (%m)\n",
-			err);
+	return 0;
+}
 
- out:
-	mem_deref(buf);
-	mem_deref(od);
+
+static bool subscribed(const struct ctrl_st *st, const char *cls,
+		       const struct ua *ua)
+{
+	const char *aor;
+	struct le *le;
+
+	if (st->classes && !(st->classes & class_bit(cls)))
+		return false;
+
+	if (list_isempty(&st->aorl) || !ua)
+		return true;
+
+	aor = account_aor(ua_account(ua));
+
+	for (le = st->aorl.head; le; le = le->next) {
+		const struct aor *a = le->data;
+
+		if (0 == str_casecmp(a->aor, aor))
+			return true;
+	}
+
+	return false;
+}
+
+
+static int encode_response(struct re_printf *pf, int cmd_error,
+			   const char *data, const char *token)
+{
+	char m[256];
+	int err;
+
+	if (cmd_error && !str_isset(data))
+		data = str_error(cmd_error, m, sizeof(m));
+
+	err = re_hprintf(pf, "{\"response\":true,\"ok\":%s,"
+			 "\"data\":\"%H\"",
+			 cmd_error ? "false" : "true",
+			 utf8_encode, data);
+
+	if (token)
+		err |= re_hprintf(pf, ",\"token\":\"%H\"",
+				  utf8_encode, token);
+
+	err |= re_hprintf(pf, "}");
 
 	return err;
 }
 
 
-static bool command_handler(struct mbuf *mb, void *arg)
+static int process_command(struct ctrl_st *st, const struct odict *od)
 {
-	struct ctrl_st *st = arg;
-	struct mbuf *resp = mbuf_alloc(2048);
-	struct re_printf pf = {print_handler, resp};
-	struct odict *od = NULL;
+	struct re_printf pf_cmd = {print_handler, st->mb_cmd};
+	struct re_printf pf_enc = {print_handler, st->mb_enc};
 	const struct odict_entry *oe_cmd, *oe_prm, *oe_tok;
+	struct mlprof_probe probe;
 	char buf[1024];
 	int err;
 
-	err = json_decode_odict(&od, 32, (const char*)mb->buf, mb->end, 16);
-	if (err) {
-		warning("ctrl_tcp: failed to decode JSON (%m)\n", err);
-		goto out;
-	}
-
 	oe_cmd = odict_lookup(od, "command");
 	oe_prm = odict_lookup(od, "params");
 	oe_tok = odict_lookup(od, "token");
-	if (!oe_cmd) {
+	if (!oe_cmd || oe_cmd->type != ODICT_STRING) {
 		warning("ctrl_tcp: missing json entries\n");
-		goto out;
+		return EPROTO;
 	}
 
 	debug("ctrl_tcp: handle_command:  cmd='%s', params:'%s', token='%s'\n",
@@ -198,31 +318,72 @@ static bool command_handler(struct mbuf *mb, void *arg)
 		    oe_prm ? " " : "",
 		    oe_prm ? oe_prm->u.str : "");
 
-	resp->pos = NETSTRING_HEADER_SIZE;
+	mbuf_rewind(st->mb_cmd);
 
 	/* Relay message to long commands */
+	mlprof_enter(&probe, "ctrl_tcp command");
 	err = cmd_process_long(baresip_commands(),
 			       buf,
 			       str_len(buf),
-			       &pf, NULL);
+			       &pf_cmd, NULL);
+	mlprof_leave(&probe);
 	if (err) {
 		warning("ctrl_tcp: error processing command (%m)\n", err);
 	}
 
-	err = encode_response(err, resp, oe_tok ? oe_tok->u.str : NULL);
+	/* terminate the command output */
+	if (mbuf_write_u8(st->mb_cmd, 0))
+		return ENOMEM;
+
+	mbuf_rewind(st->mb_enc);
+
+	err = encode_response(&pf_enc, err, (char *)st->mb_cmd->buf,
+			      oe_tok ? oe_tok->u.str : NULL);
 	if (err) {
 		warning("ctrl_tcp: failed to encode response (%m)\n", err);
-		goto out;
+		return err;
 	}
 
-	resp->pos = NETSTRING_HEADER_SIZE;
-	err = tcp_send(st->tc, resp);
+	err = queue_frame(st, st->mb_enc, false);
 	if (err) {
 		warning("ctrl_tcp: failed to send the response (%m)\n", err);
 	}
 
+	return err;
+}
+
+
+static bool command_handler(struct mbuf *mb, void *arg)
+{
+	struct ctrl_st *st = arg;
+	struct odict *od = NULL;
+	const struct odict_entry *oe_batch;
+	struct le *le;
+	int err;
+
+	err = json_decode_odict(&od, 32, (const char*)mb->buf, mb->end, 16);
+	if (err) {
+		warning("ctrl_tcp: failed to decode JSON (%m)\n", err);
+		goto out;
+	}
+
+	/* A batch of commands, processed in order */
+	oe_batch = odict_lookup(od, "commands");
+	if (oe_batch && oe_batch->type == ODICT_ARRAY) {
+
+		for (le = oe_batch->u.odict->lst.head; le; le = le->next) {
+
+			const struct odict_entry *oe = le->data;
+
+			if (oe->type == ODICT_OBJECT)
+				(void)process_command(st, oe->u.odict);
+		}
+	}
+	else {
+		(void)process_command(st, od);
+	}
+
  out:
-	mem_deref(resp);
 	mem_deref(od);
 
 	return true;  /* always handled */
@@ -235,6 +396,9 @@ static void tcp_close_handler(int err, void *arg)
 
 	(void)err;
 
+	tmr_cancel(&st->tmr_flush);
+	mbuf_rewind(st->outq);
+
 	st->tc = mem_deref(st->tc);
 }
 
@@ -249,7 +413,14 @@ static void tcp_conn_handler(const struct sa *peer, void *arg)
 	st->tc = mem_deref(st->tc);
 	st->ns = mem_deref(st->ns);
 
+	/* the subscription belongs to the connection */
+	tmr_cancel(&st->tmr_flush);
+	mbuf_rewind(st->outq);
+	list_flush(&st->aorl);
+	st->classes = 0;
+
 	(void)tcp_accept(&st->tc, st->ts, NULL, NULL, tcp_close_handler, st);
+	(void)tcp_conn_txqsz_set(st->tc, TXQ_SIZE);
 	(void)netstring_insert(&st->ns, st->tc, 0, command_handler, st);
 }
 
@@ -261,41 +432,24 @@ static void ua_event_handler(struct ua *ua, enum ua_event ev,
 			     struct call *call, const char *prm, void *arg)
 {
 	struct ctrl_st *st = arg;
-	struct mbuf *buf = mbuf_alloc(1024);
-	struct re_printf pf = {print_handler, buf};
-	struct odict *od = NULL;
+	struct re_printf pf = {print_handler, st->mb_enc};
 	int err;
 
-	buf->pos = NETSTRING_HEADER_SIZE;
-
-	err = odict_alloc(&od, 8);
-	if (err)
+	if (!st->tc || !subscribed(st, uag_event_class_str(ev), ua))
 		return;
 
-	err = odict_entry_add(od, "event", ODICT_BOOL, true);
-	err |= event_encode_dict(od, ua, ev, call, prm);
-	if (err) {
-		warning("ctrl_tcp: failed to encode event (%m)\n", err);
-		goto out;
-	}
+	mbuf_rewind(st->mb_enc);
 
-	err = json_encode_odict(&pf, od);
+	err = event_encode_json(&pf, ua, ev, call, prm);
 	if (err) {
-		warning("ctrl_tcp: failed to encode event JSON (%m)\n", err);
-		goto out;
+		warning("ctrl_tcp: failed to encode event (%m)\n", err);
+		return;
 	}
 
-	if (st->tc) {
-		buf->pos = NETSTRING_HEADER_SIZE;
-		err = tcp_send(st->tc, buf);
-		if (err) {
-			warning("ctrl_tcp: failed to send event (%m)\n", err);
-		}
+	err = queue_frame(st, st->mb_enc, true);
+	if (err && err != ENOBUFS) {
+		warning("ctrl_tcp: failed to send event (%m)\n", err);
 	}
-
- out:
-	mem_deref(buf);
-	mem_deref(od);
 }
 
 
@@ -304,12 +458,12 @@ static void message_handler(struct ua *ua, const struct pl *peer,
 			    struct mbuf *body, void *arg)
 {
 	struct ctrl_st *st = arg;
-	struct mbuf *buf = mbuf_alloc(1024);
-	struct re_printf pf = {print_handler, buf};
+	struct re_printf pf = {print_handler, st->mb_enc};
 	struct odict *od = NULL;
 	int err;
 
-	buf->pos = NETSTRING_HEADER_SIZE;
+	if (!st->tc || !subscribed(st, "message", ua))
+		return;
 
 	err = odict_alloc(&od, 8);
 	if (err)
@@ -322,35 +476,250 @@ static void message_handler(struct ua *ua, const struct pl *peer,
 		goto out;
 	}
 
+	mbuf_rewind(st->mb_enc);
+
 	err = json_encode_odict(&pf, od);
 	if (err) {
 		warning("ctrl_tcp: failed to encode event JSON (%m)\n", err);
 		goto out;
 	}
 
-	buf->pos = NETSTRING_HEADER_SIZE;
-	if (!st->tc)
-		goto out;
-
-	err = tcp_send(st->tc, buf);
-	if (err) {
+	err = queue_frame(st, st->mb_enc, true);
+	if (err && err != ENOBUFS) {
 		warning("ctrl_tcp: failed to send the SIP message (%m)\n",
 			err);
 	}
 
 out:
-	mem_deref(buf);
 	mem_deref(od);
 }
 
 
+static void aor_destructor(void *arg)
+{
+	struct aor *a = arg;
+
+	list_unlink(&a->le);
+	mem_deref(a->aor);
+}
+
+
+static int print_subscription(struct re_printf *pf, const struct ctrl_st *st)
+{
+	struct le *le;
+	size_t i;
+	int err = 0;
+
+	err |= re_hprintf(pf, "classes:");
+
+	for (i=0; i<ARRAY_SIZE(classv); i++) {
+		if (!st->classes || st->classes & (1u << i))
+			err |= re_hprintf(pf, " %s", classv[i]);
+	}
+
+	err |= re_hprintf(pf, "\naccounts:");
+
+	if (list_isempty(&st->aorl))
+		err |= re_hprintf(pf, " (all)");
+
+	for (le = st->aorl.head; le; le = le->next) {
+		const struct aor *a = le->data;
+
+		err |= re_hprintf(pf, " %s", a->aor);
+	}
+
+	err |= re_hprintf(pf, "\ndropped: %llu\n", st->n_drop);
+
+	return err;
+}
+
+
+/**
+ * Set the event subscription of the connection. The parameters are event
+ * classes and account AORs, separated by spaces. No parameters select
+ * all events.
+ *
+ * Example:
+ *
+ \verbatim
+  /ctrl_subscribe call register sip:alice@atlanta.com
+ \endverbatim
+ */
+static int cmd_subscribe(struct re_printf *pf, void *arg)
+{
+	const struct cmd_arg *carg = arg;
+	struct list aorl = LIST_INIT;
+	uint32_t classes = 0;
+	struct pl rem, tok;
+	struct le *le;
+	int err = 0;
+
+	if (!ctrl)
+		return ENOENT;
+
+	pl_set_str(&rem, carg->prm);
+
+	/* the subscription is only changed if all parameters are valid */
+
+	while (!re_regex(rem.p, rem.l, "[^ ]+", &tok)) {
+
+		rem.l -= tok.p + tok.l - rem.p;
+		rem.p  = tok.p + tok.l;
+
+		if (pl_strchr(&tok, ':')) {
+			struct aor *a = mem_zalloc(sizeof(*a),
+						   aor_destructor);
+			if (!a) {
+				err = ENOMEM;
+				goto out;
+			}
+
+			list_append(&aorl, &a->le, a);
+
+			err = pl_strdup(&a->aor, &tok);
+			if (err)
+				goto out;
+		}
+		else {
+			char cls[32];
+			uint32_t bit;
+
+			pl_strcpy(&tok, cls, sizeof(cls));
+
+			bit = class_bit(cls);
+			if (!bit) {
+				err = re_hprintf(pf, "unknown class: %s\n",
+						 cls);
+				goto out;
+			}
+
+			classes |= bit;
+		}
+	}
+
+	list_flush(&ctrl->aorl);
+	ctrl->classes = classes;
+
+	while ((le = aorl.head)) {
+		list_unlink(le);
+		list_append(&ctrl->aorl, le, le->data);
+	}
+
+	err = print_subscription(pf, ctrl);
+
+ out:
+	list_flush(&aorl);
+
+	return err;
+}
+
+
+/**
+ * Benchmark the event encoding, the result is printed as events/sec
+ * for the streaming JSON encoder and the dictionary encoder.
+ */
+static int cmd_bench(struct re_printf *pf, void *arg)
+{
+	const struct cmd_arg *carg = arg;
+	struct ua *ua = list_ledata(list_head(uag_list()));
+	struct mbuf *mb, *frames;
+	struct re_printf pf_mb;
+	uint32_t i, n = BENCH_EVENTS;
+	uint64_t t0, t_json, t_dict;
+	int err = 0;
+
+	if (str_isset(carg->prm))
+		n = max(atoi(carg->prm), 1);
+
+	mb = mbuf_alloc(BUF_SIZE);
+	frames = mbuf_alloc(BUF_SIZE);
+	if (!mb || !frames) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	pf_mb.vph = print_handler;
+	pf_mb.arg = mb;
+
+	t0 = tmr_jiffies_usec();
+
+	for (i=0; i<n && !err; i++) {
+
+		mbuf_rewind(mb);
+
+		err  = event_encode_json(&pf_mb, ua, UA_EVENT_REGISTER_OK,
+					 NULL, "200 OK");
+		err |= netstring_frame_write(frames, mb->buf, mb->end);
+
+		if (frames->end > OUTQ_MAX)
+			mbuf_rewind(frames);
+	}
+
+	t_json = tmr_jiffies_usec() - t0;
+	mbuf_rewind(frames);
+
+	t0 = tmr_jiffies_usec();
+
+	for (i=0; i<n && !err; i++) {
+
+		struct odict *od;
+
+		err = odict_alloc(&od, 8);
+		if (err)
+			break;
+
+		mbuf_rewind(mb);
+
+		err  = odict_entry_add(od, "event", ODICT_BOOL, true);
+		err |= event_encode_dict(od, ua, UA_EVENT_REGISTER_OK,
+					 NULL, "200 OK");
+		err |= json_encode_odict(&pf_mb, od);
+		err |= netstring_frame_write(frames, mb->buf, mb->end);
+
+		mem_deref(od);
+
+		if (frames->end > OUTQ_MAX)
+			mbuf_rewind(frames);
+	}
+
+	t_dict = tmr_jiffies_usec() - t0;
+
+	if (err)
+		goto out;
+
+	err = re_hprintf(pf, "ctrl_tcp: %u events\n"
+			 "  json stream: %llu events/sec\n"
+			 "  odict:       %llu events/sec\n",
+			 n,
+			 t_json ? (uint64_t)n * 1000000 / t_json : 0,
+			 t_dict ? (uint64_t)n * 1000000 / t_dict : 0);
+
+ out:
+	mem_deref(frames);
+	mem_deref(mb);
+
+	return err;
+}
+
+
+static const struct cmd cmdv[] = {
+{"ctrl_bench",     0, CMD_PRM, "Benchmark ctrl_tcp events", cmd_bench     },
+{"ctrl_subscribe", 0, CMD_PRM, "Filter ctrl_tcp events",    cmd_subscribe },
+};
+
+
 static void ctrl_destructor(void *arg)
 {
 	struct ctrl_st *st = arg;
 
+	tmr_cancel(&st->tmr_flush);
+	list_flush(&st->aorl);
 	mem_deref(st->tc);
 	mem_deref(st->ts);
 	mem_deref(st->ns);
+	mem_deref(st->outq);
+	mem_deref(st->mb_enc);
+	mem_deref(st->mb_cmd);
 }
 
 
@@ -366,6 +735,13 @@ static int ctrl_alloc(struct ctrl_st **stp, const struct sa *laddr)
 	if (!st)
 		return ENOMEM;
 
+	st->mb_enc = mbuf_alloc(BUF_SIZE);
+	st->mb_cmd = mbuf_alloc(BUF_SIZE);
+	if (!st->mb_enc || !st->mb_cmd) {
+		err = ENOMEM;
+		goto out;
+	}
+
 	err = tcp_listen(&st->ts, laddr, tcp_conn_handler, st);
 	if (err) {
 		warning("ctrl_tcp: failed to listen on TCP %J (%m)\n",
@@ -406,12 +782,13 @@ static int ctrl_init(void)
 	if (err)
 		return err;
 
-	return 0;
+	return cmd_register(baresip_commands(), cmdv, ARRAY_SIZE(cmdv));
 }
 
 
 static int ctrl_close(void)
 {
+	cmd_unregister(baresip_commands(), cmdv);
 	uag_event_unregister(ua_event_handler);
 	message_unlisten(baresip_message(), message_handler);
 	ctrl = mem_deref(ctrl);
@@ -32,6 +32,7 @@ struct netstring {
 
 	uint64_t n_tx;
 	uint64_t n_rx;
+	bool framed;       /**< Sending pre-encoded frames */
 };
 
 
@@ -44,6 +45,9 @@ static bool netstring_send_handler(int *err, struct mbuf *mb, void *arg)
 	size_t num_len;
 	char num_str[32];
 
+	if (netstring->framed)
+		return false;
+
 	if (mb->pos < NETSTRING_HEADER_SIZE) {
 		DEBUG_WARNING("send: not enough space for netstring header\n");
 		*err = ENOMEM;
@@ -179,6 +183,56 @@ static void destructor(void *arg)
 }
 
 
+/**
+ * Append one netstring frame to a buffer
+ *
+ * @param mb  Buffer to write to
+ * @param p   Frame payload
+ * @param len Payload length
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int netstring_frame_write(struct mbuf *mb, const uint8_t *p, size_t len)
+{
+	int err;
+
+	if (!mb || (!p && len))
+		return EINVAL;
+
+	if (len > NETSTRING_MAX_SIZE)
+		return EMSGSIZE;
+
+	err  = mbuf_printf(mb, "%zu:", len);
+	err |= mbuf_write_mem(mb, p, len);
+	err |= mbuf_write_u8(mb, ',');
+
+	return err;
+}
+
+
+/**
+ * Send a buffer with one or more frames from netstring_frame_write()
+ *
+ * @param netstring Netstring framing
+ * @param mb        Buffer with frames
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int netstring_send_frames(struct netstring *netstring, struct mbuf *mb)
+{
+	int err;
+
+	if (!netstring || !mb)
+		return EINVAL;
+
+	netstring->framed = true;
+	err = tcp_send(netstring->tc, mb);
+	netstring->framed = false;
+
+	return err;
+}
+
+
 int netstring_insert(struct netstring **netstringp, struct tcp_conn *tc,
 		int layer, netstring_frame_h *frameh, void *arg)
 {
@@ -13,3 +13,5 @@ typedef bool (netstring_frame_h)(struct mbuf *mb, void *arg);
 
 int netstring_insert(struct netstring **netstringp, struct tcp_conn *tc,
 		int layer, netstring_frame_h *frameh, void *arg);
+int netstring_frame_write(struct mbuf *mb, const uint8_t *p, size_t len);
+int netstring_send_frames(struct netstring *netstring, struct mbuf *mb);
@@ -333,6 +333,30 @@ static int reload_config(struct re_printf *pf, void *arg)
 }
 
 
+static int cmd_acl(struct re_printf *pf, void *unused)
+{
+	(void)unused;
+	return acl_debug(pf, acl_current());
+}
+
+
+static int cmd_acl_reload(struct re_printf *pf, void *arg)
+{
+	const struct cmd_arg *carg = arg;
+	const char *file = conf_config()->call.acl;
+	int err;
+
+	if (str_isset(carg->prm))
+		file = carg->prm;
+
+	err = acl_reload(file);
+	if (err)
+		return re_hprintf(pf, "acl_reload failed: %m\n", err);
+
+	return re_hprintf(pf, "acl: reloaded %s\n", file);
+}
+
+
 static int cmd_log_level(struct re_printf *pf, void *unused)
 {
 	int level;
@@ -351,6 +375,38 @@ static int cmd_log_level(struct re_printf *pf, void *unused)
 }
 
 
+static int cmd_loopstat(struct re_printf *pf, void *arg)
+{
+	const struct cmd_arg *carg = arg;
+	uint32_t stall_ms = 50;
+
+	if (0 == str_casecmp(carg->prm, "on")) {
+		(void)conf_get_u32(conf_cur(), "mainloop_stall_ms", &stall_ms);
+		return mlprof_init(stall_ms);
+	}
+	else if (0 == str_casecmp(carg->prm, "off"))
+		mlprof_close();
+	else if (0 == str_casecmp(carg->prm, "reset"))
+		mlprof_reset();
+	else if (str_isset(carg->prm))
+		return re_hprintf(pf, "usage: /loopstat [on|off|reset]\n");
+
+	return mlprof_debug(pf, NULL);
+}
+
+
+static int cmd_log_bench(struct re_printf *pf, void *arg)
+{
+	const struct cmd_arg *carg = arg;
+	uint32_t n = 10000;
+
+	if (str_isset(carg->prm))
+		n = (uint32_t)max(atoi(carg->prm), 1);
+
+	return log_bench(pf, n);
+}
+
+
 static int print_uuid(struct re_printf *pf, void *arg)
 {
 	struct config *cfg = conf_config();
@@ -363,21 +419,33 @@ static int print_uuid(struct re_printf *pf, void *arg)
 
 
 static const struct cmd debugcmdv[] = {
+{"acl",         0,       0, "Call-screening ACL",     cmd_acl             },
+{"acl_reload",  0, CMD_PRM, "Reload ACL [file]",      cmd_acl_reload      },
 {"apistate",    0,       0, "User Agent state",       cmd_api_uastate     },
 {"aufileinfo",  0, CMD_PRM, "Audio file info",        cmd_aufileinfo      },
+{"callsetup",   0,       0, "Call setup latency",     callsetup_debug     },
+{"codecpool",   0,       0, "Codec state pools",      codecpool_debug     },
 {"conf_reload", 0,       0, "Reload config file",     reload_config       },
 {"config",      0,       0, "Print configuration",    cmd_config_print    },
+{"logbench",    0, CMD_PRM, "Log cost benchmark [n]", cmd_log_bench       },
 {"loglevel",   'v',      0, "Log level toggle",       cmd_log_level       },
+{"logstat",     0,       0, "Logging status",         log_debug           },
+{"loopstat",    0, CMD_PRM, "Main-loop profile",      cmd_loopstat        },
 {"main",        0,       0, "Main loop debug",        re_debug            },
 {"memstat",    'y',      0, "Memory status",          mem_status          },
+{"modtime",     0,       0, "Module load times",      module_debug        },
 {"modules",     0,       0, "Module debug",           mod_debug           },
+{"mthreads",    0,       0, "Media threads",          mthread_debug       },
 {"netstat",    'n',      0, "Network debug",          cmd_net_debug       },
 {"play",        0, CMD_PRM, "Play audio file",        cmd_play_file       },
+{"regsched",    0,       0, "Register scheduler",     reg_sched_debug     },
 {"sipstat",    'i',      0, "SIP debug",              cmd_sip_debug       },
 {"sysinfo",    's',      0, "System info",            print_system_info   },
 {"timers",      0,       0, "Timer debug",            tmr_status          },
 {"uastat",     'u',      0, "UA debug",               cmd_ua_debug        },
 {"uuid",        0,       0, "Print UUID",             print_uuid          },
+{"vidshare",    0,       0, "Shared video sources",   vidsrc_share_debug  },
+{"wheel",       0,       0, "Timer wheel debug",      wheel_debug         },
 };
 
 
@@ -6,7 +6,6 @@
 #define _DEFAULT_SOURCE 1
 #define _BSD_SOURCE 1
 #include <unistd.h>
-#include <pthread.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
@@ -31,7 +30,7 @@
 struct vidsrc_st {
 	struct vidframe *frame;
 #ifdef HAVE_PTHREAD
-	pthread_t thread;
+	struct mthread *thread;
 	bool run;
 #else
 	struct tmr tmr;
@@ -103,7 +102,7 @@ static void src_destructor(void *arg)
 #ifdef HAVE_PTHREAD
 	if (st->run) {
 		st->run = false;
-		pthread_join(st->thread, NULL);
+		st->thread = mem_deref(st->thread);
 	}
 #else
 	tmr_cancel(&st->tmr);
@@ -170,7 +169,8 @@ static int src_alloc(struct vidsrc_st **stp, const struct vidsrc *vs,
 
 #ifdef HAVE_PTHREAD
 	st->run = true;
-	err = pthread_create(&st->thread, NULL, read_thread, st);
+	err = mthread_create(&st->thread, MTHREAD_VIDEO_SRC,
+			     "fakevideo", read_thread, st);
 	if (err) {
 		st->run = false;
 		goto out;
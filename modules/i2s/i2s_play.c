@@ -7,7 +7,6 @@
 #include <sys/time.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <pthread.h>
 #include "freertos/FreeRTOS.h"
 #include "driver/i2s.h"
 #include <re.h>
@@ -17,7 +16,7 @@
 
 
 struct auplay_st {
-	pthread_t thread;
+	struct mthread *thread;
 	bool run;
 	void *sampv;
 	size_t sampc;
@@ -37,7 +36,7 @@ static void auplay_destructor(void *arg)
 	if (st->run) {
 		info("i2s: stopping playback thread\n");
 		st->run = false;
-		(void)pthread_join(st->thread, NULL);
+		st->thread = mem_deref(st->thread);
 	}
 
 	mem_deref(st->sampv);
@@ -151,7 +150,8 @@ int i2s_play_alloc(struct auplay_st **stp, const struct auplay *ap,
 
 	st->run = true;
 	info("%s starting play thread\n", __func__);
-	err = pthread_create(&st->thread, NULL, write_thread, st);
+	err = mthread_create(&st->thread, MTHREAD_AUDIO_PLAY,
+			     "i2s_play", write_thread, st);
 	if (err) {
 		st->run = false;
 		goto out;
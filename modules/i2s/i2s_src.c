@@ -7,7 +7,6 @@
 #include <sys/time.h>
 #include <stdlib.h>
 #include <unistd.h>
-#include <pthread.h>
 #include "freertos/FreeRTOS.h"
 #include "driver/i2s.h"
 #include <re.h>
@@ -17,7 +16,7 @@
 
 
 struct ausrc_st {
-	pthread_t thread;
+	struct mthread *thread;
 	bool run;
 	void *sampv;
 	size_t sampc;
@@ -37,7 +36,7 @@ static void ausrc_destructor(void *arg)
 	if (st->run) {
 		info("i2s: stopping recording thread\n");
 		st->run = false;
-		(void)pthread_join(st->thread, NULL);
+		st->thread = mem_deref(st->thread);
 	}
 
 	mem_deref(st->sampv);
@@ -161,7 +160,8 @@ int i2s_src_alloc(struct ausrc_st **stp, const struct ausrc *as,
 
 	st->run = true;
 	info("%s starting src thread\n", __func__);
-	err = pthread_create(&st->thread, NULL, read_thread, st);
+	err = mthread_create(&st->thread, MTHREAD_AUDIO_SRC,
+			     "i2s_src", read_thread, st);
 	if (err) {
 		st->run = false;
 		goto out;
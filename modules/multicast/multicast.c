@@ -18,13 +18,25 @@
 
 struct mccfg {
 	uint32_t callprio;
+	bool mix;
+	uint32_t duck;
 };
 
 static struct mccfg mccfg = {
 	0,
+	false,
+	30,
 };
 
 
+/* Call state, cached for the RTP handlers */
+static struct {
+	struct tmr tmr;           /**< Deferred update after call close */
+	bool active;              /**< There are calls                  */
+	uint32_t gen;             /**< Changed on every call event      */
+} calls;
+
+
 /**
  * Decode IP-address <IP>:<PORT>
  *
@@ -112,6 +124,77 @@ uint8_t multicast_callprio(void)
 }
 
 
+/**
+ * Getter for the mix mode, all receivers are played concurrently
+ *
+ * @return true if the multicast groups are mixed
+ */
+bool multicast_mix(void)
+{
+	return mccfg.mix;
+}
+
+
+/**
+ * Getter for the gain of lower priority groups while mixing
+ *
+ * @return Ducking gain in [%]
+ */
+uint32_t multicast_duck(void)
+{
+	return mccfg.duck;
+}
+
+
+/**
+ * Check if there are active calls, without walking all User-Agents
+ *
+ * @return true if there are calls, otherwise false
+ */
+bool multicast_calls_active(void)
+{
+	return calls.active;
+}
+
+
+/**
+ * Get the call state generation, which changes on every call event
+ *
+ * @return Call state generation
+ */
+uint32_t multicast_callgen(void)
+{
+	return calls.gen;
+}
+
+
+static void calls_update(void *arg)
+{
+	(void)arg;
+
+	calls.active = uag_call_count() != 0;
+}
+
+
+static void ua_event_handler(struct ua *ua, enum ua_event ev,
+			     struct call *call, const char *prm, void *arg)
+{
+	(void)ua;
+	(void)ev;
+	(void)prm;
+	(void)arg;
+
+	if (!call)
+		return;
+
+	++calls.gen;
+	calls_update(NULL);
+
+	/* a closed call is removed from the UA after the event */
+	tmr_start(&calls.tmr, 0, calls_update, NULL);
+}
+
+
 /**
  * Create a new multicast sender
  *
@@ -388,6 +471,48 @@ static int cmd_mcchprio(struct re_printf *pf, void *arg)
 }
 
 
+/**
+ * Change gain of existing multicast listener
+ *
+ * @param pf  Printer
+ * @param arg Command arguments
+ *
+ * @return  0 if success, otherwise errorcode
+ */
+static int cmd_mcgain(struct re_printf *pf, void *arg)
+{
+	int err = 0;
+	const struct cmd_arg *carg = arg;
+	struct pl pladdr, plgain;
+	struct sa addr;
+	uint32_t gain;
+
+	err = re_regex(carg->prm, str_len(carg->prm),
+		"addr=[^ ]* gain=[0-9]+", &pladdr, &plgain);
+	if (err)
+		goto out;
+
+	err = decode_addr(&pladdr, &addr);
+	if (err)
+		goto out;
+
+	gain = pl_u32(&plgain);
+	if (plgain.l > 3 || gain > MAX_GAIN) {
+		err = EINVAL;
+		goto out;
+	}
+
+	err = mcreceiver_gain(&addr, gain);
+
+  out:
+	if (err)
+		re_hprintf(pf, "usage: /mcgain addr=<IP>:<PORT> "
+			"gain=<0-%u>\n", MAX_GAIN);
+
+	return err;
+}
+
+
 /**
  * Enables all multicast listener with prio <= given prio and
  * disables those with prio > given pri
@@ -496,6 +621,9 @@ static int module_read_config(void)
 	struct sa laddr;
 
 	(void)conf_get_u32(conf_cur(), "multicast_call_prio", &mccfg.callprio);
+	(void)conf_get_bool(conf_cur(), "multicast_mix", &mccfg.mix);
+	(void)conf_get_u32(conf_cur(), "multicast_duck", &mccfg.duck);
+	mccfg.duck = min(mccfg.duck, 100);
 
 	sa_init(&laddr, AF_INET);
 	err = conf_apply(conf_cur(), "multicast_listener",
@@ -521,6 +649,7 @@ static const struct cmd cmdv[] = {
 		cmd_mcunregall},
 	{"mcchprio"  ,0, CMD_PRM, "Change priority"           , cmd_mcchprio },
 	{"mcprioen"  ,0, CMD_PRM, "Enable Listener Prio >="   , cmd_mcprioen },
+	{"mcgain"    ,0, CMD_PRM, "Change gain of listener"   , cmd_mcgain   },
 	{"mcregen"   ,0, CMD_PRM, "Enable / Disable all listener",
 		cmd_mcregen},
 };
@@ -532,9 +661,9 @@ static int module_init(void)
 
 	err = module_read_config();
 	err |= cmd_register(baresip_commands(), cmdv, ARRAY_SIZE(cmdv));
+	err |= uag_event_register(ua_event_handler, NULL);
 
 	err |= mcsource_init();
-	err |= mcplayer_init();
 
 	if (!err)
 		info("multicast: module init\n");
@@ -549,9 +678,10 @@ static int module_close(void)
 	mcreceiver_unregall();
 
 	cmd_unregister(baresip_commands(), cmdv);
+	uag_event_unregister(ua_event_handler);
+	tmr_cancel(&calls.tmr);
 
 	mcsource_terminate();
-	mcplayer_terminate();
 
 	return 0;
 }
@@ -15,10 +15,16 @@ enum {
 
 	AUDIO_SAMPSZ	= MAX_SRATE * MAX_CHANNELS * MAX_PTIME / 1000,
 	PTIME		= 20,
+
+	MAX_GAIN	= 200,                /* Maximum gain in [%]         */
 };
 
 
 uint8_t multicast_callprio(void);
+bool multicast_calls_active(void);
+uint32_t multicast_callgen(void);
+bool multicast_mix(void);
+uint32_t multicast_duck(void);
 
 
 /* Sender */
@@ -37,17 +43,26 @@ int mcreceiver_alloc(struct sa *addr, uint8_t prio);
 void mcreceiver_unregall(void);
 void mcreceiver_unreg(struct sa *addr);
 int mcreceiver_chprio(struct sa *addr, uint32_t prio);
+int mcreceiver_gain(struct sa *addr, uint32_t gain);
 void mcreceiver_enprio(uint32_t prio);
 void mcreceiver_enable(bool enable);
 
 void mcreceiver_print(struct re_printf *pf);
 
 /* Player <exchangable player> */
-int mcplayer_start(struct jbuf *jbuf, const struct aucodec *ac);
-void mcplayer_stop(void);
+struct mcplayer_stats {
+	uint64_t frames;     /* Frames mixed                      */
+	uint64_t underrun;   /* Frames without enough audio       */
+	uint64_t overrun;    /* Decoded frames, buffer was full   */
+	uint64_t again;      /* Jitter buffer not ready           */
+	double level;        /* Level of the last frame in [dBov] */
+};
 
-int  mcplayer_init(void);
-void mcplayer_terminate(void);
+struct mcvoice;
+int mcplayer_start(struct mcvoice **voicep, struct jbuf *jbuf,
+	const struct aucodec *ac, uint8_t prio, uint32_t gain,
+	struct mcplayer_stats *stats);
+void mcplayer_set_gain(struct mcvoice *voice, uint32_t gain);
 
 /* Source <exchangable source> */
 struct mcsource;
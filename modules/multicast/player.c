@@ -4,12 +4,18 @@
  * Copyright (C) 2021 Commend.com - c.huber@commend.com
  */
 
+#include <string.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
 #ifdef HAVE_PTHREAD
 #include <pthread.h>
 #endif
+#if defined (__SSE2__)
+#include <emmintrin.h>
+#elif defined (__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 
 #include "multicast.h"
@@ -20,40 +26,59 @@
 #include <re_dbg.h>
 
 
+enum {
+	DECODE_MAX = 8,      /**< Max. packets decoded per voice and pass */
+};
+
+
 /**
- * Multicast player struct
+ * Multicast voice struct
  *
- * Contains configuration of the audio player and buffer for the audio data
+ * Decodes the stream of one multicast receiver into its own buffer, which
+ * is mixed into the output of the player
  */
-struct mcplayer{
-	struct config_audio *cfg;
-	struct jbuf *jbuf;
-	bool jbuf_started;
+struct mcvoice {
+	struct le le;
+	struct mcplayer_stats *stats;
 
-	struct auplay_st *auplay;
-	struct auplay_prm auplay_prm;
+	struct jbuf *jbuf;
 	const struct aucodec *ac;
 	struct audec_state *dec;
+	struct list filterl;
+	struct auresamp resamp;
 	struct aubuf *aubuf;
-	volatile bool aubuf_started;
-	size_t aubuf_minsz;
 	size_t aubuf_maxsz;
-	size_t num_bytes;
-
-	struct auresamp resamp;
-	struct list filterl;
-	char *module;
-	char *device;
-	void*sampv;
+	int16_t *sampv;
 	int16_t *sampv_rs;
-	uint32_t ptime;
+
+	uint8_t prio;
+	uint32_t gain;
+};
+
+
+/**
+ * Multicast player struct
+ *
+ * Contains configuration of the audio player and mixes the voices of all
+ * running multicast receivers into one audio player, on the clock of the
+ * audio player
+ */
+struct mcplayer{
+	struct config_audio *cfg;
+
+	struct auplay_st *auplay;
+	struct auplay_prm auplay_prm;
 	enum aufmt play_fmt;
-	enum aufmt dec_fmt;
-	uint32_t again;
+	struct list voicel;
+	struct lock *lock;
+	volatile size_t sampc;
+	int16_t *mixv;
+	int16_t *readv;
+	uint32_t duck;
 
 #ifdef HAVE_PTHREAD
 	struct {
-		pthread_t tid;
+		struct mthread *mt;
 		bool run;
 		pthread_cond_t cond;
 		pthread_mutex_t mutex;
@@ -75,8 +100,12 @@ static void mcplayer_destructor(void *arg)
 
 #ifdef HAVE_PTHREAD
 	if (player->thr.run) {
+		pthread_mutex_lock(&player->thr.mutex);
 		player->thr.run = false;
-		pthread_join(player->thr.tid, NULL);
+		pthread_cond_signal(&player->thr.cond);
+		pthread_mutex_unlock(&player->thr.mutex);
+
+		player->thr.mt = mem_deref(player->thr.mt);
 	}
 
 	pthread_mutex_destroy(&player->thr.mutex);
@@ -85,55 +114,122 @@ static void mcplayer_destructor(void *arg)
 	tmr_cancel(&player->tmr);
 #endif
 
-	player->jbuf     = mem_deref(player->jbuf);
-	player->module   = mem_deref(player->module);
-	player->device   = mem_deref(player->device);
-	player->dec      = mem_deref(player->dec);
+	player->mixv  = mem_deref(player->mixv);
+	player->readv = mem_deref(player->readv);
+	player->lock  = mem_deref(player->lock);
+}
+
+
+static void mcvoice_destructor(void *arg)
+{
+	struct mcvoice *voice = arg;
+	bool empty = false;
+
+	if (player) {
+		lock_write_get(player->lock);
+		list_unlink(&voice->le);
+		empty = list_isempty(&player->voicel);
+		lock_rel(player->lock);
+	}
+
+	list_flush(&voice->filterl);
+	mem_deref(voice->dec);
+	mem_deref(voice->jbuf);
+	mem_deref(voice->aubuf);
+	mem_deref(voice->sampv);
+	mem_deref(voice->sampv_rs);
+
+	/* the audio device is only open while there are voices */
+	if (empty)
+		player = mem_deref(player);
+}
+
+
+/**
+ * Scale samples by a gain in percent, with saturation
+ *
+ * @param sampv Samples
+ * @param sampc Number of samples
+ * @param gain  Gain in [%]
+ */
+static void gain_apply(int16_t *sampv, size_t sampc, uint32_t gain)
+{
+	const int64_t g = (int64_t)min(gain, MAX_GAIN) * 256 / 100;
+	size_t i;
+
+	for (i=0; i<sampc; i++) {
+		int64_t s = (sampv[i] * g) >> 8;
+
+		sampv[i] = (int16_t)min(max(s, -32768), 32767);
+	}
+}
+
+
+/**
+ * Add samples to the mix, with saturation
+ *
+ * @param mixv  Mix buffer
+ * @param sampv Samples to add
+ * @param sampc Number of samples
+ */
+static void mix_add(int16_t *mixv, const int16_t *sampv, size_t sampc)
+{
+	size_t i = 0;
+
+#if defined (__SSE2__)
+	for (; i + 8 <= sampc; i += 8) {
+		__m128i a = _mm_loadu_si128((const __m128i *)&mixv[i]);
+		__m128i b = _mm_loadu_si128((const __m128i *)&sampv[i]);
+
+		_mm_storeu_si128((__m128i *)&mixv[i], _mm_adds_epi16(a, b));
+	}
+#elif defined (__ARM_NEON)
+	for (; i + 8 <= sampc; i += 8) {
+		vst1q_s16(&mixv[i], vqaddq_s16(vld1q_s16(&mixv[i]),
+					       vld1q_s16(&sampv[i])));
+	}
+#endif
+
+	for (; i < sampc; i++) {
+		int32_t s = (int32_t)mixv[i] + sampv[i];
 
-	player->sampv    = mem_deref(player->sampv);
-	player->sampv_rs = mem_deref(player->sampv_rs);
-	player->aubuf    = mem_deref(player->aubuf);
+		mixv[i] = (int16_t)min(max(s, -32768), 32767);
+	}
 }
 
 
 /**
  * Decode the payload of the RTP packet
  *
- * @param hdr RTP header
- * @param mb  RTP payload
+ * @param voice Multicast voice
+ * @param hdr   RTP header
+ * @param mb    RTP payload
  *
  * @return 0 if success, otherwise errorcode
  */
-static int stream_recv_handler(const struct rtp_header *hdr, struct mbuf *mb)
+static int stream_recv_handler(struct mcvoice *voice,
+			       const struct rtp_header *hdr, struct mbuf *mb)
 {
 	struct auframe af;
 	struct le *le;
 	size_t sampc = AUDIO_SAMPSZ;
 	bool marker = hdr->m;
-	void *sampv;
-	uint32_t srate;
-	uint8_t ch;
+	int16_t *sampv;
 	int err = 0;
 
-	if (!player)
-		return EINVAL;
-
-	if (!player->ac)
-		return 0;
-
 	if (hdr->ext && hdr->x.len && mb)
 		return ENOTSUP;
 
 	if (mbuf_get_left(mb)) {
-		err = player->ac->dech(player->dec, player->dec_fmt,
-			player->sampv, &sampc, marker,
+		err = voice->ac->dech(voice->dec, AUFMT_S16LE,
+			voice->sampv, &sampc, marker,
 			mbuf_buf(mb), mbuf_get_left(mb));
 		if (err)
 			goto out;
 	}
-	else if (player->ac->plch && player->dec_fmt == AUFMT_S16LE) {
-		err = player->ac->plch(player->dec, player->dec_fmt,
-			player->sampv, &sampc,
+	else if (voice->ac->plch) {
+		err = voice->ac->plch(voice->dec, AUFMT_S16LE,
+			voice->sampv, &sampc,
 			mbuf_buf(mb), mbuf_get_left(mb));
 		if (err)
 			goto out;
@@ -142,18 +238,10 @@ static int stream_recv_handler(const struct rtp_header *hdr, struct mbuf *mb)
 		sampc = 0;
 	}
 
-	if (player->resamp.resample) {
-		srate = player->resamp.irate;
-		ch = player->resamp.ich;
-	}
-	else {
-		srate = player->auplay_prm.srate;
-		ch = player->auplay_prm.ch;
-	}
-
-	auframe_init(&af, player->dec_fmt, player->sampv, sampc, srate, ch);
+	auframe_init(&af, AUFMT_S16LE, voice->sampv, sampc,
+		     voice->ac->srate, voice->ac->ch);
 
-	for (le = player->filterl.tail; le; le = le->prev) {
+	for (le = voice->filterl.tail; le; le = le->prev) {
 		struct aufilt_dec_st *st = le->data;
 
 		if (st->af && st->af->dech)
@@ -161,59 +249,28 @@ static int stream_recv_handler(const struct rtp_header *hdr, struct mbuf *mb)
 
 	}
 
-	if (!player->aubuf)
-		goto out;
-
 	sampv = af.sampv;
 	sampc = af.sampc;
 
-	if (player->resamp.resample) {
+	if (voice->resamp.resample) {
 		size_t sampc_rs = AUDIO_SAMPSZ;
 
-		if (player->dec_fmt != AUFMT_S16LE)
-			return ENOTSUP;
-
-		err = auresamp(&player->resamp, player->sampv_rs, &sampc_rs,
-			player->sampv, sampc);
+		err = auresamp(&voice->resamp, voice->sampv_rs, &sampc_rs,
+			sampv, sampc);
 		if (err)
 			goto out;
 
-		sampv = player->sampv_rs;
+		sampv = voice->sampv_rs;
 		sampc = sampc_rs;
 	}
 
-	if (player->play_fmt == player->dec_fmt) {
-		size_t num_bytes = sampc * aufmt_sample_size(player->play_fmt);
-		err = aubuf_write(player->aubuf, sampv, num_bytes);
-		if (err)
-			goto out;
-	}
-	else if (player->dec_fmt == AUFMT_S16LE) {
-		void *tmp_sampv;
-
-		size_t num_bytes = sampc * aufmt_sample_size(player->play_fmt);
-
-		tmp_sampv = mem_zalloc(num_bytes, NULL);
-		if (!tmp_sampv)
-			return ENOMEM;
+	if (aubuf_cur_size(voice->aubuf) >= voice->aubuf_maxsz)
+		++voice->stats->overrun;
 
-		auconv_from_s16(player->play_fmt, tmp_sampv, sampv, sampc);
-		err = aubuf_write(player->aubuf, tmp_sampv, num_bytes);
-		mem_deref(tmp_sampv);
-
-		if (err)
-			goto out;
-	}
-	else {
-		warning ("multicast player: invalid sample format "
-			"(%s -> %s)\n", aufmt_name(player->dec_fmt),
-			aufmt_name(player->play_fmt));
-	}
-
-	player->aubuf_started = true;
+	err = aubuf_write(voice->aubuf, (uint8_t *)sampv,
+			  sampc * sizeof(int16_t));
 
   out:
-
 	return err;
 }
 
@@ -221,31 +278,21 @@ static int stream_recv_handler(const struct rtp_header *hdr, struct mbuf *mb)
 /**
  * Decode RTP packet
  *
- * @param arg Multicast player object
+ * @param voice Multicast voice
  *
  * @return 0 if success, otherwise errorcode
  */
-static int stream_decode(void *arg)
+static int stream_decode(struct mcvoice *voice)
 {
 	void *mb = NULL;
 	struct rtp_header hdr;
 	int err = 0;
 
-	(void) arg;
-
-	if (!player)
-		return EINVAL;
-
-	if (!player->jbuf)
-		return ENOENT;
-
-	err = jbuf_get(player->jbuf, &hdr, &mb);
+	err = jbuf_get(voice->jbuf, &hdr, &mb);
 	if (err && err != EAGAIN)
 		return ENOENT;
 
-	player->jbuf_started = true;
-
-	err = stream_recv_handler(&hdr, mb);
+	err = stream_recv_handler(voice, &hdr, mb);
 	mb = mem_deref(mb);
 
 	return err;
@@ -253,37 +300,48 @@ static int stream_decode(void *arg)
 
 
 /**
- * Decode audio
+ * Decode audio of all voices, until one frame of the audio player
+ * is buffered
  *
  * @param arg Multicast player object
  */
 static void audio_decode(void *arg)
 {
-	int err = 0;
+	struct le *le;
 
 	(void) arg;
 
-	while (err == EAGAIN ||
-		(!err && aubuf_cur_size(player->aubuf) < player->num_bytes)) {
-		if (err == EAGAIN)
-			player->again++;
+	lock_read_get(player->lock);
 
-		err = stream_decode(player);
-		if (err && err != EAGAIN)
-			break;
+	for (le = player->voicel.head; le; le = le->next) {
+		struct mcvoice *voice = le->data;
+		size_t num_bytes = player->sampc * sizeof(int16_t);
+		int err = 0;
+		int n = 0;
+
+		while (n++ < DECODE_MAX && (err == EAGAIN ||
+		       (!err && aubuf_cur_size(voice->aubuf) < num_bytes))) {
+			if (err == EAGAIN)
+				voice->stats->again++;
+
+			err = stream_decode(voice);
+			if (err && err != EAGAIN)
+				break;
 
 #ifdef HAVE_PTHREAD
-		if (!player->thr.run)
-			break;
+			if (!player->thr.run)
+				break;
 #endif
+		}
 	}
-	return;
+
+	lock_rel(player->lock);
 }
 
 
 #ifdef HAVE_PTHREAD
 /**
- * Receiver Thread, which decodecs the stream contained in the jbuf
+ * Receiver Thread, which decodecs the streams contained in the jbufs
  *
  * @param arg Multicast player object
  *
@@ -322,22 +380,67 @@ static void *rx_thread(void *arg)
 
 
 /**
- * Audio player write handler
+ * Audio player write handler, mixes all voices
  *
- * @param sampv Sample buffer
- * @param sampc Sample counter
- * @param arg   Multicast player object (unused)
+ * @param af  Audio frame to write to
+ * @param arg Multicast player object (unused)
  */
 static void auplay_write_handler(struct auframe *af, void *arg)
 {
+	size_t sampc = min(af->sampc, AUDIO_SAMPSZ);
+	size_t num_bytes = sampc * sizeof(int16_t);
+	uint8_t hprio = 255;
+	struct le *le;
+
 	(void) arg;
 
 	if (!player)
 		return;
 
-	player->num_bytes = af->sampc * aufmt_sample_size(player->play_fmt);
+	player->sampc = sampc;
+	memset(player->mixv, 0, num_bytes);
+
+	lock_read_get(player->lock);
+
+	/* the voices with a lower priority than the best one are ducked */
+	for (le = player->voicel.head; le; le = le->next) {
+		const struct mcvoice *voice = le->data;
+
+		if (voice->prio < hprio &&
+		    aubuf_cur_size(voice->aubuf) >= num_bytes)
+			hprio = voice->prio;
+	}
+
+	for (le = player->voicel.head; le; le = le->next) {
+		struct mcvoice *voice = le->data;
+		struct mcplayer_stats *stats = voice->stats;
+		uint32_t gain = voice->gain;
+
+		++stats->frames;
+		if (aubuf_cur_size(voice->aubuf) < num_bytes)
+			++stats->underrun;
+
+		aubuf_read(voice->aubuf, (uint8_t *)player->readv, num_bytes);
+
+		if (voice->prio > hprio)
+			gain = gain * player->duck / 100;
+
+		if (gain != 100)
+			gain_apply(player->readv, sampc, gain);
+
+		stats->level = aulevel_calc_dbov(AUFMT_S16LE, player->readv,
+						 sampc);
 
-	aubuf_read(player->aubuf, af->sampv, player->num_bytes);
+		mix_add(player->mixv, player->readv, sampc);
+	}
+
+	lock_rel(player->lock);
+
+	if (player->play_fmt == AUFMT_S16LE)
+		memcpy(af->sampv, player->mixv, num_bytes);
+	else
+		auconv_from_s16(player->play_fmt, af->sampv, player->mixv,
+				sampc);
 
 #ifdef HAVE_PTHREAD
 	pthread_mutex_lock(&player->thr.mutex);
@@ -345,10 +448,11 @@ static void auplay_write_handler(struct auframe *af, void *arg)
 		int err;
 
 		player->thr.run = true;
-		err = pthread_create(&player->thr.tid, NULL,
-			rx_thread, player);
+		err = mthread_create(&player->thr.mt, MTHREAD_AUDIO_PROC,
+			"mcplayer", rx_thread, player);
 		if (err) {
 			player->thr.run = false;
+			pthread_mutex_unlock(&player->thr.mutex);
 			return;
 		}
 	}
@@ -362,27 +466,22 @@ static void auplay_write_handler(struct auframe *af, void *arg)
 
 
 /**
- * Setup all available audio filter for the decoder
+ * Setup all available audio filter for the decoder of a voice
  *
+ * @param voice   Multicast voice
  * @param aufiltl List of audio filter
  *
  * @return 0 if success, otherwise errorcode
  */
-static int aufilt_setup(struct list *aufiltl)
+static int aufilt_setup(struct mcvoice *voice, struct list *aufiltl)
 {
 	struct aufilt_prm prm;
 	struct le *le;
 	int err = 0;
 
-	if (!player->ac)
-		return 0;
-
-	if (!list_isempty(&player->filterl))
-		return 0;
-
-	prm.srate = player->ac->srate;
-	prm.ch = player->ac->ch;
-	prm.fmt = player->dec_fmt;
+	prm.srate = voice->ac->srate;
+	prm.ch = voice->ac->ch;
+	prm.fmt = AUFMT_S16LE;
 
 	for (le = list_head(aufiltl); le; le = le->next) {
 		struct aufilt *af = le->data;
@@ -398,7 +497,7 @@ static int aufilt_setup(struct list *aufiltl)
 			}
 			else {
 				decst->af = af;
-				list_append(&player->filterl, &decst->le,
+				list_append(&voice->filterl, &decst->le,
 					decst);
 			}
 		}
@@ -415,56 +514,36 @@ static int aufilt_setup(struct list *aufiltl)
 
 
 /**
- * Allocate and start a media player for the multicast
- *
- * @note singleton
+ * Allocate the multicast player and open the audio device
  *
- * @param jbuf Jitter buffer containing the RTP stream
- * @param ac   Audio codec
+ * @param ac Audio codec of the first voice
  *
  * @return 0 if success, otherwise errorcode
  */
-int mcplayer_start(struct jbuf *jbuf, const struct aucodec *ac)
+static int mcplayer_alloc(const struct aucodec *ac)
 {
-	int err = 0;
 	struct config_audio *cfg = &conf_config()->audio;
-	uint32_t srate_dsp;
-	uint32_t channels_dsp;
 	struct auplay_prm prm;
-	bool resamp = false;
-
-	if (!jbuf || !ac)
-		return EINVAL;
-
-	if (player) {
-		warning ("multicast player: already started\n");
-		return EINPROGRESS;
-	}
+	int err = 0;
 
 	player = mem_zalloc(sizeof(*player), mcplayer_destructor);
 	if (!player)
 		return ENOMEM;
 
 	player->cfg = cfg;
-	player->ac = ac;
-	player->jbuf = mem_ref(jbuf);
 	player->play_fmt = cfg->play_fmt;
-	player->dec_fmt = cfg->dec_fmt;
+	player->duck = multicast_duck();
 
-	err = str_dup(&player->module, cfg->play_mod);
-	err |= str_dup(&player->device, cfg->play_dev);
-	if (err)
-		goto out;
-
-	player->sampv = mem_zalloc(AUDIO_SAMPSZ *
-		aufmt_sample_size(player->dec_fmt), NULL);
-	if (!player->sampv) {
+	player->mixv  = mem_zalloc(AUDIO_SAMPSZ * sizeof(int16_t), NULL);
+	player->readv = mem_zalloc(AUDIO_SAMPSZ * sizeof(int16_t), NULL);
+	if (!player->mixv || !player->readv) {
 		err = ENOMEM;
 		goto out;
 	}
 
-	auresamp_init(&player->resamp);
-	player->ptime = PTIME;
+	err = lock_alloc(&player->lock);
+	if (err)
+		goto out;
 
 #ifdef HAVE_PTHREAD
 	err = pthread_mutex_init(&player->thr.mutex, NULL);
@@ -473,121 +552,143 @@ int mcplayer_start(struct jbuf *jbuf, const struct aucodec *ac)
 		goto out;
 #endif
 
-	if (player->ac->decupdh) {
-		err = player->ac->decupdh(&player->dec, player->ac, NULL);
-		if (err) {
-			warning ("multicast player: alloc decoder(%m)\n",
-				err);
-			goto out;
-		}
-	}
+	/* all voices are resampled to the clock of the player */
+	prm.srate = cfg->srate_play ? cfg->srate_play : ac->srate;
+	prm.ch = cfg->channels_play ? cfg->channels_play : ac->ch;
+	prm.ptime = PTIME;
+	prm.fmt = player->play_fmt;
 
-	srate_dsp = player->ac->srate;
-	channels_dsp = player->ac->ch;
-	if (cfg->srate_play && cfg->srate_play != srate_dsp) {
-		resamp = true;
-		srate_dsp = cfg->srate_play;
-	}
-	if (cfg->channels_play && cfg->channels_play != channels_dsp) {
-		resamp = true;
-		channels_dsp = cfg->channels_play;
+	player->auplay_prm = prm;
+
+	err = auplay_alloc(&player->auplay, baresip_auplayl(), cfg->play_mod,
+		&prm, cfg->play_dev, auplay_write_handler, player);
+	if (err) {
+		warning("multicast player: start of %s.%s failed (%m)\n",
+			cfg->play_mod, cfg->play_dev, err);
+		goto out;
 	}
 
-	if (resamp && !player->sampv_rs) {
-		player->sampv_rs = mem_zalloc(AUDIO_SAMPSZ * sizeof(int16_t),
-			NULL);
+  out:
+	if (err)
+		player = mem_deref(player);
 
-		if (!player->sampv_rs) {
-			err = ENOMEM;
-			goto out;
-		}
+	return err;
+}
 
-		err = auresamp_setup(&player->resamp,
-			player->ac->srate, player->ac->ch,
-			srate_dsp, channels_dsp);
-		if (err) {
-			warning("multicast player: could not setup auplay"
-				" resampler (%m)\n", err);
-			goto out;
-		}
+
+/**
+ * Start a voice of the multicast player
+ *
+ * @param voicep Pointer to allocated voice, mem_deref() stops it
+ * @param jbuf   Jitter buffer containing the RTP stream
+ * @param ac     Audio codec
+ * @param prio   Priority of the stream, for ducking
+ * @param gain   Gain in [%]
+ * @param stats  Statistics of the stream
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mcplayer_start(struct mcvoice **voicep, struct jbuf *jbuf,
+		   const struct aucodec *ac, uint8_t prio, uint32_t gain,
+		   struct mcplayer_stats *stats)
+{
+	struct config_audio *cfg = &conf_config()->audio;
+	const struct auplay_prm *prm;
+	struct mcvoice *voice;
+	size_t min_sz, max_sz;
+	int err = 0;
+
+	if (!voicep || !jbuf || !ac || !stats)
+		return EINVAL;
+
+	if (!cfg->buffer.min || !cfg->buffer.max)
+		return EINVAL;
+
+	if (!player) {
+		err = mcplayer_alloc(ac);
+		if (err)
+			return err;
 	}
 
-	prm.srate = srate_dsp;
-	prm.ch = channels_dsp;
-	prm.ptime = player->ptime;
-	prm.fmt = player->play_fmt;
-	if (!player->aubuf) {
-		const size_t sz = aufmt_sample_size(player->play_fmt);
-		const size_t ptime_min = cfg->buffer.min;
-		const size_t ptime_max = cfg->buffer.max;
-		size_t min_sz;
-		size_t max_sz;
-
-		if (!ptime_min || !ptime_max) {
-			err = EINVAL;
-			goto out;
-		}
+	voice = mem_zalloc(sizeof(*voice), mcvoice_destructor);
+	if (!voice)
+		return ENOMEM;
+
+	voice->jbuf  = mem_ref(jbuf);
+	voice->ac    = ac;
+	voice->prio  = prio;
+	voice->gain  = min(gain, MAX_GAIN);
+	voice->stats = stats;
 
-		min_sz = sz * ((prm.srate * prm.ch * ptime_min) / 10000);
-		max_sz = sz * ((prm.srate * prm.ch * ptime_max) / 10000);
+	voice->sampv = mem_zalloc(AUDIO_SAMPSZ * sizeof(int16_t), NULL);
+	voice->sampv_rs = mem_zalloc(AUDIO_SAMPSZ * sizeof(int16_t), NULL);
+	if (!voice->sampv || !voice->sampv_rs) {
+		err = ENOMEM;
+		goto out;
+	}
 
-		err = aubuf_alloc(&player->aubuf, min_sz, max_sz * 2);
+	if (ac->decupdh) {
+		err = ac->decupdh(&voice->dec, ac, NULL);
 		if (err) {
-			warning("multicast player: aubuf alloc error (%m)\n",
+			warning ("multicast player: alloc decoder(%m)\n",
 				err);
 			goto out;
 		}
 	}
 
-	err = aufilt_setup(baresip_aufiltl());
-	if (err)
-	{
-		warning("multicast player: aufilt setup error (%m)\n)", err);
+	prm = &player->auplay_prm;
+
+	auresamp_init(&voice->resamp);
+	err = auresamp_setup(&voice->resamp, ac->srate, ac->ch,
+			     prm->srate, prm->ch);
+	if (err) {
+		warning("multicast player: could not setup auplay"
+			" resampler (%m)\n", err);
 		goto out;
 	}
 
-	err = auplay_alloc(&player->auplay, baresip_auplayl(), player->module,
-		&prm, player->device, auplay_write_handler, player);
+	min_sz = sizeof(int16_t) *
+		((prm->srate * prm->ch * cfg->buffer.min) / 10000);
+	max_sz = sizeof(int16_t) *
+		((prm->srate * prm->ch * cfg->buffer.max) / 10000);
+
+	voice->aubuf_maxsz = max_sz * 2;
+	err = aubuf_alloc(&voice->aubuf, min_sz, voice->aubuf_maxsz);
 	if (err) {
-		warning("multicast player: start of %s.%s failed (%m)\n",
-			player->module, player->device, err);
+		warning("multicast player: aubuf alloc error (%m)\n", err);
 		goto out;
 	}
 
-	player->auplay_prm = prm;
+	err = aufilt_setup(voice, baresip_aufiltl());
+	if (err) {
+		warning("multicast player: aufilt setup error (%m)\n)", err);
+		goto out;
+	}
+
+	lock_write_get(player->lock);
+	list_append(&player->voicel, &voice->le, voice);
+	lock_rel(player->lock);
 
   out:
 	if (err)
-		player = mem_deref(player);
+		mem_deref(voice);
+	else
+		*voicep = voice;
 
 	return err;
 }
 
 
 /**
- * Stop multicast player
- */
-void mcplayer_stop(void)
-{
-	player = mem_deref(player);
-}
-
-
-/**
- * Initialize everything needed for the player beforhand
+ * Set the gain of a voice
  *
- * @return 0 if success, otherwise errorcode
+ * @param voice Multicast voice
+ * @param gain  Gain in [%]
  */
-int mcplayer_init(void)
+void mcplayer_set_gain(struct mcvoice *voice, uint32_t gain)
 {
-	return 0;
-}
+	if (!voice)
+		return;
 
-/**
- * Terminate everything needed for the player afterwards
- *
- */
-void mcplayer_terminate(void)
-{
-	return;
+	voice->gain = min(gain, MAX_GAIN);
 }
@@ -25,9 +25,14 @@ struct lock *mcreceivl_lock = NULL;
 
 
 enum {
-	TIMEOUT = 500,
+	TIMEOUT       = 500,   /**< RTP timeout [ms]              */
+	TIMEOUT_CHECK = 100,   /**< Period of timeout checks [ms] */
 };
 
+
+/* One timer checks the RTP timeout of all receivers */
+static struct tmrw tmrw_timeout;
+
 /**
  * Multicast receiver struct
  *
@@ -43,8 +48,18 @@ struct mcreceiver {
 	struct jbuf *jbuf;
 
 	const struct aucodec *ac;
+	uint8_t pt;          /**< Payload type of ac             */
+	bool pt_valid;       /**< Payload type was looked up     */
+
+	uint64_t ts_last;    /**< Time of last RTP packet [ms]   */
+	bool receiving;      /**< RTP received, timeout pending  */
+
+	bool held;           /**< Calls were put on hold         */
+	uint32_t callgen;    /**< Call state when calls held     */
 
-	struct tmr timeout;
+	struct mcvoice *voice;        /**< Voice in the player      */
+	struct mcplayer_stats stats;  /**< Player statistics        */
+	uint32_t gain;                /**< Gain of the voice in [%] */
 
 	bool running;
 	bool enable;
@@ -56,10 +71,7 @@ static void mcreceiver_destructor(void *arg)
 {
 	struct mcreceiver *mcreceiver = arg;
 
-	tmr_cancel(&mcreceiver->timeout);
-
-	if (mcreceiver->running)
-		mcplayer_stop();
+	mcreceiver->voice = mem_deref(mcreceiver->voice);
 
 	mcreceiver->ssrc = 0;
 	mcreceiver->running = false;
@@ -127,15 +139,15 @@ static bool mcreceiver_running(struct le *le, void *arg)
 /**
  * Convert std rtp codec payload type to audio codec
  *
- * @param hdr RTP header object
+ * @param pt RTP payload type
  *
  * @return struct aucodec*
  */
-static const struct aucodec *pt2codec(const struct rtp_header *hdr)
+static const struct aucodec *pt2codec(uint8_t pt)
 {
 	const struct aucodec *codec = NULL;
 
-	switch (hdr->pt) {
+	switch (pt) {
 		case 0:
 			codec = aucodec_find(baresip_aucodecl(), "PCMU", 0, 1);
 			break;
@@ -150,7 +162,7 @@ static const struct aucodec *pt2codec(const struct rtp_header *hdr)
 
 		default:
 			warning ("multicast receiver: RTP Payload "
-				"Type %d not found.\n");
+				"Type %u not found.\n", pt);
 			break;
 	}
 
@@ -183,6 +195,29 @@ static void resume_uag_state(void)
 }
 
 
+/**
+ * Start the voice of a multicast receiver in the player
+ *
+ * @param mcreceiver Multicast receiver object
+ * @param ssrc       SSRC of the stream
+ *
+ * @return int 0 if success, errorcode otherwise
+ */
+static int player_start(struct mcreceiver *mcreceiver, uint32_t ssrc)
+{
+	mcreceiver->voice = mem_deref(mcreceiver->voice);
+	jbuf_flush(mcreceiver->jbuf);
+	mcreceiver->running = true;
+	mcreceiver->ssrc = ssrc;
+	module_event("multicast", "receive start", NULL, NULL,
+		     "%J (%d)", &mcreceiver->addr, mcreceiver->prio);
+
+	return mcplayer_start(&mcreceiver->voice, mcreceiver->jbuf,
+			      mcreceiver->ac, mcreceiver->prio,
+			      mcreceiver->gain, &mcreceiver->stats);
+}
+
+
 /**
  * Multicast Priority handling
  *
@@ -209,16 +244,16 @@ static int prio_handling(struct mcreceiver *mcreceiver, uint32_t ssrc)
 		uag_set_nodial(true);
 	}
 
+	if (multicast_mix()) {
+		/* all groups are mixed, the player ducks the lower prio */
+		err = player_start(mcreceiver, ssrc);
+		goto out;
+	}
+
 	le = list_apply(&mcreceivl, true, mcreceiver_running, NULL);
 	if (!le) {
 		/* start the player now */
-		mcplayer_stop();
-		jbuf_flush(mcreceiver->jbuf);
-		mcreceiver->running = true;
-		mcreceiver->ssrc = ssrc;
-		module_event("multicast", "receive start", NULL, NULL,
-			     "%J (%d)", &mcreceiver->addr, mcreceiver->prio);
-		err = mcplayer_start(mcreceiver->jbuf, mcreceiver->ac);
+		err = player_start(mcreceiver, ssrc);
 		goto out;
 	}
 
@@ -229,12 +264,7 @@ static int prio_handling(struct mcreceiver *mcreceiver, uint32_t ssrc)
 
 	if (hprio->prio == mcreceiver->prio && mcreceiver->ssrc != ssrc) {
 		/*SSRC changed -> restart player*/
-		mcplayer_stop();
-		jbuf_flush(hprio->jbuf);
-		hprio->ssrc = ssrc;
-		module_event("multicast", "receive start", NULL, NULL,
-			     "%J (%d)", &hprio->addr, hprio->prio);
-		err = mcplayer_start(hprio->jbuf, hprio->ac);
+		err = player_start(hprio, ssrc);
 		goto out;
 	}
 	else if (hprio->prio == mcreceiver->prio) {
@@ -243,14 +273,9 @@ static int prio_handling(struct mcreceiver *mcreceiver, uint32_t ssrc)
 	}
 
 	/*higher prio -> stop old player and start new one*/
-	mcplayer_stop();
+	hprio->voice = mem_deref(hprio->voice);
 	hprio->running = false;
-	jbuf_flush(mcreceiver->jbuf);
-	mcreceiver->ssrc = ssrc;
-	mcreceiver->running = true;
-	module_event("multicast", "receive start", NULL, NULL,
-		     "%J (%d)", &mcreceiver->addr, mcreceiver->prio);
-	err = mcplayer_start(mcreceiver->jbuf, mcreceiver->ac);
+	err = player_start(mcreceiver, ssrc);
 
   out:
 	lock_rel(mcreceivl_lock);
@@ -259,32 +284,78 @@ static int prio_handling(struct mcreceiver *mcreceiver, uint32_t ssrc)
 
 
 /**
- * RTP timeout handler
+ * RTP timeout handler, called with the mcreceivl_lock held
  *
- * @param arg Multicast receiver object
+ * @param mcreceiver Multicast receiver object
  */
-static void timeout_handler(void *arg)
+static void timeout_handler(struct mcreceiver *mcreceiver)
 {
-	struct mcreceiver *mcreceiver = arg;
 	info ("multicast receiver: timeout of %J (prio=%d)\n",
 		&mcreceiver->addr, mcreceiver->prio);
 
-	lock_write_get(mcreceivl_lock);
-
 	if (mcreceiver->running) {
 		module_event("multicast", "receive timeout", NULL, NULL,
 			     "%J (%d)", &mcreceiver->addr, mcreceiver->prio);
-		mcplayer_stop();
 	}
 
+	mcreceiver->voice = mem_deref(mcreceiver->voice);
+
 	mcreceiver->running = false;
 	mcreceiver->ssrc = 0;
 	mcreceiver->ac = NULL;
+	mcreceiver->pt_valid = false;
+	mcreceiver->held = false;
 
 	resume_uag_state();
+}
+
+
+/**
+ * Check the RTP timeout of all receivers
+ *
+ * @param arg Unused
+ */
+static void timeout_check(void *arg)
+{
+	const uint64_t now = tmr_jiffies();
+	struct le *le;
+	(void)arg;
+
+	lock_write_get(mcreceivl_lock);
+
+	for (le = list_head(&mcreceivl); le; le = le->next) {
+		struct mcreceiver *mcreceiver = le->data;
+
+		if (!mcreceiver->receiving ||
+		    now - mcreceiver->ts_last < TIMEOUT)
+			continue;
+
+		mcreceiver->receiving = false;
+		timeout_handler(mcreceiver);
+	}
 
 	lock_rel(mcreceivl_lock);
-	return;
+}
+
+
+/**
+ * Put all calls on hold
+ */
+static void hold_calls(void)
+{
+	struct le *leua;
+
+	for (leua = list_head(uag_list()); leua; leua = leua->next) {
+		struct ua *ua = leua->data;
+		struct le *le;
+
+		for (le = list_head(ua_calls(ua)); le; le = le->next) {
+			struct call *call = le->data;
+
+			if (!call_is_onhold(call))
+				call_hold(call, true);
+		}
+	}
 }
 
 
@@ -303,54 +374,55 @@ static void rtp_handler(const struct sa *src, const struct rtp_header *hdr,
 	struct mcreceiver *mcreceiver = arg;
 
 	(void) src;
-	(void) mb;
+
+	/* the timeout is checked by timeout_check() */
+	mcreceiver->ts_last = tmr_jiffies();
+	mcreceiver->receiving = true;
 
 	if (!mcreceiver->enable)
-		goto out;
+		return;
 
 	if (!mcreceiver->globenable)
-		goto out;
+		return;
 
-	if (mcreceiver->prio >= multicast_callprio() && uag_call_count()) {
-		goto out;
-	}
-	else if (mcreceiver->prio < multicast_callprio() && uag_call_count()) {
-		struct le *leua;
-		struct ua *ua;
-
-		for (leua = list_head(uag_list()); leua; leua = leua->next) {
-			struct le *le;
-			ua = leua->data;
-			for (le = list_head(ua_calls(ua)); le; le = le->next) {
-				struct call *call = le->data;
-				if (!call_is_onhold(call))
-					call_hold(call, true);
-			}
+	if (multicast_calls_active()) {
+
+		if (mcreceiver->prio >= multicast_callprio())
+			return;
+
+		/* hold the calls again only if the call state changed */
+		if (!mcreceiver->held ||
+		    mcreceiver->callgen != multicast_callgen()) {
+
+			mcreceiver->held = true;
+			mcreceiver->callgen = multicast_callgen();
+			hold_calls();
 		}
 	}
 
-	mcreceiver->ac = pt2codec(hdr);
+	if (!mcreceiver->pt_valid || mcreceiver->pt != hdr->pt) {
+		mcreceiver->ac = pt2codec(hdr->pt);
+		mcreceiver->pt = hdr->pt;
+		mcreceiver->pt_valid = true;
+	}
+
 	if (!mcreceiver->ac)
-		goto out;
+		return;
 
 	if (!mbuf_get_left(mb))
-		goto out;
-
-	err = prio_handling(mcreceiver, hdr->ssrc);
-	if (err)
-		goto out;
-
-	mcreceiver->ssrc = hdr->ssrc;
+		return;
 
+	/* the priority only changes with a new stream */
+	if (!mcreceiver->running || mcreceiver->ssrc != hdr->ssrc) {
 
-	err = jbuf_put(mcreceiver->jbuf, hdr, mb);
-	if (err)
-		return;
+		err = prio_handling(mcreceiver, hdr->ssrc);
+		if (err)
+			return;
+	}
 
-  out:
-	tmr_start(&mcreceiver->timeout, TIMEOUT, timeout_handler, mcreceiver);
+	mcreceiver->ssrc = hdr->ssrc;
 
-	return;
+	(void)jbuf_put(mcreceiver->jbuf, hdr, mb);
 }
 
 
@@ -437,11 +509,45 @@ int mcreceiver_chprio(struct sa *addr, uint32_t prio)
 }
 
 
+/**
+ * Change the gain of a multicast receiver
+ *
+ * @param addr Listen address
+ * @param gain Gain in [%]
+ *
+ * @return int 0 if success, errorcode otherwise
+ */
+int mcreceiver_gain(struct sa *addr, uint32_t gain)
+{
+	struct le *le;
+	struct mcreceiver *mcreceiver;
+
+	if (!addr)
+		return EINVAL;
+
+	le = list_apply(&mcreceivl, true, mcreceiver_addr_cmp, addr);
+	if (!le) {
+		warning ("multicast receiver: receiver %J not found\n", addr);
+		return EINVAL;
+	}
+
+	mcreceiver = le->data;
+	lock_write_get(mcreceivl_lock);
+	mcreceiver->gain = gain;
+	mcplayer_set_gain(mcreceiver->voice, gain);
+	lock_rel(mcreceivl_lock);
+
+	return 0;
+}
+
+
 /**
  * Un-register all multicast listener
  */
 void mcreceiver_unregall(void)
 {
+	tmrw_cancel(&tmrw_timeout);
+
 	lock_write_get(mcreceivl_lock);
 	list_flush(&mcreceivl);
 	resume_uag_state();
@@ -472,8 +578,10 @@ void mcreceiver_unreg(struct sa *addr){
 	lock_rel(mcreceivl_lock);
 	mem_deref(mcreceiver);
 
-	if (list_isempty(&mcreceivl))
+	if (list_isempty(&mcreceivl)) {
+		tmrw_cancel(&tmrw_timeout);
 		mcreceivl_lock = mem_deref(mcreceivl_lock);
+	}
 }
 
 
@@ -521,6 +629,7 @@ int mcreceiver_alloc(struct sa *addr, uint8_t prio)
 	port = sa_port(&mcreceiver->addr);
 	mcreceiver->prio = prio;
 
+	mcreceiver->gain = 100;
 	mcreceiver->running = false;
 	mcreceiver->enable = true;
 	mcreceiver->globenable = true;
@@ -556,6 +665,12 @@ int mcreceiver_alloc(struct sa *addr, uint8_t prio)
 	list_append(&mcreceivl, &mcreceiver->le, mcreceiver);
 	lock_rel(mcreceivl_lock);
 
+	if (!tmrw_isrunning(&tmrw_timeout)) {
+		tmrw_init(&tmrw_timeout, "mcreceiver timeout");
+		tmrw_start_periodic(&tmrw_timeout, TIMEOUT_CHECK,
+				    TIMEOUT_CHECK, timeout_check, NULL);
+	}
+
   out:
 	if (err)
 		mem_deref(mcreceiver);
@@ -576,11 +691,29 @@ void mcreceiver_print(struct re_printf *pf)
 
 	re_hprintf(pf, "Multicast Receiver List:\n");
 	LIST_FOREACH(&mcreceivl, le) {
+		const struct mcplayer_stats *st;
+		const struct jbuf_stat *jstat = NULL;
+		struct jbuf_stat js;
+
 		mcreceiver = le->data;
+		st = &mcreceiver->stats;
+
 		re_hprintf(pf, "   %J - %d%s%s\n", &mcreceiver->addr,
 			mcreceiver->prio,
 			mcreceiver->enable  && mcreceiver->globenable ?
 			" (enable)" : "",
 			mcreceiver->running ? " (active)" : "");
+
+		if (!jbuf_stats(mcreceiver->jbuf, &js))
+			jstat = &js;
+
+		re_hprintf(pf, "      gain=%u%% level=%.1fdBov frames=%llu"
+			   " underrun=%llu overrun=%llu lost=%u"
+			   " jbuf_overflow=%u\n",
+			   mcreceiver->gain,
+			   mcreceiver->running ? st->level : -96.0,
+			   st->frames, st->underrun, st->overrun,
+			   jstat ? jstat->n_lost : 0,
+			   jstat ? jstat->n_overflow : 0);
 	}
 }
@@ -36,6 +36,7 @@ struct mcsender {
 
 	struct config_audio *cfg;
 	const struct aucodec *ac;
+	uint8_t pt;
 
 	struct mcsource *src;
 	bool enable;
@@ -83,8 +84,6 @@ static int mcsender_send_handler(size_t ext_len, bool marker,
 	uint32_t rtp_ts, struct mbuf *mb, void *arg)
 {
 	struct mcsender *mcsender = arg;
-	struct pl placpt = PL_INIT;
-	int err = 0;
 
 	if (!mb)
 		return EINVAL;
@@ -92,14 +91,11 @@ static int mcsender_send_handler(size_t ext_len, bool marker,
 	if (!mcsender->enable)
 		return 0;
 
-	if (uag_call_count())
+	if (multicast_calls_active())
 		return 0;
 
-	pl_set_str(&placpt, mcsender->ac->pt);
-	err = rtp_send(mcsender->rtp, &mcsender->addr, ext_len != 0, marker,
-		pl_u32(&placpt), rtp_ts, mb);
-
-	return err;
+	return rtp_send(mcsender->rtp, &mcsender->addr, ext_len != 0, marker,
+		mcsender->pt, rtp_ts, mb);
 }
 
 
@@ -163,6 +159,7 @@ int mcsender_alloc(struct sa *addr, const struct aucodec *codec)
 {
 	int err = 0;
 	struct mcsender *mcsender = NULL;
+	struct pl pt;
 
 	if (!addr || !codec)
 		return EINVAL;
@@ -179,6 +176,10 @@ int mcsender_alloc(struct sa *addr, const struct aucodec *codec)
 	mcsender->ac = codec;
 	mcsender->enable = true;
 
+	/* static payload type of the codec */
+	pl_set_str(&pt, codec->pt);
+	mcsender->pt = (uint8_t)pl_u32(&pt);
+
 	err = rtp_open(&mcsender->rtp, sa_af(&mcsender->addr));
 	if (err)
 		goto out;
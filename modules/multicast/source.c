@@ -9,9 +9,6 @@
 #include <baresip.h>
 
 #include <stdlib.h>
-#ifdef HAVE_PTHREAD
-#include <pthread.h>
-#endif
 
 #include "multicast.h"
 
@@ -57,7 +54,7 @@ struct mcsource {
 
 #ifdef HAVE_PTHREAD
 	struct {
-		pthread_t tid;
+		struct mthread *mt;
 		bool run;
 	} thr;
 #endif
@@ -73,7 +70,7 @@ static void mcsource_destructor(void *arg)
 		case AUDIO_MODE_THREAD:
 			if (src->thr.run) {
 				src->thr.run = false;
-				pthread_join(src->thr.tid, NULL);
+				src->thr.mt = mem_deref(src->thr.mt);
 			}
 #endif
 		default:
@@ -424,8 +421,9 @@ static int start_source(struct mcsource *src)
 			case AUDIO_MODE_THREAD:
 				if (!src->thr.run) {
 					src->thr.run = true;
-					err = pthread_create(&src->thr.tid,
-						NULL, tx_thread, src);
+					err = mthread_create(&src->thr.mt,
+						MTHREAD_AUDIO_PROC, "mcsource",
+						tx_thread, src);
 					if (err) {
 						src->thr.run = false;
 						return err;
@@ -12,16 +12,30 @@
  * Notifier - other people are subscribing to the status of our AOR.
  * we must maintain a list of active notifications. we receive a SUBSCRIBE
  * message from peer, and send NOTIFY to all peers when the Status changes
+ *
+ * The notifiers are hashed by their User-Agent, and the PIDF document
+ * is built once per status change and shared by all the NOTIFYs.
  */
 
 
+enum {
+	NOTIFIER_HASH_SIZE = 256
+};
+
+
 struct notifier {
 	struct le le;
 	struct sipnot *not;
 	struct ua *ua;
 };
 
-static struct list notifierl;
+static struct hash *notifierh;
+
+
+static uint32_t ua_hash(const struct ua *ua)
+{
+	return hash_joaat((const uint8_t *)&ua, sizeof(ua));
+}
 
 
 static const char *presence_status_str(enum presence_status st)
@@ -35,9 +49,9 @@ static const char *presence_status_str(enum presence_status st)
 }
 
 
-static int notify(struct notifier *not, enum presence_status status)
+static int pidf_encode(struct mbuf **mbp, const char *aor,
+		       enum presence_status status)
 {
-	const char *aor = account_aor(ua_account(not->ua));
 	struct mbuf *mb;
 	int err;
 
@@ -65,13 +79,26 @@ static int notify(struct notifier *not, enum presence_status status)
 
 	mb->pos = 0;
 
+ out:
+	if (err)
+		mem_deref(mb);
+	else
+		*mbp = mb;
+
+	return err;
+}
+
+
+static int notify(struct notifier *not, struct mbuf *mb)
+{
+	int err;
+
 	err = sipevent_notify(not->not, mb, SIPEVENT_ACTIVE, 0, 0);
 	if (err) {
-		warning("presence: notify to %s failed (%m)\n", aor, err);
+		warning("presence: notify to %s failed (%m)\n",
+			account_aor(ua_account(not->ua)), err);
 	}
 
- out:
-	mem_deref(mb);
 	return err;
 }
 
@@ -97,7 +124,7 @@ static void destructor(void *arg)
 {
 	struct notifier *not = arg;
 
-	list_unlink(&not->le);
+	hash_unlink(&not->le);
 	mem_deref(not->not);
 	mem_deref(not->ua);
 }
@@ -137,7 +164,7 @@ static int notifier_alloc(struct notifier **notp,
 		goto out;
 	}
 
-	list_append(&notifierl, &not->le, not);
+	hash_append(notifierh, ua_hash(ua), &not->le, not);
 
  out:
 	if (err)
@@ -154,6 +181,7 @@ static int notifier_add(const struct sip_msg *msg, struct ua *ua)
 	const struct sip_hdr *hdr;
 	struct sipevent_event se;
 	struct notifier *not;
+	struct mbuf *mb;
 	int err;
 
 	hdr = sip_msg_hdr(msg, SIP_HDR_EVENT);
@@ -173,7 +201,11 @@ static int notifier_add(const struct sip_msg *msg, struct ua *ua)
 	if (err)
 		return err;
 
-	(void)notify(not, ua_presence_status(ua));
+	if (0 == pidf_encode(&mb, account_aor(ua_account(ua)),
+			     ua_presence_status(ua))) {
+		(void)notify(not, mb);
+		mem_deref(mb);
+	}
 
 	return 0;
 }
@@ -181,15 +213,26 @@ static int notifier_add(const struct sip_msg *msg, struct ua *ua)
 
 void notifier_update_status(struct ua *ua)
 {
+	struct mbuf *mb = NULL;
 	struct le *le;
 
-	for (le = notifierl.head; le; le = le->next) {
+	for (le = list_head(hash_list(notifierh, ua_hash(ua)));
+	     le;
+	     le = le->next) {
 
 		struct notifier *not = le->data;
 
-		if (not->ua == ua)
-			(void)notify(not, ua_presence_status(not->ua));
+		if (not->ua != ua)
+			continue;
+
+		if (!mb && pidf_encode(&mb, account_aor(ua_account(ua)),
+				       ua_presence_status(ua)))
+			return;
+
+		(void)notify(not, mb);
 	}
+
+	mem_deref(mb);
 }
 
 
@@ -206,6 +249,14 @@ static bool sub_handler(const struct sip_msg *msg, void *arg)
 
 int notifier_init(void)
 {
+	int err;
+
+	if (!notifierh) {
+		err = hash_alloc(&notifierh, NOTIFIER_HASH_SIZE);
+		if (err)
+			return err;
+	}
+
 	uag_set_sub_handler(sub_handler);
 
 	return 0;
@@ -214,6 +265,7 @@ int notifier_init(void)
 
 void notifier_close(void)
 {
-	list_flush(&notifierl);
+	hash_flush(notifierh);
+	notifierh = mem_deref(notifierh);
 	uag_set_sub_handler(NULL);
 }
@@ -53,6 +53,8 @@ static int cmd_pres(struct re_printf *pf, void *arg)
 
 static const struct cmd cmdv[] = {
 	{"presence", 0, CMD_PRM, "Set presence <online|offline>", cmd_pres },
+	{"presstat", 0,       0, "Presence subscriber status",
+	 subscriber_debug },
 };
 
 
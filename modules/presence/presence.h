@@ -7,6 +7,7 @@
 int  subscriber_init(void);
 void subscriber_close(void);
 void subscriber_close_all(void);
+int  subscriber_debug(struct re_printf *pf, void *unused);
 
 
 int  notifier_init(void);
@@ -17,3 +18,4 @@ void notifier_update_status(struct ua *ua);
 int  publisher_init(void);
 void publisher_close(void);
 void publisher_update_status(struct ua *ua);
+
@@ -3,6 +3,7 @@
  *
  * Copyright (C) 2010 Alfred E. Heggestad
  */
+#include <string.h>
 #include <re.h>
 #include <baresip.h>
 #include "presence.h"
@@ -14,30 +15,70 @@
  * For each entry in the address book marked with ;presence=p2p,
  * we send a SUBSCRIBE to that person, and expect to receive
  * a NOTIFY when her status changes.
+ *
+ * Entries marked with ;presence=rls are carried by one subscription to
+ * the resource list server in presence_rls_uri (RFC 4662), which sends
+ * the status of all the resources in multipart NOTIFYs.
+ *
+ * All the retries are scheduled on the core timer wheel. New SUBSCRIBEs
+ * are paced to presence_rate per second, and the retry intervals and the
+ * requested expiry are jittered, so that the refreshes of many
+ * subscriptions do not cluster.
  */
 
 
 /** Constants */
 enum {
-	SHUTDOWN_DELAY = 500  /**< Delay before un-registering [ms] */
+	SHUTDOWN_DELAY =  500,  /**< Delay before un-registering [ms] */
+	START_DELAY    = 1000,  /**< Delay before first SUBSCRIBE [ms] */
+	PACE_MIN       =   10,  /**< Min. pacer interval [ms]          */
+	JITTER         =   10,  /**< Jitter of intervals [%]           */
 };
 
 
 struct presence {
-	struct le le;
+	struct le le;              /**< Member of presence hash (by URI)  */
+	struct le le_ready;        /**< Member of ready queue             */
+	struct tmrw tmr;           /**< Retry and shutdown timer          */
 	struct sipsub *sub;
-	struct tmr tmr;
 	enum presence_status status;
 	unsigned failc;
-	struct contact *contact;
+	struct contact *contact;   /**< Contact, NULL for the RLS dialog  */
 	struct ua *ua;
+	bool rls;                  /**< Carried by the RLS dialog         */
 	bool shutdown;
 };
 
-static struct list presencel;
+static struct {
+	struct hash *presh;        /**< Presence entries (by contact URI) */
+	struct list readyl;        /**< Waiting for the pacer             */
+	struct tmr pacer;          /**< Paces new SUBSCRIBEs              */
+	struct presence *rls;      /**< Resource list subscription        */
+	uint32_t rate;             /**< Max. new SUBSCRIBEs per second    */
+	uint32_t expires;          /**< Requested expiry [s]              */
+	char rls_uri[256];         /**< Resource list URI                 */
+
+	struct {
+		uint64_t n_sub;        /**< SUBSCRIBEs sent               */
+		uint64_t n_close;      /**< Closed subscriptions          */
+		uint64_t n_notify;     /**< NOTIFYs received              */
+		uint64_t n_rls_res;    /**< Resource updates via RLS      */
+	} stats;
+} subs;
+
+
+static void ready_handler(void *arg);
 
 
-static void tmr_handler(void *arg);
+static uint32_t jitter(uint32_t val)
+{
+	const uint32_t range = val * JITTER / 100;
+
+	if (!range)
+		return val;
+
+	return val - range + rand_u32() % (2 * range + 1);
+}
 
 
 static uint32_t wait_term(const struct sipevent_substate *substate)
@@ -81,18 +122,265 @@ static uint32_t wait_fail(unsigned failc)
 }
 
 
+static const char *presence_uri(const struct presence *pres)
+{
+	return pres->contact ? contact_uri(pres->contact) : subs.rls_uri;
+}
+
+
+static bool uri_cmp_handler(struct le *le, void *arg)
+{
+	const struct presence *pres = le->data;
+	const struct pl *uri = arg;
+
+	return 0 == pl_strcasecmp(uri, contact_uri(pres->contact));
+}
+
+
+static struct presence *presence_find(const struct pl *uri)
+{
+	return list_ledata(hash_lookup(subs.presh,
+				       hash_joaat_ci(uri->p, uri->l),
+				       uri_cmp_handler, (void *)uri));
+}
+
+
+static enum presence_status pidf_status(const char *p, size_t len)
+{
+	enum presence_status status = PRESENCE_CLOSED;
+	struct pl pl;
+
+	if (!re_regex(p, len, "<basic[ \t]*>[^<]+</basic[ \t]*>",
+		      NULL, &pl, NULL)) {
+	    if (!pl_strcasecmp(&pl, "open"))
+		status = PRESENCE_OPEN;
+	}
+
+	if (!re_regex(p, len, "<rpid:away[ \t]*/>", NULL)) {
+
+		status = PRESENCE_CLOSED;
+	}
+	else if (!re_regex(p, len, "<rpid:busy[ \t]*/>", NULL)) {
+
+		status = PRESENCE_BUSY;
+	}
+	else if (!re_regex(p, len, "<rpid:on-the-phone[ \t]*/>", NULL)) {
+
+		status = PRESENCE_BUSY;
+	}
+
+	return status;
+}
+
+
+static const char *find(const char *p, size_t len, const char *s, size_t n)
+{
+	const char *end;
+
+	if (!n || len < n)
+		return NULL;
+
+	for (end = p + len - n; p <= end; p++) {
+
+		if (*p == *s && 0 == memcmp(p, s, n))
+			return p;
+	}
+
+	return NULL;
+}
+
+
+/* The resources are looked up by their SIP URI, also for a PRES URI */
+static void rls_resource(const struct pl *uri, enum presence_status status)
+{
+	struct presence *pres;
+	char *sipuri = NULL;
+	struct pl pl = *uri, rest;
+
+	if (!re_regex(uri->p, uri->l, "^pres:[^]+", &rest)) {
+
+		if (re_sdprintf(&sipuri, "sip:%r", &rest))
+			return;
+
+		pl_set_str(&pl, sipuri);
+	}
+
+	pres = presence_find(&pl);
+	if (!pres || !pres->rls) {
+		debug("presence: rls: unknown resource <%r>\n", uri);
+		goto out;
+	}
+
+	++subs.stats.n_rls_res;
+
+	contact_set_presence(pres->contact, status);
+
+ out:
+	mem_deref(sipuri);
+}
+
+
+static void rls_pidf_decode(const char *p, size_t len)
+{
+	struct pl entity;
+
+	if (re_regex(p, len, "entity=\"[^\"]+\"", &entity))
+		return;
+
+	rls_resource(&entity, pidf_status(p, len));
+}
+
+
+/* Resources without an active or pending instance are unknown */
+static void rlmi_decode(const char *p, size_t len)
+{
+	const char *end = p + len;
+	const char *tag;
+
+	while ((tag = find(p, end - p, "<resource", 9))) {
+
+		const char *tag_end, *res_end;
+		struct pl uri;
+
+		tag_end = find(tag, end - tag, ">", 1);
+		if (!tag_end)
+			break;
+
+		res_end = find(tag_end, end - tag_end, "</resource>", 11);
+		if (!res_end)
+			res_end = tag_end;
+
+		p = res_end;
+
+		if (re_regex(tag, tag_end - tag, "uri=\"[^\"]+\"", &uri))
+			continue;
+
+		if (find(tag_end, res_end - tag_end, "\"terminated\"", 12))
+			rls_resource(&uri, PRESENCE_UNKNOWN);
+	}
+}
+
+
+static void rls_part_decode(const char *p, size_t len)
+{
+	const char *body;
+	struct pl ctype;
+	size_t hlen, blen;
+
+	body = find(p, len, "\r\n\r\n", 4);
+	if (!body)
+		return;
+
+	hlen = body - p;
+	body += 4;
+	blen = p + len - body;
+
+	if (re_regex(p, hlen, "Content-Type:[ \t]*[^;\r\n]+", NULL, &ctype))
+		return;
+
+	if (0 == pl_strcasecmp(&ctype, "application/pidf+xml")) {
+
+		rls_pidf_decode(body, blen);
+	}
+	else if (0 == pl_strcasecmp(&ctype, "application/rlmi+xml")) {
+
+		rlmi_decode(body, blen);
+	}
+}
+
+
+static int rls_decode(const struct sip_msg *msg)
+{
+	const char *p, *end;
+	struct pl bnd;
+
+	/* no state yet */
+	if (!mbuf_get_left(msg->mb))
+		return 0;
+
+	/* the state of a single resource */
+	if (msg_ctype_cmp(&msg->ctyp, "application", "pidf+xml")) {
+		rls_pidf_decode((const char *)mbuf_buf(msg->mb),
+				mbuf_get_left(msg->mb));
+		return 0;
+	}
+
+	if (!msg_ctype_cmp(&msg->ctyp, "multipart", "related"))
+		return EPROTO;
+
+	if (re_regex(msg->ctyp.params.p, msg->ctyp.params.l,
+		     "boundary=[\"]*[^\";]+", NULL, &bnd))
+		return EBADMSG;
+
+	p   = (const char *)mbuf_buf(msg->mb);
+	end = p + mbuf_get_left(msg->mb);
+
+	p = find(p, end - p, bnd.p, bnd.l);
+	while (p) {
+
+		const char *next;
+
+		p += bnd.l;
+
+		/* close-delimiter */
+		if (end - p >= 2 && p[0] == '-' && p[1] == '-')
+			break;
+
+		next = find(p, end - p, bnd.p, bnd.l);
+		if (!next)
+			break;
+
+		/* strip the "--" of the next delimiter */
+		if (next - p > 2)
+			rls_part_decode(p, next - p - 2);
+
+		p = next;
+	}
+
+	return 0;
+}
+
+
+static bool rls_unknown_handler(struct le *le, void *arg)
+{
+	struct presence *pres = le->data;
+	(void)arg;
+
+	if (pres->rls)
+		contact_set_presence(pres->contact, PRESENCE_UNKNOWN);
+
+	return false;
+}
+
+
 static void notify_handler(struct sip *sip, const struct sip_msg *msg,
 			   void *arg)
 {
 	enum presence_status status = PRESENCE_CLOSED;
 	struct presence *pres = arg;
 	const struct sip_hdr *type_hdr, *length_hdr;
-	struct pl pl;
 
 	if (pres->shutdown)
 		goto done;
 
 	pres->failc = 0;
+	++subs.stats.n_notify;
+
+	if (!pres->contact) {
+
+		if (rls_decode(msg)) {
+			sip_treplyf(NULL, NULL, sip, msg, false,
+				    415, "Unsupported Media Type",
+				    "Accept: multipart/related,"
+				    " application/rlmi+xml,"
+				    " application/pidf+xml\r\n"
+				    "Content-Length: 0\r\n"
+				    "\r\n");
+			return;
+		}
+
+		goto done;
+	}
 
 	type_hdr = sip_msg_hdr(msg, SIP_HDR_CONTENT_TYPE);
 
@@ -121,34 +409,14 @@ static void notify_handler(struct sip *sip, const struct sip_msg *msg,
 		return;
 	}
 
-	if (!re_regex((const char *)mbuf_buf(msg->mb), mbuf_get_left(msg->mb),
-		      "<basic[ \t]*>[^<]+</basic[ \t]*>", NULL, &pl, NULL)) {
-	    if (!pl_strcasecmp(&pl, "open"))
-		status = PRESENCE_OPEN;
-	}
-
-	if (!re_regex((const char *)mbuf_buf(msg->mb), mbuf_get_left(msg->mb),
-		      "<rpid:away[ \t]*/>", NULL)) {
-
-		status = PRESENCE_CLOSED;
-	}
-	else if (!re_regex((const char *)mbuf_buf(msg->mb),
-			   mbuf_get_left(msg->mb),
-			   "<rpid:busy[ \t]*/>", NULL)) {
-
-		status = PRESENCE_BUSY;
-	}
-	else if (!re_regex((const char *)mbuf_buf(msg->mb),
-			   mbuf_get_left(msg->mb),
-			   "<rpid:on-the-phone[ \t]*/>", NULL)) {
-
-		status = PRESENCE_BUSY;
-	}
+	status = pidf_status((const char *)mbuf_buf(msg->mb),
+			     mbuf_get_left(msg->mb));
 
 done:
 	(void)sip_treply(NULL, sip, msg, 200, "OK");
 
-	contact_set_presence(pres->contact, status);
+	if (pres->contact)
+		contact_set_presence(pres->contact, status);
 
 	if (pres->shutdown)
 		mem_deref(pres);
@@ -163,8 +431,9 @@ static void close_handler(int err, const struct sip_msg *msg,
 
 	pres->sub = mem_deref(pres->sub);
 
-	info("presence: subscriber closed <%s>: ",
-	     contact_uri(pres->contact));
+	++subs.stats.n_close;
+
+	info("presence: subscriber closed <%s>: ", presence_uri(pres));
 
 	if (substate) {
 		info("%s", sipevent_reason_name(substate->reason));
@@ -179,11 +448,16 @@ static void close_handler(int err, const struct sip_msg *msg,
 		wait = wait_fail(++pres->failc);
 	}
 
+	wait = jitter(wait);
+
 	info("; will retry in %u secs (failc=%u)\n", wait, pres->failc);
 
-	tmr_start(&pres->tmr, wait * 1000, tmr_handler, pres);
+	tmrw_start(&pres->tmr, wait * 1000ULL, ready_handler, pres);
 
-	contact_set_presence(pres->contact, PRESENCE_UNKNOWN);
+	if (pres->contact)
+		contact_set_presence(pres->contact, PRESENCE_UNKNOWN);
+	else
+		hash_apply(subs.presh, rls_unknown_handler, NULL);
 }
 
 
@@ -193,8 +467,9 @@ static void destructor(void *arg)
 
 	debug("presence: subscriber destroyed\n");
 
-	list_unlink(&pres->le);
-	tmr_cancel(&pres->tmr);
+	hash_unlink(&pres->le);
+	list_unlink(&pres->le_ready);
+	tmrw_cancel(&pres->tmr);
 	mem_deref(pres->contact);
 	mem_deref(pres->sub);
 	mem_deref(pres->ua);
@@ -234,85 +509,193 @@ static int subscribe(struct presence *pres)
 	routev[0] = ua_outbound(ua);
 
 	err = sipevent_subscribe(&pres->sub, uag_sipevent_sock(),
-				 contact_uri(pres->contact), NULL,
+				 presence_uri(pres), NULL,
 				 account_aor(ua_account(ua)),
-				 "presence", NULL, 600,
+				 "presence", NULL, jitter(subs.expires),
 				 ua_cuser(ua), routev, routev[0] ? 1 : 0,
 				 auth_handler, ua_account(ua), true, NULL,
 				 notify_handler, close_handler, pres,
-				 "%H", ua_print_supported, ua);
+				 "%H%s", ua_print_supported, ua,
+				 pres->contact ? "" :
+				 "Supported: eventlist\r\n"
+				 "Accept: application/pidf+xml,"
+				 " application/rlmi+xml,"
+				 " multipart/related\r\n");
 	if (err) {
 		warning("presence: sipevent_subscribe failed: %m\n", err);
 	}
+	else {
+		++subs.stats.n_sub;
+	}
 
 	return err;
 }
 
 
-static void tmr_handler(void *arg)
+static void pacer_handler(void *arg)
 {
-	struct presence *pres = arg;
+	uint32_t interval, burst;
+	struct le *le;
+	(void)arg;
 
-	if (subscribe(pres)) {
-		tmr_start(&pres->tmr, wait_fail(++pres->failc) * 1000,
-			  tmr_handler, pres);
+	if (subs.rate) {
+		interval = max(1000 / subs.rate, PACE_MIN);
+		burst    = max(subs.rate * interval / 1000, 1);
 	}
+	else {
+		interval = PACE_MIN;
+		burst    = (uint32_t)-1;
+	}
+
+	if (!subs.readyl.head)
+		return;
+
+	while (burst-- && (le = subs.readyl.head)) {
+
+		struct presence *pres = le->data;
+
+		list_unlink(&pres->le_ready);
+
+		if (subscribe(pres)) {
+			tmrw_start(&pres->tmr,
+				   jitter(wait_fail(++pres->failc)) * 1000ULL,
+				   ready_handler, pres);
+		}
+	}
+
+	/* keep the spacing to the next burst */
+	tmr_start(&subs.pacer, interval, pacer_handler, NULL);
 }
 
 
-static int presence_alloc(struct contact *contact)
+static void ready_handler(void *arg)
+{
+	struct presence *pres = arg;
+
+	if (list_contains(&subs.readyl, &pres->le_ready))
+		return;
+
+	list_append(&subs.readyl, &pres->le_ready, pres);
+
+	if (!tmr_isrunning(&subs.pacer))
+		tmr_start(&subs.pacer, 0, pacer_handler, NULL);
+}
+
+
+static int rls_alloc(void)
 {
 	struct presence *pres;
 
+	if (subs.rls)
+		return 0;
+
 	pres = mem_zalloc(sizeof(*pres), destructor);
 	if (!pres)
 		return ENOMEM;
 
+	tmrw_init(&pres->tmr, "presence");
+	pres->status = PRESENCE_UNKNOWN;
+
+	tmrw_start(&pres->tmr, START_DELAY, ready_handler, pres);
+
+	subs.rls = pres;
+
+	info("presence: resource list <%s>\n", subs.rls_uri);
+
+	return 0;
+}
+
+
+static int presence_alloc(struct contact *contact, bool rls)
+{
+	struct presence *pres;
+	int err = 0;
+
+	pres = mem_zalloc(sizeof(*pres), destructor);
+	if (!pres)
+		return ENOMEM;
+
+	tmrw_init(&pres->tmr, "presence");
 	pres->status  = PRESENCE_UNKNOWN;
 	pres->contact = mem_ref(contact);
+	pres->rls     = rls;
 
-	tmr_init(&pres->tmr);
-	tmr_start(&pres->tmr, 1000, tmr_handler, pres);
+	hash_append(subs.presh, hash_joaat_str_ci(contact_uri(contact)),
+		    &pres->le, pres);
 
-	list_append(&presencel, &pres->le, pres);
+	if (rls) {
+		err = rls_alloc();
+		if (err)
+			mem_deref(pres);
+	}
+	else {
+		tmrw_start(&pres->tmr, jitter(START_DELAY),
+			   ready_handler, pres);
+	}
 
-	return 0;
+	return err;
+}
+
+
+/* Returns true if presence is enabled for the contact */
+static bool presence_mode(const struct contact *contact, bool *rls)
+{
+	struct sip_addr *addr = contact_addr(contact);
+	struct pl val;
+
+	if (msg_param_decode(&addr->params, "presence", &val))
+		return false;
+
+	if (0 == pl_strcasecmp(&val, "p2p")) {
+		*rls = false;
+		return true;
+	}
+
+	if (0 == pl_strcasecmp(&val, "rls")) {
+
+		/* without a resource list, subscribe directly */
+		*rls = str_isset(subs.rls_uri);
+		return true;
+	}
+
+	return false;
+}
+
+
+static bool contact_cmp_handler(struct le *le, void *arg)
+{
+	const struct presence *pres = le->data;
+
+	return pres->contact == arg;
 }
 
 
 static void contact_handler(struct contact *contact,
 				bool removed, void *arg)
 {
-	struct le *le;
-	struct pl val;
-	struct presence *pres = NULL;
-	struct sip_addr *addr = contact_addr(contact);
+	struct presence *pres;
+	bool rls;
 	(void)arg;
 
-	if (0 == msg_param_decode(&addr->params, "presence", &val) &&
-				0 == pl_strcasecmp(&val, "p2p")) {
-		if (!removed) {
-			if (presence_alloc(contact) != 0) {
-				warning("presence: presence_alloc failed\n");
-				return;
-			}
+	if (!presence_mode(contact, &rls))
+		return;
+
+	if (!removed) {
+		if (presence_alloc(contact, rls) != 0) {
+			warning("presence: presence_alloc failed\n");
+			return;
+		}
+	}
+	else {
+		/* Find matching presence element for contact */
+		pres = list_ledata(hash_lookup(subs.presh,
+				   hash_joaat_str_ci(contact_uri(contact)),
+				   contact_cmp_handler, contact));
+		if (pres) {
+			mem_deref(pres);
 		}
 		else {
-			/* Find matching presence element for contact */
-			for (le = list_head(&presencel); le; le = le->next) {
-				pres = (struct presence*)le->data;
-				if (pres->contact == contact) {
-					break;
-				}
-				pres = NULL;
-			}
-
-			if (pres) {
-				mem_deref(pres);
-			}
-			else {
-				warning("presence: No contact to remove\n");
-			}
+			warning("presence: No contact to remove\n");
 		}
 	}
 }
@@ -322,22 +705,37 @@ int subscriber_init(void)
 {
 	struct contacts *contacts = baresip_contacts();
 	struct le *le;
-	int err = 0;
+	uint32_t n = 0;
+	int err;
+
+	subs.rate    = 20;
+	subs.expires = 600;
+
+	(void)conf_get_u32(conf_cur(), "presence_rate", &subs.rate);
+	(void)conf_get_u32(conf_cur(), "presence_expires", &subs.expires);
+	(void)conf_get_str(conf_cur(), "presence_rls_uri",
+			   subs.rls_uri, sizeof(subs.rls_uri));
+
+	tmr_init(&subs.pacer);
+
+	err = hash_alloc(&subs.presh, hash_valid_size(
+			 max(list_count(contact_list(contacts)), 64)));
+	if (err)
+		return err;
 
 	for (le = list_head(contact_list(contacts)); le; le = le->next) {
 
 		struct contact *c = le->data;
-		struct sip_addr *addr = contact_addr(c);
-		struct pl val;
+		bool rls;
 
-		if (0 == msg_param_decode(&addr->params, "presence", &val) &&
-		    0 == pl_strcasecmp(&val, "p2p")) {
+		if (!presence_mode(c, &rls))
+			continue;
 
-			err |= presence_alloc(le->data);
-		}
+		err |= presence_alloc(c, rls);
+		++n;
 	}
 
-	info("Subscribing to %u contacts\n", list_count(&presencel));
+	info("Subscribing to %u contacts\n", n);
 
 	contact_set_update_handler(contacts, contact_handler, NULL);
 
@@ -350,34 +748,112 @@ int subscriber_init(void)
 void subscriber_close(void)
 {
 	contact_set_update_handler(baresip_contacts(), NULL, NULL);
-	list_flush(&presencel);
+
+	tmr_cancel(&subs.pacer);
+
+	hash_flush(subs.presh);
+	subs.rls   = mem_deref(subs.rls);
+	subs.presh = mem_deref(subs.presh);
+}
+
+
+static void presence_shutdown(struct presence *pres)
+{
+	debug("presence: shutdown: sub=%p\n", pres->sub);
+
+	pres->shutdown = true;
+	list_unlink(&pres->le_ready);
+
+	if (pres->sub) {
+		pres->sub = mem_deref(pres->sub);
+		tmrw_start(&pres->tmr, SHUTDOWN_DELAY, deref_handler, pres);
+	}
+	else
+		mem_deref(pres);
+}
+
+
+static bool shutdown_handler(struct le *le, void *arg)
+{
+	(void)arg;
+
+	presence_shutdown(le->data);
+
+	return false;
+}
+
+
+static bool count_handler(struct le *le, void *arg)
+{
+	const struct presence *pres = le->data;
+	uint32_t *countv = arg;
+
+	++countv[0];
+
+	if (pres->sub)
+		++countv[1];
+
+	if (pres->rls)
+		++countv[2];
+
+	return false;
 }
 
 
 void subscriber_close_all(void)
 {
-	struct le *le;
+	uint32_t countv[3] = {0, 0, 0};
 
-	info("presence: subscriber: closing %u subs\n",
-	     list_count(&presencel));
+	hash_apply(subs.presh, count_handler, countv);
+
+	info("presence: subscriber: closing %u subs\n", countv[0]);
 
 	contact_set_update_handler(baresip_contacts(), NULL, NULL);
 
-	le = presencel.head;
-	while (le) {
+	tmr_cancel(&subs.pacer);
 
-		struct presence *pres = le->data;
-		le = le->next;
+	hash_apply(subs.presh, shutdown_handler, NULL);
 
-		debug("presence: shutdown: sub=%p\n", pres->sub);
+	if (subs.rls) {
+		presence_shutdown(subs.rls);
+		subs.rls = NULL;
+	}
+}
 
-		pres->shutdown = true;
-		if (pres->sub) {
-			pres->sub = mem_deref(pres->sub);
-			tmr_start(&pres->tmr, SHUTDOWN_DELAY,
-				  deref_handler, pres);
-		}
-		else
-			mem_deref(pres);
+
+/**
+ * Print the presence subscriber status
+ *
+ * @param pf     Print function
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int subscriber_debug(struct re_printf *pf, void *unused)
+{
+	uint32_t countv[3] = {0, 0, 0};
+	int err = 0;
+	(void)unused;
+
+	hash_apply(subs.presh, count_handler, countv);
+
+	err |= re_hprintf(pf, "\nPresence subscriber:\n");
+	err |= re_hprintf(pf, " contacts:   %u (%u via resource list)\n",
+			  countv[0], countv[2]);
+	err |= re_hprintf(pf, " active:     %u\n", countv[1]);
+	err |= re_hprintf(pf, " pending:    %u (rate %u/s)\n",
+			  list_count(&subs.readyl), subs.rate);
+
+	if (subs.rls) {
+		err |= re_hprintf(pf, " rls:        <%s> (%s)\n",
+				  subs.rls_uri,
+				  subs.rls->sub ? "active" : "idle");
 	}
+
+	err |= re_hprintf(pf, " subscribe:  %llu sent, %llu closed\n",
+			  subs.stats.n_sub, subs.stats.n_close);
+	err |= re_hprintf(pf, " notify:     %llu (%llu rls resources)\n",
+			  subs.stats.n_notify, subs.stats.n_rls_res);
+
+	return err;
 }
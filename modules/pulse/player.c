@@ -5,7 +5,6 @@
  */
 #include <pulse/pulseaudio.h>
 #include <pulse/simple.h>
-#include <pthread.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
@@ -14,7 +13,7 @@
 
 struct auplay_st {
 	pa_simple *s;
-	pthread_t thread;
+	struct mthread *thread;
 	bool run;
 	void *sampv;
 	size_t sampc;
@@ -35,7 +34,7 @@ static void auplay_destructor(void *arg)
 	if (st->run) {
 		debug("pulse: stopping playback thread\n");
 		st->run = false;
-		(void)pthread_join(st->thread, NULL);
+		st->thread = mem_deref(st->thread);
 	}
 
 	if (st->s) {
@@ -146,7 +145,8 @@ int pulse_player_alloc(struct auplay_st **stp, const struct auplay *ap,
 	}
 
 	st->run = true;
-	err = pthread_create(&st->thread, NULL, write_thread, st);
+	err = mthread_create(&st->thread, MTHREAD_AUDIO_PLAY,
+			     "pulse_play", write_thread, st);
 	if (err) {
 		st->run = false;
 		goto out;
@@ -5,7 +5,6 @@
  */
 #include <pulse/pulseaudio.h>
 #include <pulse/simple.h>
-#include <pthread.h>
 #include <string.h>
 #include <re.h>
 #include <rem.h>
@@ -16,7 +15,7 @@
 struct ausrc_st {
 	struct ausrc_prm prm;
 	pa_simple *s;
-	pthread_t thread;
+	struct mthread *thread;
 	bool run;
 	void *sampv;
 	size_t sampc;
@@ -36,7 +35,7 @@ static void ausrc_destructor(void *arg)
 	if (st->run) {
 		debug("pulse: stopping record thread\n");
 		st->run = false;
-		(void)pthread_join(st->thread, NULL);
+		st->thread = mem_deref(st->thread);
 	}
 
 	if (st->s)
@@ -187,7 +186,8 @@ int pulse_recorder_alloc(struct ausrc_st **stp, const struct ausrc *as,
 	}
 
 	st->run = true;
-	err = pthread_create(&st->thread, NULL, read_thread, st);
+	err = mthread_create(&st->thread, MTHREAD_AUDIO_SRC,
+			     "pulse_src", read_thread, st);
 	if (err) {
 		st->run = false;
 		goto out;
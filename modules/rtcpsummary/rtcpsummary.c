@@ -8,6 +8,15 @@
 #include <baresip.h>
 
 
+/* Milliseconds of CPU time spent in one media processing stage */
+static uint64_t cpu_ms(const struct stream *s, enum media_cpu_stage stage)
+{
+	const struct media_cpu *cpu = stream_media_cpu(s);
+
+	return cpu ? cpu->stagev[stage].usec / 1000 : 0;
+}
+
+
 static void print_rtcp_summary_line(const struct call *call,
 				    const struct stream *s)
 {
@@ -32,6 +41,7 @@ static void print_rtcp_summary_line(const struct call *call,
 			"JI=%.1f,%.1f;"/* Jitter RX, TX in ms */
 			"DL=%.1f;"     /* RTT in ms */
 			"IP=%J,%J;"    /* Local, Remote IPs */
+			"CPU=%llu,%llu,%llu,%llu,%llu,%llu;" /* CPU [ms] */
 			 "\n"
 			,
 			 call_setup_duration(call) * 1000,
@@ -46,7 +56,13 @@ static void print_rtcp_summary_line(const struct call *call,
 			 1.0 * rtcp->tx.jit/1000,
 			 1.0 * rtcp->rtt/1000,
 			 sdp_media_laddr(stream_sdpmedia(s)),
-			 sdp_media_raddr(stream_sdpmedia(s)));
+			 sdp_media_raddr(stream_sdpmedia(s)),
+			 cpu_ms(s, MEDIA_CPU_ENCODE),
+			 cpu_ms(s, MEDIA_CPU_DECODE),
+			 cpu_ms(s, MEDIA_CPU_FILTER_ENC),
+			 cpu_ms(s, MEDIA_CPU_FILTER_DEC),
+			 cpu_ms(s, MEDIA_CPU_RESAMPLE_ENC),
+			 cpu_ms(s, MEDIA_CPU_RESAMPLE_DEC));
 	}
 	else {
 		/*
@@ -6,7 +6,6 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sndio.h>
-#include <pthread.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
@@ -21,7 +20,7 @@
 
 struct ausrc_st {
 	struct sio_hdl *hdl;
-	pthread_t thread;
+	struct mthread *thread;
 	int16_t *sampv;
 	size_t sampc;
 	int run;
@@ -32,7 +31,7 @@ struct ausrc_st {
 
 struct auplay_st {
 	struct sio_hdl *hdl;
-	pthread_t thread;
+	struct mthread *thread;
 	int16_t *sampv;
 	size_t sampc;
 	int run;
@@ -122,7 +121,7 @@ static void ausrc_destructor(void *arg)
 
 	if (st->run) {
 		st->run = false;
-		(void)pthread_join(st->thread, NULL);
+		st->thread = mem_deref(st->thread);
 	}
 
 	if (st->hdl)
@@ -138,7 +137,7 @@ static void auplay_destructor(void *arg)
 
 	if (st->run) {
 		st->run = false;
-		(void)pthread_join(st->thread, NULL);
+		st->thread = mem_deref(st->thread);
 	}
 
 	if (st->hdl)
@@ -211,7 +210,8 @@ static int src_alloc(struct ausrc_st **stp, const struct ausrc *as,
 	}
 
 	st->run = true;
-	err = pthread_create(&st->thread, NULL, read_thread, st);
+	err = mthread_create(&st->thread, MTHREAD_AUDIO_SRC,
+			     "sndio_src", read_thread, st);
 	if (err)
 		st->run = false;
 
@@ -285,7 +285,8 @@ static int play_alloc(struct auplay_st **stp, const struct auplay *ap,
 	}
 
 	st->run = true;
-	err = pthread_create(&st->thread, NULL, write_thread, st);
+	err = mthread_create(&st->thread, MTHREAD_AUDIO_PLAY,
+			     "sndio_play", write_thread, st);
 	if (err)
 		st->run = false;
 
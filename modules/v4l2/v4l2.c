@@ -15,7 +15,6 @@
 #include <fcntl.h>
 #include <unistd.h>
 #undef __STRICT_ANSI__ /* needed for RHEL4 kernel 2.6.9 */
-#include <pthread.h>
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
@@ -41,29 +40,80 @@
  * @defgroup v4l2 v4l2
  *
  * V4L2 (Video for Linux 2) video-source module
+ *
+ * The captured buffers are delivered without copying. Each dequeued
+ * buffer is wrapped in a reference counted video frame, and the buffer
+ * is queued back to the driver when the last reference is released.
+ * A consumer can keep a frame with mem_ref() beyond the frame handler.
+ *
+ * A compressed format from the camera (H.264) can be passed through
+ * to the encoder as video packets, if the consumer has a packet handler
+ * and the selected video codec is the same format. MJPEG is never
+ * passed through, since there is no MJPEG video codec.
+ *
+ * Example config:
+ \verbatim
+  v4l2_buffers        4        # Number of capture buffers (2-32)
+  v4l2_passthrough    no       # Pass through compressed formats
+ \endverbatim
  */
 
 
+enum {
+	BUFFERS_MIN = 2,
+	BUFFERS_MAX = 32,
+};
+
+
 struct buffer {
 	void  *start;
 	size_t length;
 };
 
+/* Capture buffers, shared by the source and the frames in use */
+struct bufpool {
+	struct lock *lock;
+	int fd;
+	struct buffer *buffers;
+	unsigned int   n_buffers;
+	unsigned int   n_out;       /* Buffers dequeued and in use */
+	bool streaming;
+};
+
+/* Reference counted frame, owns a dequeued buffer */
+struct v4l2_frame {
+	struct vidframe frame;      /* NOTE: must be first */
+	struct bufpool *pool;
+	unsigned int index;
+};
+
 struct vidsrc_st {
 	int fd;
-	pthread_t thread;
+	struct mthread *thread;
 	bool run;
 	struct vidsz sz;
 	u_int32_t pixfmt;
-	struct buffer *buffers;
-	unsigned int   n_buffers;
+	bool passthrough;
+	struct bufpool *pool;
 	vidsrc_frame_h *frameh;
+	vidsrc_packet_h *packeth;
 	void *arg;
+
+	uint64_t n_frames;
+	uint64_t n_stalls;
 };
 
 
 static struct vidsrc *vidsrc;
 
+static struct {
+	uint32_t buffers;
+	bool passthrough;
+} v4l2 = {
+	4,
+	false
+};
+
 
 static enum vidfmt match_fmt(u_int32_t fmt)
 {
@@ -139,13 +189,73 @@ static int xioctl(int fd, unsigned long int request, void *arg)
 }
 
 
+/* Check if a compressed device format can be sent with the codec */
+static bool passthrough_fmt(u_int32_t fmt, const char *codec)
+{
+	switch (fmt) {
+
+#ifdef V4L2_PIX_FMT_H264
+	case V4L2_PIX_FMT_H264:  return 0 == str_casecmp(codec, "H264");
+#endif
+	default:                 return false;
+	}
+}
+
+
+static void pool_destructor(void *arg)
+{
+	struct bufpool *pool = arg;
+	unsigned int i;
+
+	for (i=0; i<pool->n_buffers; ++i) {
+		v4l2_munmap(pool->buffers[i].start, pool->buffers[i].length);
+	}
+
+	mem_deref(pool->buffers);
+
+	if (pool->fd >= 0)
+		v4l2_close(pool->fd);
+
+	mem_deref(pool->lock);
+}
+
+
+static void frame_destructor(void *arg)
+{
+	struct v4l2_frame *vf = arg;
+	struct bufpool *pool = vf->pool;
+
+	lock_write_get(pool->lock);
+
+	if (pool->streaming) {
+		struct v4l2_buffer buf;
+
+		memset(&buf, 0, sizeof(buf));
+
+		buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+		buf.memory = V4L2_MEMORY_MMAP;
+		buf.index  = vf->index;
+
+		if (-1 == xioctl(pool->fd, VIDIOC_QBUF, &buf))
+			warning("v4l2: VIDIOC_QBUF: %m\n", errno);
+	}
+
+	--pool->n_out;
+
+	lock_rel(pool->lock);
+
+	mem_deref(pool);
+}
+
+
 static int init_mmap(struct vidsrc_st *st, const char *dev_name)
 {
+	struct bufpool *pool = st->pool;
 	struct v4l2_requestbuffers req;
 
 	memset(&req, 0, sizeof(req));
 
-	req.count  = 4;
+	req.count  = v4l2.buffers;
 	req.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 	req.memory = V4L2_MEMORY_MMAP;
 
@@ -160,38 +270,44 @@ static int init_mmap(struct vidsrc_st *st, const char *dev_name)
 		}
 	}
 
-	if (req.count < 2) {
+	if (req.count < BUFFERS_MIN) {
 		warning("v4l2: Insufficient buffer memory on %s\n", dev_name);
 		return ENOMEM;
 	}
 
-	st->buffers = mem_zalloc(req.count * sizeof(*st->buffers), NULL);
-	if (!st->buffers)
+	if (req.count != v4l2.buffers) {
+		info("v4l2: %s: using %u buffers (requested %u)\n",
+		     dev_name, req.count, v4l2.buffers);
+	}
+
+	pool->buffers = mem_zalloc(req.count * sizeof(*pool->buffers), NULL);
+	if (!pool->buffers)
 		return ENOMEM;
 
-	for (st->n_buffers = 0; st->n_buffers<req.count; ++st->n_buffers) {
+	for (pool->n_buffers = 0; pool->n_buffers<req.count;
+	     ++pool->n_buffers) {
+		struct buffer *b = &pool->buffers[pool->n_buffers];
 		struct v4l2_buffer buf;
 
 		memset(&buf, 0, sizeof(buf));
 
 		buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 		buf.memory = V4L2_MEMORY_MMAP;
-		buf.index  = st->n_buffers;
+		buf.index  = pool->n_buffers;
 
 		if (-1 == xioctl(st->fd, VIDIOC_QUERYBUF, &buf)) {
 			warning("v4l2: VIDIOC_QUERYBUF\n");
 			return errno;
 		}
 
-		st->buffers[st->n_buffers].length = buf.length;
-		st->buffers[st->n_buffers].start =
-			v4l2_mmap(NULL /* start anywhere */,
-				  buf.length,
-				  PROT_READ | PROT_WRITE /* required */,
-				  MAP_SHARED /* recommended */,
-				  st->fd, buf.m.offset);
+		b->length = buf.length;
+		b->start  = v4l2_mmap(NULL /* start anywhere */,
+				      buf.length,
+				      PROT_READ | PROT_WRITE /* required */,
+				      MAP_SHARED /* recommended */,
+				      st->fd, buf.m.offset);
 
-		if (MAP_FAILED == st->buffers[st->n_buffers].start) {
+		if (MAP_FAILED == b->start) {
 			warning("v4l2: mmap failed\n");
 			return ENODEV;
 		}
@@ -202,7 +318,7 @@ static int init_mmap(struct vidsrc_st *st, const char *dev_name)
 
 
 static int v4l2_init_device(struct vidsrc_st *st, const char *dev_name,
-			    int width, int height)
+			    int width, int height, const char *codec)
 {
 	struct v4l2_capability cap;
 	struct v4l2_format fmt;
@@ -237,8 +353,24 @@ static int v4l2_init_device(struct vidsrc_st *st, const char *dev_name,
 	memset(&fmts, 0, sizeof(fmts));
 
 	fmts.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-	for (fmts.index=0; !v4l2_ioctl(st->fd, VIDIOC_ENUM_FMT, &fmts);
-			fmts.index++) {
+
+	/* Prefer the encoder format, if it can be passed through */
+	if (v4l2.passthrough && st->packeth && str_isset(codec)) {
+
+		for (fmts.index=0;
+		     !v4l2_ioctl(st->fd, VIDIOC_ENUM_FMT, &fmts);
+		     fmts.index++) {
+			if (passthrough_fmt(fmts.pixelformat, codec)) {
+				st->pixfmt = fmts.pixelformat;
+				st->passthrough = true;
+				break;
+			}
+		}
+	}
+
+	for (fmts.index=0;
+	     !st->pixfmt && !v4l2_ioctl(st->fd, VIDIOC_ENUM_FMT, &fmts);
+	     fmts.index++) {
 		if (match_fmt(fmts.pixelformat) != VID_FMT_N) {
 			st->pixfmt = fmts.pixelformat;
 			break;
@@ -290,9 +422,10 @@ static int v4l2_init_device(struct vidsrc_st *st, const char *dev_name,
 		return ENODEV;
 	}
 
-	info("v4l2: %s: found valid V4L2 device (%u x %u) pixfmt=%c%c%c%c\n",
+	info("v4l2: %s: found valid V4L2 device (%u x %u) pixfmt=%c%c%c%c%s\n",
 	       dev_name, fmt.fmt.pix.width, fmt.fmt.pix.height,
-	       pix[0], pix[1], pix[2], pix[3]);
+	       pix[0], pix[1], pix[2], pix[3],
+	       st->passthrough ? " (pass-through)" : "");
 
 	return 0;
 }
@@ -307,20 +440,10 @@ static void stop_capturing(struct vidsrc_st *st)
 
 	type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
 
+	lock_write_get(st->pool->lock);
 	xioctl(st->fd, VIDIOC_STREAMOFF, &type);
-}
-
-
-static void uninit_device(struct vidsrc_st *st)
-{
-	unsigned int i;
-
-	for (i=0; i<st->n_buffers; ++i) {
-		v4l2_munmap(st->buffers[i].start, st->buffers[i].length);
-	}
-
-	st->buffers = mem_deref(st->buffers);
-	st->n_buffers = 0;
+	st->pool->streaming = false;
+	lock_rel(st->pool->lock);
 }
 
 
@@ -329,7 +452,7 @@ static int start_capturing(struct vidsrc_st *st)
 	unsigned int i;
 	enum v4l2_buf_type type;
 
-	for (i = 0; i < st->n_buffers; ++i) {
+	for (i = 0; i < st->pool->n_buffers; ++i) {
 		struct v4l2_buffer buf;
 
 		memset(&buf, 0, sizeof(buf));
@@ -347,26 +470,55 @@ static int start_capturing(struct vidsrc_st *st)
 	if (-1 == xioctl (st->fd, VIDIOC_STREAMON, &type))
 		return errno;
 
+	st->pool->streaming = true;
+
 	return 0;
 }
 
 
-static void call_frame_handler(struct vidsrc_st *st, uint8_t *buf,
+static void call_frame_handler(struct vidsrc_st *st, struct v4l2_frame *vf,
+			       const struct v4l2_buffer *buf,
 			       uint64_t timestamp)
 {
-	struct vidframe frame;
+	uint8_t *start = st->pool->buffers[buf->index].start;
+
+	if (st->passthrough) {
+		struct vidpacket packet;
 
-	vidframe_init_buf(&frame, match_fmt(st->pixfmt), &st->sz, buf);
+		packet.buf       = start;
+		packet.size      = buf->bytesused;
+		packet.timestamp = timestamp;
 
-	st->frameh(&frame, timestamp, st->arg);
+		st->packeth(&packet, st->arg);
+	}
+	else {
+		vidframe_init_buf(&vf->frame, match_fmt(st->pixfmt), &st->sz,
+				  start);
+
+		st->frameh(&vf->frame, timestamp, st->arg);
+	}
 }
 
 
 static int read_frame(struct vidsrc_st *st)
 {
+	struct bufpool *pool = st->pool;
+	struct v4l2_frame *vf;
 	struct v4l2_buffer buf;
 	struct timeval ts;
 	uint64_t timestamp;
+	bool stall;
+
+	/* all buffers are held by the consumers */
+	lock_read_get(pool->lock);
+	stall = pool->n_out >= pool->n_buffers;
+	lock_rel(pool->lock);
+
+	if (stall) {
+		++st->n_stalls;
+		sys_msleep(4);
+		return 0;
+	}
 
 	memset(&buf, 0, sizeof(buf));
 
@@ -390,21 +542,39 @@ static int read_frame(struct vidsrc_st *st)
 		}
 	}
 
-	if (buf.index >= st->n_buffers) {
+	if (buf.index >= pool->n_buffers) {
 		warning("v4l2: index >= n_buffers\n");
+		return EINVAL;
 	}
 
 	ts = buf.timestamp;
 	timestamp = 1000000U * ts.tv_sec + ts.tv_usec;
 	timestamp = timestamp * VIDEO_TIMEBASE / 1000000U;
 
-	call_frame_handler(st, st->buffers[buf.index].start, timestamp);
+	/* the buffer is queued again when the frame is released */
+	vf = mem_zalloc(sizeof(*vf), frame_destructor);
+	if (!vf) {
+		if (-1 == xioctl (st->fd, VIDIOC_QBUF, &buf)) {
+			warning("v4l2: VIDIOC_QBUF\n");
+			return errno;
+		}
 
-	if (-1 == xioctl (st->fd, VIDIOC_QBUF, &buf)) {
-		warning("v4l2: VIDIOC_QBUF\n");
-		return errno;
+		return ENOMEM;
 	}
 
+	lock_write_get(pool->lock);
+	++pool->n_out;
+	lock_rel(pool->lock);
+
+	vf->pool  = mem_ref(pool);
+	vf->index = buf.index;
+
+	++st->n_frames;
+
+	call_frame_handler(st, vf, &buf, timestamp);
+
+	mem_deref(vf);
+
 	return 0;
 }
 
@@ -435,12 +605,26 @@ static int set_available_devices(struct list* dev_list)
 
 static int vd_open(struct vidsrc_st *st, const char *device)
 {
+	int err;
+
+	st->pool = mem_zalloc(sizeof(*st->pool), pool_destructor);
+	if (!st->pool)
+		return ENOMEM;
+
+	st->pool->fd = -1;
+
+	err = lock_alloc(&st->pool->lock);
+	if (err)
+		return err;
+
 	st->fd = v4l2_open(device, O_RDWR);
 	if (st->fd < 0) {
 		warning("v4l2: open %s: %m\n", device, errno);
 		return errno;
 	}
 
+	st->pool->fd = st->fd;
+
 	return 0;
 }
 
@@ -449,18 +633,19 @@ static void destructor(void *arg)
 {
 	struct vidsrc_st *st = arg;
 
-	debug("v4l2: stopping video source..\n");
+	debug("v4l2: stopping video source.. (frames=%llu stalls=%llu)\n",
+	      st->n_frames, st->n_stalls);
 
 	if (st->run) {
 		st->run = false;
-		pthread_join(st->thread, NULL);
+		st->thread = mem_deref(st->thread);
 	}
 
-	stop_capturing(st);
-	uninit_device(st);
+	if (st->pool && st->pool->lock)
+		stop_capturing(st);
 
-	if (st->fd >= 0)
-		v4l2_close(st->fd);
+	/* NOTE: buffers and fd are released with the last frame */
+	mem_deref(st->pool);
 }
 
 
@@ -493,8 +678,6 @@ static int alloc(struct vidsrc_st **stp, const struct vidsrc *vs,
 
 	(void)ctx;
 	(void)prm;
-	(void)fmt;
-	(void)packeth;
 	(void)errorh;
 
 	if (!stp || !size || !frameh)
@@ -517,15 +700,16 @@ static int alloc(struct vidsrc_st **stp, const struct vidsrc *vs,
 
 	st->fd = -1;
 	st->sz = *size;
-	st->frameh = frameh;
-	st->arg    = arg;
-	st->pixfmt = 0;
+	st->frameh  = frameh;
+	st->packeth = packeth;
+	st->arg     = arg;
+	st->pixfmt  = 0;
 
 	err = vd_open(st, dev);
 	if (err)
 		goto out;
 
-	err = v4l2_init_device(st, dev, size->w, size->h);
+	err = v4l2_init_device(st, dev, size->w, size->h, fmt);
 	if (err)
 		goto out;
 
@@ -538,7 +722,8 @@ static int alloc(struct vidsrc_st **stp, const struct vidsrc *vs,
 		goto out;
 
 	st->run = true;
-	err = pthread_create(&st->thread, NULL, read_thread, st);
+	err = mthread_create(&st->thread, MTHREAD_VIDEO_SRC,
+			     "v4l2", read_thread, st);
 	if (err) {
 		st->run = false;
 		goto out;
@@ -558,6 +743,11 @@ static int v4l_init(void)
 {
 	int err;
 
+	(void)conf_get_u32(conf_cur(), "v4l2_buffers", &v4l2.buffers);
+	(void)conf_get_bool(conf_cur(), "v4l2_passthrough", &v4l2.passthrough);
+
+	v4l2.buffers = min(max(v4l2.buffers, BUFFERS_MIN), BUFFERS_MAX);
+
 	err = vidsrc_register(&vidsrc, baresip_vidsrcl(),
 			       "v4l2", alloc, NULL);
 	if (err)
@@ -8,5 +8,9 @@ MOD		:= x11grab
 $(MOD)_SRCS	+= x11grab.c
 $(MOD)_LFLAGS	+= -lX11 -lXext
 $(MOD)_CFLAGS	+= -Wno-variadic-macros
+ifneq ($(HAVE_XDAMAGE),)
+$(MOD)_LFLAGS	+= -lXdamage
+$(MOD)_CFLAGS	+= -DHAVE_XDAMAGE
+endif
 
 include mk/mod.mk
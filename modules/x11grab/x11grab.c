@@ -11,7 +11,12 @@
 #endif
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
-#include <pthread.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+#include <X11/extensions/XShm.h>
+#ifdef HAVE_XDAMAGE
+#include <X11/extensions/Xdamage.h>
+#endif
 #include <re.h>
 #include <rem.h>
 #include <baresip.h>
@@ -22,24 +27,199 @@
  *
  * X11 window-grabbing video-source module
  *
+ * The screen is grabbed into a persistent MIT-SHM segment if the X server
+ * supports it, otherwise the module falls back to XGetSubImage().
+ *
+ * If built with the XDamage extension, unchanged frames can be skipped.
+ * The last frame is then repeated once per second to keep the
+ * encoder going.
+ *
+ * Example config:
+ \verbatim
+  x11grab_shm       yes    # use MIT-SHM if available
+  x11grab_damage    no     # skip unchanged frames (requires XDamage)
+ \endverbatim
  */
 
 
+enum {
+	KEEPALIVE_INTERVAL = 1000,  /* Repeat unchanged frames [ms] */
+};
+
+
 struct vidsrc_st {
 	Display *disp;
+	Window root;
 	XImage *image;
-	pthread_t thread;
+	XShmSegmentInfo shm;
+	bool xshmat;
+#ifdef HAVE_XDAMAGE
+	Damage damage;
+	int damage_event;
+	bool damaged;
+#endif
+	struct mthread *thread;
 	bool run;
 	int fps;
 	struct vidsz size;
 	enum vidfmt pixfmt;
 	vidsrc_frame_h *frameh;
 	void *arg;
+
+	uint64_t n_grab;
+	uint64_t n_skip;
 };
 
 
 static struct vidsrc *vidsrc;
 
+static struct {
+	bool shm;
+	bool damage;
+	int shm_error;
+	int (*errorh) (Display *, XErrorEvent *);
+} x11grab = {
+	true,
+	false,
+	0,
+	NULL
+};
+
+
+/*
+ * NOTE: Global handler, installed once by the module. It catches the
+ * BadAccess from XShmAttach() when the X server cannot attach to the
+ * segment, e.g. a remote display, and forwards all other errors.
+ */
+static int error_handler(Display *d, XErrorEvent *e)
+{
+	if (e->error_code == BadAccess)
+		x11grab.shm_error = 1;
+	else if (x11grab.errorh)
+		return x11grab.errorh(d, e);
+
+	return 0;
+}
+
+
+static void shm_detach(struct vidsrc_st *st)
+{
+	if (st->xshmat) {
+		XShmDetach(st->disp, &st->shm);
+		st->xshmat = false;
+	}
+
+	if (st->image) {
+		st->image->data = NULL;
+		XDestroyImage(st->image);
+		st->image = NULL;
+	}
+
+	if (st->shm.shmaddr != (char *)-1) {
+		shmdt(st->shm.shmaddr);
+		st->shm.shmaddr = (char *)-1;
+	}
+}
+
+
+static int shm_attach(struct vidsrc_st *st, const struct vidsz *sz)
+{
+	const int screen = DefaultScreen(st->disp);
+
+	st->image = XShmCreateImage(st->disp, DefaultVisual(st->disp, screen),
+				    DefaultDepth(st->disp, screen), ZPixmap,
+				    NULL, &st->shm, sz->w, sz->h);
+	if (!st->image) {
+		warning("x11grab: failed to create shm image\n");
+		return ENOMEM;
+	}
+
+	st->shm.shmid = shmget(IPC_PRIVATE,
+			       st->image->bytes_per_line * st->image->height,
+			       IPC_CREAT | 0600);
+	if (st->shm.shmid < 0) {
+		warning("x11grab: failed to allocate shared memory\n");
+		return ENOMEM;
+	}
+
+	st->shm.shmaddr = shmat(st->shm.shmid, NULL, 0);
+
+	/* the segment is removed when both sides have detached */
+	shmctl(st->shm.shmid, IPC_RMID, NULL);
+
+	if (st->shm.shmaddr == (char *)-1) {
+		warning("x11grab: failed to attach to shared memory\n");
+		return ENOMEM;
+	}
+
+	st->image->data = st->shm.shmaddr;
+	st->shm.readOnly = False;
+
+	x11grab.shm_error = 0;
+
+	if (!XShmAttach(st->disp, &st->shm))
+		x11grab.shm_error = 1;
+
+	XSync(st->disp, False);
+
+	if (x11grab.shm_error) {
+		warning("x11grab: failed to attach X to shared memory\n");
+		return ENODEV;
+	}
+
+	st->xshmat = true;
+
+	return 0;
+}
+
+
+#ifdef HAVE_XDAMAGE
+static void damage_open(struct vidsrc_st *st)
+{
+	int error_base;
+
+	if (!XDamageQueryExtension(st->disp, &st->damage_event, &error_base)) {
+		info("x11grab: no damage extension\n");
+		return;
+	}
+
+	st->damage  = XDamageCreate(st->disp, st->root,
+				    XDamageReportNonEmpty);
+	st->damaged = true;
+
+	info("x11grab: damage tracking enabled\n");
+}
+
+
+/* Returns true if the screen has changed since the last grab */
+static bool damage_poll(struct vidsrc_st *st)
+{
+	bool damaged;
+
+	if (!st->damage)
+		return true;
+
+	while (XPending(st->disp)) {
+
+		XEvent ev;
+
+		XNextEvent(st->disp, &ev);
+
+		if (ev.type == st->damage_event + XDamageNotify)
+			st->damaged = true;
+	}
+
+	damaged = st->damaged;
+
+	if (damaged) {
+		XDamageSubtract(st->disp, st->damage, None, None);
+		st->damaged = false;
+	}
+
+	return damaged;
+}
+#endif
+
 
 static int x11grab_open(struct vidsrc_st *st, const struct vidsz *sz,
 			const char *dev)
@@ -52,12 +232,27 @@ static int x11grab_open(struct vidsrc_st *st, const struct vidsz *sz,
 		return ENODEV;
 	}
 
-	st->image = XGetImage(st->disp,
-			      RootWindow(st->disp, DefaultScreen(st->disp)),
-			      x, y, sz->w, sz->h, AllPlanes, ZPixmap);
-	if (!st->image) {
-		warning("x11grab: error creating Ximage\n");
-		return ENODEV;
+	st->root = RootWindow(st->disp, DefaultScreen(st->disp));
+
+	if (x11grab.shm && XShmQueryExtension(st->disp)) {
+
+		if (shm_attach(st, sz)) {
+			info("x11grab: shared memory disabled\n");
+			shm_detach(st);
+		}
+		else {
+			info("x11grab: shared memory enabled\n");
+		}
+	}
+
+	if (!st->xshmat) {
+
+		st->image = XGetImage(st->disp, st->root,
+				      x, y, sz->w, sz->h, AllPlanes, ZPixmap);
+		if (!st->image) {
+			warning("x11grab: error creating Ximage\n");
+			return ENODEV;
+		}
 	}
 
 	switch (st->image->bits_per_pixel) {
@@ -72,6 +267,11 @@ static int x11grab_open(struct vidsrc_st *st, const struct vidsz *sz,
 		return ENOSYS;
 	}
 
+#ifdef HAVE_XDAMAGE
+	if (x11grab.damage)
+		damage_open(st);
+#endif
+
 	return 0;
 }
 
@@ -81,8 +281,15 @@ static inline uint8_t *x11grab_read(struct vidsrc_st *st)
 	const int x = 0, y = 0;
 	XImage *im;
 
-	im = XGetSubImage(st->disp,
-			  RootWindow(st->disp, DefaultScreen(st->disp)),
+	if (st->xshmat) {
+		if (!XShmGetImage(st->disp, st->root, st->image,
+				  x, y, AllPlanes))
+			return NULL;
+
+		return (uint8_t *)st->image->data;
+	}
+
+	im = XGetSubImage(st->disp, st->root,
 			  x, y, st->size.w, st->size.h, AllPlanes, ZPixmap,
 			  st->image, 0, 0);
 	if (!im)
@@ -107,23 +314,39 @@ static void *read_thread(void *arg)
 {
 	struct vidsrc_st *st = arg;
 	uint64_t ts = tmr_jiffies();
-	uint8_t *buf;
+	uint64_t last = 0;
+	uint8_t *buf = NULL;
 
 	while (st->run) {
 
 		uint64_t timestamp;
+		bool grab = true;
 
 		if (tmr_jiffies() < ts) {
 			sys_msleep(4);
 			continue;
 		}
 
-		buf = x11grab_read(st);
-		if (!buf)
+#ifdef HAVE_XDAMAGE
+		grab = damage_poll(st);
+#endif
+
+		if (grab || !buf) {
+			buf = x11grab_read(st);
+			if (!buf)
+				continue;
+
+			++st->n_grab;
+		}
+		else if (ts < last + KEEPALIVE_INTERVAL) {
+			ts += (1000/st->fps);
+			++st->n_skip;
 			continue;
+		}
 
 		timestamp = ts * VIDEO_TIMEBASE / 1000;
 
+		last = ts;
 		ts += (1000/st->fps);
 
 		call_frame_handler(st, buf, timestamp);
@@ -139,10 +362,20 @@ static void destructor(void *arg)
 
 	if (st->run) {
 		st->run = false;
-		pthread_join(st->thread, NULL);
+		st->thread = mem_deref(st->thread);
 	}
 
-	if (st->image)
+	debug("x11grab: frames grabbed=%llu skipped=%llu\n",
+	      st->n_grab, st->n_skip);
+
+#ifdef HAVE_XDAMAGE
+	if (st->damage)
+		XDamageDestroy(st->disp, st->damage);
+#endif
+
+	if (st->xshmat)
+		shm_detach(st);
+	else if (st->image)
 		XDestroyImage(st->image);
 
 	if (st->disp)
@@ -173,6 +406,7 @@ static int alloc(struct vidsrc_st **stp, const struct vidsrc *vs,
 	if (!st)
 		return ENOMEM;
 
+	st->shm.shmaddr = (char *)-1;
 	st->size   = *size;
 	st->fps    = prm->fps;
 	st->frameh = frameh;
@@ -183,7 +417,8 @@ static int alloc(struct vidsrc_st **stp, const struct vidsrc *vs,
 		goto out;
 
 	st->run = true;
-	err = pthread_create(&st->thread, NULL, read_thread, st);
+	err = mthread_create(&st->thread, MTHREAD_VIDEO_SRC,
+			     "x11grab", read_thread, st);
 	if (err) {
 		st->run = false;
 		goto out;
@@ -201,6 +436,17 @@ static int alloc(struct vidsrc_st **stp, const struct vidsrc *vs,
 
 static int x11grab_init(void)
 {
+	(void)conf_get_bool(conf_cur(), "x11grab_shm", &x11grab.shm);
+	(void)conf_get_bool(conf_cur(), "x11grab_damage", &x11grab.damage);
+
+#ifndef HAVE_XDAMAGE
+	if (x11grab.damage)
+		warning("x11grab: built without XDamage support\n");
+#endif
+
+	if (x11grab.shm)
+		x11grab.errorh = XSetErrorHandler(error_handler);
+
 	return vidsrc_register(&vidsrc, baresip_vidsrcl(),
 			       "x11grab", alloc, NULL);
 }
@@ -209,6 +455,12 @@ static int x11grab_init(void)
 static int x11grab_close(void)
 {
 	vidsrc = mem_deref(vidsrc);
+
+	if (x11grab.shm) {
+		XSetErrorHandler(x11grab.errorh);
+		x11grab.errorh = NULL;
+	}
+
 	return 0;
 }
 
@@ -12,9 +12,29 @@
 
 enum {
 	REG_INTERVAL    = 3600,
+	CODEC_CACHE_MAX = 16,
+	CODEC_HASH_SIZE = 64,
 };
 
 
+/** Resolved codec list, shared by accounts with identical settings */
+struct codec_cache {
+	struct le he;                 /**< Hash element                      */
+	char *spec;                   /**< Codec list parameter value        */
+	bool video;                   /**< Video codecs, otherwise audio     */
+	unsigned n;                   /**< Number of codecs                  */
+	void *codecv[CODEC_CACHE_MAX]; /**< Codec pointers                   */
+};
+
+
+/** Codec lists interned during bulk provisioning */
+static struct {
+	struct hash *ht;              /**< Codec lists by parameter value    */
+	uint32_t n;                   /**< Number of interned codec lists    */
+	uint32_t hits;                /**< Codec lists reused                */
+} bulk;
+
+
 static void destructor(void *arg)
 {
 	struct account *acc = arg;
@@ -305,6 +325,80 @@ static int csl_parse(struct pl *pl, char *str, size_t sz)
 }
 
 
+static void codec_cache_destructor(void *arg)
+{
+	struct codec_cache *cc = arg;
+
+	hash_unlink(&cc->he);
+	mem_deref(cc->spec);
+}
+
+
+static bool codec_cache_cmp(struct le *le, void *arg)
+{
+	const struct codec_cache *cc = le->data;
+	const struct codec_cache *key = arg;
+
+	return cc->video == key->video && 0 == str_cmp(cc->spec, key->spec);
+}
+
+
+/* Use an interned codec list, only valid while provisioning in bulk */
+static bool codec_cache_apply(struct list *lst, struct le *lev, size_t levc,
+			      const struct pl *spec, bool video)
+{
+	struct codec_cache key, *cc;
+	char buf[256];
+	unsigned i;
+
+	if (!bulk.ht || pl_strcpy(spec, buf, sizeof(buf)))
+		return false;
+
+	key.spec  = buf;
+	key.video = video;
+
+	cc = list_ledata(hash_lookup(bulk.ht, hash_joaat_pl(spec),
+				     codec_cache_cmp, &key));
+	if (!cc)
+		return false;
+
+	for (i=0; i<cc->n && i<levc; i++)
+		list_append(lst, &lev[i], cc->codecv[i]);
+
+	++bulk.hits;
+
+	return true;
+}
+
+
+static void codec_cache_add(const struct list *lst, const struct pl *spec,
+			    bool video)
+{
+	struct codec_cache *cc;
+	struct le *le;
+
+	if (!bulk.ht)
+		return;
+
+	cc = mem_zalloc(sizeof(*cc), codec_cache_destructor);
+	if (!cc)
+		return;
+
+	if (pl_strdup(&cc->spec, spec)) {
+		mem_deref(cc);
+		return;
+	}
+
+	cc->video = video;
+
+	for (le = list_head(lst); le && cc->n < CODEC_CACHE_MAX; le = le->next)
+		cc->codecv[cc->n++] = le->data;
+
+	hash_append(bulk.ht, hash_joaat_pl(spec), &cc->he, cc);
+	++bulk.n;
+}
+
+
 static int audio_codecs_decode(struct account *acc, const struct pl *prm)
 {
 	struct list *aucodecl = baresip_aucodecl();
@@ -316,13 +410,18 @@ static int audio_codecs_decode(struct account *acc, const struct pl *prm)
 	list_init(&acc->aucodecl);
 
 	if (0 == msg_param_exists(prm, "audio_codecs", &tmp)) {
-		struct pl acs;
+		struct pl acs, spec;
 		char cname[64];
 		unsigned i = 0;
 
 		if (msg_param_decode(prm, "audio_codecs", &acs))
 			return 0;
 
+		spec = acs;
+		if (codec_cache_apply(&acc->aucodecl, acc->acv,
+				      ARRAY_SIZE(acc->acv), &spec, false))
+			return 0;
+
 		while (0 == csl_parse(&acs, cname, sizeof(cname))) {
 			struct aucodec *ac;
 			struct pl pl_cname, pl_srate, pl_ch = PL_INIT;
@@ -356,6 +455,8 @@ static int audio_codecs_decode(struct account *acc, const struct pl *prm)
 			if (i >= ARRAY_SIZE(acc->acv))
 				break;
 		}
+
+		codec_cache_add(&acc->aucodecl, &spec, false);
 	}
 
 	return 0;
@@ -373,14 +474,20 @@ static int video_codecs_decode(struct account *acc, const struct pl *prm)
 	list_init(&acc->vidcodecl);
 
 	if (0 == msg_param_exists(prm, "video_codecs", &tmp)) {
-		struct pl vcs;
+		struct pl vcs, spec;
 		char cname[64];
 		unsigned i = 0;
 
 		if (msg_param_decode(prm, "video_codecs", &vcs))
 			return 0;
 
-		while (0 == csl_parse(&vcs, cname, sizeof(cname))) {
+		spec = vcs;
+		if (codec_cache_apply(&acc->vidcodecl, acc->vcv,
+				      ARRAY_SIZE(acc->vcv), &spec, true))
+			return 0;
+
+		while (i < ARRAY_SIZE(acc->vcv) &&
+		       0 == csl_parse(&vcs, cname, sizeof(cname))) {
 			struct le *le;
 
 			for (le=list_head(vidcodecl); le; le=le->next) {
@@ -394,9 +501,11 @@ static int video_codecs_decode(struct account *acc, const struct pl *prm)
 						vc);
 
 				if (i >= ARRAY_SIZE(acc->vcv))
-					return 0;
+					break;
 			}
 		}
+
+		codec_cache_add(&acc->vidcodecl, &spec, true);
 	}
 
 	return 0;
@@ -480,6 +589,34 @@ static int encode_uri_user(struct re_printf *pf, const struct uri *uri)
 }
 
 
+/**
+ * Get the Address-of-Record of a sip address string, without creating
+ * the account
+ *
+ * @param aorp     Pointer to allocated Address-of-Record
+ * @param sipaddr  SIP address with parameters
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int account_aor_decode(char **aorp, const char *sipaddr)
+{
+	struct sip_addr addr;
+	struct pl pl;
+	int err;
+
+	if (!aorp || !sipaddr)
+		return EINVAL;
+
+	pl_set_str(&pl, sipaddr);
+
+	err = sip_addr_decode(&addr, &pl);
+	if (err)
+		return err;
+
+	return re_sdprintf(aorp, "%H", encode_uri_user, &addr.uri);
+}
+
+
 /**
  * Create a SIP account from a sip address string
  *
@@ -584,6 +721,43 @@ int account_alloc(struct account **accp, const char *sipaddr)
 }
 
 
+/**
+ * Start bulk provisioning of accounts. Until account_bulk_end() is called,
+ * the resolved codec lists are interned and shared between the accounts
+ * with identical codec settings.
+ *
+ * NOTE: Codec modules must not be unloaded during bulk provisioning
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int account_bulk_begin(void)
+{
+	if (bulk.ht)
+		return EALREADY;
+
+	bulk.n    = 0;
+	bulk.hits = 0;
+
+	return hash_alloc(&bulk.ht, CODEC_HASH_SIZE);
+}
+
+
+/**
+ * End bulk provisioning of accounts and flush the interned codec lists
+ */
+void account_bulk_end(void)
+{
+	if (!bulk.ht)
+		return;
+
+	debug("account: bulk: %u codec lists, %u reused\n",
+	      bulk.n, bulk.hits);
+
+	hash_flush(bulk.ht);
+	bulk.ht = mem_deref(bulk.ht);
+}
+
+
 /**
  * Set the authentication user for a SIP account
  *
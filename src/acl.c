@@ -0,0 +1,806 @@
+/**
+ * @file acl.c  Call-screening access control list
+ *
+ * Copyright (C) 2010 Alfred E. Heggestad
+ */
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/**
+ * \page CallAcl Call-screening access control list
+ *
+ * Incoming calls are screened against a list of rules, loaded from the
+ * file set by the config item call_acl. One rule per line:
+ *
+ *<pre>
+ *   # action  pattern
+ *   block     sip:+1900*@*               user prefix, any domain
+ *   block     sip:+4420*@example.com     user prefix, one domain
+ *   allow     sip:alice@example.com      exact match
+ *   allow     sip:1234@*                 exact user, any domain
+ *   block     sip:*@spam.example.com     domain
+ *   block     sip:*@*.spam.net           sub-domains of spam.net
+ *   block     ~666@                      regex on "user@host"
+ *   allow     sip:*@*                    default
+ *</pre>
+ *
+ * The rules are compiled into a hash table of exact matches, a trie of
+ * user prefixes and a hash table of domains, so that a check takes time
+ * in the order of the length of the URI, regardless of the number of
+ * rules. The regex rules (re_regex syntax) are only tried if no other
+ * rule matched. The first matching class of rules wins:
+ *
+ *   exact, longest user prefix, longest domain, regex, default
+ *
+ * The domain part is compared case-insensitive. The current list is
+ * replaced atomically on reload, so a broken file keeps the old rules.
+ */
+
+
+enum {
+	HASH_SIZE  = 256,
+	URI_MAX    = 512,
+	LINE_SIZE  = 1024,    /**< Max. length of a line in the file */
+	REGEX_SETS = 8,       /**< Max. character sets in a regex   */
+};
+
+enum rule_type {
+	RULE_EXACT,           /**< user@host                        */
+	RULE_PREFIX,          /**< user-prefix*@domain or user@*    */
+	RULE_DOMAIN,          /**< *@domain or *@*.domain           */
+	RULE_REGEX,           /**< ~regex                           */
+	RULE_ANY,             /**< *@*                              */
+};
+
+struct acl_rule {
+	struct le le;         /**< Member of rule list, file order  */
+	struct le he;         /**< Member of hash, trie or regexl   */
+	enum rule_type type;
+	enum acl_action action;
+	char *pattern;        /**< Pattern as written               */
+	char *key;            /**< Compiled key                     */
+	char *host;           /**< Domain of prefix rules, or NULL  */
+	bool suffix;          /**< Host is a sub-domain suffix      */
+	bool full;            /**< Prefix rule must match all user  */
+	uint32_t line;        /**< Line number in the file          */
+	uint64_t hits;        /**< Number of matches                */
+};
+
+struct trie_node {
+	struct le le;         /**< Member of parent's child list    */
+	struct list childl;   /**< Child nodes                      */
+	struct list rulel;    /**< Prefix rules ending here         */
+	char c;               /**< Character of this node           */
+};
+
+/** Access control list */
+struct acl {
+	struct list rulel;        /**< All rules in file order       */
+	struct hash *exact;       /**< Exact rules, by user@host     */
+	struct hash *domain;      /**< Domain rules, by domain       */
+	struct trie_node *root;   /**< User prefix rules             */
+	struct list regexl;       /**< Regex rules                   */
+	struct acl_rule *any;     /**< Default rule                  */
+	uint32_t rulec;           /**< Number of rules               */
+	uint32_t n_exact;         /**< Number of exact rules         */
+	uint32_t n_domain;        /**< Number of domain rules        */
+	uint32_t nodes;           /**< Number of trie nodes          */
+	uint64_t n_check;         /**< Number of checks              */
+	uint64_t n_nomatch;       /**< Checks without a match        */
+};
+
+
+static struct acl *acl_cur;  /**< Current call-screening list */
+
+
+static const char *action_name(enum acl_action action)
+{
+	switch (action) {
+
+	case ACL_ALLOW: return "allow";
+	case ACL_BLOCK: return "block";
+	default:        return "none";
+	}
+}
+
+
+static const char *type_name(enum rule_type type)
+{
+	switch (type) {
+
+	case RULE_EXACT:  return "exact";
+	case RULE_PREFIX: return "prefix";
+	case RULE_DOMAIN: return "domain";
+	case RULE_REGEX:  return "regex";
+	case RULE_ANY:    return "default";
+	default:          return "???";
+	}
+}
+
+
+static void rule_destructor(void *arg)
+{
+	struct acl_rule *r = arg;
+
+	list_unlink(&r->le);
+	list_unlink(&r->he);
+	mem_deref(r->pattern);
+	mem_deref(r->key);
+	mem_deref(r->host);
+}
+
+
+static void node_destructor(void *arg)
+{
+	struct trie_node *n = arg;
+
+	list_flush(&n->childl);
+	list_unlink(&n->le);
+}
+
+
+static void acl_destructor(void *arg)
+{
+	struct acl *acl = arg;
+
+	list_flush(&acl->rulel);
+	mem_deref(acl->root);
+	mem_deref(acl->exact);
+	mem_deref(acl->domain);
+}
+
+
+static int lower_dup(char **dst, const struct pl *pl)
+{
+	size_t i;
+	int err;
+
+	err = pl_strdup(dst, pl);
+	if (err)
+		return err;
+
+	for (i=0; i<pl->l; i++)
+		(*dst)[i] = tolower((unsigned char)(*dst)[i]);
+
+	return 0;
+}
+
+
+static struct trie_node *node_find(const struct trie_node *n, char c)
+{
+	struct le *le;
+
+	for (le = n->childl.head; le; le = le->next) {
+
+		struct trie_node *child = le->data;
+
+		if (child->c == c)
+			return child;
+	}
+
+	return NULL;
+}
+
+
+static int trie_add(struct acl *acl, struct acl_rule *r,
+		    const struct pl *prefix)
+{
+	struct trie_node *n = acl->root;
+	size_t i;
+
+	for (i=0; i<prefix->l; i++) {
+
+		struct trie_node *child = node_find(n, prefix->p[i]);
+
+		if (!child) {
+			child = mem_zalloc(sizeof(*child), node_destructor);
+			if (!child)
+				return ENOMEM;
+
+			child->c = prefix->p[i];
+			list_append(&n->childl, &child->le, child);
+			++acl->nodes;
+		}
+
+		n = child;
+	}
+
+	list_append(&n->rulel, &r->he, r);
+
+	return 0;
+}
+
+
+static int host_decode(struct acl_rule *r, const struct pl *host)
+{
+	struct pl h = *host;
+
+	if (!pl_strcmp(&h, "*"))
+		return 0;
+
+	if (h.l > 2 && h.p[0] == '*' && h.p[1] == '.') {
+		pl_advance(&h, 1);
+		r->suffix = true;
+	}
+
+	return lower_dup(&r->host, &h);
+}
+
+
+/* A domain or sub-domain suffix matches the host */
+static bool host_match(const char *domain, bool suffix, const struct pl *host)
+{
+	size_t n = str_len(domain);
+
+	if (!suffix)
+		return 0 == pl_strcmp(host, domain);
+
+	return host->l > n && 0 == memcmp(host->p + host->l - n, domain, n);
+}
+
+
+static void skip_scheme(struct pl *p)
+{
+	struct pl scheme;
+
+	if (re_regex(p->p, p->l, "[a-z]+:", &scheme) || scheme.p != p->p)
+		return;
+
+	if (!pl_strcasecmp(&scheme, "sip") || !pl_strcasecmp(&scheme, "sips"))
+		pl_advance(p, scheme.l + 1);
+}
+
+
+static int rule_compile(struct acl *acl, struct acl_rule *r,
+			const struct pl *pat)
+{
+	struct pl p = *pat, user, host;
+	char *at;
+
+	if (p.l && p.p[0] == '~') {
+
+		uint32_t sets = 0;
+		size_t i;
+
+		pl_advance(&p, 1);
+		if (!p.l)
+			return EINVAL;
+
+		for (i=0; i<p.l; i++) {
+			if (p.p[i] == '[')
+				++sets;
+		}
+
+		if (sets > REGEX_SETS)
+			return E2BIG;
+
+		r->type = RULE_REGEX;
+		list_append(&acl->regexl, &r->he, r);
+
+		return pl_strdup(&r->key, &p);
+	}
+
+	skip_scheme(&p);
+
+	at = (char *)pl_strchr(&p, '@');
+	if (!at)
+		return EINVAL;
+
+	user.p = p.p;
+	user.l = at - p.p;
+	host.p = at + 1;
+	host.l = p.l - user.l - 1;
+
+	if (!user.l || !host.l)
+		return EINVAL;
+
+	/* *@* */
+	if (!pl_strcmp(&user, "*") && !pl_strcmp(&host, "*")) {
+
+		if (acl->any)
+			return EALREADY;
+
+		r->type = RULE_ANY;
+		acl->any = r;
+
+		return 0;
+	}
+
+	/* *@domain and *@*.domain */
+	if (!pl_strcmp(&user, "*")) {
+
+		int err = host_decode(r, &host);
+		if (err)
+			return err;
+
+		r->type = RULE_DOMAIN;
+
+		/* sub-domain suffixes are keyed with the leading dot */
+		err = str_dup(&r->key, r->host);
+		if (err)
+			return err;
+
+		hash_append(acl->domain, hash_joaat_str(r->key), &r->he, r);
+		++acl->n_domain;
+
+		return 0;
+	}
+
+	/* user@host */
+	if (user.p[user.l - 1] != '*' && pl_strcmp(&host, "*") &&
+	    !(host.l > 2 && host.p[0] == '*')) {
+
+		char *h;
+		int err;
+
+		err = lower_dup(&h, &host);
+		if (err)
+			return err;
+
+		r->type = RULE_EXACT;
+		err = re_sdprintf(&r->key, "%r@%s", &user, h);
+		mem_deref(h);
+		if (err)
+			return err;
+
+		hash_append(acl->exact, hash_joaat_str(r->key), &r->he, r);
+		++acl->n_exact;
+
+		return 0;
+	}
+
+	/* user-prefix*@domain and user@* */
+	if (user.p[user.l - 1] == '*')
+		--user.l;
+	else
+		r->full = true;
+
+	r->type = RULE_PREFIX;
+
+	if (host_decode(r, &host) || pl_strdup(&r->key, &user))
+		return ENOMEM;
+
+	return trie_add(acl, r, &user);
+}
+
+
+/**
+ * Allocate an empty access control list
+ *
+ * @param aclp Pointer to allocated access control list
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int acl_alloc(struct acl **aclp)
+{
+	struct acl *acl;
+	int err;
+
+	if (!aclp)
+		return EINVAL;
+
+	acl = mem_zalloc(sizeof(*acl), acl_destructor);
+	if (!acl)
+		return ENOMEM;
+
+	err  = hash_alloc(&acl->exact, HASH_SIZE);
+	err |= hash_alloc(&acl->domain, HASH_SIZE);
+	if (err)
+		goto out;
+
+	acl->root = mem_zalloc(sizeof(*acl->root), node_destructor);
+	if (!acl->root) {
+		err = ENOMEM;
+		goto out;
+	}
+
+ out:
+	if (err)
+		mem_deref(acl);
+	else
+		*aclp = acl;
+
+	return err;
+}
+
+
+static int rule_add(struct acl *acl, const struct pl *line, uint32_t lineno)
+{
+	struct pl action, pat;
+	struct acl_rule *r;
+	int err;
+
+	err = re_regex(line->p, line->l, "[ \t]*[a-z]+[ \t]+[^ \t\r]+",
+		       NULL, &action, NULL, &pat);
+	if (err)
+		return EBADMSG;
+
+	r = mem_zalloc(sizeof(*r), rule_destructor);
+	if (!r)
+		return ENOMEM;
+
+	if (!pl_strcasecmp(&action, "allow")) {
+		r->action = ACL_ALLOW;
+	}
+	else if (!pl_strcasecmp(&action, "block")) {
+		r->action = ACL_BLOCK;
+	}
+	else {
+		err = EBADMSG;
+		goto out;
+	}
+
+	r->line = lineno;
+
+	err = pl_strdup(&r->pattern, &pat);
+	if (err)
+		goto out;
+
+	list_append(&acl->rulel, &r->le, r);
+
+	err = rule_compile(acl, r, &pat);
+	if (err)
+		goto out;
+
+	++acl->rulec;
+
+ out:
+	if (err) {
+		warning("acl: line %u: invalid rule '%r' (%m)\n",
+			lineno, line, err);
+		mem_deref(r);
+	}
+
+	return err;
+}
+
+
+/**
+ * Add a rule to an access control list
+ *
+ * @param acl  Access control list
+ * @param line Rule, e.g. "block sip:+1900*@*"
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int acl_add(struct acl *acl, const struct pl *line)
+{
+	if (!acl || !line)
+		return EINVAL;
+
+	return rule_add(acl, line, acl->rulec + 1);
+}
+
+
+/* Read the rules line by line, to keep the line numbers of the file */
+static int acl_read(struct acl *acl, FILE *f)
+{
+	char buf[LINE_SIZE];
+	uint32_t lineno = 0;
+
+	while (fgets(buf, sizeof(buf), f)) {
+
+		struct pl pl;
+
+		++lineno;
+
+		pl_set_str(&pl, buf);
+
+		if (pl.l && pl.p[pl.l - 1] == '\n')
+			--pl.l;
+		else if (!feof(f)) {
+			warning("acl: line %u: too long\n", lineno);
+			return E2BIG;
+		}
+
+		/* also strips the \r of CRLF line endings */
+		(void)pl_trim(&pl);
+
+		if (!pl.l || pl.p[0] == '#')
+			continue;
+
+		if (rule_add(acl, &pl, lineno))
+			return EBADMSG;
+	}
+
+	return ferror(f) ? EIO : 0;
+}
+
+
+/**
+ * Load the rules of an access control list from a file
+ *
+ * @param aclp Pointer to allocated access control list
+ * @param file Filename
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int acl_load(struct acl **aclp, const char *file)
+{
+	struct acl *acl = NULL;
+	FILE *f;
+	int err;
+
+	if (!aclp || !file)
+		return EINVAL;
+
+	f = fopen(file, "r");
+	if (!f) {
+		err = errno;
+		warning("acl: could not open %s (%m)\n", file, err);
+		return err;
+	}
+
+	err = acl_alloc(&acl);
+	if (!err)
+		err = acl_read(acl, f);
+
+	(void)fclose(f);
+
+	if (err) {
+		warning("acl: could not load %s (%m)\n", file, err);
+		mem_deref(acl);
+		return err;
+	}
+
+	*aclp = acl;
+
+	return 0;
+}
+
+
+static bool exact_cmp_handler(struct le *le, void *arg)
+{
+	const struct acl_rule *r = le->data;
+
+	return 0 == str_cmp(r->key, arg);
+}
+
+
+static bool domain_cmp_handler(struct le *le, void *arg)
+{
+	const struct acl_rule *r = le->data;
+	const struct pl *key = arg;
+
+	return 0 == pl_strcmp(key, r->key);
+}
+
+
+static struct acl_rule *prefix_lookup(const struct acl *acl,
+				      const struct pl *user,
+				      const struct pl *host)
+{
+	const struct trie_node *n = acl->root;
+	struct acl_rule *match = NULL;
+	size_t i = 0;
+
+	/* the longest prefix that matches the domain wins */
+	while (n) {
+
+		struct le *le;
+
+		for (le = n->rulel.head; le; le = le->next) {
+
+			struct acl_rule *r = le->data;
+
+			if (r->full && i < user->l)
+				continue;
+
+			if (r->host && !host_match(r->host, r->suffix, host))
+				continue;
+
+			match = r;
+			break;
+		}
+
+		if (i >= user->l)
+			break;
+
+		n = node_find(n, user->p[i++]);
+	}
+
+	return match;
+}
+
+
+static struct acl_rule *domain_lookup(const struct acl *acl,
+				      const struct pl *host)
+{
+	struct pl key = *host;
+	struct le *le;
+
+	/* exact domain first, then the sub-domain suffixes by length */
+	le = hash_lookup(acl->domain, hash_joaat_pl(&key),
+			 domain_cmp_handler, &key);
+
+	while (!le && key.l) {
+
+		const char *dot = pl_strchr(&key, '.');
+
+		if (!dot || dot == key.p + key.l - 1)
+			break;
+
+		if (dot == key.p) {
+			pl_advance(&key, 1);
+			continue;
+		}
+
+		pl_advance(&key, dot - key.p);
+
+		le = hash_lookup(acl->domain, hash_joaat_pl(&key),
+				 domain_cmp_handler, &key);
+	}
+
+	return list_ledata(le);
+}
+
+
+/**
+ * Check a SIP URI against an access control list
+ *
+ * @param acl Access control list
+ * @param uri SIP URI to check, e.g. "sip:alice@example.com;transport=tcp"
+ *
+ * @return Action of the first matching rule, ACL_NONE if no rule matched
+ */
+enum acl_action acl_check(struct acl *acl, const char *uri)
+{
+	struct acl_rule *r = NULL;
+	char buf[URI_MAX], hbuf[256];
+	struct pl pl, host;
+	struct uri u;
+	struct le *le;
+	size_t i;
+
+	if (!acl || !uri)
+		return ACL_NONE;
+
+	++acl->n_check;
+
+	pl_set_str(&pl, uri);
+	if (uri_decode(&u, &pl) || u.host.l >= sizeof(hbuf))
+		goto fallback;
+
+	for (i=0; i<u.host.l; i++)
+		hbuf[i] = tolower((unsigned char)u.host.p[i]);
+
+	host.p = hbuf;
+	host.l = u.host.l;
+
+	if (re_snprintf(buf, sizeof(buf), "%r@%r", &u.user, &host) < 0)
+		goto fallback;
+
+	r = list_ledata(hash_lookup(acl->exact, hash_joaat_str(buf),
+				    exact_cmp_handler, buf));
+	if (r)
+		goto out;
+
+	r = prefix_lookup(acl, &u.user, &host);
+	if (r)
+		goto out;
+
+	r = domain_lookup(acl, &host);
+	if (r)
+		goto out;
+
+	for (le = acl->regexl.head; le; le = le->next) {
+
+		struct acl_rule *rx = le->data;
+
+		/* one (unused) argument per character set */
+		if (0 == re_regex(buf, str_len(buf), rx->key,
+				  NULL, NULL, NULL, NULL,
+				  NULL, NULL, NULL, NULL)) {
+			r = rx;
+			goto out;
+		}
+	}
+
+ fallback:
+	r = acl->any;
+
+ out:
+	if (!r) {
+		++acl->n_nomatch;
+		return ACL_NONE;
+	}
+
+	++r->hits;
+
+	return r->action;
+}
+
+
+/**
+ * Print an access control list with the hit counters of the rules
+ *
+ * @param pf  Print function
+ * @param acl Access control list
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int acl_debug(struct re_printf *pf, const struct acl *acl)
+{
+	struct le *le;
+	int err = 0;
+
+	if (!acl)
+		return re_hprintf(pf, "acl: (no access control list)\n");
+
+	err |= re_hprintf(pf, "\nAccess control list:\n");
+	err |= re_hprintf(pf, " rules:    %u (%u exact, %u domain,"
+			  " %u regex, %u trie nodes)\n",
+			  acl->rulec, acl->n_exact, acl->n_domain,
+			  list_count(&acl->regexl),
+			  acl->nodes);
+	err |= re_hprintf(pf, " checks:   %llu (%llu without match)\n",
+			  acl->n_check, acl->n_nomatch);
+
+	for (le = acl->rulel.head; le; le = le->next) {
+
+		const struct acl_rule *r = le->data;
+
+		if (!r->hits)
+			continue;
+
+		err |= re_hprintf(pf, "  %5u  %-5s  %-7s  %-32s  %llu hits\n",
+				  r->line, action_name(r->action),
+				  type_name(r->type), r->pattern, r->hits);
+	}
+
+	return err;
+}
+
+
+/**
+ * Load the call-screening access control list from a file. The current
+ * list is only replaced if the new file could be loaded.
+ *
+ * @param file Filename, or NULL to clear the list
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int acl_reload(const char *file)
+{
+	struct acl *acl = NULL;
+	int err;
+
+	if (str_isset(file)) {
+
+		err = acl_load(&acl, file);
+		if (err)
+			return err;
+
+		info("acl: loaded %u rules from %s\n", acl->rulec, file);
+	}
+
+	mem_deref(acl_cur);
+	acl_cur = acl;
+
+	return 0;
+}
+
+
+/**
+ * Get the current call-screening access control list
+ *
+ * @return Access control list, or NULL if not loaded
+ */
+struct acl *acl_current(void)
+{
+	return acl_cur;
+}
+
+
+/**
+ * Close the call-screening access control list
+ */
+void acl_close(void)
+{
+	acl_cur = mem_deref(acl_cur);
+}
@@ -36,6 +36,7 @@ void aucodec_unregister(struct aucodec *ac)
 	if (!ac)
 		return;
 
+	codecpool_flush_codec(ac);
 	list_unlink(&ac->le);
 }
 
@@ -72,5 +73,9 @@ const struct aucodec *aucodec_find(const struct list *aucodecl,
 		return ac;
 	}
 
+	/* retry after loading a lazy module providing it */
+	if (!module_lazy_load("aucodec", name))
+		return aucodec_find(aucodecl, name, srate, ch);
+
 	return NULL;
 }
@@ -60,6 +60,14 @@ enum {
 	AUDIO_SAMPSZ    = MAX_SRATE * MAX_CHANNELS * MAX_PTIME / 1000,
 
 	SILENCE_Q = 1024 * 1024,  /* Quadratic sample value for silence */
+
+	SHQ_MAX         =    16,  /* Max packets from shared encoder */
+
+	PLAYOUT_WINDOW  =   500,  /* Packets in transit delay window  */
+};
+
+enum {
+	MQ_FIRSTPLAY = 1,         /* First frame played, from player */
 };
 
 
@@ -86,6 +94,12 @@ struct autx {
 	struct ausrc_prm ausrc_prm;   /**< Audio Source parameters         */
 	const struct aucodec *ac;     /**< Current audio encoder           */
 	struct auenc_state *enc;      /**< Audio encoder state (optional)  */
+	struct encshare_memb *encm;   /**< Shared encoder (optional)       */
+	struct lock *lock;            /**< Protects ac, enc and encm       */
+	char *enc_params;             /**< Encoder fmtp, for shared key    */
+	struct lock *shq_lock;        /**< Protects the shared queue       */
+	struct list shq;              /**< Packets from shared encoder     */
+	uint32_t shq_skip;            /**< Duration of dropped packets     */
 	struct aubuf *aubuf;          /**< Packetize outgoing stream       */
 	size_t aubuf_maxsz;           /**< Maximum aubuf size in [bytes]   */
 	volatile bool aubuf_started;  /**< Aubuf was started flag          */
@@ -108,15 +122,17 @@ struct autx {
 	enum aufmt src_fmt;           /**< Sample format for audio source  */
 	enum aufmt enc_fmt;           /**< Sample format for encoder       */
 	bool need_conv;               /**< Sample format conversion needed */
+	struct media_cpu *cpu;        /**< CPU accounting of the stream    */
 
 	struct {
 		uint64_t aubuf_overrun;
 		uint64_t aubuf_underrun;
+		uint64_t shq_drop;
 	} stats;
 
 #ifdef HAVE_PTHREAD
 	struct {
-		pthread_t tid;/**< Audio transmit thread           */
+		struct mthread *mt;/**< Audio transmit thread      */
 		bool run;     /**< Audio transmit thread running   */
 	} thr;
 #endif
@@ -149,6 +165,7 @@ struct aurx {
 	size_t aubuf_maxsz;           /**< Maximum aubuf size in [bytes]   */
 	size_t num_bytes;             /**< Size of one frame in [bytes]    */
 	volatile bool aubuf_started;  /**< Aubuf was started flag          */
+	uint64_t t_play;              /**< First frame played [us]         */
 	struct auresamp resamp;       /**< Optional resampler for DSP      */
 	struct list filtl;            /**< Audio filters in decoding order */
 	char *module;                 /**< Audio player module name        */
@@ -163,9 +180,26 @@ struct aurx {
 	enum aufmt dec_fmt;           /**< Sample format for decoder       */
 	bool need_conv;               /**< Sample format conversion needed */
 	uint32_t again;               /**< Stream decode EAGAIN counter    */
+	struct media_cpu *cpu;        /**< CPU accounting of the stream    */
 	struct timestamp_recv ts_recv;/**< Receive timestamp state         */
 	size_t last_sampc;
 
+	struct {
+		int16_t *pend;        /**< Pending samples for playout     */
+		size_t pend_len;      /**< Number of pending samples       */
+		int16_t *tmp;         /**< Scratch buffer for stretching   */
+		bool started;         /**< First packet has arrived        */
+		uint32_t ts_last;     /**< Last arrived RTP timestamp      */
+		int64_t ts_ext;       /**< Extended RTP timestamp          */
+		int64_t d_min;        /**< Minimum transit delay [us]      */
+		int64_t d_min_next;   /**< Minimum in current window [us]  */
+		uint32_t d_win;       /**< Packets in current window       */
+		double hist[AUDIO_PLAYOUT_HIST_BINS]; /**< Decaying hist.  */
+		double hist_sum;      /**< Sum of decaying histogram       */
+		struct lock *lock;    /**< Protects the statistics         */
+		struct audio_playout_stat stat;  /**< Playout statistics   */
+	} po;                         /**< Adaptive playout                */
+
 	struct {
 		uint64_t aubuf_overrun;
 		uint64_t aubuf_underrun;
@@ -177,7 +211,7 @@ struct aurx {
 
 #ifdef HAVE_PTHREAD
 	struct {
-		pthread_t tid;
+		struct mthread *mt;
 		bool start;
 		bool run;
 		pthread_cond_t cond;
@@ -205,6 +239,8 @@ struct audio {
 	audio_event_h *eventh;        /**< Event handler                   */
 	audio_level_h *levelh;        /**< Audio level handler             */
 	audio_err_h *errh;            /**< Audio error handler             */
+	audio_firstplay_h *firstplayh; /**< First frame played handler     */
+	struct mqueue *mq;            /**< Messages from the player thread */
 	void *arg;                    /**< Handler argument                */
 };
 
@@ -213,6 +249,28 @@ struct audio {
 static const char *uri_aulevel = "urn:ietf:params:rtp-hdrext:ssrc-audio-level";
 
 
+/**
+ * Get the audio buffer overrun and underrun counters
+ *
+ * @param a  Audio object
+ * @param st Returned counters
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int audio_aubuf_stat(const struct audio *a, struct audio_aubuf_stat *st)
+{
+	if (!a || !st)
+		return EINVAL;
+
+	st->tx_overrun  = a->tx.stats.aubuf_overrun;
+	st->tx_underrun = a->tx.stats.aubuf_underrun;
+	st->rx_overrun  = a->rx.stats.aubuf_overrun;
+	st->rx_underrun = a->rx.stats.aubuf_underrun;
+
+	return 0;
+}
+
+
 /**
  * Get the current audio receive buffer length in milliseconds
  *
@@ -248,6 +306,28 @@ uint64_t audio_jb_current_value(const struct audio *au)
 }
 
 
+/**
+ * Get the adaptive playout statistics
+ *
+ * @param au   Audio object
+ * @param stat Returned playout statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int audio_playout_stat(const struct audio *au,
+		       struct audio_playout_stat *stat)
+{
+	if (!au || !stat)
+		return EINVAL;
+
+	lock_read_get(au->rx.po.lock);
+	*stat = au->rx.po.stat;
+	lock_rel(au->rx.po.lock);
+
+	return 0;
+}
+
+
 static double autx_calc_seconds(const struct autx *autx)
 {
 	uint64_t dur;
@@ -285,7 +365,7 @@ static void stop_tx(struct autx *tx, struct audio *a)
 	case AUDIO_MODE_THREAD:
 		if (tx->thr.run) {
 			tx->thr.run = false;
-			pthread_join(tx->thr.tid, NULL);
+			tx->thr.mt = mem_deref(tx->thr.mt);
 		}
 		break;
 #endif
@@ -312,7 +392,7 @@ static void stop_rx(struct aurx *rx)
 	if (rx->thr.run) {
 		rx->thr.run = false;
 		pthread_cond_signal(&rx->thr.cond);
-		pthread_join(rx->thr.tid, NULL);
+		rx->thr.mt = mem_deref(rx->thr.mt);
 	}
 
 #else
@@ -321,6 +401,7 @@ static void stop_rx(struct aurx *rx)
 
 	rx->auplay = mem_deref(rx->auplay);
 	rx->aubuf  = mem_deref(rx->aubuf);
+	rx->po.pend_len = 0;
 	list_flush(&rx->filtl);
 }
 
@@ -334,7 +415,12 @@ static void audio_destructor(void *arg)
 	stop_tx(&a->tx, a);
 	stop_rx(&a->rx);
 
+	mem_deref(a->tx.encm);
 	mem_deref(a->tx.enc);
+	mem_deref(a->tx.enc_params);
+	mem_deref(a->tx.lock);
+	list_flush(&a->tx.shq);
+	mem_deref(a->tx.shq_lock);
 	mem_deref(a->rx.dec);
 	mem_deref(a->tx.aubuf);
 	mem_deref(a->tx.mb);
@@ -343,6 +429,9 @@ static void audio_destructor(void *arg)
 	mem_deref(a->rx.aubuf);
 	mem_deref(a->tx.sampv_rs);
 	mem_deref(a->rx.sampv_rs);
+	mem_deref(a->rx.po.pend);
+	mem_deref(a->rx.po.tmp);
+	mem_deref(a->rx.po.lock);
 	mem_deref(a->tx.module);
 	mem_deref(a->tx.device);
 	mem_deref(a->rx.module);
@@ -358,6 +447,7 @@ static void audio_destructor(void *arg)
 
 	mem_deref(a->strm);
 	mem_deref(a->telev);
+	mem_deref(a->mq);
 }
 
 
@@ -438,6 +528,137 @@ static int append_rtpext(struct audio *au, struct mbuf *mb,
 }
 
 
+/** Packet from the shared encoder, queued for a follower */
+struct shpkt {
+	struct le le;
+	struct mbuf *mb;    /**< Extension header and payload     */
+	size_t hdr_len;     /**< Length of extension header       */
+	uint32_t dur;       /**< Duration in RTP clockrate        */
+	bool marker;        /**< Marker bit from the encoder      */
+};
+
+
+static void shpkt_destructor(void *arg)
+{
+	struct shpkt *pkt = arg;
+
+	list_unlink(&pkt->le);
+	mem_deref(pkt->mb);
+}
+
+
+/*
+ * Queue a packet from the shared encoder. This is called from the
+ * thread of the leader, so the packet is sent later from the transmit
+ * thread of this stream. The timestamp argument is the duration of
+ * the packet in RTP clockrate.
+ *
+ * @note This function has REAL-TIME properties
+ */
+static int shared_packet_handler(bool marker, uint64_t ts,
+				 const uint8_t *hdr, size_t hdr_len,
+				 const uint8_t *pld, size_t pld_len,
+				 void *arg)
+{
+	struct audio *a = arg;
+	struct autx *tx = &a->tx;
+	struct shpkt *pkt;
+	int err = 0;
+
+	pkt = mem_zalloc(sizeof(*pkt), shpkt_destructor);
+	if (!pkt)
+		return ENOMEM;
+
+	pkt->mb = mbuf_alloc(hdr_len + pld_len);
+	if (!pkt->mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	err  = mbuf_write_mem(pkt->mb, hdr, hdr_len);
+	err |= mbuf_write_mem(pkt->mb, pld, pld_len);
+	if (err)
+		goto out;
+
+	pkt->hdr_len = hdr_len;
+	pkt->dur     = (uint32_t)ts;
+	pkt->marker  = marker;
+
+	lock_write_get(tx->shq_lock);
+
+	/* drop the oldest packet, but keep its duration */
+	if (list_count(&tx->shq) >= SHQ_MAX) {
+		struct shpkt *old = list_ledata(tx->shq.head);
+
+		tx->shq_skip += old->dur;
+		++tx->stats.shq_drop;
+		mem_deref(old);
+	}
+
+	list_append(&tx->shq, &pkt->le, pkt);
+	pkt = NULL;
+
+	lock_rel(tx->shq_lock);
+
+ out:
+	mem_deref(pkt);
+
+	return err;
+}
+
+
+/*
+ * Send the queued packets from the shared encoder, with the timestamp
+ * and sequence number of this stream
+ *
+ * @note This function has REAL-TIME properties
+ */
+static void shared_queue_send(struct audio *a, struct autx *tx)
+{
+	for (;;) {
+		struct shpkt *pkt;
+		int err = 0;
+
+		lock_write_get(tx->shq_lock);
+
+		tx->ts_ext  += tx->shq_skip;
+		tx->shq_skip = 0;
+
+		pkt = list_ledata(tx->shq.head);
+		if (pkt)
+			list_unlink(&pkt->le);
+
+		lock_rel(tx->shq_lock);
+
+		if (!pkt)
+			break;
+
+		/* only send packets with a payload */
+		if (pkt->mb->end > pkt->hdr_len) {
+
+			tx->mb->pos = tx->mb->end = STREAM_PRESZ;
+
+			err = mbuf_write_mem(tx->mb, pkt->mb->buf,
+					     pkt->mb->end);
+			if (!err) {
+				tx->mb->pos = STREAM_PRESZ;
+
+				err = stream_send(a->strm, pkt->hdr_len != 0,
+						  pkt->marker || tx->marker,
+						  -1, tx->ts_ext & 0xffffffff,
+						  tx->mb);
+			}
+			if (!err)
+				tx->marker = false;
+		}
+
+		tx->ts_ext += pkt->dur;
+
+		mem_deref(pkt);
+	}
+}
+
+
 /*
  * Encode audio and send via stream
  *
@@ -452,11 +673,18 @@ static void encode_rtp_send(struct audio *a, struct autx *tx,
 	size_t ext_len = 0;
 	uint32_t ts_delta = 0;
 	bool marker = tx->marker;
+	uint64_t t0;
 	int err;
 
 	if (!tx->ac || !tx->ac->ench)
 		return;
 
+	/* the leader encodes for all streams sharing the encoder */
+	if (tx->encm && !encshare_leader(tx->encm)) {
+		shared_queue_send(a, tx);
+		return;
+	}
+
 	tx->mb->pos = tx->mb->end = STREAM_PRESZ;
 
 	if (a->level_enabled) {
@@ -483,8 +711,10 @@ static void encode_rtp_send(struct audio *a, struct autx *tx,
 
 	len = mbuf_get_space(tx->mb);
 
+	t0 = tmr_jiffies_usec();
 	err = tx->ac->ench(tx->enc, &marker, mbuf_buf(tx->mb), &len,
 			   tx->enc_fmt, sampv, sampc);
+	media_cpu_add(&tx->cpu->stagev[MEDIA_CPU_ENCODE], t0);
 
 	if ((err & 0xffff0000) == 0x00010000) {
 
@@ -502,6 +732,19 @@ static void encode_rtp_send(struct audio *a, struct autx *tx,
 	tx->mb->pos = STREAM_PRESZ;
 	tx->mb->end = STREAM_PRESZ + ext_len + len;
 
+	if (tx->encm) {
+		uint32_t dur = ts_delta;
+
+		if (!dur) {
+			dur = (uint32_t)(sampc * tx->ac->crate / tx->ac->srate
+					 / tx->ac->ch);
+		}
+
+		(void)encshare_send(tx->encm, marker, dur,
+				    mbuf_buf(tx->mb), ext_len,
+				    mbuf_buf(tx->mb) + ext_len, len);
+	}
+
 	if (mbuf_get_left(tx->mb)) {
 
 		uint32_t rtp_ts = tx->ts_ext & 0xffffffff;
@@ -550,6 +793,7 @@ static void poll_aubuf_tx(struct audio *a)
 	struct le *le;
 	uint32_t srate;
 	uint8_t ch;
+	uint64_t t0;
 	int err = 0;
 
 	sz = aufmt_sample_size(tx->src_fmt);
@@ -605,9 +849,12 @@ static void poll_aubuf_tx(struct audio *a)
 			return;
 		}
 
+		t0 = tmr_jiffies_usec();
 		err = auresamp(&tx->resamp,
 			       tx->sampv_rs, &sampc_rs,
 			       tx->sampv, sampc);
+		media_cpu_add(&tx->cpu->stagev[MEDIA_CPU_RESAMPLE_ENC],
+			      t0);
 		if (err)
 			return;
 
@@ -627,18 +874,26 @@ static void poll_aubuf_tx(struct audio *a)
 	auframe_init(&af, tx->enc_fmt, sampv, sampc, srate, ch);
 
 	/* Process exactly one audio-frame in list order */
+	t0 = tmr_jiffies_usec();
 	for (le = tx->filtl.head; le; le = le->next) {
 		struct aufilt_enc_st *st = le->data;
+		uint64_t t1 = tmr_jiffies_usec();
 
 		if (st->af && st->af->ench)
 			err |= st->af->ench(st, &af);
+
+		media_cpu_add(&st->cpu, t1);
 	}
+	if (tx->filtl.head)
+		media_cpu_add(&tx->cpu->stagev[MEDIA_CPU_FILTER_ENC], t0);
 	if (err) {
 		warning("audio: aufilter encode: %m\n", err);
 	}
 
 	/* Encode and send */
+	lock_read_get(tx->lock);
 	encode_rtp_send(a, tx, af.sampv, af.sampc);
+	lock_rel(tx->lock);
 }
 
 
@@ -701,6 +956,11 @@ static void auplay_write_handler(struct auframe *af, void *arg)
 			aufmt_name(rx->play_fmt), aufmt_name(af->fmt));
 	}
 
+	if (!rx->t_play && rx->aubuf_started) {
+		rx->t_play = tmr_jiffies_usec();
+		(void)mqueue_push(a->mq, MQ_FIRSTPLAY, NULL);
+	}
+
 	if (rx->aubuf_started && aubuf_cur_size(rx->aubuf) < num_bytes) {
 
 		++rx->stats.aubuf_underrun;
@@ -795,6 +1055,224 @@ static void *rx_thread(void *arg)
 #endif
 
 
+/*
+ * Adaptive playout
+ *
+ * The playout delay is kept close to a target delay, which is derived
+ * from a percentile of the packet transit delay relative to the fastest
+ * packet in a sliding window. The delay is adjusted by time-stretching
+ * with overlap-add at the best matching lag (WSOLA), instead of dropping
+ * or inserting whole frames.
+ */
+
+
+static void stream_arrival_handler(const struct rtp_header *hdr,
+				   uint64_t ts_arrival, void *arg)
+{
+	struct audio *a = arg;
+	struct aurx *rx = &a->rx;
+	struct audio_playout_stat *st = &rx->po.stat;
+	const struct aucodec *ac = rx->ac;
+	uint32_t jitter, target;
+	double thres, acc = 0.0;
+	int32_t delta;
+	int64_t d;
+	size_t i, bin;
+
+	if (!ac || !ac->crate || hdr->pt != rx->pt)
+		return;
+
+	delta = (int32_t)(hdr->ts - rx->po.ts_last);
+
+	/* first packet or a timestamp jump */
+	if (!rx->po.started || abs(delta) > (int32_t)ac->crate * 10) {
+		rx->po.started    = true;
+		rx->po.ts_ext     = 0;
+		rx->po.d_min      = INT64_MAX;
+		rx->po.d_min_next = INT64_MAX;
+		rx->po.d_win      = 0;
+		delta = 0;
+	}
+
+	rx->po.ts_last = hdr->ts;
+	rx->po.ts_ext += delta;
+
+	/* relative transit delay [us] */
+	d = (int64_t)ts_arrival - rx->po.ts_ext * 1000000 / ac->crate;
+
+	rx->po.d_min      = min(rx->po.d_min, d);
+	rx->po.d_min_next = min(rx->po.d_min_next, d);
+
+	if (++rx->po.d_win >= PLAYOUT_WINDOW) {
+		rx->po.d_min      = rx->po.d_min_next;
+		rx->po.d_min_next = INT64_MAX;
+		rx->po.d_win      = 0;
+	}
+
+	d = (d - rx->po.d_min) / 1000;
+
+	bin = min((size_t)d / AUDIO_PLAYOUT_HIST_MS,
+		  (size_t)AUDIO_PLAYOUT_HIST_BINS - 1);
+
+	/* exponentially decaying histogram, about 500 packets */
+	for (i = 0; i < AUDIO_PLAYOUT_HIST_BINS; i++)
+		rx->po.hist[i] *= 0.998;
+
+	rx->po.hist[bin] += 1.0;
+	rx->po.hist_sum = rx->po.hist_sum * 0.998 + 1.0;
+
+	thres = rx->po.hist_sum * a->cfg.jitter_pct / 100.0;
+
+	for (i = 0; i < AUDIO_PLAYOUT_HIST_BINS; i++) {
+		acc += rx->po.hist[i];
+		if (acc >= thres)
+			break;
+	}
+
+	jitter = (uint32_t)min(i + 1, (size_t)AUDIO_PLAYOUT_HIST_BINS) *
+		AUDIO_PLAYOUT_HIST_MS;
+
+	target = jitter + rx->ptime;
+	target = max(target, a->cfg.buffer.min);
+	target = min(target, a->cfg.buffer.max);
+
+	lock_write_get(rx->po.lock);
+
+	++st->hist[bin];
+	st->jitter_ms = jitter;
+	st->target_ms = target;
+
+	if (d > target)
+		++st->n_late;
+
+	lock_rel(rx->po.lock);
+}
+
+
+/* Top up the pending buffer with samples from the aubuf */
+static int playout_fill(struct aurx *rx, size_t n)
+{
+	const size_t sz = sizeof(int16_t);
+	size_t need;
+	int err = 0;
+
+	if (rx->po.pend_len >= n)
+		return 0;
+
+	need = (n - rx->po.pend_len) * sz;
+
+	if (rx->aubuf_started && aubuf_cur_size(rx->aubuf) < need) {
+
+		++rx->stats.aubuf_underrun;
+		err = ENOENT;
+
+		lock_write_get(rx->po.lock);
+		rx->po.stat.n_concealed += need / sz / rx->auplay_prm.ch;
+		lock_rel(rx->po.lock);
+	}
+
+	aubuf_read(rx->aubuf, (uint8_t *)(rx->po.pend + rx->po.pend_len),
+		   need);
+	rx->po.pend_len = n;
+
+	return err;
+}
+
+
+static void playout_consume(struct aurx *rx, size_t n)
+{
+	rx->po.pend_len -= n;
+	memmove(rx->po.pend, rx->po.pend + n,
+		rx->po.pend_len * sizeof(int16_t));
+}
+
+
+static int playout_read(struct aurx *rx, struct auframe *af)
+{
+	struct audio_playout_stat *st = &rx->po.stat;
+	const size_t sz = sizeof(int16_t);
+	const size_t ch = af->ch;
+	const size_t nf = af->sampc / ch;
+	const uint32_t srate = af->srate;
+	int16_t *out = af->sampv;
+	int16_t *x = rx->po.pend;
+	int16_t *y = rx->po.tmp;
+	size_t avail, lmax, yn, lag, rest;
+	uint32_t delay_ms, frame_ms, target_ms;
+	int err = 0;
+
+	avail = aubuf_cur_size(rx->aubuf) / sz + rx->po.pend_len;
+
+	lmax = min(tstretch_maxlag(srate), nf / 2);
+
+	delay_ms = (uint32_t)(avail * 1000 / (srate * ch));
+	frame_ms = (uint32_t)(nf * 1000 / srate);
+
+	lock_write_get(rx->po.lock);
+	st->delay_ms = delay_ms;
+	target_ms = st->target_ms;
+	lock_rel(rx->po.lock);
+
+	if (!target_ms || af->sampc > AUDIO_SAMPSZ)
+		goto out;
+
+	if (delay_ms > target_ms + frame_ms && avail >= (nf + lmax) * ch) {
+
+		/* accelerate: remove one period */
+		(void)playout_fill(rx, (nf + lmax) * ch);
+
+		if (tstretch_s16(y, &yn, x, nf + lmax, ch, srate, true))
+			goto out;
+
+		lag = nf + lmax - yn;
+
+		memcpy(out, y, nf*ch*sz);
+		playout_consume(rx, (nf + lag) * ch);
+
+		lock_write_get(rx->po.lock);
+		st->n_accel += lag;
+		lock_rel(rx->po.lock);
+
+		return 0;
+	}
+	else if (rx->aubuf_started && delay_ms + frame_ms / 2 < target_ms) {
+
+		/* decelerate: insert one period */
+		err = playout_fill(rx, nf * ch);
+		if (err)
+			goto out;
+
+		if (tstretch_s16(y, &yn, x, nf, ch, srate, false))
+			goto out;
+
+		lag  = yn - nf;
+		rest = rx->po.pend_len - nf * ch;
+
+		memcpy(out, y, nf*ch*sz);
+
+		/* the inserted period is played before the rest */
+		memmove(x + lag*ch, x + nf*ch, rest*sz);
+		memcpy(x, y + nf*ch, lag*ch*sz);
+		rx->po.pend_len = lag*ch + rest;
+
+		lock_write_get(rx->po.lock);
+		st->n_decel += lag;
+		lock_rel(rx->po.lock);
+
+		return 0;
+	}
+
+ out:
+	if (playout_fill(rx, nf * ch))
+		err = ENOENT;
+
+	memcpy(out, x, nf*ch*sz);
+	playout_consume(rx, nf * ch);
+
+	return err;
+}
+
+
 /*
  * Write samples to Audio Player. This version of the write handler is used
  * for the configuration jitter_buffer_type JBUF_ADAPTIVE.
@@ -810,27 +1288,34 @@ static void auplay_write_handler2(struct auframe *af, void *arg)
 
 	rx->num_bytes = auframe_size(af);
 
-	if (rx->aubuf_started && aubuf_cur_size(rx->aubuf) < rx->num_bytes) {
-
-		++rx->stats.aubuf_underrun;
-		err = ENOENT;
+	if (!rx->t_play && rx->aubuf_started) {
+		rx->t_play = tmr_jiffies_usec();
+		(void)mqueue_push(a->mq, MQ_FIRSTPLAY, NULL);
+	}
 
-#if 0
-		debug("audio: rx aubuf underrun (total %llu)\n",
-			rx->stats.aubuf_underrun);
-#endif
+	if (rx->po.pend) {
+		err = playout_read(rx, af);
 	}
+	else {
+		if (rx->aubuf_started &&
+		    aubuf_cur_size(rx->aubuf) < rx->num_bytes) {
 
-	aubuf_read(rx->aubuf, af->sampv, rx->num_bytes);
+			++rx->stats.aubuf_underrun;
+			err = ENOENT;
+		}
+
+		aubuf_read(rx->aubuf, af->sampv, rx->num_bytes);
 
-	/* Reduce latency after EAGAIN? */
-	if (rx->again &&
-	    (err || silence(af->sampv, af->sampc, rx->play_fmt))) {
+		/* Reduce latency after EAGAIN? */
+		if (rx->again &&
+		    (err || silence(af->sampv, af->sampc, rx->play_fmt))) {
 
-		rx->again--;
-		if (aubuf_cur_size(rx->aubuf) >= rx->aubuf_minsz) {
-			aubuf_read(rx->aubuf, af->sampv, rx->num_bytes);
-			debug("Dropped a frame to reduce latency\n");
+			rx->again--;
+			if (aubuf_cur_size(rx->aubuf) >= rx->aubuf_minsz) {
+				aubuf_read(rx->aubuf, af->sampv,
+					   rx->num_bytes);
+				debug("Dropped a frame to reduce latency\n");
+			}
 		}
 	}
 
@@ -845,7 +1330,8 @@ static void auplay_write_handler2(struct auframe *af, void *arg)
 	pthread_mutex_lock(&a->rx.thr.mutex);
 	if (!rx->thr.run && rx->thr.start) {
 		rx->thr.run = true;
-		err = pthread_create(&rx->thr.tid, NULL, rx_thread, a);
+		err = mthread_create(&rx->thr.mt, MTHREAD_AUDIO_PROC,
+				     "audio rx", rx_thread, a);
 		if (err)
 			rx->thr.run = false;
 	}
@@ -974,12 +1460,15 @@ static int aurx_stream_decode(struct aurx *rx, bool marker,
 	struct le *le;
 	uint32_t srate;
 	uint8_t ch;
+	uint64_t t0;
 	int err = 0;
 
 	/* No decoder set */
 	if (!rx->ac)
 		return 0;
 
+	t0 = tmr_jiffies_usec();
+
 	if (lostc && rx->ac->plch) {
 
 		err = rx->ac->plch(rx->dec,
@@ -1009,6 +1498,9 @@ static int aurx_stream_decode(struct aurx *rx, bool marker,
 		sampc = 0;
 	}
 
+	if (sampc)
+		media_cpu_add(&rx->cpu->stagev[MEDIA_CPU_DECODE], t0);
+
 	if (rx->resamp.resample) {
 		srate = rx->resamp.irate;
 		ch = rx->resamp.ich;
@@ -1018,15 +1510,27 @@ static int aurx_stream_decode(struct aurx *rx, bool marker,
 		ch = rx->auplay_prm.ch;
 	}
 
+	if (lostc && ch) {
+		lock_write_get(rx->po.lock);
+		rx->po.stat.n_concealed += sampc / ch;
+		lock_rel(rx->po.lock);
+	}
+
 	auframe_init(&af, rx->dec_fmt, rx->sampv, sampc, srate, ch);
 
 	/* Process exactly one audio-frame in reverse list order */
+	t0 = tmr_jiffies_usec();
 	for (le = rx->filtl.tail; le; le = le->prev) {
 		struct aufilt_dec_st *st = le->data;
+		uint64_t t1 = tmr_jiffies_usec();
 
 		if (st->af && st->af->dech)
 			err |= st->af->dech(st, &af);
+
+		media_cpu_add(&st->cpu, t1);
 	}
+	if (rx->filtl.tail)
+		media_cpu_add(&rx->cpu->stagev[MEDIA_CPU_FILTER_DEC], t0);
 
 	if (!rx->aubuf)
 		goto out;
@@ -1045,9 +1549,12 @@ static int aurx_stream_decode(struct aurx *rx, bool marker,
 			return ENOTSUP;
 		}
 
+		t0 = tmr_jiffies_usec();
 		err = auresamp(&rx->resamp,
 			       rx->sampv_rs, &sampc_rs,
 			       rx->sampv, sampc);
+		media_cpu_add(&rx->cpu->stagev[MEDIA_CPU_RESAMPLE_DEC],
+			      t0);
 		if (err)
 			return err;
 
@@ -1207,8 +1714,13 @@ static void stream_recv_handler(const struct rtp_header *hdr,
 	}
 
  out:
-	if (lostc)
+	if (lostc) {
+		lock_write_get(a->rx.po.lock);
+		a->rx.po.stat.n_lost += lostc;
+		lock_rel(a->rx.po.lock);
+
 		aurx_stream_decode(&a->rx, hdr->m, mb, lostc);
+	}
 
 	(void)aurx_stream_decode(&a->rx, hdr->m, mb, 0);
 }
@@ -1310,6 +1822,11 @@ int audio_alloc(struct audio **ap, struct list *streaml,
 	if (err)
 		goto out;
 
+	tx->cpu = rx->cpu = stream_cpu(a->strm);
+
+	if (rx->jbtype == JBUF_ADAPTIVE)
+		stream_set_arrival_handler(a->strm, stream_arrival_handler);
+
 	if (cfg->avt.rtp_bw.max) {
 		sdp_media_set_lbandwidth(stream_sdpmedia(a->strm),
 					 SDP_BANDWIDTH_AS,
@@ -1348,6 +1865,12 @@ int audio_alloc(struct audio **ap, struct list *streaml,
 			goto out;
 	}
 
+	err  = lock_alloc(&tx->lock);
+	err |= lock_alloc(&tx->shq_lock);
+	err |= lock_alloc(&rx->po.lock);
+	if (err)
+		goto out;
+
 	tx->mb = mbuf_alloc(STREAM_PRESZ + 4096);
 	tx->sampv = mem_zalloc(AUDIO_SAMPSZ * aufmt_sample_size(tx->enc_fmt),
 			       NULL);
@@ -1538,6 +2061,104 @@ static int aurx_print_pipeline(struct re_printf *pf, const struct aurx *aurx)
 }
 
 
+struct enc_alloc_prm {
+	const struct aucodec *ac;
+	struct auenc_param *prm;
+	const char *fmtp;
+};
+
+
+static int enc_alloc_handler(void **encp, encshare_pkt_h *pkth,
+			     void *pkth_arg, void *arg)
+{
+	struct enc_alloc_prm *eprm = arg;
+	struct auenc_state *enc = NULL;
+	int err;
+	(void)pkth;
+	(void)pkth_arg;
+
+	if (!eprm->ac->encupdh)
+		return 0;
+
+	err = eprm->ac->encupdh(&enc, eprm->ac, eprm->prm, eprm->fmtp);
+	if (err)
+		return err;
+
+	*encp = enc;
+
+	return 0;
+}
+
+
+static int print_filters(struct re_printf *pf, const struct list *filtl)
+{
+	struct le *le;
+	int err = 0;
+
+	for (le = list_head(filtl); le; le = le->next) {
+		const struct aufilt_enc_st *st = le->data;
+
+		if (st->af)
+			err |= re_hprintf(pf, ",%s", st->af->name);
+	}
+
+	return err;
+}
+
+
+/*
+ * Join the group of streams with the same source, codec, fmtp, packet
+ * time, mute state, audio level extension and audio filters. The group
+ * is only changed if the key is different, e.g. after a mute change.
+ */
+static int autx_share_update(struct audio *a)
+{
+	struct autx *tx = &a->tx;
+	const struct aucodec *ac = tx->ac;
+	struct auenc_param prm;
+	struct enc_alloc_prm eprm = {ac, &prm, tx->enc_params};
+	char key[512];
+	int err;
+
+	if (!a->cfg.enc_shared || !ac)
+		return 0;
+
+	if (re_snprintf(key, sizeof(key), "%s,%s|%s/%u/%u|%s|%u|%s|%u|%H",
+			tx->module, tx->device,
+			ac->name, ac->srate, ac->ch, tx->enc_params,
+			ac->ptime ? ac->ptime : tx->ptime,
+			tx->muted ? "muted" : "",
+			a->level_enabled ? a->extmap_aulevel : 0,
+			print_filters, &tx->filtl) < 0)
+		return ENOMEM;
+
+	if (tx->encm && 0 == str_cmp(encshare_key(tx->encm), key))
+		return 0;
+
+	prm.bitrate = 0;        /* auto */
+
+	/* the transmit thread must not encode while the group changes */
+	lock_write_get(tx->lock);
+
+	tx->encm = mem_deref(tx->encm);
+	tx->enc  = mem_deref(tx->enc);
+
+	lock_write_get(tx->shq_lock);
+	list_flush(&tx->shq);
+	tx->shq_skip = 0;
+	lock_rel(tx->shq_lock);
+
+	err = encshare_join(&tx->encm, key, enc_alloc_handler, &eprm,
+			    shared_packet_handler, a);
+	if (!err)
+		tx->enc = mem_ref(encshare_enc(tx->encm));
+
+	lock_rel(tx->lock);
+
+	return err;
+}
+
+
 /**
  * Setup the audio-filter chain
  *
@@ -1696,6 +2317,20 @@ static int start_player(struct aurx *rx, struct audio *a,
 			rx->aubuf_maxsz = max_sz;
 		}
 
+		/* Adaptive playout with time-stretching */
+		if (rx->jbtype == JBUF_ADAPTIVE &&
+		    rx->play_fmt == AUFMT_S16LE && !rx->po.pend) {
+
+			rx->po.pend = mem_zalloc(2 * AUDIO_SAMPSZ *
+						 sizeof(int16_t), NULL);
+			rx->po.tmp  = mem_zalloc(2 * AUDIO_SAMPSZ *
+						 sizeof(int16_t), NULL);
+			if (!rx->po.pend || !rx->po.tmp)
+				return ENOMEM;
+
+			rx->po.pend_len = 0;
+		}
+
 		err = auplay_alloc(&rx->auplay, auplayl,
 				   rx->module,
 				   &prm, rx->device,
@@ -1814,8 +2449,9 @@ static int start_source(struct autx *tx, struct audio *a, struct list *ausrcl)
 		case AUDIO_MODE_THREAD:
 			if (!tx->thr.run) {
 				tx->thr.run = true;
-				err = pthread_create(&tx->thr.tid, NULL,
-						     tx_thread, a);
+				err = mthread_create(&tx->thr.mt,
+						     MTHREAD_AUDIO_PROC,
+						     "audio tx", tx_thread, a);
 				if (err) {
 					tx->thr.run = false;
 					return err;
@@ -1865,6 +2501,11 @@ int audio_start(struct audio *a)
 			return err;
 	}
 
+	/* the audio filters are part of the shared encoder key */
+	err = autx_share_update(a);
+	if (err)
+		return err;
+
 	err  = start_player(&a->rx, a, baresip_auplayl());
 	err |= start_source(&a->tx, a, baresip_ausrcl());
 	if (err)
@@ -1916,6 +2557,10 @@ int audio_start_source(struct audio *a, struct list *ausrcl,
 			return err;
 	}
 
+	err = autx_share_update(a);
+	if (err)
+		return err;
+
 	err = start_source(&a->tx, a, ausrcl);
 	if (err)
 		return err;
@@ -1992,20 +2637,51 @@ int audio_encoder_set(struct audio *a, const struct aucodec *ac,
 			aubuf_flush(tx->aubuf);
 		}
 
-		tx->enc = mem_deref(tx->enc);
-		tx->ac = ac;
+		lock_write_get(tx->lock);
+		tx->encm = mem_deref(tx->encm);
+		tx->enc  = mem_deref(tx->enc);
+		tx->ac   = ac;
+		lock_rel(tx->lock);
 	}
 
-	if (ac->encupdh) {
+	if (a->cfg.enc_shared) {
+
+		if (str_cmp(tx->enc_params, params)) {
+			tx->enc_params = mem_deref(tx->enc_params);
+			if (params)
+				err = str_dup(&tx->enc_params, params);
+			if (err)
+				return err;
+		}
+
+		err = autx_share_update(a);
+		if (err) {
+			warning("audio: shared encoder: %m\n", err);
+			return err;
+		}
+	}
+	else if (ac->encupdh) {
 		struct auenc_param prm;
+		uint64_t t0 = tmr_jiffies_usec();
+		const bool setup = !tx->enc;
+		bool hit = false;
 
 		prm.bitrate = 0;        /* auto */
 
+		if (setup) {
+			tx->enc = codecpool_get(CODECPOOL_AUENC, ac, params);
+			hit = tx->enc != NULL;
+		}
+
 		err = ac->encupdh(&tx->enc, ac, &prm, params);
 		if (err) {
 			warning("audio: alloc encoder: %m\n", err);
 			return err;
 		}
+
+		/* a re-INVITE only updates the existing state */
+		if (setup)
+			codecpool_setup_time(CODECPOOL_AUENC, t0, hit);
 	}
 
 	stream_set_srate(a->strm, ac->crate, 0);
@@ -2076,11 +2752,23 @@ int audio_decoder_set(struct audio *a, const struct aucodec *ac,
 	}
 
 	if (ac->decupdh) {
+		uint64_t t0 = tmr_jiffies_usec();
+		const bool setup = !rx->dec;
+		bool hit = false;
+
+		if (setup) {
+			rx->dec = codecpool_get(CODECPOOL_AUDEC, ac, params);
+			hit = rx->dec != NULL;
+		}
+
 		err = ac->decupdh(&rx->dec, ac, params);
 		if (err) {
 			warning("audio: alloc decoder: %m\n", err);
 			return err;
 		}
+
+		if (setup)
+			codecpool_setup_time(CODECPOOL_AUDEC, t0, hit);
 	}
 
 	stream_set_srate(a->strm, 0, ac->crate);
@@ -2148,6 +2836,10 @@ void audio_mute(struct audio *a, bool muted)
 		return;
 
 	a->tx.muted = muted;
+
+	/* streams with different mute state must not share the encoder */
+	if (autx_share_update(a))
+		warning("audio: shared encoder: regroup failed\n");
 }
 
 
@@ -2320,6 +3012,7 @@ int audio_debug(struct re_printf *pf, const struct audio *a)
 	const struct autx *tx;
 	const struct aurx *rx;
 	size_t sztx, szrx;
+	struct le *le;
 	int err;
 
 	if (!a)
@@ -2354,6 +3047,19 @@ int audio_debug(struct re_printf *pf, const struct audio *a)
 			  aufmt_name(tx->src_fmt));
 	err |= re_hprintf(pf, "       time = %.3f sec\n",
 			  autx_calc_seconds(tx));
+	err |= encshare_debug(pf, tx->encm);
+	if (tx->encm) {
+		err |= re_hprintf(pf, "       shared queue drops: %llu\n",
+				  tx->stats.shq_drop);
+	}
+
+	for (le = tx->filtl.head; le; le = le->next) {
+		const struct aufilt_enc_st *st = le->data;
+
+		err |= re_hprintf(pf, "       filter: %-10s %H\n",
+				  st->af ? st->af->name : "?",
+				  media_cpu_stat_print, &st->cpu);
+	}
 
 	err |= re_hprintf(pf,
 			  " rx:   decode: %H %s\n",
@@ -2376,6 +3082,37 @@ int audio_debug(struct re_printf *pf, const struct audio *a)
 			  aufmt_name(rx->play_fmt));
 	err |= re_hprintf(pf, "       n_discard:%llu\n",
 			  rx->stats.n_discard);
+
+	for (le = rx->filtl.tail; le; le = le->prev) {
+		const struct aufilt_dec_st *st = le->data;
+
+		err |= re_hprintf(pf, "       filter: %-10s %H\n",
+				  st->af ? st->af->name : "?",
+				  media_cpu_stat_print, &st->cpu);
+	}
+	if (rx->po.pend) {
+		struct audio_playout_stat stat;
+		const struct audio_playout_stat *st = &stat;
+		size_t i;
+
+		(void)audio_playout_stat(a, &stat);
+
+		err |= re_hprintf(pf, "       playout: delay=%ums"
+				  " target=%ums jitter=%ums again=%u\n"
+				  "         late=%llu lost=%llu concealed=%llu"
+				  " accel=%llu decel=%llu\n"
+				  "         histogram [%ums]:",
+				  st->delay_ms, st->target_ms, st->jitter_ms,
+				  rx->again,
+				  st->n_late, st->n_lost, st->n_concealed,
+				  st->n_accel, st->n_decel,
+				  AUDIO_PLAYOUT_HIST_MS);
+
+		for (i = 0; i < AUDIO_PLAYOUT_HIST_BINS; i++)
+			err |= re_hprintf(pf, " %llu", st->hist[i]);
+
+		err |= re_hprintf(pf, "\n");
+	}
 	if (rx->level_set) {
 		err |= re_hprintf(pf, "       level %.3f dBov\n",
 				  rx->level_last);
@@ -2580,6 +3317,46 @@ bool audio_rxaubuf_started(const struct audio *au)
 }
 
 
+/* Called in the main thread, t_play was written before the push */
+static void mqueue_handler(int id, void *data, void *arg)
+{
+	struct audio *a = arg;
+	(void)data;
+
+	if (id == MQ_FIRSTPLAY && a->firstplayh)
+		a->firstplayh(a->rx.t_play, a->arg);
+}
+
+
+/**
+ * Set the handler for the first received audio frame that was played.
+ * The handler is called once in the main thread.
+ *
+ * @param au         Audio object
+ * @param firstplayh First play handler
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int audio_set_firstplay_handler(struct audio *au,
+				audio_firstplay_h *firstplayh)
+{
+	int err;
+
+	if (!au)
+		return EINVAL;
+
+	if (!au->mq) {
+		err = mqueue_alloc(&au->mq, mqueue_handler, au);
+		if (err)
+			return err;
+	}
+
+	au->firstplayh = firstplayh;
+
+	return 0;
+}
+
+
 /**
  * Set the audio stream on hold
  *
@@ -75,6 +75,10 @@ const struct auplay *auplay_find(const struct list *auplayl, const char *name)
 		return ap;
 	}
 
+	/* retry after loading a lazy module providing it */
+	if (!module_lazy_load("auplay", name))
+		return auplay_find(auplayl, name);
+
 	return NULL;
 }
 
@@ -75,6 +75,10 @@ const struct ausrc *ausrc_find(const struct list *ausrcl, const char *name)
 		return as;
 	}
 
+	/* retry after loading a lazy module providing it */
+	if (!module_lazy_load("ausrc", name))
+		return ausrc_find(ausrcl, name);
+
 	return NULL;
 }
 
@@ -138,6 +138,31 @@ int baresip_init(struct config *cfg)
 	if (err)
 		return err;
 
+	err = metrics_init();
+	if (err) {
+		warning("baresip: metrics init failed: %m\n", err);
+		return err;
+	}
+
+	err = mthread_init(conf_cur());
+	if (err)
+		return err;
+
+	err = codecpool_init(conf_cur());
+	if (err)
+		return err;
+
+	err = callsetup_init();
+	if (err)
+		return err;
+
+	/* a broken call-screening list must not prevent startup */
+	err = acl_reload(cfg->call.acl);
+	if (err) {
+		warning("baresip: call_acl %s not loaded, calls are not"
+			" screened (%m)\n", cfg->call.acl, err);
+	}
+
 	return 0;
 }
 
@@ -147,6 +172,13 @@ int baresip_init(struct config *cfg)
  */
 void baresip_close(void)
 {
+	acl_close();
+	metrics_close();
+	callsetup_close();
+	module_close();
+	codecpool_close();
+	mthread_close();
+
 	cmd_unregister(baresip.commands, corecmdv);
 
 	baresip.message = mem_deref(baresip.message);
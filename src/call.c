@@ -47,6 +47,7 @@ struct call {
 	struct tmr tmr_inv;       /**< Timer for incoming calls             */
 	struct tmr tmr_dtmf;      /**< Timer for incoming DTMF events       */
 	struct tmr tmr_answ;      /**< Timer for delayed answer             */
+	uint64_t setupv[CALL_SETUP_MAX]; /**< Call setup timeline [us]      */
 	time_t time_start;        /**< Time when call started               */
 	time_t time_conn;         /**< Time when call initiated             */
 	time_t time_stop;         /**< Time when call stopped               */
@@ -101,6 +102,31 @@ static void set_state(struct call *call, enum call_state st)
 }
 
 
+/* Record the first occurrence of a call setup milestone */
+static void setup_mark_ts(struct call *call, enum call_setup_ev ev,
+			  uint64_t ts)
+{
+	uint64_t usec;
+
+	if (call->setupv[ev])
+		return;
+
+	call->setupv[ev] = ts;
+	usec = ts - call->setupv[CALL_SETUP_ALLOC];
+
+	callsetup_add(ev, usec);
+
+	ua_event(call->ua, UA_EVENT_CALL_SETUP, call, "%s,%llu",
+		 call_setup_ev_name(ev), usec);
+}
+
+
+static void setup_mark(struct call *call, enum call_setup_ev ev)
+{
+	setup_mark_ts(call, ev, tmr_jiffies_usec());
+}
+
+
 static const struct sdp_format *sdp_media_rcodec(const struct sdp_media *m)
 {
 	const struct list *lst;
@@ -271,6 +297,8 @@ static void mnat_handler(int err, uint16_t scode, const char *reason,
 	info("call: media-nat '%s' established/gathered\n",
 	     call->acc->mnatid);
 
+	setup_mark(call, CALL_SETUP_MNAT);
+
 	/* Re-INVITE */
 	if (!call->mnat_wait) {
 		info("call: medianat established -- sending Re-INVITE\n");
@@ -440,6 +468,16 @@ static void audio_error_handler(int err, const char *str, void *arg)
 }
 
 
+/* The first received audio frame was played */
+static void audio_firstplay_handler(uint64_t ts, void *arg)
+{
+	struct call *call = arg;
+	MAGIC_CHECK(call);
+
+	setup_mark_ts(call, CALL_SETUP_AUDIO, ts);
+}
+
+
 static void video_error_handler(int err, const char *str, void *arg)
 {
 	struct call *call = arg;
@@ -465,6 +503,8 @@ static void menc_event_handler(enum menc_event event,
 	switch (event) {
 
 	case MENC_EVENT_SECURE:
+		setup_mark(call, CALL_SETUP_MENC);
+
 		if (strstr(prm, "audio")) {
 			stream_set_secure(audio_strm(call->audio), true);
 			stream_start(audio_strm(call->audio));
@@ -557,6 +597,8 @@ static void stream_rtpestab_handler(struct stream *strm, void *arg)
 	struct call *call = arg;
 	MAGIC_CHECK(call);
 
+	setup_mark(call, CALL_SETUP_RTP);
+
 	ua_event(call->ua, UA_EVENT_CALL_RTPESTAB, call,
 		 "%s", sdp_media_name(stream_sdpmedia(strm)));
 }
@@ -756,6 +798,7 @@ int call_alloc(struct call **callp, const struct config *cfg, struct list *lst,
 	struct stream_param stream_prm;
 	enum vidmode vidmode = prm ? prm->vidmode : VIDMODE_OFF;
 	bool use_video, got_offer = false;
+	uint64_t t0 = tmr_jiffies_usec();
 	int label = 0;
 	int err = 0;
 
@@ -765,6 +808,9 @@ int call_alloc(struct call **callp, const struct config *cfg, struct list *lst,
 	debug("call: alloc with params laddr=%j, af=%s, use_rtp=%d\n",
 	      &prm->laddr, net_af2name(prm->af), prm->use_rtp);
 
+	/* all codecs of lazy modules are needed for the SDP */
+	module_lazy_media();
+
 	memset(&stream_prm, 0, sizeof(stream_prm));
 	stream_prm.use_rtp = prm->use_rtp;
 	stream_prm.af      = prm->af;
@@ -782,6 +828,8 @@ int call_alloc(struct call **callp, const struct config *cfg, struct list *lst,
 	tmr_init(&call->tmr_inv);
 	tmr_init(&call->tmr_answ);
 
+	call->setupv[CALL_SETUP_ALLOC] = t0;
+
 	call->acc    = mem_ref(acc);
 	call->ua     = ua;
 	call->state  = CALL_STATE_IDLE;
@@ -848,6 +896,11 @@ int call_alloc(struct call **callp, const struct config *cfg, struct list *lst,
 
 	audio_set_media_context(call->audio, &call->ctx);
 
+	err = audio_set_firstplay_handler(call->audio,
+					  audio_firstplay_handler);
+	if (err)
+		goto out;
+
 	/* We require at least one video codec, and at least one
 	   video source or video display */
 	use_video = (vidmode != VIDMODE_OFF)
@@ -904,6 +957,9 @@ int call_alloc(struct call **callp, const struct config *cfg, struct list *lst,
 	 */
 	list_append(lst, &call->le, call);
 
+	/* no event, the call is not ready for the handlers yet */
+	callsetup_add(CALL_SETUP_ALLOC, tmr_jiffies_usec() - t0);
+
  out:
 	if (err)
 		mem_deref(call);
@@ -1196,6 +1252,10 @@ int call_answer(struct call *call, uint16_t scode, enum vidmode vmode)
 
 	err = sipsess_answer(call->sess, scode, "Answering", desc,
 			     "Allow: %H\r\n", ua_print_allowed, call->ua);
+	if (!err) {
+		setup_mark(call, call->got_offer ?
+			   CALL_SETUP_ANSWER : CALL_SETUP_OFFER);
+	}
 
 	mem_deref(desc);
 
@@ -1366,7 +1426,8 @@ const char *call_alerturi(const struct call *call)
  */
 int call_debug(struct re_printf *pf, const struct call *call)
 {
-	int err;
+	struct media_cpu cpu;
+	int i, err;
 
 	if (!call)
 		return 0;
@@ -1387,13 +1448,55 @@ int call_debug(struct re_printf *pf, const struct call *call)
 	err |= re_hprintf(pf, " direction: %s\n",
 			  call->outgoing ? "Outgoing" : "Incoming");
 
+	err |= re_hprintf(pf, " setup [ms]:");
+	for (i=CALL_SETUP_OFFER; i<CALL_SETUP_MAX; i++) {
+
+		if (!call->setupv[i])
+			continue;
+
+		err |= re_hprintf(pf, " %s=%llu", call_setup_ev_name(i),
+				  (call->setupv[i] -
+				   call->setupv[CALL_SETUP_ALLOC]) / 1000);
+	}
+	err |= re_hprintf(pf, "\n");
+
 	/* SDP debug */
 	err |= sdp_session_debug(pf, call->sdp);
 
+	if (!call_media_cpu(call, &cpu)) {
+		err |= re_hprintf(pf, " media processing:\n");
+		err |= media_cpu_debug(pf, &cpu);
+	}
+
 	return err;
 }
 
 
+/**
+ * Get the CPU time spent in media processing of a call, summed up over
+ * all the media streams
+ *
+ * @param call Call object
+ * @param cpu  Returned CPU accounting
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int call_media_cpu(const struct call *call, struct media_cpu *cpu)
+{
+	struct le *le;
+
+	if (!call || !cpu)
+		return EINVAL;
+
+	memset(cpu, 0, sizeof(*cpu));
+
+	for (le = call->streaml.head; le; le = le->next)
+		media_cpu_merge(cpu, stream_media_cpu(le->data));
+
+	return 0;
+}
+
+
 static int print_duration(struct re_printf *pf, const struct call *call)
 {
 	const uint32_t dur = call_duration(call);
@@ -1576,6 +1679,8 @@ static int sipsess_answer_handler(const struct sip_msg *msg, void *arg)
 
 	debug("call: got SDP answer (%zu bytes)\n", mbuf_get_left(msg->mb));
 
+	setup_mark(call, CALL_SETUP_ANSWER);
+
 	call->got_offer = false;
 	call_event_handler(call, CALL_EVENT_ANSWERED, call->peer_uri);
 
@@ -1607,6 +1712,7 @@ static void sipsess_estab_handler(const struct sip_msg *msg, void *arg)
 		return;
 
 	set_state(call, CALL_STATE_ESTABLISHED);
+	setup_mark(call, CALL_SETUP_ESTABLISHED);
 
 	call_stream_start(call, true);
 
@@ -1848,6 +1954,7 @@ int call_accept(struct call *call, struct sipsess_sock *sess_sock,
 			return err;
 
 		call->got_offer = true;
+		setup_mark(call, CALL_SETUP_OFFER);
 
 		/*
 		 * Each media description in the SDP answer MUST
@@ -1969,6 +2076,10 @@ static void sipsess_progr_handler(const struct sip_msg *msg, void *arg)
 	else
 		media = false;
 
+	setup_mark(call, CALL_SETUP_RINGING);
+	if (media)
+		setup_mark(call, CALL_SETUP_ANSWER);
+
 	switch (msg->scode) {
 
 	case 180:
@@ -2060,6 +2171,8 @@ static int send_invite(struct call *call)
 	/* save call setup timer */
 	call->time_conn = time(NULL);
 
+	setup_mark(call, CALL_SETUP_OFFER);
+
 	ua_event(call->ua, UA_EVENT_CALL_LOCAL_SDP, call, "offer");
 
  out:
@@ -2158,6 +2271,23 @@ uint32_t call_setup_duration(const struct call *call)
 }
 
 
+/**
+ * Get the time of a call setup milestone
+ *
+ * @param call  Call object
+ * @param ev    Call setup milestone
+ *
+ * @return Time since the call was allocated in [us], 0 if not reached
+ */
+uint64_t call_setup_time(const struct call *call, enum call_setup_ev ev)
+{
+	if (!call || (unsigned)ev >= CALL_SETUP_MAX || !call->setupv[ev])
+		return 0;
+
+	return call->setupv[ev] - call->setupv[CALL_SETUP_ALLOC];
+}
+
+
 /**
  * Get the audio object for the current call
  *
@@ -0,0 +1,200 @@
+/**
+ * @file callsetup.c  Call setup latency histograms
+ *
+ * Copyright (C) 2010 Alfred E. Heggestad
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/**
+ * \page CallSetup Call setup latency
+ *
+ * Every call records a monotonic timestamp for each milestone of the call
+ * setup, from call_alloc() via the SDP offer/answer, media NAT, media
+ * encryption and RTP establishment up to the first audio frame that was
+ * played. Each milestone is reported with UA_EVENT_CALL_SETUP, with the
+ * parameter "<milestone>,<usec>" where usec is the time since call_alloc().
+ *
+ * The "alloc" milestone is the duration of call_alloc() itself.
+ *
+ * The times are aggregated into one histogram per milestone. A bin
+ * counts the times up to and including its limit. The histograms are
+ * printed with the debug command "callsetup", and are exported as the
+ * histogram baresip_call_setup_seconds with the label milestone.
+ */
+
+
+enum {
+	HIST_BINS = 12,
+};
+
+/** Histogram bin limits [ms] */
+static const uint32_t hist_limitv[HIST_BINS-1] = {
+	10, 25, 50, 100, 250, 500, 1000, 2500, 5000, 10000, 30000
+};
+
+/** Setup latency of one milestone */
+struct setup_hist {
+	uint64_t n;
+	uint64_t usec;
+	uint64_t usec_max;
+	uint64_t histv[HIST_BINS];
+};
+
+static struct {
+	struct setup_hist histv[CALL_SETUP_MAX];
+	struct metrics_fam *fam;
+} cs;
+
+
+/**
+ * Get the name of a call setup milestone
+ *
+ * @param ev Call setup milestone
+ *
+ * @return Name of the milestone
+ */
+const char *call_setup_ev_name(enum call_setup_ev ev)
+{
+	switch (ev) {
+
+	case CALL_SETUP_ALLOC:       return "alloc";
+	case CALL_SETUP_OFFER:       return "offer";
+	case CALL_SETUP_RINGING:     return "ringing";
+	case CALL_SETUP_ANSWER:      return "answer";
+	case CALL_SETUP_MNAT:        return "mnat";
+	case CALL_SETUP_MENC:        return "menc";
+	case CALL_SETUP_ESTABLISHED: return "established";
+	case CALL_SETUP_RTP:         return "rtp_estab";
+	case CALL_SETUP_AUDIO:       return "audio_play";
+	default:                     return "?";
+	}
+}
+
+
+/**
+ * Add the time of a call setup milestone to its histogram
+ *
+ * @param ev   Call setup milestone
+ * @param usec Time since call_alloc() in [us]
+ */
+void callsetup_add(enum call_setup_ev ev, uint64_t usec)
+{
+	struct setup_hist *h;
+	int i;
+
+	if ((unsigned)ev >= CALL_SETUP_MAX)
+		return;
+
+	h = &cs.histv[ev];
+
+	for (i=0; i<HIST_BINS-1; i++) {
+		if (usec <= hist_limitv[i] * 1000ULL)
+			break;
+	}
+
+	++h->histv[i];
+	++h->n;
+	h->usec += usec;
+	h->usec_max = max(h->usec_max, usec);
+}
+
+
+/* One histogram per milestone, the position is the milestone index */
+static int hist_collect(struct metrics_exp *exp, uint32_t *posp,
+			void *arg)
+{
+	double limitv[HIST_BINS-1];
+	uint32_t ev;
+	int i, err;
+	(void)arg;
+
+	for (i=0; i<HIST_BINS-1; i++)
+		limitv[i] = hist_limitv[i] / 1000.0;
+
+	for (ev = *posp; ev < CALL_SETUP_MAX; ev++) {
+
+		const struct setup_hist *h = &cs.histv[ev];
+
+		if (!h->n)
+			continue;
+
+		if (metrics_yield(exp)) {
+			*posp = ev;
+			return EAGAIN;
+		}
+
+		err = metrics_histogram(exp, limitv, h->histv, HIST_BINS-1,
+					h->usec / 1e6, "milestone=\"%s\"",
+					call_setup_ev_name(ev));
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+
+int callsetup_init(void)
+{
+	return metrics_register(&cs.fam, "baresip_call_setup_seconds",
+				METRICS_HISTOGRAM,
+				"Call setup milestones, time since call alloc",
+				hist_collect, NULL);
+}
+
+
+void callsetup_close(void)
+{
+	cs.fam = mem_deref(cs.fam);
+
+	memset(cs.histv, 0, sizeof(cs.histv));
+}
+
+
+/**
+ * Print the call setup latency histograms
+ *
+ * @param pf     Print function
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int callsetup_debug(struct re_printf *pf, void *unused)
+{
+	int ev, i, err = 0;
+	(void)unused;
+
+	err |= re_hprintf(pf, "Call setup latency since call alloc [ms]:\n");
+
+	for (ev=0; ev<CALL_SETUP_MAX; ev++) {
+		const struct setup_hist *h = &cs.histv[ev];
+
+		if (!h->n)
+			continue;
+
+		err |= re_hprintf(pf, "  %-12s n=%llu avg=%llu max=%llu\n"
+				  "              ",
+				  call_setup_ev_name(ev), h->n,
+				  h->usec / h->n / 1000, h->usec_max / 1000);
+
+		for (i=0; i<HIST_BINS; i++) {
+
+			if (i < HIST_BINS-1)
+				err |= re_hprintf(pf, " <=%u:%llu",
+						  hist_limitv[i],
+						  h->histv[i]);
+			else
+				err |= re_hprintf(pf, " >%u:%llu",
+						  hist_limitv[i-1],
+						  h->histv[i]);
+		}
+
+		err |= re_hprintf(pf, "\n");
+	}
+
+	return err;
+}
@@ -277,6 +277,7 @@ static int editor_input(struct commands *commands, struct mbuf *mb, char key,
 static int cmd_report(const struct cmd *cmd, struct re_printf *pf,
 		      struct mbuf *mb, void *data)
 {
+	struct mlprof_probe probe;
 	struct cmd_arg arg;
 	int err;
 
@@ -290,7 +291,9 @@ static int cmd_report(const struct cmd *cmd, struct re_printf *pf,
 	arg.key      = cmd->key;
 	arg.data     = data;
 
+	mlprof_enter(&probe, cmd->name);
 	err = cmd->h(pf, &arg);
+	mlprof_leave(&probe);
 
 	mem_deref(arg.prm);
 
@@ -341,8 +344,13 @@ int cmd_process_long(struct commands *commands, const char *str, size_t len,
 		arg.prm      = prm;
 		arg.data     = data;
 
-		if (cmd_long->h)
+		if (cmd_long->h) {
+			struct mlprof_probe probe;
+
+			mlprof_enter(&probe, cmd_long->name);
 			err = cmd_long->h(pf_resp, &arg);
+			mlprof_leave(&probe);
+		}
 	}
 	else {
 		(void)re_hprintf(pf_resp, "command not found (%s)\n", name);
@@ -541,13 +549,13 @@ int cmd_process(struct commands *commands, struct cmd_ctx **ctxp, char key,
 
 	cmd = cmd_find_by_key(commands, key);
 	if (cmd) {
+		struct mlprof_probe probe;
 		struct cmd_arg arg;
+		int err;
 
 		/* check for parameters */
 		if (cmd->flags & CMD_PRM) {
 
-			int err = 0;
-
 			if (ctxp) {
 				err = ctx_alloc(ctxp, cmd);
 				if (err)
@@ -563,7 +571,11 @@ int cmd_process(struct commands *commands, struct cmd_ctx **ctxp, char key,
 		arg.prm      = NULL;
 		arg.data     = data;
 
-		return cmd->h(pf, &arg);
+		mlprof_enter(&probe, cmd->name);
+		err = cmd->h(pf, &arg);
+		mlprof_leave(&probe);
+
+		return err;
 	}
 	else if (key == LONG_PREFIX) {
 
@@ -0,0 +1,433 @@
+/**
+ * @file codecpool.c  Pools of pre-allocated codec states
+ *
+ * Copyright (C) 2010 Alfred E. Heggestad
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/**
+ * \page CodecPool Codec state pools
+ *
+ * The allocation of a codec state (e.g. opus_encoder_create() or
+ * avcodec_open2()) can dominate the call setup time. A pool keeps a
+ * number of pre-allocated encoder and decoder states per codec and fmtp.
+ * On call setup a ready state is handed out, and the codec update handler
+ * only has to apply the parameters to it.
+ *
+ * The pool of a codec and fmtp is created by the first call using it,
+ * and is refilled from the main loop after a state was handed out, so
+ * the allocation is not done during the call setup.
+ *
+ * A state is not returned to the pool on teardown. The codec API has no
+ * handler to reset a state, and a used state would leak the history of
+ * the previous call into the next one.
+ *
+ * Video encoders are not pooled, since their state is bound to the
+ * packet handler of the video stream.
+ *
+ * The pools are kept in the order of their last use. If the number of
+ * pools reaches codec_pool_keys, the least recently used pool and its
+ * states are dropped to make room for a new codec and fmtp.
+ *
+ * Example config:
+ \verbatim
+  codec_pool_size       4       # ready states per codec and fmtp
+  codec_pool_keys       16      # max. number of codec and fmtp pairs
+ \endverbatim
+ */
+
+
+enum {
+	POOL_MAX  = 32,          /**< Max. number of states per pool        */
+	HIST_BINS = 10,
+};
+
+/** Histogram bin limits [us] */
+static const uint32_t hist_limitv[HIST_BINS-1] = {
+	50, 100, 250, 500, 1000, 2500, 5000, 10000, 25000
+};
+
+static const char *kind_namev[CODECPOOL_KINDS] = {
+	"auenc", "audec", "viddec"
+};
+
+/** Pool of states for one codec and fmtp */
+struct pool {
+	struct le le;
+	enum codecpool_kind kind;
+	const void *codec;
+	char *fmtp;
+	void *statev[POOL_MAX];
+	uint32_t n;              /**< Number of ready states                */
+	uint32_t n_hit;
+	uint32_t n_miss;
+};
+
+/** Setup latency of one codec kind */
+struct setup_stat {
+	uint64_t n;
+	uint64_t n_hit;
+	uint64_t usec;
+	uint32_t usec_max;
+	uint32_t histv[HIST_BINS];
+};
+
+static struct {
+	struct list pooll;       /**< Pools, least recently used first      */
+	struct tmr tmr;
+	uint32_t size;           /**< Ready states per pool, 0 is disabled  */
+	uint32_t keys;           /**< Max. number of pools                  */
+	uint32_t n_evict;        /**< Pools dropped to make room            */
+	struct setup_stat statv[CODECPOOL_KINDS];
+} cp;
+
+
+static void pool_flush(struct pool *p)
+{
+	while (p->n) {
+		--p->n;
+		p->statev[p->n] = mem_deref(p->statev[p->n]);
+	}
+}
+
+
+static void pool_destructor(void *arg)
+{
+	struct pool *p = arg;
+
+	list_unlink(&p->le);
+	pool_flush(p);
+	mem_deref(p->fmtp);
+}
+
+
+static const char *codec_name(const struct pool *p)
+{
+	if (p->kind == CODECPOOL_VIDDEC)
+		return ((const struct vidcodec *)p->codec)->name;
+
+	return ((const struct aucodec *)p->codec)->name;
+}
+
+
+static int state_alloc(void **stp, const struct pool *p)
+{
+	int err = ENOTSUP;
+
+	switch (p->kind) {
+
+	case CODECPOOL_AUENC: {
+		const struct aucodec *ac = p->codec;
+		struct auenc_state *aes = NULL;
+		struct auenc_param prm;
+
+		prm.bitrate = 0;        /* auto */
+
+		if (ac->encupdh)
+			err = ac->encupdh(&aes, ac, &prm, p->fmtp);
+		*stp = aes;
+	}
+		break;
+
+	case CODECPOOL_AUDEC: {
+		const struct aucodec *ac = p->codec;
+		struct audec_state *ads = NULL;
+
+		if (ac->decupdh)
+			err = ac->decupdh(&ads, ac, p->fmtp);
+		*stp = ads;
+	}
+		break;
+
+	case CODECPOOL_VIDDEC: {
+		const struct vidcodec *vc = p->codec;
+		struct viddec_state *vds = NULL;
+
+		if (vc->decupdh)
+			err = vc->decupdh(&vds, vc, p->fmtp);
+		*stp = vds;
+	}
+		break;
+
+	default:
+		break;
+	}
+
+	if (err)
+		*stp = mem_deref(*stp);
+
+	return err;
+}
+
+
+static bool pool_cmp(const struct pool *p, enum codecpool_kind kind,
+		     const void *codec, const char *fmtp)
+{
+	return p->kind == kind && p->codec == codec &&
+		0 == str_cmp(p->fmtp, fmtp ? fmtp : "");
+}
+
+
+/* Allocate one state per timer tick, to keep the main loop responsive */
+static void refill_handler(void *arg)
+{
+	struct le *le;
+	(void)arg;
+
+	for (le = list_head(&cp.pooll); le; le = le->next) {
+		struct pool *p = le->data;
+		void *st = NULL;
+
+		if (p->n >= cp.size)
+			continue;
+
+		if (state_alloc(&st, p)) {
+			warning("codecpool: %s %s: could not allocate state\n",
+				kind_namev[p->kind], codec_name(p));
+
+			/* the pool of a failing codec is removed */
+			mem_deref(p);
+		}
+		else {
+			p->statev[p->n++] = st;
+		}
+
+		tmr_start(&cp.tmr, 0, refill_handler, NULL);
+		return;
+	}
+}
+
+
+/**
+ * Get a ready codec state from the pool. The caller must apply the
+ * parameters with the update handler of the codec.
+ *
+ * @param kind  Kind of codec state
+ * @param codec Audio codec or video codec
+ * @param fmtp  Format parameters (optional)
+ *
+ * @return Codec state, or NULL if no state is ready
+ */
+void *codecpool_get(enum codecpool_kind kind, const void *codec,
+		    const char *fmtp)
+{
+	struct pool *p = NULL;
+	struct le *le;
+	void *st = NULL;
+
+	if (!cp.size || !codec || (unsigned)kind >= CODECPOOL_KINDS)
+		return NULL;
+
+	for (le = list_head(&cp.pooll); le; le = le->next) {
+
+		if (pool_cmp(le->data, kind, codec, fmtp)) {
+			p = le->data;
+			break;
+		}
+	}
+
+	if (p) {
+		/* most recently used at the tail */
+		list_unlink(&p->le);
+		list_append(&cp.pooll, &p->le, p);
+	}
+	else {
+		if (!cp.keys)
+			return NULL;
+
+		if (list_count(&cp.pooll) >= cp.keys) {
+			struct pool *lru = list_ledata(list_head(&cp.pooll));
+
+			debug("codecpool: dropping pool %s %s\n",
+			      kind_namev[lru->kind], codec_name(lru));
+
+			mem_deref(lru);
+			++cp.n_evict;
+		}
+
+		p = mem_zalloc(sizeof(*p), pool_destructor);
+		if (!p)
+			return NULL;
+
+		p->kind  = kind;
+		p->codec = codec;
+
+		if (str_dup(&p->fmtp, fmtp ? fmtp : "")) {
+			mem_deref(p);
+			return NULL;
+		}
+
+		list_append(&cp.pooll, &p->le, p);
+	}
+
+	if (p->n) {
+		st = p->statev[--p->n];
+		p->statev[p->n] = NULL;
+		++p->n_hit;
+	}
+	else {
+		++p->n_miss;
+	}
+
+	tmr_start(&cp.tmr, 0, refill_handler, NULL);
+
+	return st;
+}
+
+
+/**
+ * Flush the pools of a codec, before the codec is unregistered
+ *
+ * @param codec Audio codec or video codec
+ */
+void codecpool_flush_codec(const void *codec)
+{
+	struct le *le = list_head(&cp.pooll);
+
+	while (le) {
+		struct pool *p = le->data;
+
+		le = le->next;
+
+		if (p->codec == codec)
+			mem_deref(p);
+	}
+}
+
+
+/**
+ * Account the setup time of a new codec state, allocated or taken
+ * from the pool
+ *
+ * @param kind Kind of codec state
+ * @param t0   Start time from tmr_jiffies_usec()
+ * @param hit  True if the state was taken from the pool
+ */
+void codecpool_setup_time(enum codecpool_kind kind, uint64_t t0, bool hit)
+{
+	struct setup_stat *st;
+	uint32_t usec;
+	int i;
+
+	if ((unsigned)kind >= CODECPOOL_KINDS)
+		return;
+
+	st = &cp.statv[kind];
+	usec = (uint32_t)(tmr_jiffies_usec() - t0);
+
+	for (i=0; i<HIST_BINS-1; i++) {
+		if (usec < hist_limitv[i])
+			break;
+	}
+
+	++st->histv[i];
+	++st->n;
+	st->usec += usec;
+	st->usec_max = max(st->usec_max, usec);
+	if (hit)
+		++st->n_hit;
+}
+
+
+/**
+ * Initialise the codec state pools
+ *
+ * @param conf Configuration
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int codecpool_init(const struct conf *conf)
+{
+	cp.size = 0;
+	cp.keys = 16;
+	(void)conf_get_u32(conf, "codec_pool_size", &cp.size);
+	(void)conf_get_u32(conf, "codec_pool_keys", &cp.keys);
+
+	if (cp.size > POOL_MAX) {
+		warning("codecpool: size limited to %u\n", POOL_MAX);
+		cp.size = POOL_MAX;
+	}
+
+	if (cp.size) {
+		info("codecpool: %u states per codec (max %u codecs)\n",
+		     cp.size, cp.keys);
+	}
+
+	return 0;
+}
+
+
+/**
+ * Close the codec state pools
+ */
+void codecpool_close(void)
+{
+	tmr_cancel(&cp.tmr);
+	list_flush(&cp.pooll);
+	memset(cp.statv, 0, sizeof(cp.statv));
+	cp.n_evict = 0;
+}
+
+
+/**
+ * Print the codec state pools and the setup latency histograms
+ *
+ * @param pf     Print function
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int codecpool_debug(struct re_printf *pf, void *unused)
+{
+	struct le *le;
+	int i, j, err = 0;
+	(void)unused;
+
+	err |= re_hprintf(pf, "Codec state pools (size=%u keys=%u/%u"
+			  " dropped=%u):\n",
+			  cp.size, list_count(&cp.pooll), cp.keys,
+			  cp.n_evict);
+
+	for (le = list_head(&cp.pooll); le; le = le->next) {
+		const struct pool *p = le->data;
+
+		err |= re_hprintf(pf, "  %-6s %-10s ready=%u hit=%u miss=%u"
+				  " fmtp=\"%s\"\n",
+				  kind_namev[p->kind], codec_name(p), p->n,
+				  p->n_hit, p->n_miss, p->fmtp);
+	}
+
+	err |= re_hprintf(pf, "Codec setup latency [us]:\n");
+
+	for (i=0; i<CODECPOOL_KINDS; i++) {
+		const struct setup_stat *st = &cp.statv[i];
+
+		if (!st->n)
+			continue;
+
+		err |= re_hprintf(pf, "  %-6s n=%llu hit=%llu avg=%llu"
+				  " max=%u\n        ",
+				  kind_namev[i], st->n, st->n_hit,
+				  st->usec / st->n, st->usec_max);
+
+		for (j=0; j<HIST_BINS; j++) {
+
+			if (j < HIST_BINS-1)
+				err |= re_hprintf(pf, " <%u:%u",
+						  hist_limitv[j],
+						  st->histv[j]);
+			else
+				err |= re_hprintf(pf, " >=%u:%u",
+						  hist_limitv[j-1],
+						  st->histv[j]);
+		}
+
+		err |= re_hprintf(pf, "\n");
+	}
+
+	return err;
+}
@@ -86,20 +86,32 @@ int conf_parse(const char *filename, confline_h *ch, void *arg)
 {
 	struct pl pl, val;
 	struct mbuf *mb;
+	struct stat st;
+	size_t size = 1024;
 	int err = 0, fd = open(filename, O_RDONLY);
 	if (fd < 0)
 		return errno;
 
-	mb = mbuf_alloc(1024);
+	/* read large files, like bulk account lists, in one go */
+	if (0 == fstat(fd, &st) && st.st_size > 0)
+		size = (size_t)st.st_size + 1;
+
+	mb = mbuf_alloc(size);
 	if (!mb) {
 		err = ENOMEM;
 		goto out;
 	}
 
 	for (;;) {
-		uint8_t buf[1024];
+		ssize_t n;
+
+		if (mb->end == mb->size) {
+			err = mbuf_resize(mb, mb->size * 2);
+			if (err)
+				break;
+		}
 
-		const ssize_t n = read(fd, (void *)buf, sizeof(buf));
+		n = read(fd, (void *)(mb->buf + mb->end), mb->size - mb->end);
 		if (n < 0) {
 			err = errno;
 			break;
@@ -107,7 +119,7 @@ int conf_parse(const char *filename, confline_h *ch, void *arg)
 		else if (n == 0)
 			break;
 
-		err |= mbuf_write_mem(mb, buf, n);
+		mb->end += n;
 	}
 
 	pl.p = (const char *)mb->buf;
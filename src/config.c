@@ -35,13 +35,16 @@ static struct config core_config = {
 		SIP_TRANSP_UDP,
 		false,
 		0xa0,
+		0,
+		0,
 	},
 
 	/** Call config */
 	{
 		120,
 		4,
-		true
+		true,
+		""
 	},
 
 	/** Audio */
@@ -61,7 +64,9 @@ static struct config core_config = {
 		AUFMT_S16LE,
 		AUFMT_S16LE,
 		{20, 160},
-		101
+		101,
+		false,
+		95,
 	},
 
 	/** Video */
@@ -73,6 +78,8 @@ static struct config core_config = {
 		30,
 		true,
 		VID_FMT_YUV420P,
+		false,
+		false,
 	},
 
 	/** Audio/Video Transport */
@@ -348,6 +355,9 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 	if (0 == conf_get_u32(conf, "sip_tos", &v))
 		cfg->sip.tos = v;
 
+	(void)conf_get_u32(conf, "sip_reg_window", &cfg->sip.reg_window);
+	(void)conf_get_u32(conf, "sip_reg_inflight", &cfg->sip.reg_inflight);
+
 	/* Call */
 	(void)conf_get_u32(conf, "call_local_timeout",
 			   &cfg->call.local_timeout);
@@ -355,6 +365,8 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 			   &cfg->call.max_calls);
 	(void)conf_get_bool(conf, "call_hold_other_calls",
 			   &cfg->call.hold_other_calls);
+	(void)conf_get_str(conf, "call_acl", cfg->call.acl,
+			   sizeof(cfg->call.acl));
 
 	/* Audio */
 	(void)conf_get_str(conf, "audio_path", cfg->audio.audio_path,
@@ -405,6 +417,11 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 	}
 
 	(void)conf_get_u32(conf, "audio_telev_pt", &cfg->audio.telev_pt);
+	(void)conf_get_bool(conf, "audio_encoder_shared",
+			    &cfg->audio.enc_shared);
+	(void)conf_get_u32(conf, "audio_jitter_percentile",
+			   &cfg->audio.jitter_pct);
+	cfg->audio.jitter_pct = min(cfg->audio.jitter_pct, 100);
 
 	/* Video */
 	(void)conf_get_csv(conf, "video_source",
@@ -422,6 +439,10 @@ int config_parse_conf(struct config *cfg, const struct conf *conf)
 	(void)conf_get_bool(conf, "video_fullscreen", &cfg->video.fullscreen);
 
 	conf_get_vidfmt(conf, "videnc_format", &cfg->video.enc_fmt);
+	(void)conf_get_bool(conf, "video_source_shared",
+			    &cfg->video.src_shared);
+	(void)conf_get_bool(conf, "video_encoder_shared",
+			    &cfg->video.enc_shared);
 
 	/* AVT - Audio/Video Transport */
 	if (0 == conf_get_u32(conf, "rtp_tos", &v))
@@ -487,11 +508,14 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 "sip_trans_def\t%s\n"
 			 "sip_verify_server\t\t\t%s\n"
 			 "sip_tos\t%u\n"
+			 "sip_reg_window\t%u ms\n"
+			 "sip_reg_inflight\t%u\n"
 			 "\n"
 			 "# Call\n"
 			 "call_local_timeout\t%u\n"
 			 "call_max_calls\t\t%u\n"
 			 "call_hold_other_calls\t%s\n"
+			 "call_acl\t\t%s\n"
 			 "\n"
 			 "# Audio\n"
 			 "audio_path\t\t%s\n"
@@ -510,6 +534,8 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 "audec_format\t\t%s\n"
 			 "audio_buffer\t\t%H\t\t# ms\n"
 			 "audio_telev_pt\t\t%u\n"
+			 "audio_encoder_shared\t%s\n"
+			 "audio_jitter_percentile\t%u\n"
 			 "\n"
 			 "# Video\n"
 			 "video_source\t\t%s,%s\n"
@@ -520,6 +546,8 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 "video_fps\t\t%.2f\n"
 			 "video_fullscreen\t%s\n"
 			 "videnc_format\t\t%s\n"
+			 "video_source_shared\t%s\n"
+			 "video_encoder_shared\t%s\n"
 			 "\n"
 			 "# AVT\n"
 			 "rtp_tos\t\t\t%u\n"
@@ -544,10 +572,13 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 sip_transp_name(cfg->sip.transp),
 			 cfg->sip.verify_server ? "yes" : "no",
 			 cfg->sip.tos,
+			 cfg->sip.reg_window,
+			 cfg->sip.reg_inflight,
 
 			 cfg->call.local_timeout,
 			 cfg->call.max_calls,
 			 cfg->call.hold_other_calls ? "yes" : "no",
+			 cfg->call.acl,
 
 			 cfg->audio.audio_path,
 			 cfg->audio.play_mod,  cfg->audio.play_dev,
@@ -564,6 +595,8 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 aufmt_name(cfg->audio.dec_fmt),
 			 range_print, &cfg->audio.buffer,
 			 cfg->audio.telev_pt,
+			 cfg->audio.enc_shared ? "yes" : "no",
+			 cfg->audio.jitter_pct,
 
 			 cfg->video.src_mod, cfg->video.src_dev,
 			 cfg->video.disp_mod, cfg->video.disp_dev,
@@ -571,6 +604,8 @@ int config_print(struct re_printf *pf, const struct config *cfg)
 			 cfg->video.bitrate, cfg->video.fps,
 			 cfg->video.fullscreen ? "yes" : "no",
 			 vidfmt_name(cfg->video.enc_fmt),
+			 cfg->video.src_shared ? "yes" : "no",
+			 cfg->video.enc_shared ? "yes" : "no",
 
 			 cfg->avt.rtp_tos,
 			 cfg->avt.rtpv_tos,
@@ -692,6 +727,17 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 				", kqueue .."
 #endif
 				"\n"
+			  "#log_async\t\tno\t\t# log from a separate thread\n"
+			  "#log_ratelimit\t\t0\t\t# messages per second\n"
+			  "#mainloop_profile\tno\n"
+			  "#mainloop_stall_ms\t50\n"
+			  "#mthread_audio_src\tfifo:60 cpus=2,3"
+				"\t# other, fifo, rr\n"
+			  "#mthread_audio_play\tfifo:60 cpus=2,3\n"
+			  "#mthread_audio_proc\trr:50 cpus=2,3\n"
+			  "#mthread_video_src\tother cpus=0-1\n"
+			  "#codec_pool_size\t4\t\t# 0 is disabled\n"
+			  "#codec_pool_keys\t16\n"
 			  "\n# SIP\n"
 			  "#sip_listen\t\t0.0.0.0:5060\n"
 			  "#sip_certificate\tcert.pem\n"
@@ -705,11 +751,14 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 			  "#sip_trans_def\t\tudp\n"
 			  "#sip_verify_server\tyes\n"
 			  "sip_tos\t\t\t160\n"
+			  "#sip_reg_window\t\t0\t\t# spread REGISTERs [ms]\n"
+			  "#sip_reg_inflight\t0\t\t# 0 is unlimited\n"
 			  "\n"
 			  "# Call\n"
 			  "call_local_timeout\t%u\n"
 			  "call_max_calls\t\t%u\n"
 			  "call_hold_other_calls\tyes\n"
+			  "#call_acl\t\t/path/to/acl\t# call screening\n"
 			  "\n"
 			  "# Audio\n"
 #if defined (SHARE_PATH)
@@ -735,6 +784,9 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 			  "audio_buffer\t\t%H\t\t# ms\n"
 			  "audio_telev_pt\t\t%u\t\t"
 			  "# payload type for telephone-event\n"
+			  "#audio_encoder_shared\tno\n"
+			  "#audio_jitter_percentile\t95\t\t"
+			  "# adaptive playout target\n"
 			  ,
 			  poll_method_name(poll_method_best()),
 			  default_cafile(),
@@ -755,6 +807,8 @@ static int core_config_template(struct re_printf *pf, const struct config *cfg)
 			  "video_fps\t\t%.2f\n"
 			  "video_fullscreen\tno\n"
 			  "videnc_format\t\t%s\n"
+			  "#video_source_shared\tno\n"
+			  "#video_encoder_shared\tno\n"
 			  ,
 			  default_video_device(),
 			  default_video_display(),
@@ -978,6 +1032,7 @@ int config_write_template(const char *file, const struct config *cfg)
 #endif
 	(void)re_fprintf(f, "#module\t\t\t" "jack" MOD_EXT "\n");
 	(void)re_fprintf(f, "#module\t\t\t" "portaudio" MOD_EXT "\n");
+	(void)re_fprintf(f, "#module\t\t\t" "aubcast" MOD_EXT "\n");
 	(void)re_fprintf(f, "#module\t\t\t" "aubridge" MOD_EXT "\n");
 	(void)re_fprintf(f, "#module\t\t\t" "aufile" MOD_EXT "\n");
 	(void)re_fprintf(f, "#module\t\t\t" "ausine" MOD_EXT "\n");
@@ -1048,6 +1103,18 @@ int config_write_template(const char *file, const struct config *cfg)
 	(void)re_fprintf(f, "module_tmp\t\t" "account" MOD_EXT "\n");
 	(void)re_fprintf(f, "\n");
 
+	(void)re_fprintf(f, "\n#------------------------------------"
+			 "------------------------------------------\n");
+	(void)re_fprintf(f, "# Lazy Modules (loaded on first use)\n");
+	(void)re_fprintf(f, "\n");
+	(void)re_fprintf(f, "#module_lazy\t\t" "opus" MOD_EXT
+			 "\taucodec:opus\n");
+	(void)re_fprintf(f, "#module_lazy\t\t" "dtls_srtp" MOD_EXT
+			 "\tmenc:dtls_srtp,dtls_srtpf\n");
+	(void)re_fprintf(f, "#module_lazy\t\t" "v4l2" MOD_EXT
+			 "\tvidsrc:v4l2\n");
+	(void)re_fprintf(f, "\n");
+
 	(void)re_fprintf(f, "\n#------------------------------------"
 			 "------------------------------------------\n");
 	(void)re_fprintf(f, "# Application Modules\n");
@@ -1202,6 +1269,8 @@ int config_write_template(const char *file, const struct config *cfg)
 			 "\n# multicast receivers (in priority order)"
 			 "- port number must be even\n"
 			 "#multicast_call_prio\t0\n"
+			 "#multicast_mix\t\tno\n"
+			 "#multicast_duck\t\t30\n"
 			 "#multicast_listener\t224.0.2.21:50000\n"
 			 "#multicast_listener\t224.0.2.21:50002\n");
 
@@ -1213,6 +1282,31 @@ int config_write_template(const char *file, const struct config *cfg)
 			 "#avformat_pass_through\tyes\n"
 			 "#avformat_rtsp_transport\tudp\n");
 
+	(void)re_fprintf(f,
+			 "\n# aubcast\n"
+			 "#aubcast_loop\t\tyes\n");
+
+	(void)re_fprintf(f,
+			 "\n# aufile\n"
+			 "#aufile_stream\t\tyes\t\t"
+			 "# stream and share open files\n");
+
+	(void)re_fprintf(f,
+			 "\n# presence\n"
+			 "#presence_rate\t\t20\t\t# SUBSCRIBEs per second\n"
+			 "#presence_expires\t600\n"
+			 "#presence_rls_uri\tsip:buddies@example.com\n");
+
+	(void)re_fprintf(f,
+			 "\n# v4l2\n"
+			 "#v4l2_buffers\t\t4\n"
+			 "#v4l2_passthrough\tno\n");
+
+	(void)re_fprintf(f,
+			 "\n# x11grab\n"
+			 "#x11grab_shm\t\tyes\n"
+			 "#x11grab_damage\t\tno\n");
+
 	if (f)
 		(void)fclose(f);
 
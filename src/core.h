@@ -88,8 +88,17 @@ struct account {
 
 struct audio;
 
+/** Audio buffer overrun/underrun counters */
+struct audio_aubuf_stat {
+	uint64_t tx_overrun;
+	uint64_t tx_underrun;
+	uint64_t rx_overrun;
+	uint64_t rx_underrun;
+};
+
 int  audio_send_digit(struct audio *a, char key);
 void audio_sdp_attr_decode(struct audio *a);
+int  audio_aubuf_stat(const struct audio *a, struct audio_aubuf_stat *st);
 
 
 /*
@@ -127,6 +136,15 @@ int  call_af(const struct call *call);
 void call_set_xrtpstat(struct call *call);
 void call_set_custom_hdrs(struct call *call, const struct list *hdrs);
 
+
+/*
+ * Call setup latency
+ */
+
+int  callsetup_init(void);
+void callsetup_close(void);
+void callsetup_add(enum call_setup_ev ev, uint64_t usec);
+
 /*
 * Custom headers
 */
@@ -144,13 +162,40 @@ int conf_get_csv(const struct conf *conf, const char *name,
 int conf_get_float(const struct conf *conf, const char *name, double *val);
 
 
+/*
+ * Encoder Sharing
+ */
+
+struct encshare_memb;
+
+typedef int (encshare_pkt_h)(bool marker, uint64_t ts,
+			     const uint8_t *hdr, size_t hdr_len,
+			     const uint8_t *pld, size_t pld_len,
+			     void *arg);
+typedef int (encshare_alloc_h)(void **encp, encshare_pkt_h *pkth,
+			       void *pkth_arg, void *arg);
+
+int   encshare_join(struct encshare_memb **mp, const char *key,
+		    encshare_alloc_h *alloch, void *alloc_arg,
+		    encshare_pkt_h *pkth, void *arg);
+void *encshare_enc(const struct encshare_memb *m);
+const char *encshare_key(const struct encshare_memb *m);
+bool  encshare_leader(const struct encshare_memb *m);
+void  encshare_request_picup(struct encshare_memb *m);
+bool  encshare_picup(struct encshare_memb *m, bool local);
+int   encshare_send(struct encshare_memb *m, bool marker, uint64_t ts,
+		    const uint8_t *hdr, size_t hdr_len,
+		    const uint8_t *pld, size_t pld_len);
+int   encshare_debug(struct re_printf *pf, const struct encshare_memb *m);
+
+
 /*
  * Metric
  */
 
 struct metric {
 	/* internal stuff: */
-	struct tmr tmr;
+	struct tmrw tmr;
 	struct lock *lock;
 	uint64_t ts_start;
 	bool started;
@@ -172,11 +217,56 @@ void     metric_add_packet(struct metric *metric, size_t packetsize);
 double   metric_avg_bitrate(const struct metric *metric);
 
 
+/*
+ * Call-screening access control list
+ */
+
+void acl_close(void);
+
+
+/*
+ * Metrics registry
+ */
+
+int  metrics_init(void);
+void metrics_close(void);
+
+
+/*
+ * Codec state pools
+ */
+
+enum codecpool_kind {
+	CODECPOOL_AUENC = 0,
+	CODECPOOL_AUDEC,
+	CODECPOOL_VIDDEC,
+
+	CODECPOOL_KINDS
+};
+
+int   codecpool_init(const struct conf *conf);
+void  codecpool_close(void);
+void *codecpool_get(enum codecpool_kind kind, const void *codec,
+		    const char *fmtp);
+void  codecpool_flush_codec(const void *codec);
+void  codecpool_setup_time(enum codecpool_kind kind, uint64_t t0, bool hit);
+
+
+/*
+ * Media thread factory
+ */
+
+int  mthread_init(const struct conf *conf);
+void mthread_close(void);
+
+
 /*
  * Module
  */
 
-int module_init(const struct conf *conf);
+int  module_init(const struct conf *conf);
+void module_close(void);
+void module_lazy_media(void);
 
 
 /*
@@ -258,6 +348,8 @@ typedef void (stream_rtp_h)(const struct rtp_header *hdr,
 			    struct rtpext *extv, size_t extc,
 			    struct mbuf *mb, unsigned lostc, void *arg);
 typedef int (stream_pt_h)(uint8_t pt, struct mbuf *mb, void *arg);
+typedef void (stream_arrival_h)(const struct rtp_header *hdr,
+				uint64_t ts_arrival, void *arg);
 
 
 struct stream;
@@ -284,11 +376,14 @@ void stream_enable_rtp_timeout(struct stream *strm, uint32_t timeout_ms);
 bool stream_is_ready(const struct stream *strm);
 int  stream_decode(struct stream *s);
 void stream_silence_on(struct stream *s, bool on);
+void stream_set_arrival_handler(struct stream *s, stream_arrival_h *arrivalh);
 const struct sa *stream_raddr(const struct stream *strm);
 enum media_type stream_type(const struct stream *strm);
 int stream_pt_enc(const struct stream *strm);
 struct rtp_sock *stream_rtp_sock(const struct stream *strm);
 int stream_ssrc_rx(const struct stream *strm, uint32_t *ssrc);
+struct media_cpu *stream_cpu(struct stream *strm);
+uint32_t stream_jbuf_packets(const struct stream *strm);
 int  stream_print(struct re_printf *pf, const struct stream *s);
 
 
@@ -0,0 +1,403 @@
+/**
+ * @file encshare.c  Encoder sharing
+ *
+ * Copyright (C) 2010 Alfred E. Heggestad
+ */
+
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/*
+ * Outgoing streams with the same source and the same negotiated codec
+ * parameters can share one encoder. The encoder state is owned by a group,
+ * which is identified by a key string built by the media stream.
+ *
+ * The first member in the group is the leader, and only the leader does
+ * the encoding. The encoded packets are fanned out to all members, and
+ * each member sends them with its own SSRC, sequence number and timestamp
+ * offset. Picture update requests from the members are coalesced into
+ * one keyframe for the whole group.
+ *
+ * A member must stop calling the encoder before it leaves the group,
+ * so that there is never more than one encoding thread per group.
+ */
+
+
+/** Defines a group of streams sharing an encoder */
+struct encshare {
+	struct le le;           /**< Member of group list              */
+	char *key;              /**< Source, codec, fmtp and bitrate   */
+	struct lock *lock;      /**< Protects the list of members      */
+	struct list membl;      /**< Members (struct encshare_memb)    */
+	void *enc;              /**< Shared encoder state              */
+	bool picup;             /**< Pending picture update request    */
+
+	struct {
+		uint64_t n_pkt;       /**< Packets from encoder        */
+		uint32_t n_picup_req; /**< Picture update requests     */
+		uint32_t n_keyframe;  /**< Coalesced keyframes         */
+	} stats;
+};
+
+/** Defines one stream in an encoder group */
+struct encshare_memb {
+	struct le le;           /**< Member of encshare membl          */
+	struct encshare *grp;   /**< Encoder group (reference)         */
+	encshare_pkt_h *pkth;   /**< Packet handler for this stream    */
+	void *arg;              /**< Handler argument                  */
+	uint64_t n_pkt;         /**< Packets sent to this stream       */
+	uint64_t n_err;         /**< Packets that failed               */
+};
+
+
+static struct list encsharel = LIST_INIT;
+
+
+static void encshare_destructor(void *arg)
+{
+	struct encshare *grp = arg;
+
+	list_unlink(&grp->le);
+	mem_deref(grp->enc);
+	mem_deref(grp->lock);
+	mem_deref(grp->key);
+}
+
+
+static void memb_destructor(void *arg)
+{
+	struct encshare_memb *m = arg;
+	struct encshare *grp = m->grp;
+
+	if (grp) {
+		lock_write_get(grp->lock);
+		list_unlink(&m->le);
+		lock_rel(grp->lock);
+	}
+
+	mem_deref(grp);
+}
+
+
+static void deliver(struct encshare_memb *m, bool marker, uint64_t ts,
+		    const uint8_t *hdr, size_t hdr_len,
+		    const uint8_t *pld, size_t pld_len)
+{
+	if (m->pkth(marker, ts, hdr, hdr_len, pld, pld_len, m->arg))
+		++m->n_err;
+	else
+		++m->n_pkt;
+}
+
+
+/*
+ * Packet handler for the shared encoder, called from the encoding
+ * thread of the leader
+ */
+static int fanout_handler(bool marker, uint64_t ts,
+			  const uint8_t *hdr, size_t hdr_len,
+			  const uint8_t *pld, size_t pld_len,
+			  void *arg)
+{
+	struct encshare *grp = arg;
+	struct le *le;
+
+	lock_read_get(grp->lock);
+
+	++grp->stats.n_pkt;
+
+	for (le = grp->membl.head; le; le = le->next)
+		deliver(le->data, marker, ts, hdr, hdr_len, pld, pld_len);
+
+	lock_rel(grp->lock);
+
+	return 0;
+}
+
+
+static struct encshare *encshare_find(const char *key)
+{
+	struct le *le;
+
+	for (le = encsharel.head; le; le = le->next) {
+
+		struct encshare *grp = le->data;
+
+		if (0 == str_cmp(grp->key, key))
+			return grp;
+	}
+
+	return NULL;
+}
+
+
+static int encshare_alloc(struct encshare **grpp, const char *key,
+			  encshare_alloc_h *alloch, void *arg)
+{
+	struct encshare *grp;
+	int err;
+
+	grp = mem_zalloc(sizeof(*grp), encshare_destructor);
+	if (!grp)
+		return ENOMEM;
+
+	err  = str_dup(&grp->key, key);
+	err |= lock_alloc(&grp->lock);
+	if (err)
+		goto out;
+
+	err = alloch(&grp->enc, fanout_handler, grp, arg);
+	if (err)
+		goto out;
+
+	list_append(&encsharel, &grp->le, grp);
+
+	debug("encshare: new encoder group '%s'\n", key);
+
+ out:
+	if (err)
+		mem_deref(grp);
+	else
+		*grpp = grp;
+
+	return err;
+}
+
+
+/**
+ * Join an encoder group, or create a new group if there is no group with
+ * the same key. The allocation handler is only called for a new group.
+ *
+ * @param mp        Pointer to allocated group member
+ * @param key       Group key, e.g. source, codec, fmtp and bitrate
+ * @param alloch    Encoder allocation handler
+ * @param alloc_arg Allocation handler argument
+ * @param pkth      Packet handler for this member
+ * @param arg       Packet handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int encshare_join(struct encshare_memb **mp, const char *key,
+		  encshare_alloc_h *alloch, void *alloc_arg,
+		  encshare_pkt_h *pkth, void *arg)
+{
+	struct encshare_memb *m;
+	struct encshare *grp;
+	int err = 0;
+
+	if (!mp || !str_isset(key) || !alloch || !pkth)
+		return EINVAL;
+
+	m = mem_zalloc(sizeof(*m), memb_destructor);
+	if (!m)
+		return ENOMEM;
+
+	m->pkth = pkth;
+	m->arg  = arg;
+
+	grp = encshare_find(key);
+	if (grp) {
+		m->grp = mem_ref(grp);
+	}
+	else {
+		err = encshare_alloc(&m->grp, key, alloch, alloc_arg);
+		if (err)
+			goto out;
+
+		grp = m->grp;
+	}
+
+	lock_write_get(grp->lock);
+	list_append(&grp->membl, &m->le, m);
+	lock_rel(grp->lock);
+
+ out:
+	if (err)
+		mem_deref(m);
+	else
+		*mp = m;
+
+	return err;
+}
+
+
+/**
+ * Get the shared encoder state of the group
+ *
+ * @param m Group member
+ *
+ * @return Encoder state
+ */
+void *encshare_enc(const struct encshare_memb *m)
+{
+	return m ? m->grp->enc : NULL;
+}
+
+
+/**
+ * Get the key of the group
+ *
+ * @param m Group member
+ *
+ * @return Group key
+ */
+const char *encshare_key(const struct encshare_memb *m)
+{
+	return m ? m->grp->key : NULL;
+}
+
+
+/**
+ * Check if a member is the leader of the group, i.e. the one encoding
+ *
+ * @param m Group member
+ *
+ * @return True if leader, otherwise false
+ */
+bool encshare_leader(const struct encshare_memb *m)
+{
+	bool leader;
+
+	if (!m)
+		return false;
+
+	lock_read_get(m->grp->lock);
+	leader = m->grp->membl.head == &m->le;
+	lock_rel(m->grp->lock);
+
+	return leader;
+}
+
+
+/**
+ * Request a picture update from the shared encoder
+ *
+ * @param m Group member
+ */
+void encshare_request_picup(struct encshare_memb *m)
+{
+	if (!m)
+		return;
+
+	lock_write_get(m->grp->lock);
+	m->grp->picup = true;
+	++m->grp->stats.n_picup_req;
+	lock_rel(m->grp->lock);
+}
+
+
+/**
+ * Get and clear the coalesced picture update request of the group.
+ * Called by the leader before each encode.
+ *
+ * @param m     Group member
+ * @param local Picture update requested by the leader itself
+ *
+ * @return True if a keyframe should be encoded
+ */
+bool encshare_picup(struct encshare_memb *m, bool local)
+{
+	struct encshare *grp;
+	bool picup;
+
+	if (!m)
+		return local;
+
+	grp = m->grp;
+
+	lock_write_get(grp->lock);
+
+	picup = local || grp->picup;
+	grp->picup = false;
+
+	if (picup)
+		++grp->stats.n_keyframe;
+
+	lock_rel(grp->lock);
+
+	return picup;
+}
+
+
+/**
+ * Send an encoded packet to all other members of the group. Used by
+ * encoders that return the packet to the caller instead of calling
+ * a packet handler.
+ *
+ * @param m       Group member sending the packet
+ * @param marker  Marker bit
+ * @param ts      Timestamp
+ * @param hdr     Packet header (optional)
+ * @param hdr_len Length of packet header
+ * @param pld     Packet payload
+ * @param pld_len Length of packet payload
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int encshare_send(struct encshare_memb *m, bool marker, uint64_t ts,
+		  const uint8_t *hdr, size_t hdr_len,
+		  const uint8_t *pld, size_t pld_len)
+{
+	struct encshare *grp;
+	struct le *le;
+
+	if (!m)
+		return EINVAL;
+
+	grp = m->grp;
+
+	lock_read_get(grp->lock);
+
+	++grp->stats.n_pkt;
+
+	for (le = grp->membl.head; le; le = le->next) {
+
+		if (le == &m->le)
+			continue;
+
+		deliver(le->data, marker, ts, hdr, hdr_len, pld, pld_len);
+	}
+
+	lock_rel(grp->lock);
+
+	return 0;
+}
+
+
+/**
+ * Print the encoder group of a member
+ *
+ * @param pf Print function
+ * @param m  Group member
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int encshare_debug(struct re_printf *pf, const struct encshare_memb *m)
+{
+	const struct encshare *grp;
+	int err;
+
+	if (!m)
+		return 0;
+
+	grp = m->grp;
+
+	lock_read_get(grp->lock);
+
+	err = re_hprintf(pf, "     shared encoder: %s (%s, %u members)\n"
+			 "       group: packets=%llu picup_req=%u"
+			 " keyframes=%u\n"
+			 "       member: packets=%llu errors=%llu\n",
+			 grp->key,
+			 grp->membl.head == &m->le ? "leader" : "follower",
+			 list_count(&grp->membl),
+			 grp->stats.n_pkt, grp->stats.n_picup_req,
+			 grp->stats.n_keyframe,
+			 m->n_pkt, m->n_err);
+
+	lock_rel(grp->lock);
+
+	return err;
+}
@@ -65,6 +65,7 @@ static const char *event_class_name(enum ua_event ev)
 	case UA_EVENT_CALL_DTMF_END:
 	case UA_EVENT_CALL_RTCP:
 	case UA_EVENT_CALL_MENC:
+	case UA_EVENT_CALL_SETUP:
 		return "call";
 	case UA_EVENT_VU_RX:
 	case UA_EVENT_VU_TX:
@@ -206,12 +207,148 @@ int event_encode_dict(struct odict *od, struct ua *ua, enum ua_event ev,
 			goto out;
 	}
 
+	if (call && (ev == UA_EVENT_CALL_RTCP || ev == UA_EVENT_CALL_CLOSED)) {
+
+		err = event_add_media_cpu(od, call);
+		if (err)
+			goto out;
+	}
+
  out:
 
 	return err;
 }
 
 
+static int json_rtcp_stats(struct re_printf *pf, const struct rtcp_stats *rs)
+{
+	return re_hprintf(pf,
+			  ",\"rtcp_stats\":{"
+			  "\"tx\":{\"sent\":%u,\"lost\":%d,\"jit\":%u},"
+			  "\"rx\":{\"sent\":%u,\"lost\":%d,\"jit\":%u},"
+			  "\"rtt\":%u}",
+			  rs->tx.sent, rs->tx.lost, rs->tx.jit,
+			  rs->rx.sent, rs->rx.lost, rs->rx.jit,
+			  rs->rtt);
+}
+
+
+static int json_media_cpu(struct re_printf *pf, const struct call *call)
+{
+	struct media_cpu cpu;
+	int i, err;
+
+	if (call_media_cpu(call, &cpu))
+		return 0;
+
+	err = re_hprintf(pf, ",\"media_cpu\":{");
+
+	for (i=0; i<MEDIA_CPU_STAGES; i++) {
+
+		const struct media_cpu_stat *st = &cpu.stagev[i];
+
+		err |= re_hprintf(pf, "%s\"%s\":{\"calls\":%llu,"
+				  "\"usec\":%llu,\"usec_max\":%u}",
+				  i ? "," : "", media_cpu_stage_name(i),
+				  st->n, st->usec, st->usec_max);
+	}
+
+	err |= re_hprintf(pf, "}");
+
+	return err;
+}
+
+
+/**
+ * Encode an event as a JSON object, without building a dictionary.
+ * The object has the member "event":true and the members from
+ * event_encode_dict().
+ *
+ * @param pf   Print function
+ * @param ua   User-Agent
+ * @param ev   Event type
+ * @param call Call object (optional)
+ * @param prm  Event parameters
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int event_encode_json(struct re_printf *pf, struct ua *ua, enum ua_event ev,
+		      struct call *call, const char *prm)
+{
+	int err;
+
+	err = re_hprintf(pf, "{\"event\":true,\"type\":\"%s\","
+			 "\"class\":\"%s\"",
+			 uag_event_str(ev), event_class_name(ev));
+
+	if (ua) {
+		err |= re_hprintf(pf, ",\"accountaor\":\"%H\"",
+				  utf8_encode, account_aor(ua_account(ua)));
+	}
+
+	if (call) {
+		const struct stream *strm = audio_strm(call_audio(call));
+
+		err |= re_hprintf(pf, ",\"direction\":\"%s\""
+				  ",\"peeruri\":\"%H\"",
+				  call_is_outgoing(call) ?
+				  "outgoing" : "incoming",
+				  utf8_encode, call_peeruri(call));
+
+		if (call_peername(call)) {
+			err |= re_hprintf(pf, ",\"peerdisplayname\":\"%H\"",
+					  utf8_encode, call_peername(call));
+		}
+
+		if (call_id(call)) {
+			err |= re_hprintf(pf, ",\"id\":\"%H\"",
+					  utf8_encode, call_id(call));
+		}
+
+		err |= re_hprintf(pf, ",\"remoteaudiodir\":\"%s\"",
+				  sdp_dir_name(sdp_media_rdir(
+					  stream_sdpmedia(strm))));
+	}
+
+	if (str_isset(prm)) {
+		err |= re_hprintf(pf, ",\"param\":\"%H\"",
+				  utf8_encode, prm);
+	}
+
+	if (ev == UA_EVENT_CALL_RTCP) {
+		struct stream *strm = NULL;
+
+		if (0 == str_casecmp(prm, "audio"))
+			strm = audio_strm(call_audio(call));
+		else if (0 == str_casecmp(prm, "video"))
+			strm = video_strm(call_video(call));
+
+		if (strm)
+			err |= json_rtcp_stats(pf, stream_rtcp_stats(strm));
+	}
+
+	if (call && (ev == UA_EVENT_CALL_RTCP || ev == UA_EVENT_CALL_CLOSED))
+		err |= json_media_cpu(pf, call);
+
+	err |= re_hprintf(pf, "}");
+
+	return err;
+}
+
+
+/**
+ * Get the class name of a User-Agent event
+ *
+ * @param ev User-agent event
+ *
+ * @return Event class name, e.g. "call"
+ */
+const char *uag_event_class_str(enum ua_event ev)
+{
+	return event_class_name(ev);
+}
+
+
 /**
  * Add audio buffer status
  *
@@ -222,9 +359,82 @@ int event_encode_dict(struct odict *od, struct ua *ua, enum ua_event ev,
  */
 int event_add_au_jb_stat(struct odict *od_parent, const struct call *call)
 {
+	struct audio_playout_stat st;
+	struct odict *od_hist = NULL;
+	size_t i;
 	int err = 0;
 	err = odict_entry_add(od_parent, "audio_jb_ms",ODICT_INT,
 			    (int64_t)audio_jb_current_value(call_audio(call)));
+
+	if (err || audio_playout_stat(call_audio(call), &st))
+		return err;
+
+	err |= odict_entry_add(od_parent, "audio_jb_target_ms", ODICT_INT,
+			       (int64_t)st.target_ms);
+	err |= odict_entry_add(od_parent, "audio_jitter_ms", ODICT_INT,
+			       (int64_t)st.jitter_ms);
+	err |= odict_entry_add(od_parent, "audio_late", ODICT_INT,
+			       (int64_t)st.n_late);
+	err |= odict_entry_add(od_parent, "audio_lost", ODICT_INT,
+			       (int64_t)st.n_lost);
+	err |= odict_entry_add(od_parent, "audio_concealed", ODICT_INT,
+			       (int64_t)st.n_concealed);
+	err |= odict_entry_add(od_parent, "audio_accelerated", ODICT_INT,
+			       (int64_t)st.n_accel);
+	err |= odict_entry_add(od_parent, "audio_decelerated", ODICT_INT,
+			       (int64_t)st.n_decel);
+
+	err |= odict_alloc(&od_hist, AUDIO_PLAYOUT_HIST_BINS);
+	if (err)
+		goto out;
+
+	for (i = 0; i < AUDIO_PLAYOUT_HIST_BINS; i++) {
+		char index[8];
+
+		/* array entries are keyed by their index */
+		re_snprintf(index, sizeof(index), "%zu", i);
+
+		err |= odict_entry_add(od_hist, index, ODICT_INT,
+				       (int64_t)st.hist[i]);
+	}
+
+	err |= odict_entry_add(od_parent, "audio_delay_hist", ODICT_ARRAY,
+			       od_hist);
+
+ out:
+	mem_deref(od_hist);
+
+	return err;
+}
+
+
+/**
+ * Add the CPU time spent in media processing of a call
+ *
+ * @param od_parent  Dictionary to encode into
+ * @param call       Call object
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int event_add_media_cpu(struct odict *od_parent, const struct call *call)
+{
+	struct media_cpu cpu;
+	struct odict *od = NULL;
+	int err;
+
+	err = call_media_cpu(call, &cpu);
+	if (err)
+		return err;
+
+	err = odict_alloc(&od, 8);
+	if (err)
+		return err;
+
+	err  = media_cpu_encode(od, &cpu);
+	err |= odict_entry_add(od_parent, "media_cpu", ODICT_OBJECT, od);
+
+	mem_deref(od);
+
 	return err;
 }
 
@@ -401,6 +611,7 @@ const char *uag_event_str(enum ua_event ev)
 	case UA_EVENT_AUDIO_ERROR:          return "AUDIO_ERROR";
 	case UA_EVENT_CALL_LOCAL_SDP:       return "CALL_LOCAL_SDP";
 	case UA_EVENT_CALL_REMOTE_SDP:      return "CALL_REMOTE_SDP";
+	case UA_EVENT_CALL_SETUP:           return "CALL_SETUP";
 	case UA_EVENT_MODULE:               return "MODULE";
 	case UA_EVENT_CUSTOM:               return "CUSTOM";
 	default: return "?";
@@ -4,21 +4,480 @@
  * Copyright (C) 2010 Alfred E. Heggestad
  */
 
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <string.h>
 #include <re.h>
 #include <baresip.h>
 
 
+#if defined (HAVE_PTHREAD) && defined (__GNUC__)
+#define LOG_ASYNC 1
+#define LOG_BARRIER() __sync_synchronize()
+#endif
+
+
+/*
+ * In asynchronous mode each thread that logs gets its own single-producer
+ * single-consumer ring buffer. The calling thread only formats the message
+ * into its ring, and a logger thread writes the messages to stdout and the
+ * log handlers. Messages from all rings are merged in sequence order.
+ *
+ * If a ring is full the message is dropped and counted, the calling thread
+ * never blocks. Repeated messages from the same call site can be rate
+ * limited, the number of suppressed messages is reported by the logger.
+ *
+ * The logger moves the records to an output buffer with the ring list
+ * locked, and does the output after unlocking.
+ */
+
+
+enum {
+	LOG_BUFSZ       =      8192,  /* Max. formatted message size     */
+	LOG_RING_SIZE   = 64 * 1024,  /* Ring buffer per thread [bytes]  */
+	LOG_INTERVAL    =        20,  /* Logger thread poll interval [ms] */
+	LOG_RL_SIZE     =        16,  /* Rate-limit call sites per thread */
+	LOG_RL_INTERVAL =      1000,  /* Rate-limit interval [ms]         */
+	LOG_DRAIN_MAX   = 64 * 1024,  /* Output buffer per drain [bytes]  */
+};
+
+
+#ifdef LOG_ASYNC
+/** Log record header, followed by the message */
+struct log_rec {
+	uint64_t seq;             /**< Global sequence number            */
+	uint32_t len;             /**< Message length, 0 for padding     */
+	uint32_t level;           /**< Log level                         */
+};
+
+/** Rate-limit state for one call site */
+struct log_rl {
+	const char *fmt;          /**< Format string of call site        */
+	uint64_t ts;              /**< Start of interval [ms]            */
+	uint32_t n;               /**< Messages in interval              */
+	uint32_t n_supp;          /**< Suppressed messages in interval   */
+};
+
+/** Ring buffer of log records for one thread */
+struct log_ring {
+	struct le le;             /**< Member of ring list               */
+	volatile size_t head;     /**< Write position (producer)         */
+	volatile size_t tail;     /**< Read position (consumer)          */
+	volatile bool closed;     /**< Owner thread has exited           */
+	volatile uint64_t n_drop; /**< Dropped messages (producer)       */
+	volatile uint64_t n_supp; /**< Suppressed messages (producer)    */
+	uint64_t n_drop_rep;      /**< Dropped messages reported         */
+	uint64_t n_supp_rep;      /**< Suppressed messages reported      */
+	uint64_t supp_ts;         /**< Last suppression report [ms]      */
+	struct log_rl rlv[LOG_RL_SIZE];  /**< Rate-limit state           */
+	uint8_t buf[LOG_RING_SIZE];      /**< Record buffer              */
+};
+#endif
+
+
 static struct {
 	struct list logl;
 	enum log_level level;
 	bool enable_stdout;
+#ifdef LOG_ASYNC
+	volatile bool async;
+	volatile uint32_t burst;
+	volatile uint64_t seq;
+	pthread_mutex_t mutex;      /**< Protects rings and statistics  */
+	pthread_cond_t cond;
+	pthread_mutex_t out_mutex;  /**< Protects output and handlers   */
+	pthread_key_t key;
+	pthread_t thread;
+	bool run;
+	struct list ringl;
+	struct log_stat stat;
+	struct mbuf *outb;
+#endif
 } lg = {
 	LIST_INIT,
 	LEVEL_INFO,
-	true
+	true,
+#ifdef LOG_ASYNC
+	false,
+	0,
+	0,
+	PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_COND_INITIALIZER,
+	PTHREAD_MUTEX_INITIALIZER,
+#endif
 };
 
 
+static void log_output(uint32_t level, const char *buf)
+{
+	struct le *le;
+
+	if (lg.enable_stdout) {
+
+		bool color = level == LEVEL_WARN || level == LEVEL_ERROR;
+
+		if (color)
+			(void)re_fprintf(stdout, "\x1b[31m"); /* Red */
+
+		(void)re_fprintf(stdout, "%s", buf);
+
+		if (color)
+			(void)re_fprintf(stdout, "\x1b[;m");
+	}
+
+	le = lg.logl.head;
+
+	while (le) {
+
+		struct log *log = le->data;
+		le = le->next;
+
+		if (log->h)
+			log->h(level, buf);
+	}
+}
+
+
+#ifdef LOG_ASYNC
+static inline size_t rec_size(size_t len)
+{
+	const size_t a = sizeof(struct log_rec);
+
+	return (sizeof(struct log_rec) + len + a - 1) / a * a;
+}
+
+
+/* Called by the producer thread only */
+static bool ring_write(struct log_ring *r, uint32_t level,
+		       const char *msg, size_t len)
+{
+	const size_t total = rec_size(len + 1);
+	size_t head = r->head;
+	size_t pos, contig, need;
+	struct log_rec *rec;
+
+	LOG_BARRIER();
+
+	pos    = head % LOG_RING_SIZE;
+	contig = LOG_RING_SIZE - pos;
+	need   = total > contig ? total + contig : total;
+
+	if (LOG_RING_SIZE - (head - r->tail) < need) {
+		++r->n_drop;
+		return false;
+	}
+
+	/* records are never split, pad to the end of the buffer */
+	if (total > contig) {
+		rec = (struct log_rec *)(void *)&r->buf[pos];
+		rec->len = 0;
+		head += contig;
+		pos = 0;
+	}
+
+	rec = (struct log_rec *)(void *)&r->buf[pos];
+	rec->seq   = __sync_fetch_and_add(&lg.seq, 1);
+	rec->len   = (uint32_t)len + 1;
+	rec->level = level;
+	memcpy(rec + 1, msg, len);
+	((char *)(rec + 1))[len] = '\0';
+
+	LOG_BARRIER();
+
+	r->head = head + total;
+
+	return true;
+}
+
+
+/* Called by the consumer thread only */
+static struct log_rec *ring_peek(struct log_ring *r)
+{
+	for (;;) {
+		size_t pos;
+		struct log_rec *rec;
+
+		if (r->tail == r->head)
+			return NULL;
+
+		LOG_BARRIER();
+
+		pos = r->tail % LOG_RING_SIZE;
+		rec = (struct log_rec *)(void *)&r->buf[pos];
+
+		if (rec->len)
+			return rec;
+
+		LOG_BARRIER();
+
+		r->tail += LOG_RING_SIZE - pos;
+	}
+}
+
+
+static void ring_pop(struct log_ring *r, const struct log_rec *rec)
+{
+	const size_t total = rec_size(rec->len);
+
+	LOG_BARRIER();
+
+	r->tail += total;
+}
+
+
+static void ring_destructor(void *arg)
+{
+	struct log_ring *r = arg;
+
+	list_unlink(&r->le);
+}
+
+
+/* Called when a thread with a ring buffer exits */
+static void thread_exit_handler(void *arg)
+{
+	struct log_ring *r = arg;
+
+	r->closed = true;
+}
+
+
+static struct log_ring *ring_get(void)
+{
+	struct log_ring *r;
+
+	r = pthread_getspecific(lg.key);
+	if (r)
+		return r;
+
+	r = mem_zalloc(sizeof(*r), ring_destructor);
+	if (!r)
+		return NULL;
+
+	pthread_mutex_lock(&lg.mutex);
+	list_append(&lg.ringl, &r->le, r);
+	pthread_mutex_unlock(&lg.mutex);
+
+	(void)pthread_setspecific(lg.key, r);
+
+	return r;
+}
+
+
+/* Append a message to the output buffer, or nothing if out of memory */
+static void out_append(struct mbuf *mb, uint32_t level, const char *msg)
+{
+	const size_t end = mb->end;
+	int err;
+
+	err  = mbuf_write_u32(mb, level);
+	err |= mbuf_write_str(mb, msg);
+	err |= mbuf_write_u8(mb, 0);
+	if (err)
+		mb->pos = mb->end = end;
+}
+
+
+/*
+ * Move pending records to the output buffer in sequence order, with
+ * lg.mutex held. Returns true if there are more records.
+ */
+static bool drain_collect(struct mbuf *mb, bool all)
+{
+	const uint64_t now = tmr_jiffies();
+	struct le *le;
+
+	while (mb->end < LOG_DRAIN_MAX) {
+		struct log_ring *best = NULL;
+		struct log_rec *best_rec = NULL;
+
+		for (le = lg.ringl.head; le; le = le->next) {
+
+			struct log_ring *r = le->data;
+			struct log_rec *rec = ring_peek(r);
+
+			if (rec && (!best_rec || rec->seq < best_rec->seq)) {
+				best = r;
+				best_rec = rec;
+			}
+		}
+
+		if (!best)
+			break;
+
+		out_append(mb, best_rec->level, (const char *)(best_rec + 1));
+		ring_pop(best, best_rec);
+
+		++lg.stat.n_msg;
+	}
+
+	if (mb->end >= LOG_DRAIN_MAX)
+		return true;
+
+	le = lg.ringl.head;
+
+	while (le) {
+
+		struct log_ring *r = le->data;
+		uint64_t n_drop = r->n_drop;
+		uint64_t n_supp = r->n_supp;
+		char buf[64];
+		le = le->next;
+
+		if (n_drop != r->n_drop_rep) {
+
+			re_snprintf(buf, sizeof(buf),
+				    "log: %llu messages dropped\n",
+				    n_drop - r->n_drop_rep);
+			out_append(mb, LEVEL_WARN, buf);
+
+			r->n_drop_rep = n_drop;
+		}
+
+		/* at most one suppression report per interval */
+		if (n_supp != r->n_supp_rep &&
+		    (all || r->closed ||
+		     now >= r->supp_ts + LOG_RL_INTERVAL)) {
+
+			re_snprintf(buf, sizeof(buf),
+				    "log: %llu similar messages suppressed\n",
+				    n_supp - r->n_supp_rep);
+			out_append(mb, LEVEL_INFO, buf);
+
+			r->n_supp_rep = n_supp;
+			r->supp_ts    = now;
+		}
+
+		if (r->closed && r->tail == r->head) {
+			lg.stat.n_drop += r->n_drop;
+			lg.stat.n_suppressed += r->n_supp;
+			mem_deref(r);
+		}
+	}
+
+	return false;
+}
+
+
+/*
+ * Write all pending records. The output is done without lg.mutex, so
+ * the logging threads are not blocked by slow output or log handlers.
+ */
+static void log_drain(bool all)
+{
+	struct mbuf *mb = lg.outb;
+	bool more = true;
+
+	if (!mb)
+		return;
+
+	/* keeps the order of the messages between drains */
+	pthread_mutex_lock(&lg.out_mutex);
+
+	while (more) {
+
+		pthread_mutex_lock(&lg.mutex);
+		more = drain_collect(mb, all);
+		pthread_mutex_unlock(&lg.mutex);
+
+		mb->pos = 0;
+
+		while (mbuf_get_left(mb) > sizeof(uint32_t)) {
+
+			uint32_t level = mbuf_read_u32(mb);
+			const char *msg = (const char *)mbuf_buf(mb);
+
+			log_output(level, msg);
+			mbuf_advance(mb, str_len(msg) + 1);
+		}
+
+		mb->pos = mb->end = 0;
+	}
+
+	pthread_mutex_unlock(&lg.out_mutex);
+}
+
+
+static void *log_thread(void *arg)
+{
+	(void)arg;
+
+	pthread_mutex_lock(&lg.mutex);
+
+	while (lg.run) {
+
+		struct timespec ts;
+		uint64_t ms;
+
+		pthread_mutex_unlock(&lg.mutex);
+		log_drain(false);
+		pthread_mutex_lock(&lg.mutex);
+
+		if (!lg.run)
+			break;
+
+		ms = tmr_jiffies() + LOG_INTERVAL;
+		ts.tv_sec  = (time_t)(ms / 1000);
+		ts.tv_nsec = (ms % 1000) * 1000000UL;
+
+		pthread_cond_timedwait(&lg.cond, &lg.mutex, &ts);
+	}
+
+	pthread_mutex_unlock(&lg.mutex);
+
+	log_drain(true);
+
+	return NULL;
+}
+
+
+/* Returns true if the message should be suppressed */
+static bool ratelimit(struct log_ring *r, const char *fmt)
+{
+	struct log_rl *rl;
+	uint64_t now;
+
+	rl  = &r->rlv[((uintptr_t)fmt >> 3) % LOG_RL_SIZE];
+	now = tmr_jiffies();
+
+	if (rl->fmt != fmt || now >= rl->ts + LOG_RL_INTERVAL) {
+
+		rl->fmt    = fmt;
+		rl->ts     = now;
+		rl->n      = 0;
+		rl->n_supp = 0;
+	}
+
+	if (++rl->n <= lg.burst)
+		return false;
+
+	++rl->n_supp;
+	++r->n_supp;
+
+	return true;
+}
+
+
+static void vlog_async(struct log_ring *r, enum log_level level,
+		       const char *fmt, va_list ap)
+{
+	char buf[LOG_BUFSZ];
+	int n;
+
+	if (lg.burst && ratelimit(r, fmt))
+		return;
+
+	n = re_vsnprintf(buf, sizeof(buf), fmt, ap);
+	if (n < 0)
+		return;
+
+	(void)ring_write(r, level, buf,
+			 min((size_t)n, (size_t)LOG_RING_SIZE / 4));
+}
+#endif
+
+
 /**
  * Register a log handler
  *
@@ -29,7 +488,13 @@ void log_register_handler(struct log *log)
 	if (!log)
 		return;
 
+#ifdef LOG_ASYNC
+	pthread_mutex_lock(&lg.out_mutex);
+#endif
 	list_append(&lg.logl, &log->le, log);
+#ifdef LOG_ASYNC
+	pthread_mutex_unlock(&lg.out_mutex);
+#endif
 }
 
 
@@ -43,7 +508,13 @@ void log_unregister_handler(struct log *log)
 	if (!log)
 		return;
 
+#ifdef LOG_ASYNC
+	pthread_mutex_lock(&lg.out_mutex);
+#endif
 	list_unlink(&log->le);
+#ifdef LOG_ASYNC
+	pthread_mutex_unlock(&lg.out_mutex);
+#endif
 }
 
 
@@ -122,46 +593,292 @@ void log_enable_stdout(bool enable)
 
 
 /**
- * Print a message to the logging system
+ * Enable asynchronous logging. Messages are written by a logger thread,
+ * and the calling threads never block on output.
  *
- * @param level Log level
- * @param fmt   Formatted message
- * @param ap    Variable argument list
+ * @param enable True to enable, false to disable and flush
+ *
+ * @return 0 if success, otherwise errorcode
+ *
+ * @note Disable only when no other threads are logging, e.g. at exit
  */
-void vlog(enum log_level level, const char *fmt, va_list ap)
+int log_enable_async(bool enable)
 {
-	char buf[8192];
-	struct le *le;
+#ifdef LOG_ASYNC
+	int err;
+
+	if (enable == lg.async)
+		return 0;
+
+	if (enable) {
+		lg.outb = mbuf_alloc(LOG_DRAIN_MAX + LOG_RING_SIZE / 4);
+		if (!lg.outb)
+			return ENOMEM;
+
+		err = pthread_key_create(&lg.key, thread_exit_handler);
+		if (err) {
+			lg.outb = mem_deref(lg.outb);
+			return err;
+		}
+
+		lg.run = true;
+		err = pthread_create(&lg.thread, NULL, log_thread, NULL);
+		if (err) {
+			lg.run = false;
+			pthread_key_delete(lg.key);
+			lg.outb = mem_deref(lg.outb);
+			return err;
+		}
+
+		lg.async = true;
+	}
+	else {
+		lg.async = false;
 
-	if (level < lg.level)
+		pthread_mutex_lock(&lg.mutex);
+		lg.run = false;
+		pthread_cond_signal(&lg.cond);
+		pthread_mutex_unlock(&lg.mutex);
+
+		pthread_join(lg.thread, NULL);
+
+		/* all rings are empty now */
+		while (lg.ringl.head) {
+			struct log_ring *r = lg.ringl.head->data;
+
+			lg.stat.n_drop += r->n_drop;
+			lg.stat.n_suppressed += r->n_supp;
+			mem_deref(r);
+		}
+
+		pthread_key_delete(lg.key);
+
+		lg.outb = mem_deref(lg.outb);
+	}
+
+	return 0;
+#else
+	(void)enable;
+	return ENOSYS;
+#endif
+}
+
+
+/**
+ * Set the rate-limit for asynchronous logging. Messages from the same
+ * call site exceeding the limit are suppressed and counted.
+ *
+ * @param burst Max. messages per call site and thread per second, 0 to
+ *              disable
+ */
+void log_set_ratelimit(uint32_t burst)
+{
+#ifdef LOG_ASYNC
+	lg.burst = burst;
+#else
+	(void)burst;
+#endif
+}
+
+
+/**
+ * Write all pending asynchronous log messages
+ */
+void log_flush(void)
+{
+#ifdef LOG_ASYNC
+	if (!lg.async)
 		return;
 
-	if (re_vsnprintf(buf, sizeof(buf), fmt, ap) < 0)
+	log_drain(true);
+#endif
+}
+
+
+/**
+ * Get the asynchronous logging statistics
+ *
+ * @param stat Returned statistics
+ */
+void log_stat_get(struct log_stat *stat)
+{
+#ifdef LOG_ASYNC
+	struct le *le;
+#endif
+
+	if (!stat)
 		return;
 
-	if (lg.enable_stdout) {
+	memset(stat, 0, sizeof(*stat));
 
-		bool color = level == LEVEL_WARN || level == LEVEL_ERROR;
+#ifdef LOG_ASYNC
+	pthread_mutex_lock(&lg.mutex);
 
-		if (color)
-			(void)re_fprintf(stdout, "\x1b[31m"); /* Red */
+	*stat = lg.stat;
 
-		(void)re_fprintf(stdout, "%s", buf);
+	for (le = lg.ringl.head; le; le = le->next) {
+		const struct log_ring *r = le->data;
 
-		if (color)
-			(void)re_fprintf(stdout, "\x1b[;m");
+		stat->n_drop += r->n_drop;
+		stat->n_suppressed += r->n_supp;
 	}
 
-	le = lg.logl.head;
+	pthread_mutex_unlock(&lg.mutex);
+#endif
+}
 
-	while (le) {
 
-		struct log *log = le->data;
-		le = le->next;
+/**
+ * Print the logging status
+ *
+ * @param pf     Print function
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int log_debug(struct re_printf *pf, void *unused)
+{
+	struct log_stat stat;
+	int err;
+	(void)unused;
+
+	log_stat_get(&stat);
+
+	err  = re_hprintf(pf, "--- Logging ---\n");
+	err |= re_hprintf(pf, " level:      %s\n", log_level_name(lg.level));
+#ifdef LOG_ASYNC
+	err |= re_hprintf(pf, " async:      %s (%u threads)\n",
+			  lg.async ? "yes" : "no", list_count(&lg.ringl));
+	err |= re_hprintf(pf, " ratelimit:  %u/s\n", lg.burst);
+#else
+	err |= re_hprintf(pf, " async:      not supported\n");
+#endif
+	err |= re_hprintf(pf, " messages:   %llu\n", stat.n_msg);
+	err |= re_hprintf(pf, " dropped:    %llu\n", stat.n_drop);
+	err |= re_hprintf(pf, " suppressed: %llu\n", stat.n_suppressed);
+
+	return err;
+}
 
-		if (log->h)
-			log->h(level, buf);
+
+/**
+ * Measure the cost of a log message for the calling thread. The
+ * synchronous path formats the message and passes it to the log
+ * handlers, without stdout. The asynchronous path formats the message
+ * into a private ring buffer, which is emptied when full.
+ *
+ * @param pf Print function for the result
+ * @param n  Number of messages per path
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int log_bench(struct re_printf *pf, uint32_t n)
+{
+	char buf[LOG_BUFSZ];
+	uint64_t t0, t_sync;
+	bool enable_stdout;
+	uint32_t i;
+	int len;
+#ifdef LOG_ASYNC
+	struct log_ring *r;
+	uint64_t t_async;
+#endif
+
+	if (!n)
+		return EINVAL;
+
+	log_flush();
+
+#ifdef LOG_ASYNC
+	/* the logger thread does not write while stdout is off */
+	pthread_mutex_lock(&lg.out_mutex);
+#endif
+	enable_stdout = lg.enable_stdout;
+	lg.enable_stdout = false;
+
+	t0 = tmr_jiffies_usec();
+
+	for (i=0; i<n; i++) {
+
+		len = re_snprintf(buf, sizeof(buf),
+				  "log: bench message %u of %u\n", i, n);
+		if (len < 0)
+			break;
+
+		log_output(LEVEL_DEBUG, buf);
+	}
+
+	t_sync = tmr_jiffies_usec() - t0;
+
+	lg.enable_stdout = enable_stdout;
+#ifdef LOG_ASYNC
+	pthread_mutex_unlock(&lg.out_mutex);
+
+	r = mem_zalloc(sizeof(*r), NULL);
+	if (!r)
+		return ENOMEM;
+
+	t0 = tmr_jiffies_usec();
+
+	for (i=0; i<n; i++) {
+
+		len = re_snprintf(buf, sizeof(buf),
+				  "log: bench message %u of %u\n", i, n);
+		if (len < 0)
+			break;
+
+		if (!ring_write(r, LEVEL_DEBUG, buf, len)) {
+			r->tail = r->head;
+			(void)ring_write(r, LEVEL_DEBUG, buf, len);
+		}
+	}
+
+	t_async = tmr_jiffies_usec() - t0;
+
+	mem_deref(r);
+
+	return re_hprintf(pf, "log: %u messages\n"
+			  "  sync:  %.3f us/msg\n"
+			  "  async: %.3f us/msg\n",
+			  n, (double)t_sync / n, (double)t_async / n);
+#else
+	return re_hprintf(pf, "log: %u messages\n"
+			  "  sync:  %.3f us/msg\n"
+			  "  async: not supported\n",
+			  n, (double)t_sync / n);
+#endif
+}
+
+
+/**
+ * Print a message to the logging system
+ *
+ * @param level Log level
+ * @param fmt   Formatted message
+ * @param ap    Variable argument list
+ */
+void vlog(enum log_level level, const char *fmt, va_list ap)
+{
+	char buf[LOG_BUFSZ];
+
+	if (level < lg.level)
+		return;
+
+#ifdef LOG_ASYNC
+	if (lg.async) {
+		struct log_ring *r = ring_get();
+
+		if (r) {
+			vlog_async(r, level, fmt, ap);
+			return;
+		}
 	}
+#endif
+
+	if (re_vsnprintf(buf, sizeof(buf), fmt, ap) < 0)
+		return;
+
+	log_output(level, buf);
 }
 
 
@@ -81,6 +81,7 @@ static void usage(void)
 			 "\t-h -?            Help\n"
 			 "\t-s               Enable SIP trace\n"
 			 "\t-t <sec>         Quit after <sec> seconds\n"
+			 "\t-T <prefix>      Write startup/shutdown trace\n"
 			 "\t-n <net_if>      Specify network interface\n"
 			 "\t-u <parameters>  Extra UA parameters\n"
 			 "\t-v               Verbose debug\n"
@@ -95,13 +96,19 @@ int main(int argc, char *argv[])
 	const char *execmdv[16];
 	const char *net_interface = NULL;
 	const char *audio_path = NULL;
+	const char *trace_prefix = NULL;
 	const char *modv[16];
 	struct tmr tmr_quit;
 	bool sip_trace = false;
+	bool log_async = false;
+	uint32_t log_burst = 0;
+	bool ml_profile = false;
+	uint32_t ml_stall = 50;
 	size_t execmdc = 0;
 	size_t modc = 0;
 	size_t i;
 	uint32_t tmo = 0;
+	uint64_t t0 = tmr_jiffies_usec();
 	int err;
 
 	/*
@@ -124,7 +131,7 @@ int main(int argc, char *argv[])
 
 #ifdef HAVE_GETOPT
 	for (;;) {
-		const int c = getopt(argc, argv, "46de:f:p:hu:n:vst:m:");
+		const int c = getopt(argc, argv, "46de:f:p:hu:n:vst:T:m:");
 		if (0 > c)
 			break;
 
@@ -185,6 +192,10 @@ int main(int argc, char *argv[])
 			tmo = atoi(optarg);
 			break;
 
+		case 'T':
+			trace_prefix = optarg;
+			break;
+
 		case 'n':
 			net_interface = optarg;
 			break;
@@ -206,7 +217,17 @@ int main(int argc, char *argv[])
 	(void)argv;
 #endif
 
+	if (trace_prefix) {
+		err = trace_init(trace_prefix, t0);
+		if (err) {
+			warning("main: trace failed (%m)\n", err);
+			goto out;
+		}
+	}
+
+	trace_begin("baresip", "conf_configure");
 	err = conf_configure();
+	trace_end("baresip", "conf_configure");
 	if (err) {
 		warning("main: configure failed: %m\n", err);
 		goto out;
@@ -232,7 +253,9 @@ int main(int argc, char *argv[])
 	 * Initialise the top-level baresip struct, must be
 	 * done AFTER configuration is complete.
 	*/
+	trace_begin("baresip", "baresip_init");
 	err = baresip_init(conf_config());
+	trace_end("baresip", "baresip_init");
 	if (err) {
 		warning("main: baresip init failed (%m)\n", err);
 		goto out;
@@ -263,8 +286,10 @@ int main(int argc, char *argv[])
 	}
 
 	/* Initialise User Agents */
+	trace_begin("baresip", "ua_init");
 	err = ua_init("baresip v" BARESIP_VERSION " (" ARCH "/" OS ")",
 		      true, true, true);
+	trace_end("baresip", "ua_init");
 	if (err)
 		goto out;
 
@@ -282,7 +307,9 @@ int main(int argc, char *argv[])
 		uag_enable_sip_trace(true);
 
 	/* Load modules */
+	trace_begin("baresip", "conf_modules");
 	err = conf_modules();
+	trace_end("baresip", "conf_modules");
 	if (err)
 		goto out;
 
@@ -294,7 +321,27 @@ int main(int argc, char *argv[])
 		log_enable_stdout(false);
 	}
 
+	/* NOTE: the logger thread must be started after daemonizing */
+	(void)conf_get_bool(conf_cur(), "log_async", &log_async);
+	(void)conf_get_u32(conf_cur(), "log_ratelimit", &log_burst);
+	if (log_async) {
+		log_set_ratelimit(log_burst);
+
+		err = log_enable_async(true);
+		if (err)
+			warning("main: async logging failed (%m)\n", err);
+	}
+
+	(void)conf_get_bool(conf_cur(), "mainloop_profile", &ml_profile);
+	(void)conf_get_u32(conf_cur(), "mainloop_stall_ms", &ml_stall);
+	if (ml_profile) {
+		err = mlprof_init(ml_stall);
+		if (err)
+			warning("main: main-loop profiler failed (%m)\n", err);
+	}
+
 	info("baresip is ready.\n");
+	trace_ready();
 
 	/* Execute any commands from input arguments */
 	for (i=0; i<execmdc; i++) {
@@ -314,21 +361,34 @@ int main(int argc, char *argv[])
 	if (err)
 		ua_stop_all(true);
 
+	trace_begin("baresip", "ua_close");
 	ua_close();
+	trace_end("baresip", "ua_close");
+
+	mlprof_close();
+
+	/* flush pending log messages before the log modules are unloaded */
+	(void)log_enable_async(false);
 
 	/* note: must be done before mod_close() */
 	module_app_unload();
 
 	conf_close();
 
+	trace_begin("baresip", "baresip_close");
 	baresip_close();
+	trace_end("baresip", "baresip_close");
 
 	/* NOTE: modules must be unloaded after all application
 	 *       activity has stopped.
 	 */
 	debug("main: unloading modules..\n");
+	if (trace_enabled())
+		module_unload_all();
 	mod_close();
 
+	trace_close();
+
 	libre_close();
 
 	/* Check for memory leaks */
@@ -0,0 +1,190 @@
+/**
+ * @file mediacpu.c  CPU accounting of media processing
+ *
+ * Copyright (C) 2010 Alfred E. Heggestad
+ */
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/**
+ * \page MediaCpu Media CPU accounting
+ *
+ * The time spent in the encoder, decoder, filters and resampler of each
+ * media stream is measured with the monotonic clock and accumulated per
+ * processing stage. The encoding and decoding paths have separate
+ * stages, so the counters of a stage are only written by the thread
+ * running that stage, other threads only read them for printing.
+ */
+
+
+static const char *stage_namev[MEDIA_CPU_STAGES] = {
+	"encode",
+	"decode",
+	"filter_enc",
+	"filter_dec",
+	"resample_enc",
+	"resample_dec",
+};
+
+
+/**
+ * Account the processing time of one invocation of a stage
+ *
+ * @param st CPU statistics of the processing stage
+ * @param t0 Start time from tmr_jiffies_usec()
+ */
+void media_cpu_add(struct media_cpu_stat *st, uint64_t t0)
+{
+	uint32_t usec;
+
+	if (!st)
+		return;
+
+	usec = (uint32_t)(tmr_jiffies_usec() - t0);
+
+	++st->n;
+	st->usec += usec;
+	if (usec > st->usec_max)
+		st->usec_max = usec;
+}
+
+
+/**
+ * Add the CPU statistics of one media stream to another
+ *
+ * @param dst Destination CPU accounting
+ * @param src Source CPU accounting
+ */
+void media_cpu_merge(struct media_cpu *dst, const struct media_cpu *src)
+{
+	int i;
+
+	if (!dst || !src)
+		return;
+
+	for (i=0; i<MEDIA_CPU_STAGES; i++) {
+
+		struct media_cpu_stat *d = &dst->stagev[i];
+		const struct media_cpu_stat *s = &src->stagev[i];
+
+		d->n    += s->n;
+		d->usec += s->usec;
+		d->usec_max = max(d->usec_max, s->usec_max);
+	}
+}
+
+
+/**
+ * Get the name of a media processing stage
+ *
+ * @param stage Processing stage
+ *
+ * @return Name of the stage
+ */
+const char *media_cpu_stage_name(enum media_cpu_stage stage)
+{
+	if ((unsigned)stage >= MEDIA_CPU_STAGES)
+		return "???";
+
+	return stage_namev[stage];
+}
+
+
+/**
+ * Print the CPU statistics of one processing stage
+ *
+ * @param pf Print function
+ * @param st CPU statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int media_cpu_stat_print(struct re_printf *pf,
+			 const struct media_cpu_stat *st)
+{
+	if (!st)
+		return 0;
+
+	return re_hprintf(pf, "calls=%llu avg=%lluus max=%uus",
+			  st->n, st->n ? st->usec / st->n : 0,
+			  st->usec_max);
+}
+
+
+/**
+ * Print the CPU accounting of media processing
+ *
+ * @param pf  Print function
+ * @param cpu CPU accounting
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int media_cpu_debug(struct re_printf *pf, const struct media_cpu *cpu)
+{
+	int i, err = 0;
+
+	if (!cpu)
+		return 0;
+
+	err |= re_hprintf(pf, " cpu:   %-10s %10s %10s %8s %8s\n",
+			  "stage", "calls", "total [ms]", "avg [us]",
+			  "max [us]");
+
+	for (i=0; i<MEDIA_CPU_STAGES; i++) {
+
+		const struct media_cpu_stat *st = &cpu->stagev[i];
+
+		if (!st->n)
+			continue;
+
+		err |= re_hprintf(pf, "        %-10s %10llu %10llu %8llu"
+				  " %8u\n",
+				  stage_namev[i], st->n, st->usec / 1000,
+				  st->usec / st->n, st->usec_max);
+	}
+
+	return err;
+}
+
+
+/**
+ * Encode the CPU accounting of media processing into a dictionary
+ *
+ * @param od  Dictionary to encode into
+ * @param cpu CPU accounting
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int media_cpu_encode(struct odict *od, const struct media_cpu *cpu)
+{
+	int i, err = 0;
+
+	if (!od || !cpu)
+		return EINVAL;
+
+	for (i=0; i<MEDIA_CPU_STAGES; i++) {
+
+		const struct media_cpu_stat *st = &cpu->stagev[i];
+		struct odict *ods;
+
+		err = odict_alloc(&ods, 4);
+		if (err)
+			return err;
+
+		err  = odict_entry_add(ods, "calls", ODICT_INT,
+				       (int64_t)st->n);
+		err |= odict_entry_add(ods, "usec", ODICT_INT,
+				       (int64_t)st->usec);
+		err |= odict_entry_add(ods, "usec_max", ODICT_INT,
+				       (int64_t)st->usec_max);
+		err |= odict_entry_add(od, stage_namev[i], ODICT_OBJECT, ods);
+
+		mem_deref(ods);
+
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
@@ -61,6 +61,10 @@ const struct menc *menc_find(const struct list *mencl, const char *id)
 			return me;
 	}
 
+	/* retry after loading a lazy module providing it */
+	if (!module_lazy_load("menc", id))
+		return menc_find(mencl, id);
+
 	return NULL;
 }
 
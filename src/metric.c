@@ -15,8 +15,6 @@ static void tmr_handler(void *arg)
 	const uint64_t now = tmr_jiffies();
 	uint32_t diff;
 
-	tmr_start(&metric->tmr, TMR_INTERVAL * 1000, tmr_handler, metric);
-
 	lock_write_get(metric->lock);
 
 	if (!metric->started)
@@ -62,7 +60,9 @@ int metric_init(struct metric *metric)
 	if (err)
 		return err;
 
-	tmr_start(&metric->tmr, 100, tmr_handler, metric);
+	tmrw_init(&metric->tmr, "metric");
+	tmrw_start_periodic(&metric->tmr, 100, TMR_INTERVAL * 1000,
+			    tmr_handler, metric);
 
 	return 0;
 }
@@ -73,7 +73,7 @@ void metric_reset(struct metric *metric)
 	if (!metric)
 		return;
 
-	tmr_cancel(&metric->tmr);
+	tmrw_cancel(&metric->tmr);
 	metric->lock = mem_deref(metric->lock);
 }
 
@@ -0,0 +1,742 @@
+/**
+ * @file metrics.c  Metrics registry and text exporter
+ *
+ * Copyright (C) 2010 Alfred E. Heggestad
+ */
+#include <math.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/**
+ * \page Metrics Metrics registry
+ *
+ * The core and the modules register metric families (counters, gauges
+ * and histograms) with a collect handler. An export formats all
+ * families in the Prometheus text format.
+ *
+ * The export runs in steps on the main loop. After STEP_SAMPLES samples
+ * the export yields and continues from a zero timer, and collectors with
+ * many samples (e.g. one per stream) store their position and return
+ * EAGAIN. If the registry changes during an export, the export fails
+ * with EAGAIN.
+ *
+ * The user-agents and calls are taken at the start of the export, so
+ * that their positions do not shift if they are added or removed
+ * between the steps.
+ */
+
+
+enum {
+	STEP_SAMPLES = 256,     /**< Samples per export step */
+	MB_SIZE      = 4096,
+};
+
+
+struct metrics_fam {
+	struct le le;
+	char *name;
+	char *help;
+	enum metrics_type type;
+	metrics_collect_h *colh;
+	void *arg;
+};
+
+/** A call at the start of an export */
+struct snap_call {
+	struct ua *ua;                  /**< User-agent (reference)       */
+	char *id;                       /**< Call-ID                      */
+};
+
+struct metrics_exp {
+	struct tmr tmr;
+	struct mbuf *mb;
+	struct ua **uav;                /**< User-agents (references)     */
+	uint32_t uac;                   /**< Number of user-agents        */
+	struct snap_call *callv;        /**< Calls                        */
+	uint32_t callc;                 /**< Number of calls              */
+	struct le *le;                  /**< Current family               */
+	const struct metrics_fam *fam;  /**< Family being collected       */
+	uint32_t gen;                   /**< Registry generation at start */
+	uint32_t pos;                   /**< Position in current family   */
+	uint32_t n;                     /**< Samples in current step      */
+	bool head;                      /**< HELP/TYPE of family written  */
+	metrics_done_h *doneh;
+	void *arg;
+};
+
+
+static struct {
+	struct list faml;               /**< Families (struct metrics_fam)*/
+	uint32_t gen;                   /**< Changed on (un)register      */
+} reg;
+
+
+static const char *type_name(enum metrics_type type)
+{
+	switch (type) {
+
+	case METRICS_COUNTER:   return "counter";
+	case METRICS_GAUGE:     return "gauge";
+	case METRICS_HISTOGRAM: return "histogram";
+	default:                return "untyped";
+	}
+}
+
+
+static void fam_destructor(void *arg)
+{
+	struct metrics_fam *fam = arg;
+
+	list_unlink(&fam->le);
+	++reg.gen;
+
+	mem_deref(fam->name);
+	mem_deref(fam->help);
+}
+
+
+static void exp_destructor(void *arg)
+{
+	struct metrics_exp *exp = arg;
+	uint32_t i;
+
+	tmr_cancel(&exp->tmr);
+	mem_deref(exp->mb);
+
+	for (i=0; i<exp->uac; i++)
+		mem_deref(exp->uav[i]);
+
+	for (i=0; i<exp->callc; i++) {
+		mem_deref(exp->callv[i].ua);
+		mem_deref(exp->callv[i].id);
+	}
+
+	mem_deref(exp->uav);
+	mem_deref(exp->callv);
+}
+
+
+static int snapshot(struct metrics_exp *exp)
+{
+	struct le *le, *lec;
+	uint32_t n = 0;
+
+	if (list_isempty(uag_list()))
+		return 0;
+
+	exp->uav = mem_zalloc(list_count(uag_list()) * sizeof(*exp->uav),
+			      NULL);
+	if (!exp->uav)
+		return ENOMEM;
+
+	for (le = list_head(uag_list()); le; le = le->next)
+		exp->uav[exp->uac++] = mem_ref(le->data);
+
+	for (le = list_head(uag_list()); le; le = le->next)
+		n += list_count(ua_calls(le->data));
+
+	if (!n)
+		return 0;
+
+	exp->callv = mem_zalloc(n * sizeof(*exp->callv), NULL);
+	if (!exp->callv)
+		return ENOMEM;
+
+	for (le = list_head(uag_list()), n = 0; le; le = le->next) {
+
+		for (lec = list_head(ua_calls(le->data)); lec;
+		     lec = lec->next) {
+
+			struct snap_call *sc = &exp->callv[n];
+
+			if (str_dup(&sc->id, call_id(lec->data)))
+				return ENOMEM;
+
+			sc->ua = mem_ref(le->data);
+			exp->callc = ++n;
+		}
+	}
+
+	return 0;
+}
+
+
+/**
+ * Register a metric family
+ *
+ * @param famp Pointer to allocated metric family
+ * @param name Metric name, e.g. "baresip_calls_active"
+ * @param type Metric type
+ * @param help Help text
+ * @param colh Collect handler
+ * @param arg  Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int metrics_register(struct metrics_fam **famp, const char *name,
+		     enum metrics_type type, const char *help,
+		     metrics_collect_h *colh, void *arg)
+{
+	struct metrics_fam *fam;
+	int err;
+
+	if (!famp || !str_isset(name) || !colh)
+		return EINVAL;
+
+	fam = mem_zalloc(sizeof(*fam), fam_destructor);
+	if (!fam)
+		return ENOMEM;
+
+	err  = str_dup(&fam->name, name);
+	err |= str_dup(&fam->help, help ? help : name);
+	if (err)
+		goto out;
+
+	fam->type = type;
+	fam->colh = colh;
+	fam->arg  = arg;
+
+	list_append(&reg.faml, &fam->le, fam);
+	++reg.gen;
+
+ out:
+	if (err)
+		mem_deref(fam);
+	else
+		*famp = fam;
+
+	return err;
+}
+
+
+static int print_value(struct re_printf *pf, const double *value)
+{
+	const double v = *value;
+
+	if (v == floor(v) && fabs(v) < 1e15)
+		return re_hprintf(pf, "%lld", (long long)v);
+
+	return re_hprintf(pf, "%.6f", v);
+}
+
+
+/**
+ * Add a sample to the metric family that is being collected
+ *
+ * @param exp   Export context
+ * @param value Sample value
+ * @param fmt   Formatted labels without braces, e.g. "dir=\"tx\"" or NULL
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int metrics_sample(struct metrics_exp *exp, double value,
+		   const char *fmt, ...)
+{
+	va_list ap;
+	int err;
+
+	if (!exp || !exp->fam)
+		return EINVAL;
+
+	err = mbuf_write_str(exp->mb, exp->fam->name);
+
+	if (str_isset(fmt)) {
+		va_start(ap, fmt);
+		err |= mbuf_printf(exp->mb, "{%v}", fmt, &ap);
+		va_end(ap);
+	}
+
+	err |= mbuf_printf(exp->mb, " %H\n", print_value, &value);
+
+	++exp->n;
+
+	return err;
+}
+
+
+/**
+ * Add one histogram to the histogram family that is being collected.
+ * The _bucket, _sum and _count samples are written, the bucket counts
+ * are made cumulative.
+ *
+ * @param exp    Export context
+ * @param limitv Upper bounds of the buckets, increasing
+ * @param countv Observations per bucket, with limitc + 1 entries, the
+ *               last one counts the observations above all bounds
+ * @param limitc Number of bucket bounds
+ * @param sum    Sum of all observations
+ * @param fmt    Formatted labels without braces, or NULL
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int metrics_histogram(struct metrics_exp *exp, const double *limitv,
+		      const uint64_t *countv, size_t limitc, double sum,
+		      const char *fmt, ...)
+{
+	const char *name;
+	char *labels = NULL;
+	const char *sep;
+	uint64_t n = 0;
+	va_list ap;
+	size_t i;
+	int err = 0;
+
+	if (!exp || !exp->fam || !limitv || !countv ||
+	    exp->fam->type != METRICS_HISTOGRAM)
+		return EINVAL;
+
+	if (str_isset(fmt)) {
+		va_start(ap, fmt);
+		err = re_vsdprintf(&labels, fmt, ap);
+		va_end(ap);
+		if (err)
+			return err;
+	}
+
+	name = exp->fam->name;
+	sep  = labels ? "," : "";
+
+	for (i=0; i<limitc; i++) {
+
+		n += countv[i];
+
+		err |= mbuf_printf(exp->mb, "%s_bucket{%s%sle=\"%H\"} %llu\n",
+				   name, labels ? labels : "", sep,
+				   print_value, &limitv[i], n);
+	}
+
+	n += countv[limitc];
+
+	err |= mbuf_printf(exp->mb, "%s_bucket{%s%sle=\"+Inf\"} %llu\n",
+			   name, labels ? labels : "", sep, n);
+
+	if (labels) {
+		err |= mbuf_printf(exp->mb, "%s_sum{%s} %H\n",
+				   name, labels, print_value, &sum);
+		err |= mbuf_printf(exp->mb, "%s_count{%s} %llu\n",
+				   name, labels, n);
+	}
+	else {
+		err |= mbuf_printf(exp->mb, "%s_sum %H\n",
+				   name, print_value, &sum);
+		err |= mbuf_printf(exp->mb, "%s_count %llu\n", name, n);
+	}
+
+	exp->n += (uint32_t)limitc + 3;
+
+	mem_deref(labels);
+
+	return err;
+}
+
+
+/**
+ * Check if a collector should stop and continue in the next step
+ *
+ * @param exp Export context
+ *
+ * @return True to yield, otherwise false
+ */
+bool metrics_yield(const struct metrics_exp *exp)
+{
+	return exp && exp->n >= STEP_SAMPLES;
+}
+
+
+/**
+ * Print a label value with escaping
+ *
+ * @param pf  Print function
+ * @param str Label value
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int metrics_label_print(struct re_printf *pf, const char *str)
+{
+	int err = 0;
+
+	if (!str)
+		return 0;
+
+	for (; *str && !err; str++) {
+
+		switch (*str) {
+
+		case '\\': err = re_hprintf(pf, "\\\\"); break;
+		case '"':  err = re_hprintf(pf, "\\\""); break;
+		case '\n': err = re_hprintf(pf, "\\n");  break;
+		default:   err = re_hprintf(pf, "%c", *str); break;
+		}
+	}
+
+	return err;
+}
+
+
+static void step_handler(void *arg)
+{
+	struct metrics_exp *exp = arg;
+	int err = 0;
+
+	exp->n = 0;
+
+	if (exp->gen != reg.gen) {
+		warning("metrics: registry changed during export\n");
+		err = EAGAIN;
+		goto out;
+	}
+
+	while (exp->le) {
+
+		const struct metrics_fam *fam = exp->le->data;
+
+		exp->fam = fam;
+
+		if (!exp->head) {
+			err = mbuf_printf(exp->mb,
+					  "# HELP %s %s\n# TYPE %s %s\n",
+					  fam->name, fam->help,
+					  fam->name, type_name(fam->type));
+			if (err)
+				goto out;
+
+			exp->head = true;
+		}
+
+		err = fam->colh(exp, &exp->pos, fam->arg);
+		if (err == EAGAIN) {
+			tmr_start(&exp->tmr, 0, step_handler, exp);
+			return;
+		}
+		else if (err)
+			goto out;
+
+		exp->le   = exp->le->next;
+		exp->pos  = 0;
+		exp->head = false;
+
+		if (exp->le && metrics_yield(exp)) {
+			tmr_start(&exp->tmr, 0, step_handler, exp);
+			return;
+		}
+	}
+
+ out:
+	exp->fam = NULL;
+	exp->le  = NULL;
+
+	if (!err)
+		exp->mb->pos = 0;
+
+	exp->doneh(err, exp->mb, exp->arg);
+}
+
+
+/**
+ * Export all registered metrics in the Prometheus text format. The
+ * export runs in steps on the main loop, the done handler is called
+ * with the formatted text when finished.
+ *
+ * @param expp  Pointer to allocated export, dereference to cancel
+ * @param doneh Done handler
+ * @param arg   Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int metrics_export(struct metrics_exp **expp, metrics_done_h *doneh,
+		   void *arg)
+{
+	struct metrics_exp *exp;
+	int err;
+
+	if (!expp || !doneh)
+		return EINVAL;
+
+	exp = mem_zalloc(sizeof(*exp), exp_destructor);
+	if (!exp)
+		return ENOMEM;
+
+	exp->mb = mbuf_alloc(MB_SIZE);
+	if (!exp->mb) {
+		mem_deref(exp);
+		return ENOMEM;
+	}
+
+	err = snapshot(exp);
+	if (err) {
+		mem_deref(exp);
+		return err;
+	}
+
+	exp->le    = reg.faml.head;
+	exp->gen   = reg.gen;
+	exp->doneh = doneh;
+	exp->arg   = arg;
+
+	tmr_start(&exp->tmr, 0, step_handler, exp);
+
+	*expp = exp;
+
+	return 0;
+}
+
+
+/*
+ * Core metrics
+ */
+
+enum call_metric {
+	CM_PACKETS,
+	CM_BYTES,
+	CM_LOST,
+	CM_JITTER,
+	CM_JBUF,
+	CM_AUBUF_OVERRUN,
+	CM_AUBUF_UNDERRUN,
+	CM_CPU,
+};
+
+static const struct call_fam {
+	const char *name;
+	enum metrics_type type;
+	const char *help;
+	enum call_metric id;
+} callfamv[] = {
+	{"baresip_rtp_packets_total", METRICS_COUNTER,
+	 "RTP packets per stream", CM_PACKETS},
+	{"baresip_rtp_bytes_total", METRICS_COUNTER,
+	 "RTP bytes per stream", CM_BYTES},
+	{"baresip_rtp_lost_packets_total", METRICS_COUNTER,
+	 "Lost RTP packets per stream, from RTCP", CM_LOST},
+	{"baresip_rtp_jitter_seconds", METRICS_GAUGE,
+	 "Interarrival jitter per stream, from RTCP", CM_JITTER},
+	{"baresip_jbuf_packets", METRICS_GAUGE,
+	 "Packets in the jitter buffer", CM_JBUF},
+	{"baresip_aubuf_overruns_total", METRICS_COUNTER,
+	 "Audio buffer overruns", CM_AUBUF_OVERRUN},
+	{"baresip_aubuf_underruns_total", METRICS_COUNTER,
+	 "Audio buffer underruns", CM_AUBUF_UNDERRUN},
+	{"baresip_media_cpu_seconds_total", METRICS_COUNTER,
+	 "CPU time spent in media processing", CM_CPU},
+};
+
+
+static struct {
+	struct metrics_fam *calls;
+	struct metrics_fam *regs;
+	struct metrics_fam *callv[ARRAY_SIZE(callfamv)];
+} core;
+
+
+static int calls_collect(struct metrics_exp *exp, uint32_t *posp, void *arg)
+{
+	(void)posp;
+	(void)arg;
+
+	return metrics_sample(exp, exp->callc, NULL);
+}
+
+
+/* One sample per user-agent, the position is the snapshot index */
+static int regs_collect(struct metrics_exp *exp, uint32_t *posp, void *arg)
+{
+	uint32_t i;
+	int err;
+	(void)arg;
+
+	for (i = *posp; i < exp->uac; i++) {
+
+		const struct ua *ua = exp->uav[i];
+
+		if (metrics_yield(exp)) {
+			*posp = i;
+			return EAGAIN;
+		}
+
+		err = metrics_sample(exp, ua_isregistered(ua),
+				     "aor=\"%H\"", metrics_label_print,
+				     account_aor(ua_account(ua)));
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+
+static int sample_dir(struct metrics_exp *exp, const struct call *call,
+		      const struct stream *s, double tx, double rx)
+{
+	const char *id = call_id(call);
+	const char *media = sdp_media_name(stream_sdpmedia(s));
+	int err;
+
+	err  = metrics_sample(exp, tx, "call=\"%H\",media=\"%s\",dir=\"tx\"",
+			      metrics_label_print, id, media);
+	err |= metrics_sample(exp, rx, "call=\"%H\",media=\"%s\",dir=\"rx\"",
+			      metrics_label_print, id, media);
+
+	return err;
+}
+
+
+static int stream_sample(struct metrics_exp *exp, const struct call *call,
+			 const struct stream *s, enum call_metric id)
+{
+	const struct rtcp_stats *rtcp = stream_rtcp_stats(s);
+	const struct media_cpu *cpu = stream_media_cpu(s);
+	int i, err = 0;
+
+	switch (id) {
+
+	case CM_PACKETS:
+		return sample_dir(exp, call, s,
+				  stream_metric_get_tx_n_packets(s),
+				  stream_metric_get_rx_n_packets(s));
+
+	case CM_BYTES:
+		return sample_dir(exp, call, s,
+				  stream_metric_get_tx_n_bytes(s),
+				  stream_metric_get_rx_n_bytes(s));
+
+	case CM_LOST:
+		return sample_dir(exp, call, s, rtcp->tx.lost, rtcp->rx.lost);
+
+	case CM_JITTER:
+		return sample_dir(exp, call, s,
+				  rtcp->tx.jit / 1e6, rtcp->rx.jit / 1e6);
+
+	case CM_JBUF:
+		return metrics_sample(exp, stream_jbuf_packets(s),
+				      "call=\"%H\",media=\"%s\"",
+				      metrics_label_print, call_id(call),
+				      sdp_media_name(stream_sdpmedia(s)));
+
+	case CM_CPU:
+		for (i=0; i<MEDIA_CPU_STAGES; i++) {
+
+			if (!cpu->stagev[i].n)
+				continue;
+
+			err |= metrics_sample(exp, cpu->stagev[i].usec / 1e6,
+					      "call=\"%H\",media=\"%s\","
+					      "stage=\"%s\"",
+					      metrics_label_print,
+					      call_id(call),
+					      sdp_media_name(
+						  stream_sdpmedia(s)),
+					      media_cpu_stage_name(i));
+		}
+		return err;
+
+	default:
+		return 0;
+	}
+}
+
+
+static int call_sample(struct metrics_exp *exp, const struct call *call,
+		       enum call_metric id)
+{
+	struct audio_aubuf_stat st;
+	struct le *le;
+	int err = 0;
+
+	switch (id) {
+
+	case CM_AUBUF_OVERRUN:
+	case CM_AUBUF_UNDERRUN:
+		if (audio_aubuf_stat(call_audio(call), &st))
+			return 0;
+
+		if (id == CM_AUBUF_OVERRUN) {
+			return sample_dir(exp, call,
+					  audio_strm(call_audio(call)),
+					  st.tx_overrun, st.rx_overrun);
+		}
+
+		return sample_dir(exp, call, audio_strm(call_audio(call)),
+				  st.tx_underrun, st.rx_underrun);
+
+	default:
+		for (le = list_head(call_streaml(call)); le; le = le->next)
+			err |= stream_sample(exp, call, le->data, id);
+
+		return err;
+	}
+}
+
+
+/*
+ * One sample per stream of each call, the position is the snapshot
+ * index. Calls that were closed since the start are skipped.
+ */
+static int call_collect(struct metrics_exp *exp, uint32_t *posp, void *arg)
+{
+	const struct call_fam *cf = arg;
+	uint32_t i;
+	int err;
+
+	for (i = *posp; i < exp->callc; i++) {
+
+		const struct snap_call *sc = &exp->callv[i];
+		const struct call *call;
+
+		if (metrics_yield(exp)) {
+			*posp = i;
+			return EAGAIN;
+		}
+
+		call = call_find_id(ua_calls(sc->ua), sc->id);
+		if (!call)
+			continue;
+
+		err = call_sample(exp, call, cf->id);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+
+int metrics_init(void)
+{
+	size_t i;
+	int err;
+
+	err  = metrics_register(&core.calls, "baresip_calls_active",
+				METRICS_GAUGE, "Active calls",
+				calls_collect, NULL);
+	err |= metrics_register(&core.regs, "baresip_ua_registered",
+				METRICS_GAUGE,
+				"User-agent registration state (1=registered)",
+				regs_collect, NULL);
+	if (err)
+		return err;
+
+	for (i=0; i<ARRAY_SIZE(callfamv); i++) {
+
+		err = metrics_register(&core.callv[i], callfamv[i].name,
+				       callfamv[i].type, callfamv[i].help,
+				       call_collect, (void *)&callfamv[i]);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+
+void metrics_close(void)
+{
+	size_t i;
+
+	core.calls = mem_deref(core.calls);
+	core.regs  = mem_deref(core.regs);
+
+	for (i=0; i<ARRAY_SIZE(core.callv); i++)
+		core.callv[i] = mem_deref(core.callv[i]);
+}
@@ -0,0 +1,441 @@
+/**
+ * @file mlprof.c  Main-loop profiler and stall detector
+ *
+ * Copyright (C) 2010 Alfred E. Heggestad
+ */
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/**
+ * \page MainLoopProfiler Main-loop profiler
+ *
+ * All SIP, RTP, timer and command handlers share the re main loop.
+ * The profiler measures the execution time of the instrumented handlers
+ * and keeps a histogram per handler name. A handler that runs longer
+ * than the stall threshold is counted and reported as a "stall" event.
+ *
+ * A watchdog thread checks the handler that is currently running, so a
+ * stall is logged with the name of the handler while it is still
+ * blocking the main loop.
+ *
+ * A probe timer measures the dispatch latency of the main loop, which
+ * also covers the handlers that are not instrumented (e.g. in libre).
+ *
+ * Example config:
+ \verbatim
+  mainloop_profile      yes
+  mainloop_stall_ms     50
+ \endverbatim
+ */
+
+
+enum {
+	HASH_SIZE      = 256,      /**< Handler name hash table size   */
+	DEPTH          = 8,        /**< Max. nesting of handlers       */
+	PROBE_INTERVAL = 100,      /**< Latency probe interval [ms]    */
+	HIST_BINS      = 12,
+};
+
+/** Histogram bin limits [us] */
+static const uint32_t hist_limitv[HIST_BINS-1] = {
+	100, 250, 500, 1000, 2500, 5000,
+	10000, 25000, 50000, 100000, 250000
+};
+
+
+/** Statistics for one handler name */
+struct mlprof_site {
+	struct le le;
+	struct le he;
+	char *name;
+	uint64_t n_calls;
+	uint64_t usec_sum;
+	uint32_t usec_max;
+	uint32_t n_stall;
+	uint32_t histv[HIST_BINS];
+};
+
+
+static struct {
+	bool enabled;
+	uint32_t stall_ms;              /**< Stall threshold [ms]         */
+	struct list sitel;              /**< Handlers (struct mlprof_site)*/
+	struct hash *siteh;             /**< Handlers by name             */
+
+	/* currently running handlers, read by the watchdog (atomic) */
+	const char *namev[DEPTH];
+	uint64_t t0;                    /**< Start of outermost handler   */
+	int depth;
+
+	struct mlprof_site *latency;    /**< Main-loop dispatch latency   */
+	struct tmr tmr_probe;
+	uint64_t latency_due;
+	uint64_t n_stall;
+
+#ifdef HAVE_PTHREAD
+	pthread_t thread;
+	bool run;                       /**< Watchdog running (atomic)    */
+#endif
+} mlp;
+
+
+static void site_destructor(void *arg)
+{
+	struct mlprof_site *site = arg;
+
+	list_unlink(&site->le);
+	hash_unlink(&site->he);
+	mem_deref(site->name);
+}
+
+
+static bool site_cmp_handler(struct le *le, void *arg)
+{
+	const struct mlprof_site *site = le->data;
+
+	return 0 == str_cmp(site->name, arg);
+}
+
+
+/* By content, the name may be a string of a module that was unloaded */
+static struct mlprof_site *site_find(const char *name)
+{
+	struct mlprof_site *site;
+	const uint32_t key = hash_joaat_str(name);
+
+	site = list_ledata(hash_lookup(mlp.siteh, key, site_cmp_handler,
+				       (void *)name));
+	if (site)
+		return site;
+
+	site = mem_zalloc(sizeof(*site), site_destructor);
+	if (!site)
+		return NULL;
+
+	/* copy, the name may be owned by a module */
+	if (str_dup(&site->name, name)) {
+		mem_deref(site);
+		return NULL;
+	}
+
+	list_append(&mlp.sitel, &site->le, site);
+	hash_append(mlp.siteh, key, &site->he, site);
+
+	return site;
+}
+
+
+static void site_update(struct mlprof_site *site, uint32_t usec)
+{
+	unsigned bin;
+
+	for (bin=0; bin<HIST_BINS-1; bin++) {
+		if (usec < hist_limitv[bin])
+			break;
+	}
+
+	++site->histv[bin];
+	++site->n_calls;
+	site->usec_sum += usec;
+	site->usec_max  = max(site->usec_max, usec);
+}
+
+
+static void probe_handler(void *arg)
+{
+	const uint64_t now = tmr_jiffies();
+	uint32_t late;
+	(void)arg;
+
+	late = (uint32_t)(now - min(now, mlp.latency_due));
+
+	mlp.latency_due = now + PROBE_INTERVAL;
+	tmr_start(&mlp.tmr_probe, PROBE_INTERVAL, probe_handler, NULL);
+
+	if (!mlp.latency)
+		return;
+
+	site_update(mlp.latency, late * 1000);
+
+	if (mlp.stall_ms && late >= mlp.stall_ms) {
+		++mlp.latency->n_stall;
+		++mlp.n_stall;
+
+		module_event("mainloop", "latency", NULL, NULL,
+			     "%u", late);
+	}
+}
+
+
+#ifdef HAVE_PTHREAD
+static void *watchdog_thread(void *arg)
+{
+	const uint32_t interval = max(mlp.stall_ms / 2, 10);
+	uint64_t reported = 0;
+	(void)arg;
+
+	while (__atomic_load_n(&mlp.run, __ATOMIC_RELAXED)) {
+
+		uint64_t t0, now;
+		const char *name;
+		int depth;
+
+		sys_msleep(interval);
+
+		/* the depth is stored last by the main thread */
+		depth = __atomic_load_n(&mlp.depth, __ATOMIC_ACQUIRE);
+		t0    = __atomic_load_n(&mlp.t0, __ATOMIC_RELAXED);
+
+		if (depth <= 0 || depth > DEPTH || t0 == reported)
+			continue;
+
+		name = __atomic_load_n(&mlp.namev[depth - 1],
+				       __ATOMIC_RELAXED);
+		now  = tmr_jiffies_usec();
+
+		if (now > t0 && (now - t0) / 1000 >= mlp.stall_ms) {
+
+			warning("mainloop: stalled for %llu ms in '%s'\n",
+				(now - t0) / 1000, name ? name : "?");
+
+			reported = t0;
+		}
+	}
+
+	return NULL;
+}
+#endif
+
+
+/**
+ * Enable the main-loop profiler
+ *
+ * @param stall_ms Stall threshold in [ms], 0 to disable stall detection
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mlprof_init(uint32_t stall_ms)
+{
+	int err = 0;
+
+	if (mlp.enabled)
+		mlprof_close();
+
+	err = hash_alloc(&mlp.siteh, HASH_SIZE);
+	if (err)
+		return err;
+
+	mlp.stall_ms = stall_ms;
+	mlp.depth    = 0;
+	mlp.enabled  = true;
+
+	mlp.latency = site_find("(main-loop latency)");
+
+	mlp.latency_due = tmr_jiffies() + PROBE_INTERVAL;
+	tmr_start(&mlp.tmr_probe, PROBE_INTERVAL, probe_handler, NULL);
+
+#ifdef HAVE_PTHREAD
+	if (stall_ms) {
+		__atomic_store_n(&mlp.run, true, __ATOMIC_RELAXED);
+		err = pthread_create(&mlp.thread, NULL, watchdog_thread, NULL);
+		if (err) {
+			__atomic_store_n(&mlp.run, false, __ATOMIC_RELAXED);
+			warning("mlprof: could not start watchdog (%m)\n",
+				err);
+		}
+	}
+#endif
+
+	info("mainloop: profiler enabled (stall threshold %u ms)\n",
+	     stall_ms);
+
+	return err;
+}
+
+
+/**
+ * Disable the main-loop profiler and free the statistics
+ */
+void mlprof_close(void)
+{
+#ifdef HAVE_PTHREAD
+	if (__atomic_load_n(&mlp.run, __ATOMIC_RELAXED)) {
+		__atomic_store_n(&mlp.run, false, __ATOMIC_RELAXED);
+		pthread_join(mlp.thread, NULL);
+	}
+#endif
+
+	mlp.enabled = false;
+	tmr_cancel(&mlp.tmr_probe);
+
+	mlprof_reset();
+	mlp.siteh = mem_deref(mlp.siteh);
+}
+
+
+/**
+ * Reset the main-loop profiler statistics
+ */
+void mlprof_reset(void)
+{
+	list_flush(&mlp.sitel);
+	mlp.n_stall = 0;
+
+	mlp.latency = mlp.enabled ? site_find("(main-loop latency)") : NULL;
+}
+
+
+/**
+ * Check if the main-loop profiler is enabled
+ *
+ * @return True if enabled, otherwise false
+ */
+bool mlprof_enabled(void)
+{
+	return mlp.enabled;
+}
+
+
+/**
+ * Mark the start of a main-loop handler
+ *
+ * @param probe Probe for this handler invocation
+ * @param name  Handler name (static string)
+ *
+ * NOTE: must be called from the main thread
+ */
+void mlprof_enter(struct mlprof_probe *probe, const char *name)
+{
+	if (!probe)
+		return;
+
+	probe->t0 = 0;
+
+	if (!mlp.enabled || mlp.depth >= DEPTH)
+		return;
+
+	probe->t0 = tmr_jiffies_usec();
+	probe->name = name;
+
+	__atomic_store_n(&mlp.namev[mlp.depth], name, __ATOMIC_RELAXED);
+	if (mlp.depth == 0)
+		__atomic_store_n(&mlp.t0, probe->t0, __ATOMIC_RELAXED);
+
+	__atomic_store_n(&mlp.depth, mlp.depth + 1, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Mark the end of a main-loop handler
+ *
+ * @param probe Probe from mlprof_enter()
+ */
+void mlprof_leave(struct mlprof_probe *probe)
+{
+	struct mlprof_site *site;
+	uint32_t usec;
+
+	if (!probe || !probe->t0 || !mlp.enabled || !mlp.depth)
+		return;
+
+	usec = (uint32_t)(tmr_jiffies_usec() - probe->t0);
+
+	__atomic_store_n(&mlp.depth, mlp.depth - 1, __ATOMIC_RELEASE);
+
+	site = site_find(probe->name);
+	if (!site)
+		return;
+
+	site_update(site, usec);
+
+	if (mlp.stall_ms && usec >= mlp.stall_ms * 1000) {
+		++site->n_stall;
+		++mlp.n_stall;
+
+		module_event("mainloop", "stall", NULL, NULL,
+			     "%s,%u", site->name, usec / 1000);
+	}
+}
+
+
+static int print_hist(struct re_printf *pf, const struct mlprof_site *site)
+{
+	unsigned i;
+	int err = 0;
+
+	for (i=0; i<HIST_BINS; i++) {
+
+		if (!site->histv[i])
+			continue;
+
+		if (i < HIST_BINS-1) {
+			err |= re_hprintf(pf, " <%u.%ums:%u",
+					  hist_limitv[i] / 1000,
+					  hist_limitv[i] % 1000 / 100,
+					  site->histv[i]);
+		}
+		else {
+			err |= re_hprintf(pf, " >=%ums:%u",
+					  hist_limitv[i-1] / 1000,
+					  site->histv[i]);
+		}
+	}
+
+	return err;
+}
+
+
+/**
+ * Print the main-loop profile
+ *
+ * @param pf     Print function
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mlprof_debug(struct re_printf *pf, void *unused)
+{
+	struct le *le;
+	int err = 0;
+	(void)unused;
+
+	err |= re_hprintf(pf, "\nMain-loop profile (%s, stall %u ms,"
+			  " %llu stalls):\n",
+			  mlp.enabled ? "enabled" : "disabled",
+			  mlp.stall_ms, mlp.n_stall);
+
+	err |= re_hprintf(pf, " %-24s %10s %10s %8s %8s %6s\n",
+			  "handler", "calls", "total [ms]", "avg [us]",
+			  "max [us]", "stalls");
+
+	for (le = mlp.sitel.head; le; le = le->next) {
+
+		const struct mlprof_site *site = le->data;
+
+		err |= re_hprintf(pf, " %-24s %10llu %10llu %8llu %8u %6u\n",
+				  site->name, site->n_calls,
+				  site->usec_sum / 1000,
+				  site->n_calls ?
+				  site->usec_sum / site->n_calls : 0,
+				  site->usec_max, site->n_stall);
+	}
+
+	err |= re_hprintf(pf, "\nHistograms:\n");
+
+	for (le = mlp.sitel.head; le; le = le->next) {
+
+		const struct mlprof_site *site = le->data;
+
+		err |= re_hprintf(pf, " %-24s%H\n", site->name,
+				  print_hist, site);
+	}
+
+	return err;
+}
+
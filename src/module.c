@@ -8,6 +8,100 @@
 #include "core.h"
 
 
+/**
+ * \page LazyModules Lazy module loading
+ *
+ * Modules listed with "module_lazy" are not loaded at startup. The config
+ * line is a manifest with the module file, followed by the kinds and names
+ * of what the module registers:
+ *
+ *     module_lazy   opus.so        aucodec:opus
+ *     module_lazy   dtls_srtp.so   menc:dtls_srtp,dtls_srtpf
+ *     module_lazy   alsa.so        ausrc:alsa auplay:alsa
+ *     module_lazy   vumeter.so     aufilt
+ *
+ * A device or media encryption module is loaded when it is looked up by
+ * name. Codec and filter modules are loaded with the first call, since
+ * the SDP offer contains all codecs.
+ *
+ * The codecs and filters of a lazy module are registered after those of
+ * the modules loaded at startup, not at the position of the config line.
+ * A lazy opus is thus offered after PCMU and PCMA. The account
+ * parameters "audio_codecs" and "video_codecs" set the codec preference:
+ *
+ *     <sip:alice@example.com>;audio_codecs=opus/48000/2,pcmu,pcma
+ */
+
+
+/** Module registered by manifest, loaded on first use */
+struct lazymod {
+	struct le le;
+	char *path;          /**< Module path                              */
+	char *file;          /**< Module filename                          */
+	char *manifest;      /**< Provided kinds, e.g. "aucodec:opus,l16"  */
+};
+
+/** Load and init time of a module */
+struct modtime {
+	struct le le;
+	char *name;          /**< Module filename                          */
+	uint64_t usec;       /**< Load and init time in [us]               */
+	uint64_t ts;         /**< Time since startup in [ms]               */
+	bool lazy;           /**< Loaded on first use                      */
+	int err;             /**< Load error                               */
+};
+
+static struct {
+	struct list lazyl;   /**< Lazy modules not loaded yet              */
+	struct list timel;   /**< Load times of all modules                */
+	uint64_t t0;         /**< Start of module_init [ms]                */
+	uint64_t usec;       /**< Time spent in module_init [us]           */
+} modules;
+
+
+static void lazymod_destructor(void *arg)
+{
+	struct lazymod *lm = arg;
+
+	list_unlink(&lm->le);
+	mem_deref(lm->path);
+	mem_deref(lm->file);
+	mem_deref(lm->manifest);
+}
+
+
+static void modtime_destructor(void *arg)
+{
+	struct modtime *mt = arg;
+
+	list_unlink(&mt->le);
+	mem_deref(mt->name);
+}
+
+
+static void modtime_add(const struct pl *name, uint64_t usec, bool lazy,
+			int err)
+{
+	struct modtime *mt;
+
+	mt = mem_zalloc(sizeof(*mt), modtime_destructor);
+	if (!mt)
+		return;
+
+	if (pl_strdup(&mt->name, name)) {
+		mem_deref(mt);
+		return;
+	}
+
+	mt->usec = usec;
+	mt->ts   = tmr_jiffies() - modules.t0;
+	mt->lazy = lazy;
+	mt->err  = err;
+
+	list_append(&modules.timel, &mt->le, mt);
+}
+
+
 /*
  * Append module extension, if not exist
  *
@@ -54,30 +148,35 @@ static const struct mod_export *lookup_static_module(const struct pl *pl)
 
 
 static int load_module(struct mod **modp, const struct pl *modpath,
-		       const struct pl *name)
+		       const struct pl *name, bool lazy)
 {
 	char file[FS_PATH_MAX];
 	char namestr[256];
 	struct mod *m = NULL;
+	uint64_t t0;
 	int err = 0;
 
 	if (!name)
 		return EINVAL;
 
-#ifdef STATIC
-	/* Try static first */
+	t0 = tmr_jiffies_usec();
+
 	pl_strcpy(name, namestr, sizeof(namestr));
 
+#ifdef STATIC
+	/* Try static first */
 	if (mod_find(namestr)) {
 		info("static module already loaded: %r\n", name);
 		return EALREADY;
 	}
 
+	trace_begin("module", namestr);
+
 	err = mod_add(&m, lookup_static_module(name));
 	if (!err)
 		goto out;
 #else
-	(void)namestr;
+	trace_begin("module", namestr);
 #endif
 
 	/* Then dynamic */
@@ -90,6 +189,9 @@ static int load_module(struct mod **modp, const struct pl *modpath,
 		goto out;
 
  out:
+	trace_end("module", namestr);
+	modtime_add(name, tmr_jiffies_usec() - t0, lazy, err);
+
 	if (err) {
 		warning("module %r: %m\n", name, err);
 	}
@@ -102,7 +204,7 @@ static int load_module(struct mod **modp, const struct pl *modpath,
 
 static int module_handler(const struct pl *val, void *arg)
 {
-	(void)load_module(NULL, arg, val);
+	(void)load_module(NULL, arg, val, false);
 	return 0;
 }
 
@@ -110,12 +212,43 @@ static int module_handler(const struct pl *val, void *arg)
 static int module_tmp_handler(const struct pl *val, void *arg)
 {
 	struct mod *mod = NULL;
-	(void)load_module(&mod, arg, val);
+	(void)load_module(&mod, arg, val, false);
 	mem_deref(mod);
 	return 0;
 }
 
 
+static int module_lazy_handler(const struct pl *val, void *arg)
+{
+	const struct pl *path = arg;
+	struct pl file, manifest;
+	struct lazymod *lm;
+	int err;
+
+	if (re_regex(val->p, val->l, "[^ \t]+[ \t]*[^]*",
+		     &file, NULL, &manifest)) {
+		warning("module: invalid module_lazy '%r'\n", val);
+		return 0;
+	}
+
+	lm = mem_zalloc(sizeof(*lm), lazymod_destructor);
+	if (!lm)
+		return ENOMEM;
+
+	err  = pl_strdup(&lm->path, path);
+	err |= pl_strdup(&lm->file, &file);
+	err |= pl_strdup(&lm->manifest, &manifest);
+	if (err) {
+		mem_deref(lm);
+		return err;
+	}
+
+	list_append(&modules.lazyl, &lm->le, lm);
+
+	return 0;
+}
+
+
 static int module_app_handler(const struct pl *val, void *arg)
 {
 	struct mod *mod = NULL;
@@ -123,7 +256,7 @@ static int module_app_handler(const struct pl *val, void *arg)
 
 	debug("module: loading app %r\n", val);
 
-	if (load_module(&mod, arg, val)) {
+	if (load_module(&mod, arg, val, false)) {
 		return 0;
 	}
 
@@ -140,14 +273,22 @@ static int module_app_handler(const struct pl *val, void *arg)
 int module_init(const struct conf *conf)
 {
 	struct pl path;
+	uint64_t t0;
 	int err;
 
 	if (!conf)
 		return EINVAL;
 
+	modules.t0 = tmr_jiffies();
+	t0 = tmr_jiffies_usec();
+
 	if (conf_get(conf, "module_path", &path))
 		pl_set_str(&path, ".");
 
+	err = conf_apply(conf, "module_lazy", module_lazy_handler, &path);
+	if (err)
+		return err;
+
 	err = conf_apply(conf, "module", module_handler, &path);
 	if (err)
 		return err;
@@ -160,10 +301,174 @@ int module_init(const struct conf *conf)
 	if (err)
 		return err;
 
+	modules.usec = tmr_jiffies_usec() - t0;
+
+	info("module: %u modules loaded in %llu ms (%u lazy)\n",
+	     list_count(&modules.timel), modules.usec / 1000,
+	     list_count(&modules.lazyl));
+
 	return 0;
 }
 
 
+/**
+ * Free the lazy module manifests and the load times
+ */
+void module_close(void)
+{
+	list_flush(&modules.lazyl);
+	list_flush(&modules.timel);
+}
+
+
+/*
+ * Check if a lazy module provides a kind, and optionally a name
+ *
+ * manifest: "aucodec:opus,l16 aufilt"
+ */
+static bool lazymod_provides(const struct lazymod *lm, const char *kind,
+			     const char *name)
+{
+	struct pl pl, tok, k, names, n;
+
+	pl_set_str(&pl, lm->manifest);
+
+	while (!re_regex(pl.p, pl.l, "[^ \t]+", &tok)) {
+
+		pl_advance(&pl, tok.p + tok.l - pl.p);
+
+		if (re_regex(tok.p, tok.l, "[^:]+[:]*[^]*",
+			     &k, NULL, &names))
+			continue;
+
+		if (pl_strcasecmp(&k, kind))
+			continue;
+
+		/* without names the module must be loaded to find out */
+		if (!str_isset(name) || !pl_isset(&names))
+			return true;
+
+		while (!re_regex(names.p, names.l, "[^,]+", &n)) {
+
+			if (!pl_strcasecmp(&n, name))
+				return true;
+
+			pl_advance(&names, n.p + n.l - names.p);
+		}
+	}
+
+	return false;
+}
+
+
+/**
+ * Load the lazy modules providing a media kind
+ *
+ * @param kind Kind, e.g. "aucodec", "aufilt", "menc", "ausrc", "vidisp"
+ * @param name Name of the codec, filter or device, NULL for all
+ *
+ * @return 0 if a module was loaded, otherwise errorcode
+ */
+int module_lazy_load(const char *kind, const char *name)
+{
+	struct le *le;
+	int err = ENOENT;
+
+	if (!str_isset(kind))
+		return EINVAL;
+
+	le = list_head(&modules.lazyl);
+	while (le) {
+		struct lazymod *lm = le->data;
+		struct pl path, file;
+
+		le = le->next;
+
+		if (!lazymod_provides(lm, kind, name))
+			continue;
+
+		debug("module: lazy loading %s for %s:%s\n",
+		      lm->file, kind, name ? name : "*");
+
+		pl_set_str(&path, lm->path);
+		pl_set_str(&file, lm->file);
+
+		/* a failed module is not retried */
+		list_unlink(&lm->le);
+
+		if (!load_module(NULL, &path, &file, true))
+			err = 0;
+
+		mem_deref(lm);
+	}
+
+	return err;
+}
+
+
+/**
+ * Load the lazy codec and filter modules, needed for the SDP offer
+ * and the media streams
+ */
+void module_lazy_media(void)
+{
+	static const char *kindv[] = {
+		"aucodec", "vidcodec", "aufilt", "vidfilt"
+	};
+	size_t i;
+
+	if (list_isempty(&modules.lazyl))
+		return;
+
+	for (i=0; i<ARRAY_SIZE(kindv); i++)
+		(void)module_lazy_load(kindv[i], NULL);
+}
+
+
+/**
+ * Print the load and init time of all modules
+ *
+ * @param pf     Print function
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int module_debug(struct re_printf *pf, void *unused)
+{
+	struct le *le;
+	int err;
+	(void)unused;
+
+	err = re_hprintf(pf, "Module load times (module_init %llu ms):\n",
+			 modules.usec / 1000);
+	err |= re_hprintf(pf, "  %-24s %10s %8s\n",
+			  "module", "init [ms]", "at [ms]");
+
+	for (le = list_head(&modules.timel); le; le = le->next) {
+		const struct modtime *mt = le->data;
+
+		err |= re_hprintf(pf, "  %-24s %6llu.%03llu %8llu%s",
+				  mt->name, mt->usec / 1000,
+				  mt->usec % 1000, mt->ts,
+				  mt->lazy ? " (lazy)" : "");
+		if (mt->err)
+			err |= re_hprintf(pf, " (%m)", mt->err);
+		err |= re_hprintf(pf, "\n");
+	}
+
+	err |= re_hprintf(pf, "Lazy modules not loaded (%u):\n",
+			  list_count(&modules.lazyl));
+
+	for (le = list_head(&modules.lazyl); le; le = le->next) {
+		const struct lazymod *lm = le->data;
+
+		err |= re_hprintf(pf, "  %-24s %s\n", lm->file, lm->manifest);
+	}
+
+	return err;
+}
+
+
 /**
  * Unload all application modules in reverse order
  */
@@ -179,13 +484,44 @@ void module_app_unload(void)
 		le = le->prev;
 
 		if (me && 0 == str_casecmp(me->type, "application")) {
+			char name[64];
+
 			debug("module: unloading app %s\n", me->name);
+
+			/* the export is gone after unloading */
+			str_ncpy(name, me->name, sizeof(name));
+
+			trace_begin("module close", name);
 			mem_deref(mod);
+			trace_end("module close", name);
 		}
 	}
 }
 
 
+/**
+ * Unload all modules, in the same order as mod_close()
+ */
+void module_unload_all(void)
+{
+	struct le *le = list_head(mod_list());
+
+	while (le) {
+		struct mod *mod = le->data;
+		const struct mod_export *me = mod_export(mod);
+		char name[64];
+
+		le = le->next;
+
+		str_ncpy(name, me ? me->name : "?", sizeof(name));
+
+		trace_begin("module close", name);
+		mem_deref(mod);
+		trace_end("module close", name);
+	}
+}
+
+
 /**
  * Pre-load a module from the current working directory
  *
@@ -203,7 +539,7 @@ int module_preload(const char *module)
 	pl_set_str(&path, ".");
 	pl_set_str(&name, module);
 
-	return load_module(NULL, &path, &name);
+	return load_module(NULL, &path, &name, false);
 }
 
 
@@ -232,7 +568,7 @@ int module_load(const char *path, const char *name)
 	pl_set_str(&pl_path, path);
 	pl_set_str(&pl_name, filename);
 
-	err = load_module(NULL, &pl_path, &pl_name);
+	err = load_module(NULL, &pl_path, &pl_name, false);
 
 	return err;
 }
@@ -0,0 +1,541 @@
+/**
+ * @file mthread.c  Media thread factory
+ *
+ * Copyright (C) 2010 Alfred E. Heggestad
+ */
+#if defined (LINUX) && !defined (_GNU_SOURCE)
+#define _GNU_SOURCE 1
+#endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#endif
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/**
+ * \page MediaThreads Media thread factory
+ *
+ * All media threads are created with mthread_create(). The thread is
+ * named, and gets the scheduling policy, priority and CPU affinity of its
+ * thread class from the config. The CPU time of every thread is measured,
+ * and accumulated per class when the thread exits.
+ *
+ * Example config:
+ \verbatim
+  mthread_audio_src     fifo:60 cpus=2,3
+  mthread_audio_play    fifo:60 cpus=2,3
+  mthread_audio_proc    rr:50 cpus=2-3
+  mthread_video_src     other cpus=0-1
+ \endverbatim
+ *
+ * A real-time policy (fifo, rr) needs the privilege CAP_SYS_NICE. If it
+ * cannot be set, the thread runs with the default policy. The CPU
+ * affinity and the CPU time are only supported on Linux.
+ */
+
+
+enum {
+	PRIO_MIN = 1,                /**< Min. real-time priority          */
+	PRIO_MAX = 99,               /**< Max. real-time priority          */
+};
+
+enum mthread_policy {
+	POLICY_DEFAULT = 0,
+	POLICY_OTHER,
+	POLICY_FIFO,
+	POLICY_RR,
+};
+
+/** Scheduling of a thread class */
+struct mthread_sched {
+	enum mthread_policy policy;
+	int prio;                    /**< Real-time priority 1-99          */
+	uint64_t cpus;               /**< CPU affinity mask, 0 for all     */
+};
+
+/** Media thread */
+struct mthread {
+	struct le le;
+	enum mthread_class cls;
+	char name[16];               /**< Thread name, max. 15 characters  */
+	mthread_h *h;
+	void *arg;
+	uint64_t cpu_ns;             /**< CPU time at thread exit [ns]     */
+	bool sched_ok;               /**< Scheduling was applied           */
+#ifdef HAVE_PTHREAD
+	pthread_t tid;
+	bool joinable;
+#ifdef LINUX
+	clockid_t cid;
+	bool cid_valid;
+#endif
+#endif
+};
+
+/** Statistics of a thread class */
+struct mthread_stat {
+	uint32_t n_started;
+	uint32_t n_sched_err;
+	uint64_t cpu_ns;             /**< CPU time of exited threads [ns]  */
+};
+
+
+static const char *class_namev[MTHREAD_CLASS_MAX] = {
+	"audio_src",
+	"audio_play",
+	"audio_proc",
+	"video_src",
+};
+
+static const char *policy_namev[] = {
+	"default", "other", "fifo", "rr"
+};
+
+static struct {
+	struct mthread_sched schedv[MTHREAD_CLASS_MAX];
+	struct mthread_stat statv[MTHREAD_CLASS_MAX];
+	struct list threadl;         /**< Running threads                  */
+	struct lock *lock;
+} mth;
+
+
+/*
+ * Decode a CPU list, e.g. "2,3" or "0-1,4"
+ */
+static int cpus_decode(uint64_t *cpus, const struct pl *pl)
+{
+	struct pl val = *pl;
+	struct pl tok;
+
+	*cpus = 0;
+
+	while (!re_regex(val.p, val.l, "[^,]+", &tok)) {
+		struct pl first, dash, last;
+		uint32_t a, b, i;
+
+		if (re_regex(tok.p, tok.l, "[0-9]+[^0-9]*[0-9]*",
+			     &first, &dash, &last))
+			return EINVAL;
+
+		a = pl_u32(&first);
+		b = pl_isset(&dash) && pl_isset(&last) ? pl_u32(&last) : a;
+
+		if (a > b || b >= 64)
+			return EINVAL;
+
+		for (i=a; i<=b; i++)
+			*cpus |= 1ULL << i;
+
+		pl_advance(&val, tok.p + tok.l - val.p);
+	}
+
+	return *cpus ? 0 : EINVAL;
+}
+
+
+/*
+ * Decode the scheduling of a thread class
+ *
+ * format: <other|fifo|rr>[:<prio>] [cpus=<list>]
+ */
+static int sched_decode(struct mthread_sched *sched, const struct pl *pl)
+{
+	struct pl policy, colon, prio, cpus;
+	int err;
+
+	memset(sched, 0, sizeof(*sched));
+
+	err = re_regex(pl->p, pl->l, "[a-z]+[:]*[0-9]*",
+		       &policy, &colon, &prio);
+	if (err)
+		return err;
+
+	if (!pl_strcasecmp(&policy, "other"))
+		sched->policy = POLICY_OTHER;
+	else if (!pl_strcasecmp(&policy, "fifo"))
+		sched->policy = POLICY_FIFO;
+	else if (!pl_strcasecmp(&policy, "rr"))
+		sched->policy = POLICY_RR;
+	else
+		return EINVAL;
+
+	if (pl_isset(&prio)) {
+		if (sched->policy < POLICY_FIFO || prio.l > 2)
+			return EINVAL;
+
+		sched->prio = pl_u32(&prio);
+	}
+
+	if (sched->policy >= POLICY_FIFO &&
+	    (sched->prio < PRIO_MIN || sched->prio > PRIO_MAX))
+		return EINVAL;
+
+	if (!re_regex(pl->p, pl->l, "cpus=[^ \t]+", &cpus)) {
+		err = cpus_decode(&sched->cpus, &cpus);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+
+#ifdef HAVE_PTHREAD
+static int sched_apply(const struct mthread_sched *sched)
+{
+	int err = 0;
+
+	if (sched->policy != POLICY_DEFAULT) {
+		struct sched_param param;
+		int policy;
+
+		memset(&param, 0, sizeof(param));
+
+		switch (sched->policy) {
+
+		case POLICY_FIFO:
+			policy = SCHED_FIFO;
+			param.sched_priority = sched->prio;
+			break;
+
+		case POLICY_RR:
+			policy = SCHED_RR;
+			param.sched_priority = sched->prio;
+			break;
+
+		default:
+			policy = SCHED_OTHER;
+			break;
+		}
+
+		err = pthread_setschedparam(pthread_self(), policy, &param);
+	}
+
+#ifdef LINUX
+	if (sched->cpus) {
+		cpu_set_t set;
+		int i;
+
+		CPU_ZERO(&set);
+		for (i=0; i<64; i++) {
+			if (sched->cpus & (1ULL << i))
+				CPU_SET(i, &set);
+		}
+
+		err |= pthread_setaffinity_np(pthread_self(), sizeof(set),
+					      &set);
+	}
+#endif
+
+	return err;
+}
+
+
+static uint64_t thread_cpu_ns(const struct mthread *mt)
+{
+#ifdef LINUX
+	struct timespec ts;
+
+	if (!mt->cid_valid || clock_gettime(mt->cid, &ts))
+		return mt->cpu_ns;
+
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#else
+	return mt->cpu_ns;
+#endif
+}
+
+
+static void *thread_main(void *arg)
+{
+	struct mthread *mt = arg;
+	void *ret;
+
+#ifdef LINUX
+	(void)pthread_setname_np(pthread_self(), mt->name);
+#elif defined (DARWIN)
+	(void)pthread_setname_np(mt->name);
+#endif
+
+	lock_write_get(mth.lock);
+#ifdef LINUX
+	mt->cid_valid = !pthread_getcpuclockid(pthread_self(), &mt->cid);
+#endif
+	mt->sched_ok = 0 == sched_apply(&mth.schedv[mt->cls]);
+	if (!mt->sched_ok)
+		++mth.statv[mt->cls].n_sched_err;
+	lock_rel(mth.lock);
+
+	if (!mt->sched_ok) {
+		warning("mthread: %s: could not set scheduling of class %s\n",
+			mt->name, class_namev[mt->cls]);
+	}
+
+	ret = mt->h(mt->arg);
+
+	lock_write_get(mth.lock);
+	mt->cpu_ns = thread_cpu_ns(mt);
+#ifdef LINUX
+	mt->cid_valid = false;
+#endif
+	lock_rel(mth.lock);
+
+	return ret;
+}
+
+
+static void mthread_destructor(void *arg)
+{
+	struct mthread *mt = arg;
+
+	if (mt->joinable)
+		pthread_join(mt->tid, NULL);
+
+	lock_write_get(mth.lock);
+	list_unlink(&mt->le);
+	mth.statv[mt->cls].cpu_ns += mt->cpu_ns;
+	lock_rel(mth.lock);
+}
+#endif
+
+
+/**
+ * Create a media thread. The thread is joined with mem_deref(), so it
+ * must be stopped by the caller before.
+ *
+ * @param mtp  Pointer to allocated media thread
+ * @param cls  Thread class
+ * @param name Thread name (max. 15 characters are used)
+ * @param h    Thread function
+ * @param arg  Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mthread_create(struct mthread **mtp, enum mthread_class cls,
+		   const char *name, mthread_h *h, void *arg)
+{
+#ifdef HAVE_PTHREAD
+	struct mthread *mt;
+	int err;
+
+	if (!mtp || (unsigned)cls >= MTHREAD_CLASS_MAX || !h)
+		return EINVAL;
+
+	if (!mth.lock) {
+		err = lock_alloc(&mth.lock);
+		if (err)
+			return err;
+	}
+
+	mt = mem_zalloc(sizeof(*mt), mthread_destructor);
+	if (!mt)
+		return ENOMEM;
+
+	mt->cls = cls;
+	mt->h   = h;
+	mt->arg = arg;
+	str_ncpy(mt->name, name ? name : class_namev[cls], sizeof(mt->name));
+
+	lock_write_get(mth.lock);
+	list_append(&mth.threadl, &mt->le, mt);
+	lock_rel(mth.lock);
+
+	err = pthread_create(&mt->tid, NULL, thread_main, mt);
+	if (err) {
+		mem_deref(mt);
+		return err;
+	}
+
+	mt->joinable = true;
+
+	lock_write_get(mth.lock);
+	++mth.statv[cls].n_started;
+	lock_rel(mth.lock);
+
+	*mtp = mt;
+
+	return 0;
+#else
+	(void)mtp;
+	(void)cls;
+	(void)name;
+	(void)h;
+	(void)arg;
+
+	return ENOSYS;
+#endif
+}
+
+
+/**
+ * Set the scheduling of a thread class, for the threads created after.
+ * An invalid scheduling leaves the current one unchanged.
+ *
+ * @param cls   Thread class
+ * @param sched Scheduling, e.g. "fifo:60 cpus=2,3", or NULL for default
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mthread_set_sched(enum mthread_class cls, const struct pl *sched)
+{
+	struct mthread_sched s;
+	int err;
+
+	if ((unsigned)cls >= MTHREAD_CLASS_MAX)
+		return EINVAL;
+
+	if (sched) {
+		err = sched_decode(&s, sched);
+		if (err)
+			return err;
+	}
+	else {
+		memset(&s, 0, sizeof(s));
+	}
+
+	if (!mth.lock) {
+		err = lock_alloc(&mth.lock);
+		if (err)
+			return err;
+	}
+
+	lock_write_get(mth.lock);
+	mth.schedv[cls] = s;
+	lock_rel(mth.lock);
+
+	return 0;
+}
+
+
+/**
+ * Initialise the media thread factory, and read the scheduling of the
+ * thread classes from the config
+ *
+ * @param conf Configuration
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mthread_init(const struct conf *conf)
+{
+	int i, err;
+
+	if (!mth.lock) {
+		err = lock_alloc(&mth.lock);
+		if (err)
+			return err;
+	}
+
+	for (i=0; i<MTHREAD_CLASS_MAX; i++) {
+		char key[32];
+		struct pl pl;
+
+		(void)mthread_set_sched(i, NULL);
+
+		re_snprintf(key, sizeof(key), "mthread_%s", class_namev[i]);
+
+		if (conf_get(conf, key, &pl))
+			continue;
+
+		if (mthread_set_sched(i, &pl)) {
+			warning("mthread: invalid %s '%r'\n", key, &pl);
+			continue;
+		}
+
+		info("mthread: %s: %s:%d cpus=0x%llx\n", class_namev[i],
+		     policy_namev[mth.schedv[i].policy],
+		     mth.schedv[i].prio, mth.schedv[i].cpus);
+	}
+
+	return 0;
+}
+
+
+/**
+ * Close the media thread factory
+ *
+ * @note Threads of modules can still run until the modules are unloaded
+ */
+void mthread_close(void)
+{
+	if (list_isempty(&mth.threadl))
+		mth.lock = mem_deref(mth.lock);
+}
+
+
+/**
+ * Get the name of a thread class
+ *
+ * @param cls Thread class
+ *
+ * @return Name of the thread class
+ */
+const char *mthread_class_name(enum mthread_class cls)
+{
+	if ((unsigned)cls >= MTHREAD_CLASS_MAX)
+		return "???";
+
+	return class_namev[cls];
+}
+
+
+/**
+ * Print the media threads and the CPU time per thread class
+ *
+ * @param pf     Print function
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int mthread_debug(struct re_printf *pf, void *unused)
+{
+	struct le *le;
+	int i, err = 0;
+	(void)unused;
+
+	if (!mth.lock)
+		return 0;
+
+	lock_read_get(mth.lock);
+
+	err |= re_hprintf(pf, "Media thread classes:\n");
+	err |= re_hprintf(pf, "  %-12s %-8s %4s %18s %8s %10s %12s\n",
+			  "class", "policy", "prio", "cpus", "started",
+			  "sched_err", "cpu [ms]");
+
+	for (i=0; i<MTHREAD_CLASS_MAX; i++) {
+		const struct mthread_sched *sched = &mth.schedv[i];
+		const struct mthread_stat *st = &mth.statv[i];
+
+		err |= re_hprintf(pf, "  %-12s %-8s %4d %18llx %8u %10u"
+				  " %12llu\n",
+				  class_namev[i], policy_namev[sched->policy],
+				  sched->prio, sched->cpus, st->n_started,
+				  st->n_sched_err, st->cpu_ns / 1000000);
+	}
+
+	err |= re_hprintf(pf, "Media threads (%u):\n",
+			  list_count(&mth.threadl));
+
+	for (le = list_head(&mth.threadl); le; le = le->next) {
+		const struct mthread *mt = le->data;
+		uint64_t cpu_ns = 0;
+
+#ifdef HAVE_PTHREAD
+		cpu_ns = thread_cpu_ns(mt);
+#endif
+
+		err |= re_hprintf(pf, "  %-16s %-12s %12llu ms%s\n",
+				  mt->name, class_namev[mt->cls],
+				  cpu_ns / 1000000,
+				  mt->sched_ok ? "" : " (sched failed)");
+	}
+
+	lock_rel(mth.lock);
+
+	return err;
+}
@@ -8,6 +8,13 @@
 #include "core.h"
 
 
+enum {
+	BACKOFF_MIN  =  1000,   /**< Min. delay for failed accounts [ms] */
+	BACKOFF_MAX  = 60000,   /**< Max. delay for failed accounts [ms] */
+	RWAIT_JITTER =    10,   /**< Max. refresh jitter [%]             */
+};
+
+
 /** Register client */
 struct reg {
 	struct le le;                /**< Linked list element                */
@@ -20,16 +27,133 @@ struct reg {
 	uint16_t scode;              /**< Registration status code           */
 	char *srv;                   /**< SIP Server id                      */
 	int af;                      /**< Cached address family for SIP conn */
+
+	/* scheduler: */
+	struct le le_sched;          /**< Member of scheduler queue          */
+	char *uri;                   /**< Pending Register URI               */
+	char *params;                /**< Pending Contact parameters         */
+	char *outbound;              /**< Pending outbound proxy             */
+	uint64_t ts_due;             /**< Scheduled send time [ms]           */
+	uint64_t ts_queued;          /**< Time when queued [ms]              */
+	uint64_t ts_sent;            /**< Time when sent [ms]                */
+	uint32_t failc;              /**< Consecutive failures               */
+	bool inflight;               /**< Waiting for a final response       */
 };
 
 
+/*
+ * The Register scheduler spreads the initial REGISTER requests of all
+ * accounts over a time window with random jitter, and limits the number
+ * of REGISTER transactions in flight. Failed accounts are sent first,
+ * after an exponential backoff. Refreshes are spread by a random
+ * reduction of the refresh wait.
+ *
+ * New registrations are appended to the queue, each one a random
+ * fraction of the window per account after the previous one. The
+ * failed accounts have their own queue.
+ *
+ * The scheduler is disabled if both sip_reg_window and sip_reg_inflight
+ * are zero.
+ */
+static struct {
+	struct list queue;           /**< Pending registrations, by due time */
+	struct list retry;           /**< Failed registrations, by due time  */
+	struct tmr tmr;              /**< Scheduler timer                    */
+	uint32_t inflight;           /**< Transactions in flight             */
+	uint32_t depth;              /**< Number of queued registrations     */
+	uint32_t nreg;               /**< Number of register clients         */
+
+	struct {
+		uint64_t n_sent;       /**< Scheduled REGISTERs sent         */
+		uint64_t n_ok;         /**< Successful responses             */
+		uint64_t n_fail;       /**< Failed requests                  */
+		uint32_t depth_max;    /**< Max. queue depth                 */
+		uint64_t wait_sum;     /**< Sum of queue wait times [ms]     */
+		uint32_t wait_max;     /**< Max. queue wait time [ms]        */
+		uint64_t lat_sum;      /**< Sum of register latencies [ms]   */
+		uint32_t lat_max;      /**< Max. register latency [ms]       */
+		uint64_t n_lat;        /**< Number of latency samples        */
+	} stats;
+} sched;
+
+
+static void sched_run(void *arg);
+
+
+static void sched_kick(void)
+{
+	if (sched.queue.head || sched.retry.head)
+		tmr_start(&sched.tmr, 0, sched_run, NULL);
+}
+
+
+static void sched_unlink(struct reg *reg)
+{
+	if (!reg->le_sched.list)
+		return;
+
+	list_unlink(&reg->le_sched);
+	--sched.depth;
+}
+
+
+static void sched_remove(struct reg *reg)
+{
+	sched_unlink(reg);
+
+	if (reg->inflight) {
+		reg->inflight = false;
+		--sched.inflight;
+		sched_kick();
+	}
+
+	if (!sched.queue.head && !sched.retry.head)
+		tmr_cancel(&sched.tmr);
+}
+
+
+static void sched_done(struct reg *reg, bool ok)
+{
+	uint32_t lat;
+
+	if (ok)
+		reg->failc = 0;
+	else
+		++reg->failc;
+
+	if (!reg->inflight)
+		return;
+
+	reg->inflight = false;
+	--sched.inflight;
+
+	lat = (uint32_t)(tmr_jiffies() - reg->ts_sent);
+
+	if (ok)
+		++sched.stats.n_ok;
+	else
+		++sched.stats.n_fail;
+
+	sched.stats.lat_sum += lat;
+	sched.stats.lat_max  = max(sched.stats.lat_max, lat);
+	++sched.stats.n_lat;
+
+	sched_kick();
+}
+
+
 static void destructor(void *arg)
 {
 	struct reg *reg = arg;
 
+	sched_remove(reg);
+	--sched.nreg;
 	list_unlink(&reg->le);
 	mem_deref(reg->sipreg);
 	mem_deref(reg->srv);
+	mem_deref(reg->uri);
+	mem_deref(reg->params);
+	mem_deref(reg->outbound);
 }
 
 
@@ -107,6 +231,8 @@ static void register_handler(int err, const struct sip_msg *msg, void *arg)
 	enum ua_event evfail = reg->regint ?
 		UA_EVENT_REGISTER_FAIL : UA_EVENT_FALLBACK_FAIL;
 
+	sched_done(reg, !err && msg->scode < 300);
+
 	if (err) {
 		if (reg->regint)
 			warning("reg: %s (prio %u): Register: %m\n",
@@ -186,24 +312,22 @@ int reg_add(struct list *lst, struct ua *ua, int regid)
 	reg->id    = regid;
 
 	list_append(lst, &reg->le, reg);
+	++sched.nreg;
 
 	return 0;
 }
 
 
-int reg_register(struct reg *reg, const char *reg_uri, const char *params,
-		 uint32_t regint, const char *outbound)
+static int send_register(struct reg *reg, const char *reg_uri,
+			 const char *params, const char *outbound)
 {
+	const struct config *cfg = conf_config();
 	struct account *acc;
 	const char *routev[1];
+	uint32_t rwait;
 	int err;
 	bool failed;
 
-	if (!reg || !reg_uri)
-		return EINVAL;
-
-	reg->scode = 0;
-	reg->regint = regint;
 	routev[0] = outbound;
 	acc = ua_account(reg->ua);
 
@@ -212,7 +336,7 @@ int reg_register(struct reg *reg, const char *reg_uri, const char *params,
 	err = sipreg_register(&reg->sipreg, uag_sip(), reg_uri,
 			      account_aor(acc),
 			      acc ? acc->dispname : NULL, account_aor(acc),
-			      regint, ua_local_cuser(reg->ua),
+			      reg->regint, ua_local_cuser(reg->ua),
 			      routev[0] ? routev : NULL,
 			      routev[0] ? 1 : 0,
 			      reg->id,
@@ -223,8 +347,18 @@ int reg_register(struct reg *reg, const char *reg_uri, const char *params,
 	if (err)
 		return err;
 
-	if (acc && acc->rwait)
-		err = sipreg_set_rwait(reg->sipreg, acc->rwait);
+	rwait = acc ? acc->rwait : 0;
+
+	/* spread the refreshes of all accounts */
+	if (cfg && cfg->sip.reg_window) {
+		if (!rwait)
+			rwait = 90;
+
+		rwait -= rand_u32() % (min(rwait - 5, RWAIT_JITTER) + 1);
+	}
+
+	if (rwait)
+		err = sipreg_set_rwait(reg->sipreg, rwait);
 
 	if (acc && acc->fbregint)
 		err = sipreg_set_fbregint(reg->sipreg, acc->fbregint);
@@ -236,6 +370,159 @@ int reg_register(struct reg *reg, const char *reg_uri, const char *params,
 }
 
 
+static void sched_enqueue(struct reg *reg)
+{
+	const struct config *cfg = conf_config();
+	uint64_t now = tmr_jiffies();
+	struct le *le;
+
+	if (!reg->le_sched.list)
+		reg->ts_queued = now;
+
+	sched_unlink(reg);
+
+	if (reg->failc || reg_failed(reg)) {
+		uint32_t n = min(reg->failc, 6);
+
+		reg->ts_due = now + min(BACKOFF_MIN << n, BACKOFF_MAX);
+
+		/* the backoff mostly grows, so search from the tail */
+		for (le = sched.retry.tail; le; le = le->prev) {
+
+			const struct reg *r = le->data;
+
+			if (r->ts_due <= reg->ts_due)
+				break;
+		}
+
+		if (le)
+			list_insert_after(&sched.retry, le, &reg->le_sched,
+					  reg);
+		else
+			list_prepend(&sched.retry, &reg->le_sched, reg);
+	}
+	else {
+		const struct reg *last = list_ledata(sched.queue.tail);
+		uint32_t step = cfg->sip.reg_window / max(sched.nreg, 1u);
+
+		/* on average, all accounts are spread over the window */
+		reg->ts_due = last ? max(last->ts_due, now) : now;
+		if (step)
+			reg->ts_due += rand_u32() % (2 * step);
+
+		list_append(&sched.queue, &reg->le_sched, reg);
+	}
+
+	++sched.depth;
+	sched.stats.depth_max = max(sched.stats.depth_max, sched.depth);
+
+	tmr_start(&sched.tmr, 0, sched_run, NULL);
+}
+
+
+static void sched_send(struct reg *reg, uint64_t now)
+{
+	uint32_t wait;
+	int err;
+
+	err = send_register(reg, reg->uri, reg->params, reg->outbound);
+	if (err) {
+		warning("reg: %s: register failed: %m\n",
+			account_aor(ua_account(reg->ua)), err);
+
+		++reg->failc;
+		++sched.stats.n_fail;
+
+		ua_event(reg->ua, reg->regint ?
+			 UA_EVENT_REGISTER_FAIL : UA_EVENT_FALLBACK_FAIL,
+			 NULL, "%m", err);
+
+		/* try again after the backoff */
+		sched_enqueue(reg);
+		return;
+	}
+
+	wait = (uint32_t)(now - reg->ts_queued);
+
+	reg->inflight = true;
+	reg->ts_sent  = now;
+	++sched.inflight;
+
+	++sched.stats.n_sent;
+	sched.stats.wait_sum += wait;
+	sched.stats.wait_max  = max(sched.stats.wait_max, wait);
+}
+
+
+/* The next registration to send, failed accounts first */
+static struct reg *sched_next(void)
+{
+	struct reg *q = list_ledata(sched.queue.head);
+	struct reg *r = list_ledata(sched.retry.head);
+
+	if (!q || (r && r->ts_due <= q->ts_due))
+		return r;
+
+	return q;
+}
+
+
+static void sched_run(void *arg)
+{
+	const uint32_t max_inflight = conf_config()->sip.reg_inflight;
+	uint64_t now = tmr_jiffies();
+	struct reg *reg;
+	(void)arg;
+
+	while ((reg = sched_next())) {
+
+		if (reg->ts_due > now)
+			break;
+
+		if (max_inflight && sched.inflight >= max_inflight)
+			return;  /* continue on the next response */
+
+		sched_unlink(reg);
+		sched_send(reg, now);
+	}
+
+	if (reg)
+		tmr_start(&sched.tmr, reg->ts_due - now, sched_run, NULL);
+}
+
+
+int reg_register(struct reg *reg, const char *reg_uri, const char *params,
+		 uint32_t regint, const char *outbound)
+{
+	const struct config *cfg = conf_config();
+	int err;
+
+	if (!reg || !reg_uri)
+		return EINVAL;
+
+	reg->scode = 0;
+	reg->regint = regint;
+
+	if (!cfg || (!cfg->sip.reg_window && !cfg->sip.reg_inflight))
+		return send_register(reg, reg_uri, params, outbound);
+
+	reg->uri      = mem_deref(reg->uri);
+	reg->params   = mem_deref(reg->params);
+	reg->outbound = mem_deref(reg->outbound);
+
+	err  = str_dup(&reg->uri, reg_uri);
+	err |= str_dup(&reg->params, params);
+	if (outbound)
+		err |= str_dup(&reg->outbound, outbound);
+	if (err)
+		return err;
+
+	sched_enqueue(reg);
+
+	return 0;
+}
+
+
 void reg_unregister(struct reg *reg)
 {
 	if (!reg)
@@ -244,6 +531,8 @@ void reg_unregister(struct reg *reg)
 	reg->scode = 0;
 	reg->af    = 0;
 
+	sched_remove(reg);
+
 	reg->sipreg = mem_deref(reg->sipreg);
 }
 
@@ -365,3 +654,39 @@ int reg_af(const struct reg *reg)
 
 	return reg->af;
 }
+
+
+/**
+ * Print the Register scheduler status
+ *
+ * @param pf     Print function
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int reg_sched_debug(struct re_printf *pf, void *unused)
+{
+	const struct config *cfg = conf_config();
+	const uint64_t n_lat = sched.stats.n_lat;
+	const uint64_t n_sent = sched.stats.n_sent;
+	int err = 0;
+	(void)unused;
+
+	err |= re_hprintf(pf, "\nRegister scheduler:\n");
+	err |= re_hprintf(pf, " window:    %u ms\n",
+			  cfg ? cfg->sip.reg_window : 0);
+	err |= re_hprintf(pf, " inflight:  %u (max %u)\n",
+			  sched.inflight, cfg ? cfg->sip.reg_inflight : 0);
+	err |= re_hprintf(pf, " queue:     %u (max %u)\n",
+			  sched.depth, sched.stats.depth_max);
+	err |= re_hprintf(pf, " sent:      %llu (ok %llu, failed %llu)\n",
+			  n_sent, sched.stats.n_ok, sched.stats.n_fail);
+	err |= re_hprintf(pf, " wait:      avg %llu ms, max %u ms\n",
+			  n_sent ? sched.stats.wait_sum / n_sent : 0,
+			  sched.stats.wait_max);
+	err |= re_hprintf(pf, " latency:   avg %llu ms, max %u ms\n",
+			  n_lat ? sched.stats.lat_sum / n_lat : 0,
+			  sched.stats.lat_max);
+
+	return err;
+}
@@ -5,6 +5,7 @@
 #
 
 SRCS	+= account.c
+SRCS	+= acl.c
 SRCS	+= aucodec.c
 SRCS	+= audio.c
 SRCS	+= aufilt.c
@@ -12,19 +13,26 @@ SRCS	+= auplay.c
 SRCS	+= ausrc.c
 SRCS	+= baresip.c
 SRCS	+= call.c
+SRCS	+= callsetup.c
 SRCS	+= cmd.c
+SRCS	+= codecpool.c
 SRCS	+= conf.c
 SRCS	+= config.c
 SRCS	+= contact.c
 SRCS	+= custom_hdrs.c
+SRCS	+= encshare.c
 SRCS	+= event.c
 SRCS	+= log.c
+SRCS	+= mediacpu.c
 SRCS	+= mediadev.c
 SRCS	+= menc.c
 SRCS	+= message.c
 SRCS	+= metric.c
+SRCS	+= metrics.c
+SRCS	+= mlprof.c
 SRCS	+= mnat.c
 SRCS	+= module.c
+SRCS	+= mthread.c
 SRCS	+= net.c
 SRCS	+= play.c
 SRCS	+= reg.c
@@ -35,6 +43,8 @@ SRCS	+= sipreq.c
 SRCS	+= stream.c
 SRCS	+= stunuri.c
 SRCS	+= timestamp.c
+SRCS	+= trace.c
+SRCS	+= tstretch.c
 SRCS	+= ua.c
 SRCS	+= uag.c
 SRCS	+= ui.c
@@ -42,8 +52,10 @@ SRCS	+= vidcodec.c
 SRCS	+= video.c
 SRCS	+= vidfilt.c
 SRCS	+= vidisp.c
+SRCS	+= vidshare.c
 SRCS	+= vidsrc.c
 SRCS	+= vidutil.c
+SRCS	+= wheel.c
 
 ifneq ($(STATIC),)
 SRCS	+= static.c
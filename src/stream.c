@@ -33,6 +33,7 @@ struct stream {
 	enum sdp_dir ldir;       /**< SDP direction of the stream           */
 	struct rtp_sock *rtp;    /**< RTP Socket                            */
 	struct rtcp_stats rtcp_stats;/**< RTCP statistics                   */
+	struct media_cpu cpu;    /**< CPU accounting of media processing    */
 	const struct mnat *mnat; /**< Media NAT traversal module            */
 	struct mnat_media *mns;  /**< Media NAT traversal state             */
 	const struct menc *menc; /**< Media encryption module               */
@@ -46,6 +47,7 @@ struct stream {
 	bool mnat_connected;     /**< Media NAT is connected                */
 	bool menc_secure;        /**< Media stream is secure                */
 	stream_pt_h *pth;        /**< Stream payload type handler           */
+	stream_arrival_h *arrivalh;  /**< RTP arrival handler (optional)    */
 	stream_rtp_h *rtph;      /**< Stream RTP handler                    */
 	stream_rtcp_h *rtcph;    /**< Stream RTCP handler                   */
 	void *arg;               /**< Handler argument                      */
@@ -66,7 +68,7 @@ struct stream {
 	/* Receive */
 	struct receiver {
 		struct metric metric; /**< Metrics for receiving            */
-		struct tmr tmr_rtp;   /**< Timer for detecting RTP timeout  */
+		struct tmrw tmr_rtp;  /**< Timer for detecting RTP timeout  */
 		struct jbuf *jbuf;    /**< Jitter Buffer for incoming RTP   */
 		bool jbuf_started;    /**< True if jitter-buffer was started*/
 		uint64_t ts_last;     /**< Timestamp of last recv RTP pkt   */
@@ -122,7 +124,7 @@ static void stream_destructor(void *arg)
 	metric_reset(&s->tx.metric);
 	metric_reset(&s->rx.metric);
 
-	tmr_cancel(&s->rx.tmr_rtp);
+	tmrw_cancel(&s->rx.tmr_rtp);
 	list_unlink(&s->le);
 	mem_deref(s->sdp);
 	mem_deref(s->mes);
@@ -165,9 +167,6 @@ static void check_rtp_handler(void *arg)
 
 	MAGIC_CHECK(strm);
 
-	tmr_start(&strm->rx.tmr_rtp, RTP_CHECK_INTERVAL,
-		  check_rtp_handler, strm);
-
 	/* If no RTP was received at all, check later */
 	if (!strm->rx.ts_last)
 		return;
@@ -356,6 +355,9 @@ static void rtp_handler(const struct sa *src, const struct rtp_header *hdr,
 	if (err)
 		return;
 
+	if (s->arrivalh)
+		s->arrivalh(hdr, tmr_jiffies_usec(), s->arg);
+
 	if (s->rx.jbuf) {
 
 		/* Put frame in Jitter Buffer */
@@ -423,6 +425,22 @@ int stream_decode(struct stream *s)
 }
 
 
+/**
+ * Set a handler that is called for each incoming RTP packet when it
+ * arrives from the network, before the jitter buffer
+ *
+ * @param s        Stream object
+ * @param arrivalh Arrival handler
+ */
+void stream_set_arrival_handler(struct stream *s, stream_arrival_h *arrivalh)
+{
+	if (!s)
+		return;
+
+	s->arrivalh = arrivalh;
+}
+
+
 void stream_silence_on(struct stream *s, bool on)
 {
 	if (!s)
@@ -456,6 +474,30 @@ static void rtcp_handler(const struct sa *src, struct rtcp_msg *msg, void *arg)
 }
 
 
+/* Entry points from the main loop, with profiling */
+static void prof_rtp_handler(const struct sa *src,
+			     const struct rtp_header *hdr,
+			     struct mbuf *mb, void *arg)
+{
+	struct mlprof_probe probe;
+
+	mlprof_enter(&probe, "rtp_handler");
+	rtp_handler(src, hdr, mb, arg);
+	mlprof_leave(&probe);
+}
+
+
+static void prof_rtcp_handler(const struct sa *src, struct rtcp_msg *msg,
+			      void *arg)
+{
+	struct mlprof_probe probe;
+
+	mlprof_enter(&probe, "rtcp_handler");
+	rtcp_handler(src, msg, arg);
+	mlprof_leave(&probe);
+}
+
+
 static int stream_sock_alloc(struct stream *s, int af)
 {
 	struct sa laddr;
@@ -469,7 +511,7 @@ static int stream_sock_alloc(struct stream *s, int af)
 
 	err = rtp_listen(&s->rtp, IPPROTO_UDP, &laddr,
 			 s->cfg.rtp_ports.min, s->cfg.rtp_ports.max,
-			 true, rtp_handler, rtcp_handler, s);
+			 true, prof_rtp_handler, prof_rtcp_handler, s);
 	if (err) {
 		warning("stream: rtp_listen failed: af=%s ports=%u-%u"
 			" (%m)\n", net_af2name(af),
@@ -577,6 +619,8 @@ int stream_alloc(struct stream **sp, struct list *streaml,
 
 	MAGIC_INIT(s);
 
+	tmrw_init(&s->rx.tmr_rtp, "stream_rtp_check");
+
 	s->cfg    = *cfg;
 	s->type   = type;
 	s->rtph   = rtph;
@@ -877,6 +921,15 @@ void stream_flush_jbuf(struct stream *s)
 }
 
 
+uint32_t stream_jbuf_packets(const struct stream *strm)
+{
+	if (!strm || !strm->rx.jbuf)
+		return 0;
+
+	return jbuf_packets(strm->rx.jbuf);
+}
+
+
 void stream_enable_rtp_timeout(struct stream *strm, uint32_t timeout_ms)
 {
 	if (!strm)
@@ -887,7 +940,7 @@ void stream_enable_rtp_timeout(struct stream *strm, uint32_t timeout_ms)
 
 	strm->rx.rtp_timeout = timeout_ms;
 
-	tmr_cancel(&strm->rx.tmr_rtp);
+	tmrw_cancel(&strm->rx.tmr_rtp);
 
 	if (timeout_ms) {
 
@@ -895,7 +948,9 @@ void stream_enable_rtp_timeout(struct stream *strm, uint32_t timeout_ms)
 		     timeout_ms);
 
 		strm->rx.ts_last = tmr_jiffies();
-		tmr_start(&strm->rx.tmr_rtp, 10, check_rtp_handler, strm);
+		tmrw_start_periodic(&strm->rx.tmr_rtp, 10,
+				    RTP_CHECK_INTERVAL, check_rtp_handler,
+				    strm);
 	}
 }
 
@@ -940,6 +995,25 @@ const struct rtcp_stats *stream_rtcp_stats(const struct stream *strm)
 }
 
 
+/**
+ * Get the CPU accounting of the media processing of a stream
+ *
+ * @param strm Stream object
+ *
+ * @return CPU accounting
+ */
+const struct media_cpu *stream_media_cpu(const struct stream *strm)
+{
+	return strm ? &strm->cpu : NULL;
+}
+
+
+struct media_cpu *stream_cpu(struct stream *strm)
+{
+	return strm ? &strm->cpu : NULL;
+}
+
+
 /**
  * Get the number of transmitted RTP packets
  *
@@ -1238,6 +1312,7 @@ int stream_debug(struct re_printf *pf, const struct stream *s)
 
 	err |= rtp_debug(pf, s->rtp);
 	err |= jbuf_debug(pf, s->rx.jbuf);
+	err |= media_cpu_debug(pf, &s->cpu);
 
 	return err;
 }
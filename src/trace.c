@@ -0,0 +1,308 @@
+/**
+ * @file trace.c  Startup and shutdown timing trace
+ *
+ * Copyright (C) 2010 Alfred E. Heggestad
+ */
+#include <stdio.h>
+#include <errno.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/**
+ * \page StartupTrace Startup and shutdown trace
+ *
+ * The trace records monotonic timestamps of the startup phases, of the
+ * init and close of every module, and of the shutdown. It is written in
+ * the Chrome trace-event format, and can be opened with chrome://tracing
+ * or https://ui.perfetto.dev
+ *
+ * The startup trace ends with the first successful registration, or
+ * directly when no account registers. It is written to
+ * "<prefix>-startup.json". The shutdown trace starts with ua_stop_all()
+ * and is written to "<prefix>-shutdown.json" when baresip exits.
+ *
+ * The trace is enabled with the command line option -T <prefix>.
+ * Events are only recorded from the main thread.
+ */
+
+
+enum {
+	TRACE_NAME_SZ = 48,
+	TRACE_CAT_SZ  = 16,
+	TRACE_EVENTS  = 256,
+};
+
+enum trace_phase {
+	TRACE_OFF = 0,
+	TRACE_STARTUP,
+	TRACE_RUNNING,
+	TRACE_SHUTDOWN,
+};
+
+struct trace_event {
+	char name[TRACE_NAME_SZ];
+	char cat[TRACE_CAT_SZ];
+	char ph;                   /**< Chrome event type B, E or i         */
+	uint64_t ts;               /**< Monotonic timestamp in [us]         */
+};
+
+static struct {
+	enum trace_phase phase;
+	char *prefix;
+	struct trace_event *eventv;
+	size_t eventc;
+	size_t eventsz;
+} trace;
+
+
+static void trace_add(char ph, const char *cat, const char *name,
+		      uint64_t ts)
+{
+	struct trace_event *ev;
+
+	if (trace.phase != TRACE_STARTUP && trace.phase != TRACE_SHUTDOWN)
+		return;
+
+	if (trace.eventc >= trace.eventsz) {
+		size_t sz = trace.eventsz ? trace.eventsz * 2 : TRACE_EVENTS;
+		struct trace_event *v;
+
+		if (trace.eventv)
+			v = mem_realloc(trace.eventv, sz * sizeof(*v));
+		else
+			v = mem_alloc(sz * sizeof(*v), NULL);
+		if (!v)
+			return;
+
+		trace.eventv  = v;
+		trace.eventsz = sz;
+	}
+
+	ev = &trace.eventv[trace.eventc++];
+
+	str_ncpy(ev->name, name ? name : "?", sizeof(ev->name));
+	str_ncpy(ev->cat, cat ? cat : "", sizeof(ev->cat));
+	ev->ph = ph;
+	ev->ts = ts;
+}
+
+
+static int trace_write(const char *suffix)
+{
+	char file[FS_PATH_MAX];
+	FILE *f;
+	size_t i;
+	int err = 0;
+
+	if (re_snprintf(file, sizeof(file), "%s-%s.json",
+			trace.prefix, suffix) < 0)
+		return ENOMEM;
+
+	f = fopen(file, "w");
+	if (!f) {
+		err = errno;
+		warning("trace: writing %s: %m\n", file, err);
+		return err;
+	}
+
+	(void)re_fprintf(f, "{\"displayTimeUnit\":\"ms\","
+			 "\"traceEvents\":[\n");
+
+	for (i=0; i<trace.eventc; i++) {
+		const struct trace_event *ev = &trace.eventv[i];
+
+		(void)re_fprintf(f, "{\"name\":\"%H\",\"cat\":\"%H\","
+				 "\"ph\":\"%c\",\"ts\":%llu,"
+				 "\"pid\":1,\"tid\":1%s}%s\n",
+				 utf8_encode, ev->name, utf8_encode, ev->cat,
+				 ev->ph, ev->ts,
+				 ev->ph == 'i' ? ",\"s\":\"p\"" : "",
+				 i + 1 < trace.eventc ? "," : "");
+	}
+
+	(void)re_fprintf(f, "]}\n");
+
+	(void)fclose(f);
+
+	info("trace: %zu events written to %s\n", trace.eventc, file);
+
+	trace.eventc = 0;
+
+	return err;
+}
+
+
+static void startup_done(void)
+{
+	if (trace.phase != TRACE_STARTUP)
+		return;
+
+	trace_end("baresip", "startup");
+	(void)trace_write("startup");
+
+	trace.phase = TRACE_RUNNING;
+}
+
+
+static void ua_event_handler(struct ua *ua, enum ua_event ev,
+			     struct call *call, const char *prm, void *arg)
+{
+	(void)ua;
+	(void)call;
+	(void)prm;
+	(void)arg;
+
+	if (ev != UA_EVENT_REGISTER_OK)
+		return;
+
+	trace_instant("ua", "register ok");
+	startup_done();
+}
+
+
+/**
+ * Enable the startup and shutdown trace
+ *
+ * @param prefix Path and prefix of the trace files
+ * @param t0     Start of the application from tmr_jiffies_usec()
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int trace_init(const char *prefix, uint64_t t0)
+{
+	int err;
+
+	if (!str_isset(prefix))
+		return EINVAL;
+
+	err = str_dup(&trace.prefix, prefix);
+	if (err)
+		return err;
+
+	err = uag_event_register(ua_event_handler, NULL);
+	if (err) {
+		trace.prefix = mem_deref(trace.prefix);
+		return err;
+	}
+
+	trace.phase = TRACE_STARTUP;
+
+	trace_add('B', "baresip", "startup", t0);
+
+	return 0;
+}
+
+
+/**
+ * Write the pending trace and disable the trace
+ */
+void trace_close(void)
+{
+	if (trace.phase == TRACE_STARTUP) {
+		startup_done();
+	}
+	else if (trace.phase == TRACE_SHUTDOWN) {
+		trace_end("baresip", "shutdown");
+		(void)trace_write("shutdown");
+	}
+
+	if (trace.phase != TRACE_OFF)
+		uag_event_unregister(ua_event_handler);
+
+	trace.phase   = TRACE_OFF;
+	trace.prefix  = mem_deref(trace.prefix);
+	trace.eventv  = mem_deref(trace.eventv);
+	trace.eventc  = 0;
+	trace.eventsz = 0;
+}
+
+
+/**
+ * Check if the trace is enabled
+ *
+ * @return True if enabled, otherwise false
+ */
+bool trace_enabled(void)
+{
+	return trace.phase != TRACE_OFF;
+}
+
+
+/**
+ * Record the begin of a traced phase
+ *
+ * @param cat  Category
+ * @param name Name of the phase
+ */
+void trace_begin(const char *cat, const char *name)
+{
+	trace_add('B', cat, name, tmr_jiffies_usec());
+}
+
+
+/**
+ * Record the end of a traced phase
+ *
+ * @param cat  Category
+ * @param name Name of the phase
+ */
+void trace_end(const char *cat, const char *name)
+{
+	trace_add('E', cat, name, tmr_jiffies_usec());
+}
+
+
+/**
+ * Record an instant event
+ *
+ * @param cat  Category
+ * @param name Name of the event
+ */
+void trace_instant(const char *cat, const char *name)
+{
+	trace_add('i', cat, name, tmr_jiffies_usec());
+}
+
+
+/**
+ * The application is ready. Ends the startup trace, unless there are
+ * accounts waiting for their first registration.
+ */
+void trace_ready(void)
+{
+	struct le *le;
+
+	if (trace.phase != TRACE_STARTUP)
+		return;
+
+	trace_instant("baresip", "ready");
+
+	for (le = list_head(uag_list()); le; le = le->next) {
+		const struct ua *ua = le->data;
+
+		if (account_regint(ua_account(ua)))
+			return;
+	}
+
+	startup_done();
+}
+
+
+/**
+ * Start the shutdown trace. The startup trace is written first, if it
+ * was not done yet.
+ */
+void trace_shutdown(void)
+{
+	if (trace.phase == TRACE_STARTUP)
+		startup_done();
+
+	if (trace.phase != TRACE_RUNNING)
+		return;
+
+	trace.phase = TRACE_SHUTDOWN;
+
+	trace_begin("baresip", "shutdown");
+}
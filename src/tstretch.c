@@ -0,0 +1,172 @@
+/**
+ * @file tstretch.c  Audio time-stretching
+ *
+ * Copyright (C) 2010 Alfred E. Heggestad
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/*
+ * The audio is stretched by one period with overlap-add at the lag with
+ * the best normalized cross-correlation (WSOLA). The lag is searched on
+ * the first channel, decimated to 8000 Hz.
+ */
+
+
+enum {
+	LAG_MIN_US = 2500,     /* Min. time-stretch lag in [us]       */
+	LAG_MAX_US = 15000,    /* Max. time-stretch lag in [us]       */
+	MIN_CORR   = 36,       /* Min. squared correlation in [%]     */
+	SILENCE_Q  = 1024 * 1024,  /* Quadratic sample value for silence */
+};
+
+
+static bool is_silence(const int16_t *x, size_t n, size_t ch)
+{
+	int64_t sum = 0;
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		sum += x[i*ch] * x[i*ch];
+
+	return sum <= (int64_t)n * SILENCE_Q;
+}
+
+
+/*
+ * Find the lag with the best normalized cross-correlation between
+ * x[0..lag) and x[lag..2*lag). The returned correlation is squared,
+ * in [%].
+ */
+static size_t find_lag(const int16_t *x, size_t ch, size_t lmin,
+		       size_t lmax, size_t step, uint32_t *corr)
+{
+	double best_score = 0.0;
+	size_t lag, best = lmin;
+
+	for (lag = lmin; lag <= lmax; lag += step) {
+
+		double xy = 0.0, xx = 0.0, yy = 0.0;
+		size_t i;
+
+		for (i = 0; i < lag; i += step) {
+			const double u = x[i*ch];
+			const double v = x[(lag + i)*ch];
+
+			xy += u*v;
+			xx += u*u;
+			yy += v*v;
+		}
+
+		if (xy <= 0.0 || xx*yy <= 0.0)
+			continue;
+
+		if (xy*xy / (xx*yy) > best_score) {
+			best_score = xy*xy / (xx*yy);
+			best = lag;
+		}
+	}
+
+	*corr = (uint32_t)(best_score * 100);
+
+	return best;
+}
+
+
+/* Linear crossfade from a to b over n frames */
+static void xfade(int16_t *y, const int16_t *a, const int16_t *b,
+		  size_t n, size_t ch)
+{
+	size_t i, c;
+
+	for (i = 0; i < n; i++) {
+		for (c = 0; c < ch; c++) {
+			const size_t j = i*ch + c;
+
+			y[j] = (int16_t)((a[j] * (int32_t)(n - i) +
+					  b[j] * (int32_t)i) / (int32_t)n);
+		}
+	}
+}
+
+
+/**
+ * Get the maximum time-stretch lag
+ *
+ * @param srate Sample rate in [Hz]
+ *
+ * @return Maximum lag in number of frames
+ */
+size_t tstretch_maxlag(uint32_t srate)
+{
+	return (size_t)srate * LAG_MAX_US / 1000000;
+}
+
+
+/**
+ * Time-stretch S16LE samples by removing or inserting one period.
+ *
+ * To accelerate, the lag is at most a third of the input, and the
+ * output has xn - lag frames. To decelerate, the lag is at most half
+ * of the input, and the output has xn + lag frames.
+ *
+ * @param y     Output buffer, for at least 3 * xn / 2 frames
+ * @param yn    Returned number of output frames
+ * @param x     Input samples, interleaved
+ * @param xn    Number of input frames
+ * @param ch    Number of channels
+ * @param srate Sample rate in [Hz]
+ * @param accel True to remove one period, false to insert one
+ *
+ * @return 0 if success, ENOENT if there is no matching period,
+ *         otherwise errorcode
+ */
+int tstretch_s16(int16_t *y, size_t *yn, const int16_t *x, size_t xn,
+		 size_t ch, uint32_t srate, bool accel)
+{
+	const size_t sz = ch * sizeof(int16_t);
+	size_t lmin, lmax, step, lag;
+	uint32_t corr;
+
+	if (!y || !yn || !x || !ch || !srate)
+		return EINVAL;
+
+	lmin = (size_t)srate * LAG_MIN_US / 1000000;
+	lmax = min(tstretch_maxlag(srate), accel ? xn / 3 : xn / 2);
+	step = max(srate / 8000, 1u);
+
+	if (lmax <= lmin)
+		return EINVAL;
+
+	if (is_silence(x, 2*lmax, ch)) {
+		lag  = lmax;
+		corr = 100;
+	}
+	else {
+		lag = find_lag(x, ch, lmin, lmax, step, &corr);
+	}
+
+	if (corr < MIN_CORR)
+		return ENOENT;
+
+	if (accel) {
+		/* overlap x[0..lag) with x[lag..2*lag) */
+		xfade(y, x, x + lag*ch, lag, ch);
+		memcpy(y + lag*ch, x + 2*lag*ch, (xn - 2*lag) * sz);
+
+		*yn = xn - lag;
+	}
+	else {
+		/* repeat x[0..lag) with crossfade */
+		memcpy(y, x, lag * sz);
+		xfade(y + lag*ch, x + lag*ch, x, lag, ch);
+		memcpy(y + 2*lag*ch, x + lag*ch, (xn - lag) * sz);
+
+		*yn = xn + lag;
+	}
+
+	return 0;
+}
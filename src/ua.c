@@ -55,6 +55,7 @@ static void ua_destructor(void *arg)
 	mem_deref(ua->acc);
 
 	if (uag_delayed_close() && list_isempty(uag_list())) {
+		trace_instant("ua", "delayed sip close");
 		sip_close(uag_sip(), false);
 	}
 
@@ -369,6 +370,23 @@ struct call *ua_find_active_call(struct ua *ua)
 }
 
 
+/* The call-screening ACL has precedence over the contacts */
+static bool block_access(const char *uri)
+{
+	switch (acl_check(acl_current(), uri)) {
+
+	case ACL_ALLOW:
+		return false;
+
+	case ACL_BLOCK:
+		return true;
+
+	default:
+		return contact_block_access(baresip_contacts(), uri);
+	}
+}
+
+
 static void call_event_handler(struct call *call, enum call_event ev,
 			       const char *str, void *arg)
 {
@@ -385,8 +403,7 @@ static void call_event_handler(struct call *call, enum call_event ev,
 
 	case CALL_EVENT_INCOMING:
 
-		if (contact_block_access(baresip_contacts(),
-					 peeruri)) {
+		if (block_access(peeruri)) {
 
 			info("ua: blocked access: \"%s\"\n", peeruri);
 
@@ -975,10 +992,76 @@ int ua_update_account(struct ua *ua)
 	ua->extensionc = 0;
 	list_flush(&ua->regl);
 
+	if (ua->acc->mnat && 0 == str_casecmp(ua->acc->mnat->id, "ice"))
+		add_extension(ua, "ice");
+
 	return create_register_clients(ua);
 }
 
 
+/**
+ * Replace the account of a User-Agent with a new account for the same
+ * Address-of-Record, and reset the register clients. Established calls
+ * keep the account they were created with.
+ *
+ * @param ua   User-Agent object
+ * @param addr SIP address with parameters
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int ua_set_account(struct ua *ua, const char *addr)
+{
+	struct account *acc = NULL;
+	char *buf = NULL;
+	int err;
+
+	if (!ua || !addr)
+		return EINVAL;
+
+	if (uag_eprm()) {
+		err = re_sdprintf(&buf, "%s;%s", addr, uag_eprm());
+		if (err)
+			return err;
+
+		addr = buf;
+	}
+
+	err = account_alloc(&acc, addr);
+	if (err)
+		goto out;
+
+	if (str_cmp(acc->aor, ua->acc->aor)) {
+		warning("ua: set account: AOR mismatch (%s != %s)\n",
+			acc->aor, ua->acc->aor);
+		err = EINVAL;
+		goto out;
+	}
+
+	if (acc->cert) {
+		err = sip_transp_add_ccert(uag_sip(), &acc->laddr.uri,
+					   acc->cert);
+		if (err) {
+			warning("ua: SIP/TLS add client "
+				"certificate %s failed: %m\n",
+				acc->cert, err);
+			goto out;
+		}
+	}
+
+	mem_deref(ua->acc);
+	ua->acc = acc;
+	acc = NULL;
+
+	err = ua_update_account(ua);
+
+ out:
+	mem_deref(acc);
+	mem_deref(buf);
+
+	return err;
+}
+
+
 /**
  * Connect an outgoing call to a given SIP uri with audio and video direction
  *
@@ -40,6 +40,7 @@ static void exit_handler(void *arg)
 	ua_event(NULL, UA_EVENT_EXIT, NULL, NULL);
 
 	debug("ua: sip-stack exit\n");
+	trace_instant("ua", "sip exit");
 
 	if (uag.exith)
 		uag.exith(uag.arg);
@@ -603,6 +604,9 @@ void ua_stop_all(bool forced)
 
 	info("ua: stop all (forced=%d)\n", forced);
 
+	trace_shutdown();
+	trace_begin("ua", "ua_stop_all");
+
 	/* check if someone else has grabbed a ref to ua */
 	le = uag.ual.head;
 	while (le) {
@@ -618,6 +622,8 @@ void ua_stop_all(bool forced)
 	if (ext_ref) {
 		info("ua: in use (%u) by app module\n", ext_ref);
 		uag.delayed_close = true;
+		trace_end("ua", "ua_stop_all");
+		trace_instant("ua", "delayed close");
 		return;
 	}
 
@@ -625,6 +631,8 @@ void ua_stop_all(bool forced)
 		sipsess_close_all(uag.sock);
 
 	sip_close(uag.sip, forced);
+
+	trace_end("ua", "ua_stop_all");
 }
 
 
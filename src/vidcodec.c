@@ -6,6 +6,7 @@
 
 #include <re.h>
 #include <baresip.h>
+#include "core.h"
 
 
 /**
@@ -35,6 +36,7 @@ void vidcodec_unregister(struct vidcodec *vc)
 	if (!vc)
 		return;
 
+	codecpool_flush_codec(vc);
 	list_unlink(&vc->le);
 }
 
@@ -66,6 +68,10 @@ const struct vidcodec *vidcodec_find(const struct list *vidcodecl,
 		return vc;
 	}
 
+	/* retry after loading a lazy module providing it */
+	if (!module_lazy_load("vidcodec", name))
+		return vidcodec_find(vidcodecl, name, variant);
+
 	return NULL;
 }
 
@@ -78,15 +78,18 @@ struct vtx {
 	struct video *video;               /**< Parent                    */
 	const struct vidcodec *vc;         /**< Current Video encoder     */
 	struct videnc_state *enc;          /**< Video encoder state       */
+	struct encshare_memb *encm;        /**< Shared encoder (optional) */
 	struct vidsrc_prm vsrc_prm;        /**< Video source parameters   */
 	struct vidsz vsrc_size;            /**< Video source size         */
 	struct vidsrc *vs;
 	struct vidsrc_st *vsrc;            /**< Video source              */
+	struct vidsrc_sub *vsub;           /**< Shared video source       */
 	struct lock *lock_enc;             /**< Lock for encoder          */
 	struct vidframe *frame;            /**< Source frame              */
 	struct lock *lock_tx;              /**< Protect the sendq         */
 	struct list sendq;                 /**< Tx-Queue (struct vidqent) */
-	struct tmr tmr_rtp;                /**< Timer for sending RTP     */
+	struct tmrw tmr_rtp;               /**< Timer for sending RTP     */
+	uint64_t ts_poll;                  /**< Time of last RTP poll     */
 	unsigned skipc;                    /**< Number of frames skipped  */
 	struct list filtl;                 /**< Filters in encoding order */
 	enum vidfmt fmt;                   /**< Outgoing pixel format     */
@@ -156,7 +159,7 @@ struct video {
 	struct stream *strm;    /**< Generic media stream                 */
 	struct vtx vtx;         /**< Transmit/encoder direction           */
 	struct vrx vrx;         /**< Receive/decoder direction            */
-	struct tmr tmr;         /**< Timer for frame-rate estimation      */
+	struct tmrw tmr;        /**< Timer for frame-rate estimation      */
 	char *peer;             /**< Peer URI                             */
 	bool nack_pli;          /**< Send NACK/PLI to peer                */
 	video_err_h *errh;      /**< Error handler                        */
@@ -279,13 +282,13 @@ static void vidqueue_poll(struct vtx *vtx, uint64_t jfs, uint64_t prev_jfs)
 static void rtp_tmr_handler(void *arg)
 {
 	struct vtx *vtx = arg;
+	const uint64_t now = tmr_jiffies();
 	uint64_t pjfs;
 
-	pjfs = vtx->tmr_rtp.jfs;
+	pjfs = vtx->ts_poll ? vtx->ts_poll : now;
+	vtx->ts_poll = now;
 
-	tmr_start(&vtx->tmr_rtp, 1000/MEDIA_POLL_RATE, rtp_tmr_handler, vtx);
-
-	vidqueue_poll(vtx, vtx->tmr_rtp.jfs, pjfs);
+	vidqueue_poll(vtx, now, pjfs);
 }
 
 
@@ -301,11 +304,13 @@ static void video_destructor(void *arg)
 	lock_rel(vtx->lock_tx);
 	mem_deref(vtx->lock_tx);
 
-	tmr_cancel(&vtx->tmr_rtp);
+	tmrw_cancel(&vtx->tmr_rtp);
 	mem_deref(vtx->vsrc);
+	mem_deref(vtx->vsub);
 	lock_write_get(vtx->lock_enc);
 	mem_deref(vtx->frame);
 	mem_deref(vtx->enc);
+	mem_deref(vtx->encm);
 	list_flush(&vtx->filtl);
 	lock_rel(vtx->lock_enc);
 	mem_deref(vtx->lock_enc);
@@ -319,7 +324,7 @@ static void video_destructor(void *arg)
 	lock_rel(vrx->lock);
 	mem_deref(vrx->lock);
 
-	tmr_cancel(&v->tmr);
+	tmrw_cancel(&v->tmr);
 	mem_deref(v->strm);
 	mem_deref(v->peer);
 }
@@ -385,13 +390,26 @@ static int packet_handler(bool marker, uint64_t ts,
 static void encode_rtp_send(struct vtx *vtx, struct vidframe *frame,
 			    struct vidpacket *packet, uint64_t timestamp)
 {
+	struct media_cpu *cpu = stream_cpu(vtx->video->strm);
 	struct le *le;
 	int err = 0;
 	bool sendq_empty;
+	uint64_t t0;
 
 	if (!vtx->enc)
 		return;
 
+	/* the leader encodes for all streams sharing the encoder */
+	if (vtx->encm && !encshare_leader(vtx->encm)) {
+
+		if (vtx->picup) {
+			encshare_request_picup(vtx->encm);
+			vtx->picup = false;
+		}
+
+		return;
+	}
+
 	if (packet) {
 		lock_write_get(vtx->lock_enc);
 
@@ -434,18 +452,26 @@ static void encode_rtp_send(struct vtx *vtx, struct vidframe *frame,
 				goto out;
 		}
 
+		t0 = tmr_jiffies_usec();
 		vidconv(vtx->frame, frame, 0);
+		media_cpu_add(&cpu->stagev[MEDIA_CPU_RESAMPLE_ENC], t0);
 		frame = vtx->frame;
 	}
 
 	/* Process video frame through all Video Filters */
+	t0 = tmr_jiffies_usec();
 	for (le = vtx->filtl.head; le; le = le->next) {
 
 		struct vidfilt_enc_st *st = le->data;
+		uint64_t t1 = tmr_jiffies_usec();
 
 		if (st->vf && st->vf->ench)
 			err |= st->vf->ench(st, frame, &timestamp);
+
+		media_cpu_add(&st->cpu, t1);
 	}
+	if (vtx->filtl.head)
+		media_cpu_add(&cpu->stagev[MEDIA_CPU_FILTER_ENC], t0);
 
 	if (err)
 		goto out;
@@ -454,7 +480,10 @@ static void encode_rtp_send(struct vtx *vtx, struct vidframe *frame,
 		vtx->fmt = frame->fmt;
 
 	/* Encode the whole picture frame */
-	err = vtx->vc->ench(vtx->enc, vtx->picup, frame, timestamp);
+	t0 = tmr_jiffies_usec();
+	err = vtx->vc->ench(vtx->enc, encshare_picup(vtx->encm, vtx->picup),
+			    frame, timestamp);
+	media_cpu_add(&cpu->stagev[MEDIA_CPU_ENCODE], t0);
 	if (err)
 		goto out;
 
@@ -512,6 +541,34 @@ static void vidsrc_error_handler(int err, void *arg)
 	warning("video: video-source error: %m\n", err);
 
 	vtx->vsrc = mem_deref(vtx->vsrc);
+	vtx->vsub = mem_deref(vtx->vsub);
+}
+
+
+static int vtx_open_source(struct vtx *vtx, struct vidsrc *vs,
+			   struct media_ctx **ctx, const char *dev)
+{
+	const char *fmt = NULL;
+
+	vtx->vsrc = mem_deref(vtx->vsrc);
+	vtx->vsub = mem_deref(vtx->vsub);
+
+	if (vtx->video->cfg.src_shared) {
+		return vidsrc_sub_alloc(&vtx->vsub, vs, ctx, &vtx->vsrc_prm,
+					&vtx->vsrc_size, dev, &vtx->vsrc_size,
+					vidsrc_frame_handler,
+					vidsrc_packet_handler,
+					vidsrc_error_handler, vtx);
+	}
+
+	/* the source may pass through packets in the encoder format */
+	if (vtx->vc && vtx->vc->packetizeh)
+		fmt = vtx->vc->name;
+
+	return vs->alloch(&vtx->vsrc, vs, ctx, &vtx->vsrc_prm,
+			  &vtx->vsrc_size, fmt, dev,
+			  vidsrc_frame_handler, vidsrc_packet_handler,
+			  vidsrc_error_handler, vtx);
 }
 
 
@@ -524,7 +581,7 @@ static int vtx_alloc(struct vtx *vtx, struct video *video)
 	if (err)
 		return err;
 
-	tmr_init(&vtx->tmr_rtp);
+	tmrw_init(&vtx->tmr_rtp, "video_rtp_poll");
 
 	vtx->video = video;
 
@@ -533,7 +590,8 @@ static int vtx_alloc(struct vtx *vtx, struct video *video)
 
 	str_ncpy(vtx->device, video->cfg.src_dev, sizeof(vtx->device));
 
-	tmr_start(&vtx->tmr_rtp, 1, rtp_tmr_handler, vtx);
+	tmrw_start_periodic(&vtx->tmr_rtp, 1, 1000/MEDIA_POLL_RATE,
+			    rtp_tmr_handler, vtx);
 
 	vtx->fmt = (enum vidfmt)-1;
 
@@ -659,10 +717,11 @@ static int video_stream_decode(struct vrx *vrx, const struct rtp_header *hdr,
 			       struct mbuf *mb)
 {
 	struct video *v = vrx->video;
+	struct media_cpu *cpu = stream_cpu(v->strm);
 	struct vidframe *frame_filt = NULL;
 	struct vidframe frame_store, *frame = &frame_store;
 	struct le *le;
-	uint64_t timestamp;
+	uint64_t timestamp, t0;
 	bool intra;
 	int err = 0;
 
@@ -685,7 +744,9 @@ static int video_stream_decode(struct vrx *vrx, const struct rtp_header *hdr,
 						  vrx->ts_recv.last));
 
 	frame->data[0] = NULL;
+	t0 = tmr_jiffies_usec();
 	err = vrx->vc->dech(vrx->dec, frame, &intra, hdr->m, hdr->seq, mb);
+	media_cpu_add(&cpu->stagev[MEDIA_CPU_DECODE], t0);
 	if (err) {
 
 		if (err != EPROTO) {
@@ -731,13 +792,19 @@ static int video_stream_decode(struct vrx *vrx, const struct rtp_header *hdr,
 	}
 
 	/* Process video frame through all Video Filters */
+	t0 = tmr_jiffies_usec();
 	for (le = vrx->filtl.head; le; le = le->next) {
 
 		struct vidfilt_dec_st *st = le->data;
+		uint64_t t1 = tmr_jiffies_usec();
 
 		if (st->vf && st->vf->dech)
 			err |= st->vf->dech(st, frame, &timestamp);
+
+		media_cpu_add(&st->cpu, t1);
 	}
+	if (vrx->filtl.head)
+		media_cpu_add(&cpu->stagev[MEDIA_CPU_FILTER_DEC], t0);
 
 	++vrx->stats.disp_frames;
 
@@ -940,7 +1007,7 @@ int video_alloc(struct video **vp, struct list *streaml,
 	MAGIC_INIT(v);
 
 	v->cfg = cfg->video;
-	tmr_init(&v->tmr);
+	tmrw_init(&v->tmr, "video_stat");
 
 	err = stream_alloc(&v->strm, streaml, stream_prm,
 			   &cfg->avt, sdp_sess, MEDIA_VIDEO,
@@ -1075,8 +1142,6 @@ static void tmr_handler(void *arg)
 
 	MAGIC_CHECK(v);
 
-	tmr_start(&v->tmr, TMR_INTERVAL * 1000, tmr_handler, v);
-
 	/* protect vtx.frames */
 	lock_write_get(v->vtx.lock_enc);
 
@@ -1175,7 +1240,7 @@ int video_start_source(struct video *v, struct media_ctx **ctx)
 	if (!v)
 		return EINVAL;
 
-	if (v->vtx.vsrc)
+	if (v->vtx.vsrc || v->vtx.vsub)
 		return 0;
 
 	debug("video: start source\n");
@@ -1199,12 +1264,7 @@ int video_start_source(struct video *v, struct media_ctx **ctx)
 		vtx->vsrc_prm.fps    = get_fps(v);
 		vtx->vsrc_prm.fmt    = v->cfg.enc_fmt;
 
-		vtx->vsrc = mem_deref(vtx->vsrc);
-
-		err = vs->alloch(&vtx->vsrc, vs, ctx, &vtx->vsrc_prm,
-				 &vtx->vsrc_size, NULL, v->vtx.device,
-				 vidsrc_frame_handler, vidsrc_packet_handler,
-				 vidsrc_error_handler, vtx);
+		err = vtx_open_source(vtx, vs, ctx, v->vtx.device);
 		if (err) {
 			warning("video: could not set source to"
 				" [%u x %u] %m\n",
@@ -1217,7 +1277,8 @@ int video_start_source(struct video *v, struct media_ctx **ctx)
 		info("video: no video source\n");
 	}
 
-	tmr_start(&v->tmr, TMR_INTERVAL * 1000, tmr_handler, v);
+	tmrw_start_periodic(&v->tmr, TMR_INTERVAL * 1000,
+			    TMR_INTERVAL * 1000, tmr_handler, v);
 
 	if (v->vtx.vc && v->vrx.vc) {
 		info("%H%H",
@@ -1285,6 +1346,7 @@ static void video_stop_source(struct video *v, struct media_ctx **ctx)
 	debug("video: stopping video source ..\n");
 
 	v->vtx.vsrc = mem_deref(v->vtx.vsrc);
+	v->vtx.vsub = mem_deref(v->vtx.vsub);
 	if (ctx)
 		*ctx = NULL;
 }
@@ -1356,11 +1418,82 @@ static void vidsrc_update(struct vtx *vtx, const char *dev)
 {
 	struct vidsrc *vs = vtx->vs;
 
+	/* the shared device is in use by others, subscribe to a new one */
+	if (vs && vtx->vsub) {
+		int err;
+
+		str_ncpy(vtx->device, dev, sizeof(vtx->device));
+
+		err = vtx_open_source(vtx, vs, NULL, vtx->device);
+		if (err) {
+			warning("video: could not set shared source"
+				" device %s (%m)\n", dev, err);
+		}
+
+		return;
+	}
+
 	if (vs && vs->updateh)
 		vs->updateh(vtx->vsrc, &vtx->vsrc_prm, dev);
 }
 
 
+/* Encoder parameters for enc_alloc_handler() */
+struct enc_alloc_prm {
+	const struct vidcodec *vc;
+	struct videnc_param *prm;
+	const char *fmtp;
+};
+
+
+/* Allocate the shared encoder, when the first stream joins a group */
+static int enc_alloc_handler(void **encp, encshare_pkt_h *pkth,
+			     void *pkth_arg, void *arg)
+{
+	struct enc_alloc_prm *eprm = arg;
+	struct videnc_state *enc = NULL;
+	int err;
+
+	err = eprm->vc->encupdh(&enc, eprm->vc, eprm->prm, eprm->fmtp,
+				pkth, pkth_arg);
+	if (err)
+		return err;
+
+	*encp = enc;
+
+	return 0;
+}
+
+
+/*
+ * Join the group of streams with the same source, codec, fmtp and
+ * encoder parameters
+ */
+static int vtx_encoder_share(struct vtx *vtx, struct vidcodec *vc,
+			     struct videnc_param *prm, const char *params)
+{
+	const struct video *v = vtx->video;
+	struct enc_alloc_prm eprm = {vc, prm, params};
+	char key[512];
+	int err;
+
+	if (re_snprintf(key, sizeof(key), "%s,%s|%s,%s|%s|%u|%.2f|%u",
+			v->cfg.src_mod, vtx->device,
+			vc->name, vc->variant, params,
+			prm->bitrate, prm->fps, prm->pktsize) < 0)
+		return ENOMEM;
+
+	err = encshare_join(&vtx->encm, key, enc_alloc_handler, &eprm,
+			    packet_handler, vtx);
+	if (err)
+		return err;
+
+	vtx->enc = mem_ref(encshare_enc(vtx->encm));
+
+	return 0;
+}
+
+
 /**
  * Set the video encoder used
  *
@@ -1375,6 +1508,7 @@ int video_encoder_set(struct video *v, struct vidcodec *vc,
 		      int pt_tx, const char *params)
 {
 	struct vtx *vtx;
+	bool reopen = false;
 	int err = 0;
 
 	if (!v)
@@ -1402,13 +1536,24 @@ int video_encoder_set(struct video *v, struct vidcodec *vc,
 		     vc->name, vc->variant, prm.bitrate, prm.fps);
 
 		vtx->enc = mem_deref(vtx->enc);
-		err = vc->encupdh(&vtx->enc, vc, &prm, params,
-				  packet_handler, vtx);
+		vtx->encm = mem_deref(vtx->encm);
+
+		if (v->cfg.enc_shared) {
+			err = vtx_encoder_share(vtx, vc, &prm, params);
+		}
+		else {
+			err = vc->encupdh(&vtx->enc, vc, &prm, params,
+					  packet_handler, vtx);
+		}
 		if (err) {
 			warning("video: encoder alloc: %m\n", err);
 			goto out;
 		}
 
+		/* the pass-through format of the source follows the codec */
+		reopen = vtx->vsrc && vtx->vs &&
+			(vc->packetizeh || (vtx->vc && vtx->vc->packetizeh));
+
 		vtx->vc = vc;
 	}
 
@@ -1417,6 +1562,13 @@ int video_encoder_set(struct video *v, struct vidcodec *vc,
  out:
 	lock_rel(vtx->lock_enc);
 
+	/* outside the lock, the source thread takes lock_enc */
+	if (reopen) {
+		err = vtx_open_source(vtx, vtx->vs, NULL, vtx->device);
+		if (err)
+			warning("video: could not reopen source (%m)\n", err);
+	}
+
 	return err;
 }
 
@@ -1453,10 +1605,14 @@ int video_decoder_set(struct video *v, struct vidcodec *vc, int pt_rx,
 	vrx->pt_rx = pt_rx;
 
 	if (vc != vrx->vc) {
+		uint64_t t0 = tmr_jiffies_usec();
+		bool hit;
 
 		info("Set video decoder: %s %s\n", vc->name, vc->variant);
 
 		vrx->dec = mem_deref(vrx->dec);
+		vrx->dec = codecpool_get(CODECPOOL_VIDDEC, vc, fmtp);
+		hit = vrx->dec != NULL;
 
 		err = vc->decupdh(&vrx->dec, vc, fmtp);
 		if (err) {
@@ -1464,6 +1620,8 @@ int video_decoder_set(struct video *v, struct vidcodec *vc, int pt_rx,
 			return err;
 		}
 
+		codecpool_setup_time(CODECPOOL_VIDDEC, t0, hit);
+
 		vrx->vc = vc;
 	}
 
@@ -1536,6 +1694,19 @@ static int vtx_debug(struct re_printf *pf, const struct vtx *vtx)
 	err |= re_hprintf(pf, "     skipc=%u sendq=%u\n",
 			  vtx->skipc, list_count(&vtx->sendq));
 
+	err |= encshare_debug(pf, vtx->encm);
+
+	if (vtx->vsub) {
+		struct vidsrc_sub_stats stats;
+
+		if (0 == vidsrc_sub_stats(vtx->vsub, &stats)) {
+			err |= re_hprintf(pf, "     shared: frames=%llu"
+					  " scaled=%llu drop=%llu\n",
+					  stats.n_frame, stats.n_scale,
+					  stats.n_drop);
+		}
+	}
+
 	if (vtx->ts_base) {
 		err |= re_hprintf(pf, "     time = %.3f sec\n",
 			  video_calc_seconds(vtx->ts_last - vtx->ts_base));
@@ -1586,6 +1757,7 @@ int video_debug(struct re_printf *pf, const struct video *v)
 {
 	const struct vtx *vtx;
 	const struct vrx *vrx;
+	struct le *le;
 	int err;
 
 	if (!v)
@@ -1595,8 +1767,9 @@ int video_debug(struct re_printf *pf, const struct video *v)
 	vrx = &v->vrx;
 
 	err = re_hprintf(pf, "\n--- Video stream ---\n");
-	err |= re_hprintf(pf, " source started: %s\n",
-		v->vtx.vsrc ? "yes" : "no");
+	err |= re_hprintf(pf, " source started: %s%s\n",
+		v->vtx.vsrc || v->vtx.vsub ? "yes" : "no",
+		v->vtx.vsub ? " (shared)" : "");
 	err |= re_hprintf(pf, " display started: %s\n",
 		v->vrx.vidisp ? "yes" : "no");
 
@@ -1610,6 +1783,22 @@ int video_debug(struct re_printf *pf, const struct video *v)
 	if (!list_isempty(&vrx->filtl))
 		err |= vrx_print_pipeline(pf, vrx);
 
+	for (le = list_head(&vtx->filtl); le; le = le->next) {
+		const struct vidfilt_enc_st *st = le->data;
+
+		err |= re_hprintf(pf, " tx filter: %-10s %H\n",
+				  st->vf ? st->vf->name : "?",
+				  media_cpu_stat_print, &st->cpu);
+	}
+
+	for (le = list_head(&vrx->filtl); le; le = le->next) {
+		const struct vidfilt_dec_st *st = le->data;
+
+		err |= re_hprintf(pf, " rx filter: %-10s %H\n",
+				  st->vf ? st->vf->name : "?",
+				  media_cpu_stat_print, &st->cpu);
+	}
+
 	err |= stream_debug(pf, v->strm);
 
 	return err;
@@ -1649,12 +1838,7 @@ int video_set_source(struct video *v, const char *name, const char *dev)
 
 	vtx = &v->vtx;
 
-	vtx->vsrc = mem_deref(vtx->vsrc);
-
-	err = vs->alloch(&vtx->vsrc, vs, NULL, &vtx->vsrc_prm,
-			 &vtx->vsrc_size, NULL, dev,
-			 vidsrc_frame_handler, vidsrc_packet_handler,
-			 vidsrc_error_handler, vtx);
+	err = vtx_open_source(vtx, vs, NULL, dev);
 	if (err)
 		return err;
 
@@ -71,6 +71,10 @@ const struct vidisp *vidisp_find(const struct list *vidispl, const char *name)
 		return vd;
 	}
 
+	/* retry after loading a lazy module providing it */
+	if (!module_lazy_load("vidisp", name))
+		return vidisp_find(vidispl, name);
+
 	return NULL;
 }
 
@@ -0,0 +1,722 @@
+/**
+ * @file vidshare.c  Shared Video Source
+ *
+ * Copyright (C) 2010 Alfred E. Heggestad
+ */
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/**
+ * \page SharedVideoSource Shared Video Source
+ *
+ * A shared video source opens a capture device once and fans out the
+ * frames to any number of subscribers. Subscribers that want a
+ * different size than the device get a scaled frame, which is computed
+ * once per size and shared between all subscribers with the same size.
+ *
+ *<pre>
+ *                          .---------.
+ *                    .---->|  sub 1  |  (native)
+ *   .--------.       |     '---------'
+ *   | vidsrc |-------+---->|  sub 2  |  (scaled 320x240)
+ *   '--------'       |     '---------'
+ *                    '---->|  sub 3  |  (scaled 320x240)
+ *                          '---------'
+ *</pre>
+ *
+ * The capture thread only copies or scales the frame into a reference
+ * counted frame per size. Every subscriber has its own thread, which
+ * takes the latest frame and calls the frame handler (i.e. the encoder),
+ * so the subscribers are encoded in parallel. If a subscriber is still
+ * busy with the previous frame, the pending frame is replaced and
+ * counted as dropped.
+ *
+ * Packets from a pass-through source are not encoded, and are delivered
+ * directly from the capture thread.
+ */
+
+
+enum {
+	MQ_ERROR = 1,
+};
+
+
+/** Shared video source -- one per (vidsrc, device) */
+struct vidsrc_shared {
+	struct le le;                /**< Member of shared list           */
+	const struct vidsrc *vs;     /**< Video source module             */
+	struct vidsrc_st *st;        /**< Video source state              */
+	struct vidsrc_prm prm;       /**< Video source parameters         */
+	struct vidsz size;           /**< Requested capture size          */
+	char *dev;                   /**< Device name                     */
+	struct lock *lock;           /**< Protects subl and varl          */
+	struct list subl;            /**< Subscribers (struct vidsrc_sub) */
+	struct list varl;            /**< Frame variants, owned by subs   */
+	struct mqueue *mq;           /**< Error events to main thread     */
+	struct vidsz frame_size;     /**< Last frame size from device     */
+	uint64_t seq;                /**< Frame sequence number           */
+	uint64_t n_frame;            /**< Frames received from device     */
+	uint64_t n_packet;           /**< Packets received from device    */
+	int err;                     /**< Pending error from device       */
+#ifdef HAVE_PTHREAD
+	pthread_mutex_t mutex;       /**< Protects pending frames and the
+					  references of variant frames */
+#endif
+};
+
+/** A frame of one format and size, shared by its subscribers */
+struct vidvariant {
+	struct le le;                /**< Member of vidsrc_shared varl    */
+	struct vidsrc_shared *sh;    /**< Shared source (no reference)    */
+	enum vidfmt fmt;             /**< Pixel format                    */
+	struct vidsz size;           /**< Frame size                      */
+	struct vidframe *frame;      /**< Reference counted frame         */
+	uint64_t seq;                /**< Sequence number of content      */
+};
+
+/** Subscriber to a shared video source */
+struct vidsrc_sub {
+	struct le le;                /**< Member of vidsrc_shared subl    */
+	struct vidsrc_shared *sh;    /**< Shared source (reference)       */
+	struct vidvariant *var;      /**< Current variant (reference)     */
+	struct vidsz size;           /**< Wanted size, zero for native    */
+	uint64_t interval;           /**< Frame interval, VIDEO_TIMEBASE  */
+	uint64_t ts_next;            /**< Timestamp of next frame due     */
+	struct vidsrc_sub_stats stats;
+	vidsrc_frame_h *frameh;
+	vidsrc_packet_h *packeth;
+	vidsrc_error_h *errorh;
+	void *arg;
+
+	struct mthread *mt;          /**< Delivery thread (optional)      */
+	struct vidframe *pend;       /**< Pending frame (reference)       */
+	uint64_t pend_ts;            /**< Timestamp of pending frame      */
+	bool run;                    /**< Delivery thread is running      */
+#ifdef HAVE_PTHREAD
+	pthread_cond_t cond;         /**< Signals a pending frame         */
+#endif
+};
+
+
+static struct list sharedl = LIST_INIT;
+
+
+static void shared_lock(struct vidsrc_shared *sh)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_lock(&sh->mutex);
+#else
+	(void)sh;
+#endif
+}
+
+
+static void shared_unlock(struct vidsrc_shared *sh)
+{
+#ifdef HAVE_PTHREAD
+	pthread_mutex_unlock(&sh->mutex);
+#else
+	(void)sh;
+#endif
+}
+
+
+static void shared_destructor(void *arg)
+{
+	struct vidsrc_shared *sh = arg;
+
+	list_unlink(&sh->le);
+
+	/* NOTE: all subscribers and their variants are gone */
+	sh->st = mem_deref(sh->st);
+
+	mem_deref(sh->mq);
+	mem_deref(sh->lock);
+	mem_deref(sh->dev);
+#ifdef HAVE_PTHREAD
+	pthread_mutex_destroy(&sh->mutex);
+#endif
+}
+
+
+static void variant_destructor(void *arg)
+{
+	struct vidvariant *var = arg;
+
+	/* NOTE: called with both locks held */
+	list_unlink(&var->le);
+	mem_deref(var->frame);
+}
+
+
+static void sub_thread_stop(struct vidsrc_sub *sub)
+{
+	if (!sub->mt)
+		return;
+
+	shared_lock(sub->sh);
+	sub->run = false;
+#ifdef HAVE_PTHREAD
+	pthread_cond_signal(&sub->cond);
+#endif
+	shared_unlock(sub->sh);
+
+	sub->mt = mem_deref(sub->mt);
+}
+
+
+static void sub_destructor(void *arg)
+{
+	struct vidsrc_sub *sub = arg;
+	struct vidsrc_shared *sh = sub->sh;
+
+	if (sh) {
+		lock_write_get(sh->lock);
+		list_unlink(&sub->le);
+		lock_rel(sh->lock);
+
+		/* no frame handler is called after this */
+		sub_thread_stop(sub);
+
+		/* release only the variant of this subscriber */
+		lock_write_get(sh->lock);
+		shared_lock(sh);
+		sub->pend = mem_deref(sub->pend);
+		sub->var  = mem_deref(sub->var);
+		shared_unlock(sh);
+		lock_rel(sh->lock);
+	}
+
+#ifdef HAVE_PTHREAD
+	pthread_cond_destroy(&sub->cond);
+#endif
+
+	mem_deref(sh);
+}
+
+
+#ifdef HAVE_PTHREAD
+static void *sub_thread(void *arg)
+{
+	struct vidsrc_sub *sub = arg;
+	struct vidsrc_shared *sh = sub->sh;
+
+	pthread_mutex_lock(&sh->mutex);
+
+	while (sub->run) {
+
+		struct vidframe *frame;
+		uint64_t ts;
+
+		if (!sub->pend) {
+			pthread_cond_wait(&sub->cond, &sh->mutex);
+			continue;
+		}
+
+		frame = sub->pend;
+		ts    = sub->pend_ts;
+		sub->pend = NULL;
+
+		pthread_mutex_unlock(&sh->mutex);
+
+		sub->frameh(frame, ts, sub->arg);
+
+		/* frame references are only changed with the mutex held */
+		pthread_mutex_lock(&sh->mutex);
+		mem_deref(frame);
+	}
+
+	pthread_mutex_unlock(&sh->mutex);
+
+	return NULL;
+}
+#endif
+
+
+/*
+ * Find or create the variant wanted by this subscriber. A subscriber
+ * without a wanted size gets the native size of the device.
+ *
+ * NOTE: called with both locks held
+ */
+static struct vidvariant *variant_find(struct vidsrc_shared *sh,
+				       struct vidsrc_sub *sub,
+				       const struct vidframe *frame)
+{
+	const struct vidsz *sz = sub->size.w ? &sub->size : &frame->size;
+	struct vidvariant *var;
+	struct le *le;
+
+	var = sub->var;
+	if (var && var->fmt == frame->fmt && vidsz_cmp(&var->size, sz))
+		return var;
+
+	sub->var = mem_deref(sub->var);
+
+	for (le = sh->varl.head; le; le = le->next) {
+
+		var = le->data;
+
+		if (var->fmt == frame->fmt && vidsz_cmp(&var->size, sz)) {
+			sub->var = mem_ref(var);
+			return var;
+		}
+	}
+
+	var = mem_zalloc(sizeof(*var), variant_destructor);
+	if (!var)
+		return NULL;
+
+	var->sh   = sh;
+	var->fmt  = frame->fmt;
+	var->size = *sz;
+
+	list_append(&sh->varl, &var->le, var);
+
+	sub->var = var;
+
+	return var;
+}
+
+
+/*
+ * Update the frame of a variant, once per device frame. A frame that
+ * is still used by a subscriber thread is never written, a new frame is
+ * allocated instead.
+ *
+ * NOTE: called with both locks held
+ */
+static struct vidframe *variant_update(struct vidsrc_shared *sh,
+				       struct vidvariant *var,
+				       const struct vidframe *frame)
+{
+	if (var->seq == sh->seq && var->frame)
+		return var->frame;
+
+	if (var->frame && mem_nrefs(var->frame) > 1)
+		var->frame = mem_deref(var->frame);
+
+	if (!var->frame &&
+	    vidframe_alloc(&var->frame, var->fmt, &var->size))
+		return NULL;
+
+	if (vidsz_cmp(&var->size, &frame->size))
+		vidframe_copy(var->frame, frame);
+	else
+		vidconv(var->frame, frame, NULL);
+
+	var->seq = sh->seq;
+
+	return var->frame;
+}
+
+
+/* Frame-rate throttling, if the subscriber wants less than the device */
+static bool sub_throttle(struct vidsrc_sub *sub, uint64_t timestamp)
+{
+	if (!sub->interval)
+		return false;
+
+	if (sub->ts_next && timestamp < sub->ts_next)
+		return true;
+
+	sub->ts_next += sub->interval;
+	if (sub->ts_next <= timestamp)
+		sub->ts_next = timestamp + sub->interval;
+
+	return false;
+}
+
+
+/*
+ * Hand over a frame to the subscriber thread. The latest frame wins.
+ *
+ * NOTE: called with both locks held
+ */
+static void sub_deliver(struct vidsrc_sub *sub, struct vidframe *frame,
+			uint64_t timestamp)
+{
+	if (!sub->mt) {
+		sub->frameh(frame, timestamp, sub->arg);
+		return;
+	}
+
+	if (sub->pend) {
+		++sub->stats.n_drop;
+		--sub->stats.n_frame;
+		mem_deref(sub->pend);
+	}
+
+	sub->pend    = mem_ref(frame);
+	sub->pend_ts = timestamp;
+
+#ifdef HAVE_PTHREAD
+	pthread_cond_signal(&sub->cond);
+#endif
+}
+
+
+/*
+ * NOTE: This function has REAL-TIME properties
+ */
+static void shared_frame_handler(struct vidframe *frame, uint64_t timestamp,
+				 void *arg)
+{
+	struct vidsrc_shared *sh = arg;
+	struct le *le;
+
+	lock_write_get(sh->lock);
+	shared_lock(sh);
+
+	++sh->seq;
+	++sh->n_frame;
+	sh->frame_size = frame->size;
+
+	for (le = sh->subl.head; le; le = le->next) {
+
+		struct vidsrc_sub *sub = le->data;
+		struct vidvariant *var;
+		struct vidframe *f;
+
+		if (!sub->frameh)
+			continue;
+
+		if (sub_throttle(sub, timestamp)) {
+			++sub->stats.n_drop;
+			continue;
+		}
+
+		var = variant_find(sh, sub, frame);
+		f = var ? variant_update(sh, var, frame) : NULL;
+		if (!f) {
+			++sub->stats.n_drop;
+			continue;
+		}
+
+		if (!vidsz_cmp(&var->size, &frame->size))
+			++sub->stats.n_scale;
+
+		++sub->stats.n_frame;
+
+		sub_deliver(sub, f, timestamp);
+	}
+
+	shared_unlock(sh);
+	lock_rel(sh->lock);
+}
+
+
+static void shared_packet_handler(struct vidpacket *packet, void *arg)
+{
+	struct vidsrc_shared *sh = arg;
+	struct le *le;
+
+	lock_write_get(sh->lock);
+
+	++sh->n_packet;
+
+	for (le = sh->subl.head; le; le = le->next) {
+
+		struct vidsrc_sub *sub = le->data;
+
+		if (!sub->packeth) {
+			++sub->stats.n_drop;
+			continue;
+		}
+
+		++sub->stats.n_frame;
+
+		sub->packeth(packet, sub->arg);
+	}
+
+	lock_rel(sh->lock);
+}
+
+
+/* may be called from any thread, forward to the main thread */
+static void shared_error_handler(int err, void *arg)
+{
+	struct vidsrc_shared *sh = arg;
+
+	sh->err = err;
+
+	(void)mqueue_push(sh->mq, MQ_ERROR, NULL);
+}
+
+
+static void mqueue_handler(int id, void *data, void *arg)
+{
+	struct vidsrc_shared *sh = arg;
+	struct le *le;
+	(void)data;
+
+	if (id != MQ_ERROR)
+		return;
+
+	warning("vidshare: %s,%s: source error: %m\n",
+		sh->vs->name, sh->dev, sh->err);
+
+	/* new subscribers must re-open the device */
+	list_unlink(&sh->le);
+
+	mem_ref(sh);
+
+	sh->st = mem_deref(sh->st);
+
+	/* NOTE: subscribers are only removed in the main thread */
+	le = sh->subl.head;
+	while (le) {
+		struct vidsrc_sub *sub = le->data;
+		le = le->next;
+
+		if (sub->errorh)
+			sub->errorh(sh->err, sub->arg);
+	}
+
+	mem_deref(sh);
+}
+
+
+static struct vidsrc_shared *shared_find(const struct vidsrc *vs,
+					 const char *dev)
+{
+	struct le *le;
+
+	for (le = sharedl.head; le; le = le->next) {
+
+		struct vidsrc_shared *sh = le->data;
+
+		if (sh->vs == vs && 0 == str_cmp(sh->dev, dev))
+			return sh;
+	}
+
+	return NULL;
+}
+
+
+static int shared_alloc(struct vidsrc_shared **shp, const struct vidsrc *vs,
+			struct media_ctx **ctx, const struct vidsrc_prm *prm,
+			const struct vidsz *size, const char *dev)
+{
+	struct vidsrc_shared *sh;
+	int err;
+
+	sh = mem_zalloc(sizeof(*sh), shared_destructor);
+	if (!sh)
+		return ENOMEM;
+
+#ifdef HAVE_PTHREAD
+	pthread_mutex_init(&sh->mutex, NULL);
+#endif
+
+	sh->vs   = vs;
+	sh->prm  = *prm;
+	sh->size = *size;
+
+	err  = str_dup(&sh->dev, dev ? dev : "");
+	err |= lock_alloc(&sh->lock);
+	if (err)
+		goto out;
+
+	err = mqueue_alloc(&sh->mq, mqueue_handler, sh);
+	if (err)
+		goto out;
+
+	err = vs->alloch(&sh->st, vs, ctx, &sh->prm, &sh->size, NULL,
+			 sh->dev, shared_frame_handler, shared_packet_handler,
+			 shared_error_handler, sh);
+	if (err) {
+		warning("vidshare: could not open %s,%s (%m)\n",
+			vs->name, sh->dev, err);
+		goto out;
+	}
+
+	list_append(&sharedl, &sh->le, sh);
+
+	info("vidshare: opened shared source %s,%s [%u x %u]\n",
+	     vs->name, sh->dev, size->w, size->h);
+
+ out:
+	if (err)
+		mem_deref(sh);
+	else
+		*shp = sh;
+
+	return err;
+}
+
+
+/**
+ * Subscribe to a shared video source. The video source device is opened
+ * by the first subscriber and closed when the last subscriber is gone.
+ *
+ * @param subp    Pointer to allocated subscriber
+ * @param vs      Video source module
+ * @param ctx     Optional media context, used when opening the device
+ * @param prm     Video source parameters
+ * @param size    Wanted video size of the source
+ * @param dev     Video device
+ * @param scale   Deliver frames in this size (NULL for device size)
+ * @param frameh  Video frame handler
+ * @param packeth Video packet handler (optional)
+ * @param errorh  Error handler (optional)
+ * @param arg     Handler argument
+ *
+ * @return 0 if success, otherwise errorcode
+ *
+ * @note The frame handler is called from a thread of the subscriber
+ */
+int vidsrc_sub_alloc(struct vidsrc_sub **subp, const struct vidsrc *vs,
+		     struct media_ctx **ctx, const struct vidsrc_prm *prm,
+		     const struct vidsz *size, const char *dev,
+		     const struct vidsz *scale,
+		     vidsrc_frame_h *frameh, vidsrc_packet_h *packeth,
+		     vidsrc_error_h *errorh, void *arg)
+{
+	struct vidsrc_shared *sh;
+	struct vidsrc_sub *sub;
+	int err = 0;
+
+	if (!subp || !vs || !vs->alloch || !prm || !size)
+		return EINVAL;
+
+	sub = mem_zalloc(sizeof(*sub), sub_destructor);
+	if (!sub)
+		return ENOMEM;
+
+#ifdef HAVE_PTHREAD
+	pthread_cond_init(&sub->cond, NULL);
+#endif
+
+	sh = shared_find(vs, dev ? dev : "");
+	if (sh) {
+		sub->sh = mem_ref(sh);
+	}
+	else {
+		err = shared_alloc(&sub->sh, vs, ctx, prm, size, dev);
+		if (err)
+			goto out;
+
+		sh = sub->sh;
+	}
+
+	if (scale)
+		sub->size = *scale;
+
+	sub->frameh  = frameh;
+	sub->packeth = packeth;
+	sub->errorh  = errorh;
+	sub->arg     = arg;
+
+	if (prm->fps > 0 && prm->fps < sh->prm.fps)
+		sub->interval = (uint64_t)(VIDEO_TIMEBASE / prm->fps);
+
+#ifdef HAVE_PTHREAD
+	if (frameh) {
+		sub->run = true;
+
+		err = mthread_create(&sub->mt, MTHREAD_VIDEO_SRC,
+				     "vidshare sub", sub_thread, sub);
+		if (err) {
+			warning("vidshare: could not start subscriber"
+				" thread, using the capture thread (%m)\n",
+				err);
+			sub->run = false;
+			err = 0;
+		}
+	}
+#endif
+
+	lock_write_get(sh->lock);
+	list_append(&sh->subl, &sub->le, sub);
+	lock_rel(sh->lock);
+
+	debug("vidshare: %s,%s: subscriber added (%u total)\n",
+	      vs->name, sh->dev, list_count(&sh->subl));
+
+ out:
+	if (err)
+		mem_deref(sub);
+	else
+		*subp = sub;
+
+	return err;
+}
+
+
+/**
+ * Get the statistics of a shared video source subscriber
+ *
+ * @param sub   Video source subscriber
+ * @param stats Returned statistics
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidsrc_sub_stats(const struct vidsrc_sub *sub,
+		     struct vidsrc_sub_stats *stats)
+{
+	if (!sub || !stats)
+		return EINVAL;
+
+	lock_read_get(sub->sh->lock);
+	*stats = sub->stats;
+	lock_rel(sub->sh->lock);
+
+	return 0;
+}
+
+
+/**
+ * Print all shared video sources and their subscribers
+ *
+ * @param pf     Print function
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int vidsrc_share_debug(struct re_printf *pf, void *unused)
+{
+	struct le *le;
+	int err;
+	(void)unused;
+
+	err = re_hprintf(pf, "--- Shared video sources (%u) ---\n",
+			 list_count(&sharedl));
+
+	for (le = sharedl.head; le; le = le->next) {
+
+		struct vidsrc_shared *sh = le->data;
+		struct le *lem;
+
+		lock_read_get(sh->lock);
+
+		err |= re_hprintf(pf, "%s,%s: %u x %u, fps=%.2f"
+				  " frames=%llu packets=%llu variants=%u\n",
+				  sh->vs->name, sh->dev,
+				  sh->frame_size.w, sh->frame_size.h,
+				  sh->prm.fps, sh->n_frame, sh->n_packet,
+				  list_count(&sh->varl));
+
+		for (lem = sh->subl.head; lem; lem = lem->next) {
+
+			const struct vidsrc_sub *sub = lem->data;
+
+			err |= re_hprintf(pf, "    sub %p: frames=%llu"
+					  " scaled=%llu drop=%llu\n",
+					  sub, sub->stats.n_frame,
+					  sub->stats.n_scale,
+					  sub->stats.n_drop);
+		}
+
+		lock_rel(sh->lock);
+	}
+
+	return err;
+}
@@ -78,6 +78,10 @@ const struct vidsrc *vidsrc_find(const struct list *vidsrcl, const char *name)
 		return vs;
 	}
 
+	/* retry after loading a lazy module providing it */
+	if (!module_lazy_load("vidsrc", name))
+		return vidsrc_find(vidsrcl, name);
+
 	return NULL;
 }
 
@@ -91,7 +95,7 @@ const struct vidsrc *vidsrc_find(const struct list *vidsrcl, const char *name)
  * @param ctx     Optional media context
  * @param prm     Video source parameters
  * @param size    Wanted video size of the source
- * @param fmt     Format parameter
+ * @param fmt     Format parameter, e.g. the name of the encoder
  * @param dev     Video device
  * @param frameh  Video frame handler
  * @param packeth Video packet handler
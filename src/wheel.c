@@ -0,0 +1,373 @@
+/**
+ * @file wheel.c  Hierarchical timer wheel
+ *
+ * Copyright (C) 2010 Alfred E. Heggestad
+ */
+
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "core.h"
+
+
+/**
+ * \page TimerWheel Timer wheel
+ *
+ * Periodic housekeeping of many media objects (RTP timeout checks,
+ * bitrate metrics, video pacing) runs on one hierarchical timer wheel,
+ * which is driven by one timer on the re main loop instead of one timer
+ * per object.
+ *
+ *<pre>
+ *   level 0:  250 slots x 4 ms      (fine, 1 second span)
+ *   level 1:  250 slots x 1 second  (coarse, cascaded into level 0)
+ *</pre>
+ *
+ * Periodic timers of one second or more are rounded up to the coarse
+ * ticks, so that the checks of all the streams expire in the same tick.
+ * A first delay of less than one second stays on level 0.
+ * If level 0 is empty, the wheel sleeps until the next coarse tick.
+ *
+ * The callbacks are profiled per timer name by the main-loop profiler.
+ *
+ * NOTE: The timer wheel must only be used from the main thread.
+ */
+
+
+enum {
+	TICK        = 4,                    /**< Level 0 tick [ms]        */
+	SLOTS       = 250,                  /**< Slots per level          */
+	COARSE_MIN  = 1000,                 /**< Min. coarse period [ms]  */
+};
+
+enum {
+	LEVEL_FINE = 0,
+	LEVEL_COARSE,
+	LEVEL_EXPIRED,      /**< Expired, handler not called yet */
+};
+
+
+static struct {
+	struct tmr tmr;                 /**< Driving timer                */
+	struct list l0[SLOTS];          /**< Level 0 slots (fine)         */
+	struct list l1[SLOTS];          /**< Level 1 slots (coarse)       */
+	uint64_t tick;                  /**< Current tick                 */
+	uint32_t n0;                    /**< Timers in level 0            */
+	uint32_t n1;                    /**< Timers in level 1            */
+
+	uint64_t n_wakeup;              /**< Driving timer expiries       */
+	uint64_t n_cascade;             /**< Coarse ticks                 */
+	uint64_t n_expire;              /**< Expired timers               */
+} wheel;
+
+
+static void wheel_schedule(void);
+
+
+static uint64_t now_tick(void)
+{
+	return tmr_jiffies() / TICK;
+}
+
+
+static void insert(struct tmrw *tw)
+{
+	if (tw->due < wheel.tick + SLOTS) {
+		list_append(&wheel.l0[tw->due % SLOTS], &tw->le, tw);
+		tw->level = LEVEL_FINE;
+		++wheel.n0;
+	}
+	else {
+		list_append(&wheel.l1[(tw->due / SLOTS) % SLOTS],
+			    &tw->le, tw);
+		tw->level = LEVEL_COARSE;
+		++wheel.n1;
+	}
+}
+
+
+static void unlink_tw(struct tmrw *tw)
+{
+	list_unlink(&tw->le);
+
+	switch (tw->level) {
+
+	case LEVEL_FINE:
+		--wheel.n0;
+		break;
+
+	case LEVEL_COARSE:
+		--wheel.n1;
+		break;
+
+	default:
+		break;
+	}
+}
+
+
+static uint64_t due_tick(uint64_t base, uint64_t delay, bool coarse)
+{
+	uint64_t due = base + max((delay + TICK - 1) / TICK, 1);
+
+	if (coarse)
+		due = (due + SLOTS - 1) / SLOTS * SLOTS;
+
+	return max(due, wheel.tick + 1);
+}
+
+
+/* Move the timers of the current coarse tick down to level 0 */
+static void cascade(void)
+{
+	struct list *l = &wheel.l1[(wheel.tick / SLOTS) % SLOTS];
+	struct le *le = l->head;
+
+	++wheel.n_cascade;
+
+	while (le) {
+
+		struct tmrw *tw = le->data;
+
+		le = le->next;
+
+		/* more than one revolution away */
+		if (tw->due >= wheel.tick + SLOTS)
+			continue;
+
+		unlink_tw(tw);
+		insert(tw);
+	}
+}
+
+
+static void call_handler(struct tmrw *tw)
+{
+	struct mlprof_probe probe;
+
+	++wheel.n_expire;
+
+	mlprof_enter(&probe, tw->name ? tw->name : "tmrw");
+	tw->th(tw->arg);
+	mlprof_leave(&probe);
+}
+
+
+static void expire(void)
+{
+	struct list *l = &wheel.l0[wheel.tick % SLOTS];
+	struct list expl = LIST_INIT;
+	struct le *le;
+
+	if (!l->head)
+		return;
+
+	/* the handlers may start or cancel other timers */
+	while ((le = l->head)) {
+
+		struct tmrw *tw = le->data;
+
+		unlink_tw(tw);
+		list_append(&expl, &tw->le, tw);
+		tw->level = LEVEL_EXPIRED;
+	}
+
+	while ((le = expl.head)) {
+
+		struct tmrw *tw = le->data;
+
+		list_unlink(&tw->le);
+
+		if (tw->period) {
+			tw->due = due_tick(tw->due, tw->period,
+					   tw->period >= COARSE_MIN);
+			insert(tw);
+		}
+
+		call_handler(tw);
+	}
+}
+
+
+static void tmr_handler(void *arg)
+{
+	const uint64_t target = now_tick();
+	(void)arg;
+
+	++wheel.n_wakeup;
+
+	while (wheel.tick < target) {
+
+		if (wheel.n0) {
+			++wheel.tick;
+		}
+		else {
+			/* level 0 is empty, skip to the next coarse tick */
+			uint64_t next = (wheel.tick / SLOTS + 1) * SLOTS;
+
+			if (next > target) {
+				wheel.tick = target;
+				break;
+			}
+
+			wheel.tick = next;
+		}
+
+		if (!(wheel.tick % SLOTS))
+			cascade();
+
+		expire();
+	}
+
+	wheel_schedule();
+}
+
+
+static void wheel_schedule(void)
+{
+	uint64_t next;
+
+	if (wheel.n0) {
+		next = wheel.tick + 1;
+	}
+	else if (wheel.n1) {
+		next = (wheel.tick / SLOTS + 1) * SLOTS;
+	}
+	else {
+		tmr_cancel(&wheel.tmr);
+		return;
+	}
+
+	tmr_start(&wheel.tmr, next * TICK - min(next * TICK, tmr_jiffies()),
+		  tmr_handler, NULL);
+}
+
+
+static void wheel_start(struct tmrw *tw, uint64_t delay, uint32_t period,
+			tmr_h *th, void *arg)
+{
+	if (!tw)
+		return;
+
+	tmrw_cancel(tw);
+
+	if (!th)
+		return;
+
+	/* catch up with the time if the wheel was idle */
+	if (!wheel.n0 && !wheel.n1)
+		wheel.tick = now_tick();
+
+	tw->th     = th;
+	tw->arg    = arg;
+	tw->period = period;
+	tw->due    = due_tick((tmr_jiffies() + TICK - 1) / TICK, delay,
+			      period >= COARSE_MIN && delay >= COARSE_MIN);
+
+	insert(tw);
+
+	if (!tmr_isrunning(&wheel.tmr) ||
+	    (tw->level == LEVEL_FINE && wheel.n0 == 1))
+		wheel_schedule();
+}
+
+
+/**
+ * Initialize a timer wheel entry
+ *
+ * @param tw   Timer wheel entry
+ * @param name Timer name, used for profiling (static string)
+ */
+void tmrw_init(struct tmrw *tw, const char *name)
+{
+	if (!tw)
+		return;
+
+	memset(tw, 0, sizeof(*tw));
+	tw->name = name;
+}
+
+
+/**
+ * Start a one-shot timer on the timer wheel
+ *
+ * @param tw    Timer wheel entry
+ * @param delay Delay in [ms], rounded up to the next tick
+ * @param th    Timeout handler
+ * @param arg   Handler argument
+ */
+void tmrw_start(struct tmrw *tw, uint64_t delay, tmr_h *th, void *arg)
+{
+	wheel_start(tw, delay, 0, th, arg);
+}
+
+
+/**
+ * Start a periodic timer on the timer wheel. Periods of one second or
+ * more are rounded up to the coarse ticks of the wheel.
+ *
+ * @param tw     Timer wheel entry
+ * @param delay  Delay of the first expiry in [ms]
+ * @param period Period in [ms]
+ * @param th     Timeout handler
+ * @param arg    Handler argument
+ */
+void tmrw_start_periodic(struct tmrw *tw, uint64_t delay, uint32_t period,
+			 tmr_h *th, void *arg)
+{
+	wheel_start(tw, delay, max(period, TICK), th, arg);
+}
+
+
+/**
+ * Cancel a timer on the timer wheel
+ *
+ * @param tw Timer wheel entry
+ */
+void tmrw_cancel(struct tmrw *tw)
+{
+	if (!tw || !tw->le.list)
+		return;
+
+	unlink_tw(tw);
+
+	if (!wheel.n0 && !wheel.n1)
+		tmr_cancel(&wheel.tmr);
+}
+
+
+/**
+ * Check if a timer on the timer wheel is running
+ *
+ * @param tw Timer wheel entry
+ *
+ * @return True if running, otherwise false
+ */
+bool tmrw_isrunning(const struct tmrw *tw)
+{
+	return tw && tw->le.list;
+}
+
+
+/**
+ * Print the timer wheel status
+ *
+ * @param pf     Print function
+ * @param unused Unused parameter
+ *
+ * @return 0 if success, otherwise errorcode
+ */
+int wheel_debug(struct re_printf *pf, void *unused)
+{
+	int err = 0;
+	(void)unused;
+
+	err |= re_hprintf(pf, "\nTimer wheel:\n");
+	err |= re_hprintf(pf, " timers:  %u fine, %u coarse\n",
+			  wheel.n0, wheel.n1);
+	err |= re_hprintf(pf, " wakeups: %llu (%llu coarse ticks)\n",
+			  wheel.n_wakeup, wheel.n_cascade);
+	err |= re_hprintf(pf, " expired: %llu\n", wheel.n_expire);
+
+	return err;
+}
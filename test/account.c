@@ -3,7 +3,10 @@
  *
  * Copyright (C) 2010 - 2017 Alfred E. Heggestad
  */
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include <re.h>
 #include <baresip.h>
 #include "test.h"
@@ -184,3 +187,119 @@ out:
 	mem_deref(acc);
 	return err;
 }
+
+
+static int vprintf_null(const char *p, size_t size, void *arg)
+{
+	(void)p;
+	(void)size;
+	(void)arg;
+	return 0;
+}
+
+
+static void reload_event_handler(struct ua *ua, enum ua_event ev,
+				 struct call *call, const char *prm,
+				 void *arg)
+{
+	char **resultp = arg;
+	(void)ua;
+	(void)call;
+
+	if (ev != UA_EVENT_MODULE || 0 != strncmp(prm, "account,reload,", 15))
+		return;
+
+	(void)str_dup(resultp, prm + 15);
+	re_cancel();
+}
+
+
+/*
+ * Reload the accounts: one account is updated, one removed, one added,
+ * and one that was created elsewhere is skipped.
+ */
+int test_account_reload(void)
+{
+	static const char accounts[] =
+		"<sip:a@test.invalid>;regint=0\n"
+		"<sip:b@test.invalid>;regint=0\n";
+	static const char sync[] =
+		"uasync <sip:a@test.invalid>;regint=0;answermode=auto\n"
+		"<sip:c@test.invalid>;regint=0;answermode=auto\n"
+		"<sip:d@test.invalid>;regint=0\n";
+	char dir[] = "/tmp/baresip_test_XXXXXX";
+	char file[64] = "", path[256] = "";
+	struct re_printf pf = {vprintf_null, NULL};
+	struct ua *ua_c = NULL, *ua;
+	char *result = NULL;
+	FILE *f = NULL;
+	int err;
+
+	(void)conf_path_get(path, sizeof(path));
+
+	if (!mkdtemp(dir))
+		return errno;
+
+	re_snprintf(file, sizeof(file), "%s/accounts", dir);
+
+	f = fopen(file, "w");
+	if (!f) {
+		err = errno;
+		goto out;
+	}
+
+	(void)fputs(accounts, f);
+	(void)fclose(f);
+
+	/* created by other means, must not be touched */
+	err = ua_alloc(&ua_c, "<sip:c@test.invalid>;regint=0");
+	TEST_ERR(err);
+
+	err = uag_event_register(reload_event_handler, &result);
+	TEST_ERR(err);
+
+	/* NOTE: See Makefile TEST_MODULES */
+	conf_path_set(dir);
+	err = module_load(".", "account");
+	conf_path_set(path);
+	TEST_ERR(err);
+
+	ASSERT_TRUE(NULL != uag_find_aor("sip:a@test.invalid"));
+	ASSERT_TRUE(NULL != uag_find_aor("sip:b@test.invalid"));
+
+	err = cmd_process_long(baresip_commands(), sync, str_len(sync),
+			       &pf, NULL);
+	TEST_ERR(err);
+
+	err = re_main_timeout(5000);
+	TEST_ERR(err);
+
+	ASSERT_STREQ("added=1 updated=1 removed=1 unchanged=0 failed=1",
+		     result);
+
+	ua = uag_find_aor("sip:a@test.invalid");
+	ASSERT_TRUE(ua != NULL);
+	ASSERT_TRUE(ANSWERMODE_AUTO == account_answermode(ua_account(ua)));
+
+	ASSERT_TRUE(NULL == uag_find_aor("sip:b@test.invalid"));
+	ASSERT_TRUE(NULL != uag_find_aor("sip:d@test.invalid"));
+
+	ASSERT_TRUE(ua_c == uag_find_aor("sip:c@test.invalid"));
+	ASSERT_TRUE(ANSWERMODE_AUTO != account_answermode(ua_account(ua_c)));
+
+ out:
+	uag_event_unregister(reload_event_handler);
+	module_unload("account");
+
+	mem_deref(uag_find_aor("sip:a@test.invalid"));
+	mem_deref(uag_find_aor("sip:b@test.invalid"));
+	mem_deref(uag_find_aor("sip:d@test.invalid"));
+	mem_deref(ua_c);
+
+	(void)unlink(file);
+	(void)rmdir(dir);
+
+	mem_deref(result);
+
+	return err;
+}
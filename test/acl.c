@@ -0,0 +1,191 @@
+/**
+ * @file test/acl.c  Baresip selftest -- call-screening ACL
+ *
+ * Copyright (C) 2010 Alfred E. Heggestad
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+static const char *rulev[] = {
+	"block sip:+1900*@*",
+	"allow sip:+1900555*@*",
+	"block sip:+4420*@example.com",
+	"allow sip:alice@Example.com",
+	"allow sip:1234@*",
+	"block sip:*@spam.example.com",
+	"block sip:*@*.spam.net",
+	"allow sip:*@ok.spam.net",
+	"block ~666@",
+	"allow sip:*@*",
+};
+
+
+int test_acl(void)
+{
+	static const struct {
+		const char *uri;
+		enum acl_action action;
+	} testv[] = {
+		{"sip:+19001234@a.com",             ACL_BLOCK},
+		{"sip:+19005551@a.com",             ACL_ALLOW},
+		{"sip:+442012@example.com",         ACL_BLOCK},
+		{"sip:+442012@example.org",         ACL_ALLOW},
+		{"sip:alice@EXAMPLE.com;transport=tcp", ACL_ALLOW},
+		{"sip:1234@any.where",              ACL_ALLOW},
+		{"sip:12345@spam.example.com",      ACL_BLOCK},
+		{"sip:bob@spam.example.com:5060",   ACL_BLOCK},
+		{"sip:bob@x.y.spam.net",            ACL_BLOCK},
+		{"sip:bob@ok.spam.net",             ACL_ALLOW},
+		{"sip:bob@spam.net",                ACL_ALLOW},
+		{"sip:555666@other.com",            ACL_BLOCK},
+		{"sip:bob@other.com",               ACL_ALLOW},
+	};
+	struct acl *acl = NULL;
+	enum acl_action action;
+	struct pl pl;
+	size_t i;
+	int err;
+
+	err = acl_alloc(&acl);
+	TEST_ERR(err);
+
+	action = acl_check(acl, "sip:bob@other.com");
+	ASSERT_EQ(ACL_NONE, action);
+
+	for (i=0; i<ARRAY_SIZE(rulev); i++) {
+
+		pl_set_str(&pl, rulev[i]);
+
+		err = acl_add(acl, &pl);
+		TEST_ERR(err);
+	}
+
+	for (i=0; i<ARRAY_SIZE(testv); i++) {
+
+		action = acl_check(acl, testv[i].uri);
+		if (action != testv[i].action) {
+			warning("acl: %s: expected %d, got %d\n",
+				testv[i].uri, testv[i].action, action);
+			err = EBADMSG;
+			goto out;
+		}
+	}
+
+	/* invalid rules */
+	pl_set_str(&pl, "deny sip:bob@other.com");
+	ASSERT_EQ(EBADMSG, acl_add(acl, &pl));
+
+	pl_set_str(&pl, "block bob");
+	ASSERT_EQ(EINVAL, acl_add(acl, &pl));
+
+	err = 0;
+
+ out:
+	mem_deref(acl);
+
+	return err;
+}
+
+
+static int print_handler(const char *p, size_t size, void *arg)
+{
+	struct mbuf *mb = arg;
+
+	return mbuf_write_mem(mb, (uint8_t *)p, size);
+}
+
+
+/* The rules keep the line numbers of the file, blank lines, comments
+ * and CRLF line endings are accepted */
+int test_acl_load(void)
+{
+	static const char rules[] =
+		"# call screening\n"
+		"\r\n"
+		"block sip:*@spam.example.com\r\n"
+		"  # default\n"
+		"allow sip:*@*  \n"
+		" \t\n";
+	char file[] = "/tmp/baresip_acl_XXXXXX";
+	struct acl *acl = NULL;
+	struct mbuf *mb = NULL;
+	enum acl_action action;
+	struct re_printf pf;
+	char *text = NULL;
+	FILE *f = NULL;
+	int fd, err;
+
+	fd = mkstemp(file);
+	if (fd < 0)
+		return errno;
+
+	f = fdopen(fd, "w");
+	if (!f) {
+		err = errno;
+		(void)close(fd);
+		goto out;
+	}
+
+	(void)fputs(rules, f);
+	(void)fclose(f);
+
+	mb = mbuf_alloc(512);
+	if (!mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	pf.vph = print_handler;
+	pf.arg = mb;
+
+	err = acl_load(&acl, file);
+	TEST_ERR(err);
+
+	action = acl_check(acl, "sip:bob@spam.example.com");
+	ASSERT_EQ(ACL_BLOCK, action);
+
+	action = acl_check(acl, "sip:bob@example.com");
+	ASSERT_EQ(ACL_ALLOW, action);
+
+	err = acl_debug(&pf, acl);
+	TEST_ERR(err);
+
+	mb->pos = 0;
+	err = mbuf_strdup(mb, &text, mbuf_get_left(mb));
+	TEST_ERR(err);
+
+	ASSERT_TRUE(NULL != strstr(text, "rules:    2 "));
+	ASSERT_TRUE(NULL != strstr(text, "      3  block  domain "));
+	ASSERT_TRUE(NULL != strstr(text, "      5  allow  default"));
+
+	/* an invalid rule fails the whole file */
+	f = fopen(file, "a");
+	if (!f) {
+		err = errno;
+		goto out;
+	}
+
+	(void)fputs("deny sip:*@*\n", f);
+	(void)fclose(f);
+
+	acl = mem_deref(acl);
+	ASSERT_EQ(EBADMSG, acl_load(&acl, file));
+	ASSERT_TRUE(acl == NULL);
+
+	err = 0;
+
+ out:
+	(void)unlink(file);
+	mem_deref(text);
+	mem_deref(mb);
+	mem_deref(acl);
+
+	return err;
+}
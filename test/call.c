@@ -349,6 +349,7 @@ static void event_handler(struct ua *ua, enum ua_event ev,
 int test_call_answer(void)
 {
 	struct fixture fix, *f = &fix;
+	struct call *call;
 	int err = 0;
 
 	fixture_init(f);
@@ -373,6 +374,18 @@ int test_call_answer(void)
 	ASSERT_EQ(1, fix.b.n_established);
 	ASSERT_EQ(0, fix.b.n_closed);
 
+	/* call setup timeline */
+	call = ua_call(f->a.ua);
+	ASSERT_TRUE(call_setup_time(call, CALL_SETUP_OFFER) > 0);
+	ASSERT_TRUE(call_setup_time(call, CALL_SETUP_ANSWER) >=
+		    call_setup_time(call, CALL_SETUP_OFFER));
+	ASSERT_TRUE(call_setup_time(call, CALL_SETUP_ESTABLISHED) > 0);
+
+	call = ua_call(f->b.ua);
+	ASSERT_TRUE(call_setup_time(call, CALL_SETUP_OFFER) > 0);
+	ASSERT_TRUE(call_setup_time(call, CALL_SETUP_ANSWER) >=
+		    call_setup_time(call, CALL_SETUP_OFFER));
+
  out:
 	fixture_close(f);
 
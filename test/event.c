@@ -53,3 +53,99 @@ int test_event(void)
 
 	return err;
 }
+
+
+static int print_handler(const char *p, size_t size, void *arg)
+{
+	struct mbuf *mb = arg;
+
+	return mbuf_write_mem(mb, (uint8_t *)p, size);
+}
+
+
+/* The streaming JSON encoder must produce the same entries as the
+   dictionary encoder */
+int test_event_json(void)
+{
+	struct odict *od_dict = NULL, *od_json = NULL;
+	struct mbuf *mb = NULL;
+	struct re_printf pf;
+	struct ua *ua = NULL;
+	struct le *le;
+	size_t i;
+	int err;
+
+	static const enum ua_event eventv[] = {
+		UA_EVENT_REGISTERING,
+		UA_EVENT_REGISTER_FAIL,
+		UA_EVENT_MWI_NOTIFY,
+		UA_EVENT_CALL_INCOMING,
+		UA_EVENT_CUSTOM,
+	};
+
+	err = ua_alloc(&ua, "\"A \\\"B\\\"\" <sip:json@test.invalid>"
+		       ";regint=0");
+	TEST_ERR(err);
+
+	mb = mbuf_alloc(512);
+	if (!mb) {
+		err = ENOMEM;
+		goto out;
+	}
+
+	pf.vph = print_handler;
+	pf.arg = mb;
+
+	for (i=0; i<ARRAY_SIZE(eventv); i++) {
+
+		const enum ua_event ev = eventv[i];
+		const char *prm = (i % 2) ? "a \"quoted\"\\param" : NULL;
+		const struct odict_entry *oe;
+
+		mbuf_rewind(mb);
+
+		err = event_encode_json(&pf, ua, ev, NULL, prm);
+		TEST_ERR(err);
+
+		err = json_decode_odict(&od_json, 8, (char *)mb->buf,
+					mb->end, 4);
+		TEST_ERR(err);
+
+		err = odict_alloc(&od_dict, 8);
+		TEST_ERR(err);
+
+		err = event_encode_dict(od_dict, ua, ev, NULL, prm);
+		TEST_ERR(err);
+
+		oe = odict_lookup(od_json, "event");
+		ASSERT_TRUE(oe != NULL);
+		ASSERT_EQ(ODICT_BOOL, oe->type);
+		ASSERT_TRUE(oe->u.boolean);
+
+		ASSERT_EQ(odict_count(od_dict, false) + 1,
+			  odict_count(od_json, false));
+
+		for (le = od_dict->lst.head; le; le = le->next) {
+
+			const struct odict_entry *e = le->data;
+
+			ASSERT_EQ(ODICT_STRING, e->type);
+
+			oe = odict_lookup(od_json, e->key);
+			ASSERT_TRUE(oe != NULL);
+			ASSERT_EQ(ODICT_STRING, oe->type);
+			ASSERT_STREQ(e->u.str, oe->u.str);
+		}
+
+		od_json = mem_deref(od_json);
+		od_dict = mem_deref(od_dict);
+	}
+
+ out:
+	mem_deref(od_json);
+	mem_deref(od_dict);
+	mem_deref(mb);
+	mem_deref(ua);
+
+	return err;
+}
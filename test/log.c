@@ -0,0 +1,134 @@
+/**
+ * @file test/log.c  Baresip selftest -- logging
+ *
+ * Copyright (C) 2010 - 2021 Alfred E. Heggestad
+ */
+
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+enum {
+	N_MSG   = 2000,
+	N_BURST =   10,
+};
+
+
+static uint32_t n_recv;
+static uint64_t n_dropped;     /* from "messages dropped" notices    */
+static uint64_t n_suppressed;  /* from "messages suppressed" notices */
+
+
+static void log_handler(uint32_t level, const char *msg)
+{
+	struct pl n;
+	(void)level;
+
+	if (0 == re_regex(msg, str_len(msg),
+			  "log: [0-9]+ messages dropped", &n)) {
+		n_dropped += pl_u64(&n);
+		return;
+	}
+
+	if (0 == re_regex(msg, str_len(msg),
+			  "log: [0-9]+ similar messages suppressed", &n)) {
+		n_suppressed += pl_u64(&n);
+		return;
+	}
+
+	++n_recv;
+}
+
+
+static struct log lg = {
+	.h = log_handler,
+};
+
+
+static int vprintf_null(const char *p, size_t size, void *arg)
+{
+	(void)p;
+	(void)size;
+	(void)arg;
+	return 0;
+}
+
+
+static void log_burst(void)
+{
+	unsigned i;
+
+	for (i=0; i<N_MSG; i++)
+		debug("test: media path message %u of %u\n", i, N_MSG);
+}
+
+
+int test_log_async(void)
+{
+	struct re_printf pf_null = {vprintf_null, NULL};
+	enum log_level level = log_level_get();
+	struct log_stat st0, st;
+	unsigned i;
+	int err;
+
+	log_level_set(LEVEL_DEBUG);
+	log_enable_stdout(false);
+	log_register_handler(&lg);
+
+	n_recv = 0;
+	log_burst();
+	ASSERT_EQ(N_MSG, n_recv);
+
+	/* the benchmark passes the sync messages to the handlers only */
+	n_recv = 0;
+	err = log_bench(&pf_null, N_BURST);
+	TEST_ERR(err);
+	ASSERT_EQ(N_BURST, n_recv);
+	ASSERT_EQ(EINVAL, log_bench(&pf_null, 0));
+
+	err = log_enable_async(true);
+	if (err == ENOSYS) {
+		err = 0;
+		goto out;
+	}
+	TEST_ERR(err);
+
+	log_stat_get(&st0);
+
+	/* every message is either written or dropped */
+	n_recv    = 0;
+	n_dropped = 0;
+	log_burst();
+	log_flush();
+	log_stat_get(&st);
+
+	ASSERT_EQ(N_MSG, (st.n_msg - st0.n_msg) + (st.n_drop - st0.n_drop));
+	ASSERT_EQ(st.n_msg - st0.n_msg, n_recv);
+	ASSERT_EQ(st.n_drop - st0.n_drop, n_dropped);
+
+	/* repeated messages from one call site are rate-limited */
+	log_set_ratelimit(N_BURST);
+	log_stat_get(&st0);
+	n_suppressed = 0;
+
+	for (i=0; i<10*N_BURST; i++)
+		debug("test: repeated message %u\n", i);
+
+	log_flush();
+	log_stat_get(&st);
+
+	ASSERT_EQ(9*N_BURST, st.n_suppressed - st0.n_suppressed);
+
+	/* the suppressed messages are reported by the flush */
+	ASSERT_EQ(9*N_BURST, n_suppressed);
+
+ out:
+	log_set_ratelimit(0);
+	(void)log_enable_async(false);
+	log_unregister_handler(&lg);
+	log_enable_stdout(true);
+	log_level_set(level);
+
+	return err;
+}
@@ -20,7 +20,10 @@ struct test {
 
 static const struct test tests[] = {
 	TEST(test_account),
+	TEST(test_account_reload),
 	TEST(test_account_uri_complete),
+	TEST(test_acl),
+	TEST(test_acl_load),
 	TEST(test_aulevel),
 	TEST(test_call_answer),
 	TEST(test_call_answer_hangup_a),
@@ -47,11 +50,16 @@ static const struct test tests[] = {
 	TEST(test_cmd_long),
 	TEST(test_contact),
 	TEST(test_event),
+	TEST(test_event_json),
 	TEST(test_h264),
+	TEST(test_log_async),
 	TEST(test_message),
+	TEST(test_metrics),
+	TEST(test_mthread_sched),
 	TEST(test_network),
 	TEST(test_play),
 	TEST(test_stunuri),
+	TEST(test_tstretch),
 	TEST(test_ua_alloc),
 	TEST(test_ua_options),
 	TEST(test_ua_register),
@@ -60,6 +68,8 @@ static const struct test tests[] = {
 	TEST(test_ua_register_dns),
 	TEST(test_uag_find_param),
 	TEST(test_video),
+	TEST(test_wheel),
+	TEST(test_x11grab),
 };
 
 
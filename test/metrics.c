@@ -0,0 +1,164 @@
+/**
+ * @file test/metrics.c  Baresip selftest -- metrics exporter
+ *
+ * Copyright (C) 2010 Alfred E. Heggestad
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+enum {
+	NUM_SAMPLES = 300,  /* more than one export step */
+};
+
+
+struct fixture {
+	char *text;
+	int err;
+	uint32_t n_step;
+};
+
+
+static int gauge_collect(struct metrics_exp *exp, uint32_t *posp,
+			 void *arg)
+{
+	struct fixture *fix = arg;
+	uint32_t i;
+	int err;
+
+	if (*posp == 0) {
+		err = metrics_sample(exp, 1.5, "name=\"%H\"",
+				     metrics_label_print, "a\"b\\c\nd");
+		if (err)
+			return err;
+	}
+
+	++fix->n_step;
+
+	for (i = max(*posp, 1u); i < NUM_SAMPLES; i++) {
+
+		if (metrics_yield(exp)) {
+			*posp = i;
+			return EAGAIN;
+		}
+
+		err = metrics_sample(exp, i, "i=\"%u\"", i);
+		if (err)
+			return err;
+	}
+
+	return 0;
+}
+
+
+static int counter_collect(struct metrics_exp *exp, uint32_t *posp,
+			   void *arg)
+{
+	(void)posp;
+	(void)arg;
+
+	return metrics_sample(exp, 42, NULL);
+}
+
+
+static int hist_collect(struct metrics_exp *exp, uint32_t *posp, void *arg)
+{
+	static const double limitv[3] = {0.01, 0.1, 1};
+	static const uint64_t countv[4] = {1, 2, 0, 3};
+	(void)posp;
+	(void)arg;
+
+	return metrics_histogram(exp, limitv, countv, 3, 2.5,
+				 "m=\"%s\"", "a");
+}
+
+
+static void done_handler(int err, struct mbuf *mb, void *arg)
+{
+	struct fixture *fix = arg;
+
+	fix->err = err;
+
+	if (!err)
+		fix->err = mbuf_strdup(mb, &fix->text, mbuf_get_left(mb));
+
+	re_cancel();
+}
+
+
+static unsigned count(const char *str, const char *sub)
+{
+	unsigned n = 0;
+
+	while ((str = strstr(str, sub))) {
+		++n;
+		str += strlen(sub);
+	}
+
+	return n;
+}
+
+
+int test_metrics(void)
+{
+	struct metrics_fam *gauge = NULL, *counter = NULL, *hist = NULL;
+	struct metrics_exp *exp = NULL;
+	struct fixture fix;
+	int err;
+
+	memset(&fix, 0, sizeof(fix));
+
+	err  = metrics_register(&gauge, "test_gauge", METRICS_GAUGE,
+				"Test gauge", gauge_collect, &fix);
+	err |= metrics_register(&counter, "test_total", METRICS_COUNTER,
+				"Test counter", counter_collect, NULL);
+	err |= metrics_register(&hist, "test_seconds", METRICS_HISTOGRAM,
+				"Test histogram", hist_collect, NULL);
+	TEST_ERR(err);
+
+	err = metrics_export(&exp, done_handler, &fix);
+	TEST_ERR(err);
+
+	err = re_main_timeout(5000);
+	TEST_ERR(err);
+
+	TEST_ERR(fix.err);
+	ASSERT_TRUE(fix.text != NULL);
+	ASSERT_TRUE(fix.n_step >= 2);
+
+	/* the header is written once, also if the family yields */
+	ASSERT_EQ(1, count(fix.text, "# HELP test_gauge Test gauge\n"
+			   "# TYPE test_gauge gauge\n"));
+	ASSERT_EQ(1, count(fix.text, "# HELP test_total Test counter\n"
+			   "# TYPE test_total counter\n"));
+
+	ASSERT_EQ(1, count(fix.text,
+			   "test_gauge{name=\"a\\\"b\\\\c\\nd\"} 1.500000\n"));
+	ASSERT_EQ(NUM_SAMPLES - 1, count(fix.text, "test_gauge{i="));
+	ASSERT_EQ(1, count(fix.text, "test_gauge{i=\"1\"} 1\n"));
+	ASSERT_EQ(1, count(fix.text, "test_gauge{i=\"299\"} 299\n"
+			   "# HELP test_total"));
+	ASSERT_EQ(1, count(fix.text, "\ntest_total 42\n"));
+
+	/* one family, with cumulative buckets */
+	ASSERT_EQ(1, count(fix.text, "# TYPE test_seconds"));
+	ASSERT_EQ(1, count(fix.text,
+			   "# TYPE test_seconds histogram\n"
+			   "test_seconds_bucket{m=\"a\",le=\"0.010000\"} 1\n"
+			   "test_seconds_bucket{m=\"a\",le=\"0.100000\"} 3\n"
+			   "test_seconds_bucket{m=\"a\",le=\"1\"} 3\n"
+			   "test_seconds_bucket{m=\"a\",le=\"+Inf\"} 6\n"
+			   "test_seconds_sum{m=\"a\"} 2.500000\n"
+			   "test_seconds_count{m=\"a\"} 6\n"));
+
+ out:
+	mem_deref(exp);
+	mem_deref(gauge);
+	mem_deref(counter);
+	mem_deref(hist);
+	mem_deref(fix.text);
+
+	return err;
+}
@@ -0,0 +1,123 @@
+/**
+ * @file test/mthread.c  Baresip selftest -- media thread scheduling
+ *
+ * Copyright (C) 2010 Alfred E. Heggestad
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+static int print_handler(const char *p, size_t size, void *arg)
+{
+	struct mbuf *mb = arg;
+
+	return mbuf_write_mem(mb, (uint8_t *)p, size);
+}
+
+
+/* Check the scheduling of the audio_proc class, as printed by debug */
+static int check_sched(const char *policy, int prio, uint64_t cpus)
+{
+	struct re_printf pf;
+	struct mbuf *mb;
+	char row[128];
+	char *text = NULL;
+	int err;
+
+	mb = mbuf_alloc(1024);
+	if (!mb)
+		return ENOMEM;
+
+	pf.vph = print_handler;
+	pf.arg = mb;
+
+	err = mthread_debug(&pf, NULL);
+	if (err)
+		goto out;
+
+	mb->pos = 0;
+	err = mbuf_strdup(mb, &text, mbuf_get_left(mb));
+	if (err)
+		goto out;
+
+	re_snprintf(row, sizeof(row), "  %-12s %-8s %4d %18llx ",
+		    "audio_proc", policy, prio, cpus);
+
+	if (!strstr(text, row)) {
+		warning("mthread: expected '%s' in:\n%s\n", row, text);
+		err = EBADMSG;
+	}
+
+ out:
+	mem_deref(text);
+	mem_deref(mb);
+
+	return err;
+}
+
+
+int test_mthread_sched(void)
+{
+	static const struct {
+		const char *sched;
+		const char *policy;
+		int prio;
+		uint64_t cpus;
+	} testv[] = {
+		{"other",               "other", 0,  0x0},
+		{"fifo:60 cpus=2,3",    "fifo",  60, 0xc},
+		{"rr:1 cpus=0-1,4",     "rr",    1,  0x13},
+		{"fifo:99 cpus=63",     "fifo",  99, 0x8000000000000000ULL},
+	};
+	static const char *invalidv[] = {
+		"fifo",
+		"fifo:0",
+		"fifo:100",
+		"fifo:150",
+		"rr:4294967297",
+		"other:5",
+		"idle",
+		"fifo:60 cpus=3-2",
+		"fifo:60 cpus=64",
+		"fifo:60 cpus=x",
+	};
+	struct pl pl;
+	size_t i;
+	int err = 0;
+
+	for (i=0; i<ARRAY_SIZE(testv); i++) {
+
+		pl_set_str(&pl, testv[i].sched);
+
+		err = mthread_set_sched(MTHREAD_AUDIO_PROC, &pl);
+		TEST_ERR(err);
+
+		err = check_sched(testv[i].policy, testv[i].prio,
+				  testv[i].cpus);
+		TEST_ERR(err);
+	}
+
+	/* invalid settings are rejected, and the last one is kept */
+	for (i=0; i<ARRAY_SIZE(invalidv); i++) {
+
+		pl_set_str(&pl, invalidv[i]);
+
+		ASSERT_EQ(EINVAL, mthread_set_sched(MTHREAD_AUDIO_PROC, &pl));
+	}
+
+	err = check_sched("fifo", 99, 0x8000000000000000ULL);
+	TEST_ERR(err);
+
+	err = mthread_set_sched(MTHREAD_AUDIO_PROC, NULL);
+	TEST_ERR(err);
+
+	err = check_sched("default", 0, 0);
+	TEST_ERR(err);
+
+ out:
+	(void)mthread_set_sched(MTHREAD_AUDIO_PROC, NULL);
+
+	return err;
+}
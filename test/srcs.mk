@@ -9,18 +9,25 @@
 # Test-cases:
 #
 TEST_SRCS	+= account.c
+TEST_SRCS	+= acl.c
 TEST_SRCS	+= aulevel.c
 TEST_SRCS	+= call.c
 TEST_SRCS	+= cmd.c
 TEST_SRCS	+= contact.c
 TEST_SRCS	+= event.c
 TEST_SRCS	+= h264.c
+TEST_SRCS	+= log.c
 TEST_SRCS	+= message.c
+TEST_SRCS	+= metrics.c
+TEST_SRCS	+= mthread.c
 TEST_SRCS	+= net.c
 TEST_SRCS	+= play.c
 TEST_SRCS	+= stunuri.c
+TEST_SRCS	+= tstretch.c
 TEST_SRCS	+= ua.c
 TEST_SRCS	+= video.c
+TEST_SRCS	+= wheel.c
+TEST_SRCS	+= x11grab.c
 
 
 #
@@ -224,7 +224,10 @@ int mock_vidisp_register(struct vidisp **vidispp,
 /* test cases */
 
 int test_account(void);
+int test_account_reload(void);
 int test_account_uri_complete(void);
+int test_acl(void);
+int test_acl_load(void);
 int test_aulevel(void);
 int test_call_answer(void);
 int test_call_answer_hangup_a(void);
@@ -251,11 +254,16 @@ int test_cmd(void);
 int test_cmd_long(void);
 int test_contact(void);
 int test_event(void);
+int test_event_json(void);
 int test_h264(void);
+int test_log_async(void);
 int test_message(void);
+int test_metrics(void);
+int test_mthread_sched(void);
 int test_network(void);
 int test_play(void);
 int test_stunuri(void);
+int test_tstretch(void);
 int test_ua_alloc(void);
 int test_ua_options(void);
 int test_ua_register(void);
@@ -264,3 +272,5 @@ int test_ua_register_auth_dns(void);
 int test_ua_register_dns(void);
 int test_uag_find_param(void);
 int test_video(void);
+int test_wheel(void);
+int test_x11grab(void);
@@ -0,0 +1,97 @@
+/**
+ * @file test/tstretch.c  Baresip selftest -- audio time-stretching
+ *
+ * Copyright (C) 2010 Alfred E. Heggestad
+ */
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+enum {
+	SRATE  = 16000,
+	PERIOD =    64,  /* 250 Hz tone */
+	FRAMES =   320,  /* 20 ms       */
+	CH     =     2,
+};
+
+
+static int16_t tone(size_t i)
+{
+	return (int16_t)(8000.0 * sin(2 * M_PI * (double)(i % PERIOD) /
+				      PERIOD));
+}
+
+
+/* Check that y is a continuous tone in all channels */
+static bool is_tone(const int16_t *y, size_t n)
+{
+	size_t i, c;
+
+	for (i = 0; i < n; i++) {
+		for (c = 0; c < CH; c++) {
+			if (abs(y[i*CH + c] - tone(i)) > 2)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+
+int test_tstretch(void)
+{
+	int16_t x[FRAMES * CH];
+	int16_t y[FRAMES * CH * 3 / 2];
+	uint32_t lcg = 1;
+	size_t i, yn;
+	int err;
+
+	for (i = 0; i < FRAMES; i++) {
+		x[i*CH]     = tone(i);
+		x[i*CH + 1] = tone(i);
+	}
+
+	ASSERT_EQ(240, tstretch_maxlag(SRATE));
+
+	/* accelerate by a whole number of periods */
+	err = tstretch_s16(y, &yn, x, FRAMES, CH, SRATE, true);
+	TEST_ERR(err);
+	ASSERT_TRUE(yn < FRAMES);
+	ASSERT_EQ(0, (FRAMES - yn) % PERIOD);
+	ASSERT_TRUE(is_tone(y, yn));
+
+	/* decelerate by a whole number of periods */
+	err = tstretch_s16(y, &yn, x, FRAMES, CH, SRATE, false);
+	TEST_ERR(err);
+	ASSERT_TRUE(yn > FRAMES);
+	ASSERT_TRUE(yn <= FRAMES * 3 / 2);
+	ASSERT_EQ(0, (yn - FRAMES) % PERIOD);
+	ASSERT_TRUE(is_tone(y, yn));
+
+	/* silence is stretched by the maximum lag */
+	memset(x, 0, sizeof(x));
+	err = tstretch_s16(y, &yn, x, FRAMES, CH, SRATE, true);
+	TEST_ERR(err);
+	ASSERT_EQ(FRAMES - FRAMES / 3, yn);
+
+	/* noise has no matching period */
+	for (i = 0; i < FRAMES * CH; i++) {
+		lcg = lcg * 1103515245 + 12345;
+		x[i] = (int16_t)(lcg >> 16);
+	}
+	err = tstretch_s16(y, &yn, x, FRAMES, CH, SRATE, true);
+	ASSERT_EQ(ENOENT, err);
+
+	/* too short for the minimum lag */
+	err = tstretch_s16(y, &yn, x, 40, CH, SRATE, false);
+	ASSERT_EQ(EINVAL, err);
+
+	err = 0;
+
+ out:
+	return err;
+}
@@ -0,0 +1,137 @@
+/**
+ * @file test/wheel.c  Baresip selftest -- timer wheel
+ *
+ * Copyright (C) 2010 Alfred E. Heggestad
+ */
+#include <string.h>
+#include <re.h>
+#include <baresip.h>
+#include "test.h"
+
+
+struct fixture {
+	struct tmrw a, b;        /* one-shot, a cancels b            */
+	struct tmrw per;         /* short periodic, cancels itself   */
+	struct tmrw x, y;        /* coarse periodic                  */
+	struct tmrw stop;
+	uint64_t ts_start;
+	uint64_t ts_x;           /* first expiry of x                */
+	unsigned n_a, n_b, n_per, n_x, n_y;
+	bool same_tick;
+};
+
+
+static void stop_handler(void *arg)
+{
+	struct fixture *fix = arg;
+
+	/* x and y are re-armed in the tick of their expiry */
+	fix->same_tick = fix->x.due == fix->y.due;
+
+	tmrw_cancel(&fix->x);
+	tmrw_cancel(&fix->y);
+
+	re_cancel();
+}
+
+
+static void y_handler(void *arg)
+{
+	struct fixture *fix = arg;
+
+	if (++fix->n_y == 1)
+		tmrw_start(&fix->stop, 0, stop_handler, fix);
+}
+
+
+static void x_handler(void *arg)
+{
+	struct fixture *fix = arg;
+
+	if (++fix->n_x > 1)
+		return;
+
+	fix->ts_x = tmr_jiffies();
+
+	/* more than one second, via the coarse level */
+	tmrw_start_periodic(&fix->y, 1000, 1000, y_handler, fix);
+}
+
+
+static void per_handler(void *arg)
+{
+	struct fixture *fix = arg;
+
+	if (++fix->n_per == 3)
+		tmrw_cancel(&fix->per);
+}
+
+
+static void b_handler(void *arg)
+{
+	struct fixture *fix = arg;
+
+	++fix->n_b;
+}
+
+
+static void a_handler(void *arg)
+{
+	struct fixture *fix = arg;
+
+	++fix->n_a;
+	tmrw_cancel(&fix->b);
+}
+
+
+int test_wheel(void)
+{
+	struct fixture fix;
+	int err;
+
+	memset(&fix, 0, sizeof(fix));
+
+	tmrw_init(&fix.a, "test_a");
+	tmrw_init(&fix.b, "test_b");
+	tmrw_init(&fix.per, "test_per");
+	tmrw_init(&fix.x, "test_x");
+	tmrw_init(&fix.y, "test_y");
+	tmrw_init(&fix.stop, "test_stop");
+
+	fix.ts_start = tmr_jiffies();
+
+	tmrw_start(&fix.a, 40, a_handler, &fix);
+	tmrw_start(&fix.b, 40, b_handler, &fix);
+	tmrw_start_periodic(&fix.per, 10, 20, per_handler, &fix);
+
+	/* a short first delay is not rounded to the coarse ticks */
+	tmrw_start_periodic(&fix.x, 20, 1000, x_handler, &fix);
+
+	ASSERT_TRUE(tmrw_isrunning(&fix.b));
+
+	err = re_main_timeout(3000);
+	TEST_ERR(err);
+
+	ASSERT_EQ(1, fix.n_a);
+	ASSERT_EQ(0, fix.n_b);
+	ASSERT_EQ(3, fix.n_per);
+	ASSERT_TRUE(!tmrw_isrunning(&fix.per));
+
+	ASSERT_TRUE(fix.ts_x - fix.ts_start < 500);
+	ASSERT_EQ(1, fix.n_y);
+	ASSERT_TRUE(fix.n_x >= 2);
+	ASSERT_TRUE(fix.same_tick);
+
+	ASSERT_TRUE(!tmrw_isrunning(&fix.x));
+	ASSERT_TRUE(!tmrw_isrunning(&fix.y));
+
+ out:
+	tmrw_cancel(&fix.a);
+	tmrw_cancel(&fix.b);
+	tmrw_cancel(&fix.per);
+	tmrw_cancel(&fix.x);
+	tmrw_cancel(&fix.y);
+	tmrw_cancel(&fix.stop);
+
+	return err;
+}
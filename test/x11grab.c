@@ -0,0 +1,133 @@
+/**
+ * @file test/x11grab.c  Baresip selftest -- X11 grabber
+ *
+ * Copyright (C) 2010 Alfred E. Heggestad
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <re.h>
+#include <rem.h>
+#include <baresip.h>
+#include "test.h"
+
+
+/*
+ * This test needs an X server, e.g. run it under Xvfb:
+ *
+ *   xvfb-run ./selftest test_x11grab
+ *
+ * It is skipped if there is no display or no x11grab module.
+ */
+
+
+enum {
+	NUM_FRAMES = 5,
+};
+
+
+struct fixture {
+	struct mqueue *mq;
+	struct vidsz size;
+	unsigned n_frame;
+	unsigned n_badsize;
+};
+
+
+/* called from the grab thread */
+static void frame_handler(struct vidframe *frame, uint64_t timestamp,
+			  void *arg)
+{
+	struct fixture *fix = arg;
+	(void)timestamp;
+
+	if (!vidsz_cmp(&frame->size, &fix->size) ||
+	    frame->fmt != VID_FMT_RGB32)
+		++fix->n_badsize;
+
+	(void)mqueue_push(fix->mq, 0, NULL);
+}
+
+
+static void mqueue_handler(int id, void *data, void *arg)
+{
+	struct fixture *fix = arg;
+	(void)id;
+	(void)data;
+
+	if (++fix->n_frame >= NUM_FRAMES)
+		re_cancel();
+}
+
+
+static int grab_frames(bool shm)
+{
+	struct fixture fix;
+	struct vidsrc_st *st = NULL;
+	struct vidsrc_prm prm;
+	char cfg[64];
+	int n, err;
+
+	memset(&fix, 0, sizeof(fix));
+	fix.size.w = 320;
+	fix.size.h = 240;
+
+	n = re_snprintf(cfg, sizeof(cfg), "x11grab_shm %s\n",
+			shm ? "yes" : "no");
+
+	err = conf_configure_buf((uint8_t *)cfg, n);
+	TEST_ERR(err);
+
+	/* NOTE: See Makefile TEST_MODULES */
+	err = module_load(".", "x11grab");
+	if (err) {
+		info("test: x11grab module not found, skipping\n");
+		return 0;
+	}
+
+	err = mqueue_alloc(&fix.mq, mqueue_handler, &fix);
+	TEST_ERR(err);
+
+	memset(&prm, 0, sizeof(prm));
+	prm.fps = 30;
+
+	err = vidsrc_alloc(&st, baresip_vidsrcl(), "x11grab", NULL, &prm,
+			   &fix.size, NULL, NULL, frame_handler, NULL, NULL,
+			   &fix);
+	TEST_ERR(err);
+
+	err = re_main_timeout(5000);
+	TEST_ERR(err);
+
+	/* stop the grab thread before checking its results */
+	st = mem_deref(st);
+
+	ASSERT_TRUE(fix.n_frame >= NUM_FRAMES);
+	ASSERT_EQ(0, fix.n_badsize);
+
+ out:
+	mem_deref(st);
+	mem_deref(fix.mq);
+	module_unload("x11grab");
+
+	return err;
+}
+
+
+int test_x11grab(void)
+{
+	int err;
+
+	if (!getenv("DISPLAY")) {
+		info("test: no X display, skipping x11grab\n");
+		return 0;
+	}
+
+	err = grab_frames(true);
+	TEST_ERR(err);
+
+	err = grab_frames(false);
+	TEST_ERR(err);
+
+ out:
+	return err;
+}